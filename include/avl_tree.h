@@ -90,7 +90,7 @@ AVLNode *rot_right(AVLNode *node);
  * @brief get height of node
  * 
  * @param node an AVLNode
- * @return uint32_t height of node; return 0 if node is NULL
+ * @return uint32_t height of node (1 for a leaf); return 0 if node is NULL
  */
 uint32_t avl_height(AVLNode *node);
 
@@ -112,9 +112,9 @@ void avl_update(AVLNode *node);
 /**
  * @brief find the node at given offset ranking
  * 
- * @param node 
- * @param offset 
- * @return AVLNode* 
+ * @param node starting node
+ * @param offset offset relative to `node` in sorted order, may be negative
+ * @return AVLNode* the node, or NULL if out of range
  */
 AVLNode *avl_offset(AVLNode *node, int64_t offset);
 
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Kernels over bitmaps stored as plain bytes, bit 0 being the most significant
+ * bit of the first byte. Population count uses an AVX2 nibble lookup (or the
+ * popcnt instruction), BITOP and the bit search go 32 bytes per step with AVX2;
+ * the kernels are picked at runtime by what the CPU supports.
+ */
+
+enum {
+    BIT_AND = 0,
+    BIT_OR = 1,
+    BIT_XOR = 2,
+    BIT_NOT = 3,
+};
+
+/**
+ * @brief number of set bits in a byte range, with the best kernel for this CPU
+ *
+ * @param p bytes
+ * @param n number of bytes
+ * @return uint64_t set bits
+ */
+uint64_t bit_count(const uint8_t *p, size_t n);
+
+/**
+ * @brief same as `bit_count`, a word at a time with no CPU-specific instructions
+ *
+ */
+uint64_t bit_count_scalar(const uint8_t *p, size_t n);
+
+/**
+ * @brief combine a byte range into another in place: dst = dst op src, or dst = ~dst for BIT_NOT
+ *
+ * @param op BIT_AND, BIT_OR, BIT_XOR or BIT_NOT
+ * @param dst destination bytes
+ * @param src source bytes, unused for BIT_NOT
+ * @param n number of bytes
+ */
+void bit_op(uint32_t op, uint8_t *dst, const uint8_t *src, size_t n);
+
+/**
+ * @brief same as `bit_op`, a word at a time with no CPU-specific instructions
+ *
+ */
+void bit_op_scalar(uint32_t op, uint8_t *dst, const uint8_t *src, size_t n);
+
+/**
+ * @brief position of the first bit equal to `bit`
+ *
+ * @param p bytes
+ * @param n number of bytes
+ * @param bit bit value to look for
+ * @return int64_t bit offset from `p`, -1 if there is none
+ */
+int64_t bit_pos(const uint8_t *p, size_t n, bool bit);
+
+/**
+ * @brief name of the kernels picked for this CPU: "avx2", "popcnt" or "scalar"
+ *
+ * @return const char* kernel name
+ */
+const char *bitops_kernel();
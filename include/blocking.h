@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "server_utils.h"
+
+/**
+ * Blocking commands (BLPOP, BZPOPMIN, XREAD BLOCK, ...): a command that finds
+ * nothing to serve asks to wait on its keys with `block_wait` instead of
+ * replying. Its connection is then parked in STATE_BLOCKED: it leaves epoll
+ * read interest (only a hangup is still watched) and joins a FIFO of waiters
+ * per key, and its deadline, if any, goes into a min-heap that bounds the
+ * event loop's timeout.
+ *
+ * Writes that may satisfy a waiter mark their key ready with `block_signal`.
+ * Once per loop iteration, `block_run` re-runs the commands of the waiters
+ * of each ready key in arrival order, and answers the waiters whose deadline
+ * has passed with nil. A woken connection gets its reply queued and goes
+ * back to STATE_RES. A waiter that asks to wait again keeps its place; if its
+ * command consumes what it waits for (BLPOP, BZPOPMIN, ...), the key is
+ * drained and the ones queued behind it are not tried, otherwise (XREAD)
+ * they are, since each may wait for something else.
+ */
+
+// a parked connection, owned by `Conn::blocked`
+struct BlockState {
+    Conn *conn = NULL;
+    std::vector<std::string> cmd;   // re-run when a key is ready
+    std::vector<std::string> keys;
+    bool consume = true;            // serving it takes what it waited for
+    size_t heap_idx = -1;           // position in the deadline heap, -1 without a timeout
+};
+
+/**
+ * @brief ask to park the connection of the running command instead of replying
+ *
+ * @param cmd command to re-run when one of the keys is ready
+ * @param first_key index of the first key in `cmd`
+ * @param n_keys number of consecutive keys
+ * @param timeout_ms how long to wait, 0 for ever
+ * @param consume whether serving it removes what it waits for, so that waiters behind it can't be served
+ */
+void block_wait(const std::vector<std::string> &cmd, size_t first_key, size_t n_keys, uint64_t timeout_ms,
+                bool consume = true);
+
+/**
+ * @brief parse the timeout of a blocking command, 0 meaning no timeout
+ *
+ * @param s timeout argument, a non-negative number of `unit_ms`
+ * @param unit_ms milliseconds per unit (1000 for seconds)
+ * @param ms output, rounded up to whole milliseconds
+ * @return bool false if not a non-negative number
+ */
+bool block_parse_timeout(const std::string &s, double unit_ms, uint64_t &ms);
+
+/**
+ * @brief park a connection if its last command asked to wait
+ *
+ * @param conn connection whose request was just processed
+ * @param epfd epoll fd
+ * @return bool true if the connection is now blocked and gets no reply yet
+ */
+bool block_park(Conn *conn, int epfd);
+
+/**
+ * @brief mark a key whose value grew, its waiters are served by the next `block_run`
+ *
+ * @param key name of the key
+ */
+void block_signal(const std::string &key);
+
+/**
+ * @brief serve the waiters of ready keys, then time out the expired ones
+ *
+ * @param epfd epoll fd
+ */
+void block_run(int epfd);
+
+/**
+ * @brief the earliest deadline of a blocked connection
+ *
+ * @return uint64_t ms since epoch, UINT64_MAX if none
+ */
+uint64_t block_next_ms();
+
+/**
+ * @brief forget a blocked connection that is being closed
+ *
+ * @param conn connection, its `blocked` state is released
+ */
+void block_cancel(Conn *conn);
+
+/**
+ * @brief number of blocked connections
+ *
+ */
+size_t block_count();
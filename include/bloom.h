@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * Blocked Bloom filter. Every element maps to one 64-byte block (a cache
+ * line, the blocks are aligned) and sets one bit in each of its eight
+ * 64-bit words, picked by multiply-shift hashing with eight salts, so adding
+ * or checking an element touches a single cache line. AVX2 computes and
+ * tests all eight bits at once when the CPU has it.
+ *
+ * The filter is sized at creation for a capacity and an error rate, with
+ * about 10% more bits than an unblocked filter to make up for the uneven
+ * load across blocks; adding more elements than the capacity keeps working
+ * with a growing error rate.
+ */
+
+const uint64_t k_bf_default_capacity = 10000;   // filters created by BF.ADD
+const double k_bf_default_error = 0.01;
+const uint64_t k_bf_max_capacity = 1ull << 32;
+const double k_bf_min_error = 1e-6;
+const size_t k_bf_max_bytes = 1ull << 30;       // per filter, also keeps n_blocks far below the 2^32 `block_of` can index
+
+struct Bloom {
+    void *raw = NULL;           // zeroed allocation, with room to align `blocks` inside it
+    uint64_t *blocks = NULL;    // n_blocks * 8 words
+    uint64_t n_blocks = 0;
+    uint64_t capacity = 0;
+    double error_rate = 0;
+    uint64_t n_items = 0;       // adds that set at least one new bit
+};
+
+/**
+ * @brief bytes `bf_init` would allocate, to check the size before committing to it
+ *
+ * @param capacity expected number of elements, 1..k_bf_max_capacity
+ * @param error_rate wanted false positive rate, in [k_bf_min_error, 1)
+ */
+size_t bf_bytes(uint64_t capacity, double error_rate);
+
+/**
+ * @brief allocate an empty filter sized for `capacity` elements at `error_rate`
+ *
+ * @param bf target filter, must be empty
+ * @param capacity expected number of elements, 1..k_bf_max_capacity
+ * @param error_rate wanted false positive rate, in [k_bf_min_error, 1)
+ * @return bool false if the bit array can't be allocated or is over k_bf_max_bytes
+ */
+bool bf_init(Bloom *bf, uint64_t capacity, double error_rate);
+
+/**
+ * @brief add an element
+ *
+ * @return bool true if it set a new bit, i.e. the element was surely not in the filter
+ */
+bool bf_add(Bloom *bf, const char *data, size_t len);
+
+/**
+ * @brief check an element
+ *
+ * @return bool false if the element was surely never added
+ */
+bool bf_exists(const Bloom *bf, const char *data, size_t len);
+
+/**
+ * @brief same as `bf_exists` for an already hashed element, with no CPU-specific instructions
+ *
+ * @param bf target filter
+ * @param hash `hll_hash` of the element
+ */
+bool bf_exists_scalar(const Bloom *bf, uint64_t hash);
+
+/**
+ * @brief same as `bf_exists` for an already hashed element, with the best kernel for this CPU
+ *
+ */
+bool bf_exists_hash(const Bloom *bf, uint64_t hash);
+
+/**
+ * @brief bytes allocated by a filter, for memory accounting
+ *
+ */
+size_t bf_mem(const Bloom *bf);
+
+/**
+ * @brief free the bit array, leaving an empty filter
+ *
+ */
+void bf_dispose(Bloom *bf);
+
+/**
+ * @brief serialize a filter as 8b capacity, 8b error rate, 8b items, 8b blocks, then the blocks
+ *
+ * @param bf source filter
+ * @param out output buf
+ */
+void bf_encode(const Bloom *bf, std::string &out);
+
+/**
+ * @brief fill an empty filter from the output of `bf_encode`
+ *
+ * @return bool false if the data is malformed
+ */
+bool bf_decode(Bloom *bf, const char *data, size_t len);
+
+/**
+ * @brief name of the probe kernel picked for this CPU: "avx2" or "scalar"
+ *
+ */
+const char *bf_kernel();
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * LZ77 block codec in the spirit of LZ4: a block is a series of sequences,
+ *
+ *   | token | literal len ext | literals | offset (2b) | match len ext |
+ *
+ * the token's high nibble is the literal count and its low nibble the match
+ * length minus `k_lz_min_match`, 15 meaning more length bytes follow (each
+ * 255 meaning "keep adding"). The last sequence is literals only.
+ */
+
+const size_t k_lz_min_match = 4;
+
+/**
+ * @brief worst-case compressed size of a block
+ *
+ * @param len size of input
+ * @return size_t capacity `dst` needs so `lz_compress` cannot fail
+ */
+size_t lz_bound(size_t len);
+
+/**
+ * @brief compress a block
+ *
+ * @param src input
+ * @param len size of input
+ * @param dst output buffer
+ * @param cap capacity of output buffer
+ * @return size_t compressed size, or 0 if it does not fit in `cap`
+ */
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+/**
+ * @brief decompress a block, validating every length and offset against the buffers
+ *
+ * @param src compressed block
+ * @param len size of compressed block
+ * @param dst output buffer
+ * @param cap capacity of output buffer
+ * @return int64_t decompressed size, or -1 if the block is malformed or does not fit
+ */
+int64_t lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
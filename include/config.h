@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/**
+ * @brief value kinds of a config option
+ *
+ */
+enum {
+    CFG_STR = 0,
+    CFG_INT = 1,
+    CFG_BOOL = 2,
+    CFG_MEM = 3,    // int64_t bytes, accepts kb/mb/gb suffixes
+    CFG_ENUM = 4,   // uint32_t index into the option's name list
+};
+
+/**
+ * @brief maxmemory policies
+ *
+ */
+enum {
+    EVICT_NOEVICTION = 0,
+    EVICT_ALLKEYS_LRU = 1,
+    EVICT_ALLKEYS_LFU = 2,
+    EVICT_ALLKEYS_RANDOM = 3,
+    EVICT_VOLATILE_LRU = 4,
+    EVICT_VOLATILE_LFU = 5,
+    EVICT_VOLATILE_RANDOM = 6,
+    EVICT_VOLATILE_TTL = 7,
+};
+
+// server-wide settings, filled from `--name value` command line pairs
+struct Config {
+    std::string snapshot_path = "dump.nrdb";    // where SAVE writes and startup loads
+    bool snapshot_mmap = true;                  // serve reads from the mapped snapshot instead of loading it
+    int64_t load_threads = 0;                   // threads for a full snapshot load, 0 = one per CPU
+    bool snapshot_compression = false;          // lz-compress snapshot chunks (the file can't be served mapped then)
+    bool value_compression = false;             // lz-compress large string values in memory
+    int64_t value_compression_threshold = 1024; // smallest value worth compressing, in bytes
+    int64_t maxmemory = 0;                      // bytes of keyspace memory before evicting, 0 = no limit
+    uint32_t maxmemory_policy = EVICT_NOEVICTION;
+    int64_t maxmemory_samples = 5;              // keys sampled per eviction
+    int64_t lfu_log_factor = 10;                // higher = slower LFU counter growth
+    int64_t lfu_decay_time = 1;                 // minutes per decrement of an idle LFU counter
+    bool lazyfree = false;                      // DEL, expiry, eviction and overwrites free big values in the background
+    int64_t lazyfree_threshold = 64;            // free effort (~allocations) above which a value is freed lazily
+    int64_t hash_max_packed_entries = 128;      // fields of a hash kept in the packed encoding
+    int64_t hash_max_packed_value = 64;         // longest field or value of a packed hash, in bytes
+    int64_t set_max_intset_entries = 1 << 18;   // members of an all-integer set kept as a sorted array
+    int64_t hll_sparse_max_bytes = 3000;        // bytes of sparse registers before a HyperLogLog turns dense
+    int64_t slowlog_log_slower_than = 10000;    // µs of a request to enter the slow log, < 0 = off, 0 = all
+    int64_t slowlog_max_len = 128;              // entries kept in the slow log
+    int64_t latency_monitor_threshold = 10;     // ms from which latency events are kept in their history, 0 = off
+    int64_t watchdog_period = 0;                // ms of an event loop iteration before a backtrace is logged, 0 = off
+    int64_t hotkeys_sample_rate = 0;            // one key lookup in N feeds the hot key sketch, 0 = off
+    int64_t metrics_port = 0;                   // port of the Prometheus endpoint, 0 = off (read at startup)
+};
+
+extern Config g_config;
+
+/**
+ * @brief set a single option by name
+ *
+ * @param name option name, e.g. "snapshot-path"
+ * @param val textual value
+ * @return int32_t 0 on success, -1 if the option is unknown or the value is malformed or out of range
+ */
+int32_t config_set(const std::string &name, const std::string &val);
+
+/**
+ * @brief read a single option by name, formatted as text
+ *
+ * @param name option name
+ * @param out output buf for the value
+ * @return bool false if the option is unknown
+ */
+bool config_get(const std::string &name, std::string &out);
+
+/**
+ * @brief parse `--name value` pairs from the command line
+ *
+ * @return int32_t 0 on success, -1 on the first bad option
+ */
+int32_t config_parse_args(int argc, char **argv);
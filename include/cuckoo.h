@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * Cuckoo filter: membership with deletion. An element is stored as a 16-bit
+ * fingerprint in one of two buckets of 4 slots, the second bucket being
+ * derived from the first and the fingerprint alone (partial-key cuckoo
+ * hashing), so fingerprints can be relocated without the element. A check
+ * compares the fingerprint against both buckets (8 slots) with one SSE2
+ * compare. The false positive rate is about 8 / 2^16 = 0.012%.
+ *
+ * The filter doesn't grow: an add fails once relocations can't make room,
+ * which happens around 95% load.
+ */
+
+const uint64_t k_cf_default_capacity = 10000;   // filters created by CF.ADD
+const uint64_t k_cf_max_capacity = 1ull << 32;
+const size_t k_cf_max_bytes = 1ull << 30;       // per filter
+const uint32_t k_cf_bucket_slots = 4;
+const uint32_t k_cf_max_kicks = 500;
+
+struct Cuckoo {
+    uint16_t *slots = NULL;     // n_buckets * 4 fingerprints, 0 is an empty slot
+    uint64_t n_buckets = 0;     // power of 2
+    uint64_t n_items = 0;
+};
+
+/**
+ * @brief bytes `cf_init` would allocate, to check the size before committing to it
+ *
+ * @param capacity expected number of elements, 1..k_cf_max_capacity
+ */
+size_t cf_bytes(uint64_t capacity);
+
+/**
+ * @brief allocate an empty filter with room for about `capacity` elements
+ *
+ * @param cf target filter, must be empty
+ * @param capacity expected number of elements, 1..k_cf_max_capacity
+ * @return bool false if the buckets can't be allocated or are over k_cf_max_bytes
+ */
+bool cf_init(Cuckoo *cf, uint64_t capacity);
+
+/**
+ * @brief add an element, which may already be in the filter (it is then counted twice)
+ *
+ * @return bool false if the filter is full
+ */
+bool cf_add(Cuckoo *cf, const char *data, size_t len);
+
+/**
+ * @brief check an element
+ *
+ * @return bool false if the element is surely not in the filter
+ */
+bool cf_exists(const Cuckoo *cf, const char *data, size_t len);
+
+/**
+ * @brief remove one copy of an element, which must have been added before
+ *
+ * @return bool false if its fingerprint wasn't found
+ */
+bool cf_del(Cuckoo *cf, const char *data, size_t len);
+
+/**
+ * @brief number of copies of an element's fingerprint, an upper bound of how many times it was added
+ *
+ */
+uint32_t cf_count(const Cuckoo *cf, const char *data, size_t len);
+
+/**
+ * @brief bytes allocated by a filter, for memory accounting
+ *
+ */
+size_t cf_mem(const Cuckoo *cf);
+
+/**
+ * @brief free the buckets, leaving an empty filter
+ *
+ */
+void cf_dispose(Cuckoo *cf);
+
+/**
+ * @brief serialize a filter as 8b buckets, 8b items, then the fingerprints
+ *
+ * @param cf source filter
+ * @param out output buf
+ */
+void cf_encode(const Cuckoo *cf, std::string &out);
+
+/**
+ * @brief fill an empty filter from the output of `cf_encode`
+ *
+ * @return bool false if the data is malformed
+ */
+bool cf_decode(Cuckoo *cf, const char *data, size_t len);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "server_utils.h"
+
+/**
+ * `Entry::lru` depends on the maxmemory policy:
+ *   - LRU: low 32 bits of the ms clock at the last access
+ *   - LFU: minutes of the last decay (high 24 bits) | logarithmic access counter (low 8 bits)
+ * Eviction samples `maxmemory-samples` keys into a small pool of the best
+ * candidates seen so far and evicts the best one, approximating true LRU/LFU
+ * without keeping any ordered index.
+ */
+
+const uint32_t k_lfu_init_val = 5;      // counter of a new key, so it isn't evicted right away
+const size_t k_evict_pool_size = 16;
+const size_t k_evict_max_keys = 64;     // evictions per write, the rest is left to following writes
+
+/**
+ * @brief initialize the access info of a new entry
+ *
+ * @param ent new entry
+ */
+void entry_init_lru(Entry *ent);
+
+/**
+ * @brief record an access to an entry
+ *
+ * @param ent accessed entry
+ */
+void entry_touch(Entry *ent);
+
+/**
+ * @brief LFU counter of an entry after applying decay
+ *
+ * @param ent target entry
+ * @return uint32_t counter, 0..255
+ */
+uint32_t lfu_count(Entry *ent);
+
+/**
+ * @brief memory counted against maxmemory: entries, hashtable arrays and the TTL heap
+ *
+ * @return size_t bytes
+ */
+size_t used_memory();
+
+/**
+ * @brief evict keys until memory is under maxmemory, or the per-call budget is spent
+ *
+ * @return bool false if memory is over the limit and nothing can be evicted
+ */
+bool evict_run();
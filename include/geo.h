@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Geohash over a sorted set: a point is stored with its 52-bit geohash as
+ * the score (26 bits of latitude and longitude each, interleaved, exact in a
+ * double), so nearby points have nearby scores and a geohash cell of any
+ * precision is one contiguous score range. A search covers the bounding box
+ * of its area with at most k_geo_max_cells cells of the finest precision that
+ * allows, seeks each range in the AVL index, then filters the candidates by
+ * the bounding box and by exact distance.
+ *
+ * Latitudes are limited to the Web Mercator range, as in most map services.
+ */
+
+const double k_geo_lat_min = -85.05112878;
+const double k_geo_lat_max = 85.05112878;
+const double k_geo_lon_min = -180.0;
+const double k_geo_lon_max = 180.0;
+const uint32_t k_geo_step = 26;                 // bits per coordinate in a stored score
+const double k_earth_radius_m = 6372797.560856; // as used by the haversine distance
+const size_t k_geo_max_cells = 64;              // per search, finer cells mean fewer candidates but more seeks
+
+// an area to search: a circle of `radius` or a `width` x `height` box, in meters, around a center
+struct GeoShape {
+    double lon = 0;
+    double lat = 0;
+    bool box = false;
+    double radius = 0;
+    double width = 0;
+    double height = 0;
+    // bounding box, filled by `geo_bound`
+    double min_lat = 0;
+    double max_lat = 0;
+    double lon_delta = 0;   // 180 when the area reaches every longitude
+};
+
+// a range of scores [min, max) holding one or more adjacent cells
+struct GeoRange {
+    uint64_t min = 0;
+    uint64_t max = 0;
+};
+
+/**
+ * @brief geohash of a point with `step` bits per coordinate
+ *
+ * @param lon longitude, in [k_geo_lon_min, k_geo_lon_max]
+ * @param lat latitude, in [k_geo_lat_min, k_geo_lat_max]
+ * @param step bits per coordinate, 1..26
+ * @return uint64_t interleaved bits, latitude in the even bits
+ */
+uint64_t geo_encode(double lon, double lat, uint32_t step);
+
+/**
+ * @brief center of the cell of a 52-bit geohash
+ *
+ */
+void geo_decode(uint64_t bits, double *lon, double *lat);
+
+/**
+ * @brief great-circle distance in meters (haversine)
+ *
+ */
+double geo_dist(double lon1, double lat1, double lon2, double lat2);
+
+/**
+ * @brief compute the bounding box of a search area, after setting its center and size
+ *
+ * @param shape search area, updated in place
+ */
+void geo_bound(GeoShape *shape);
+
+/**
+ * @brief the score ranges whose cells cover a search area, merged and sorted
+ *
+ * @param shape search area with its bounding box
+ * @param ranges output, room for k_geo_max_cells ranges
+ * @return size_t number of ranges
+ */
+size_t geo_cover(const GeoShape *shape, GeoRange *ranges);
+
+/**
+ * @brief check a point against a search area
+ *
+ * @param shape search area with its bounding box
+ * @param lon longitude of the point
+ * @param lat latitude of the point
+ * @param dist output, distance from the center in meters
+ * @return bool true if the point is in the area
+ */
+bool geo_match(const GeoShape *shape, double lon, double lat, double *dist);
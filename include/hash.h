@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "hashtable.h"
+
+/**
+ * Field-value map. Small ones are a packed array of
+ *
+ *   | len | field | len | value | ...
+ *
+ * (`len` is 1 byte below 0x80, else 0x80 + 4 bytes) searched linearly, which
+ * beats hashing for a few dozen short fields and costs 2 bytes per field. Once
+ * it has more than `hash-max-packed-entries` fields or a field/value longer
+ * than `hash-max-packed-value` it is converted to an `HMap` of `HField`s.
+ */
+
+// encodings of a hash
+enum {
+    HASH_PACKED = 0,
+    HASH_HMAP = 1,
+};
+
+struct HField {
+    HNode node;
+    std::string field;
+    std::string val;
+};
+
+struct Hash {
+    uint32_t enc = HASH_PACKED;
+    std::string packed;     // HASH_PACKED pairs
+    HMap hmap;              // HASH_HMAP fields
+    size_t n = 0;           // number of fields
+    size_t bytes = 0;       // bytes of all HField allocations, for memory accounting
+};
+
+/**
+ * @brief lookup a field
+ *
+ * @param hash target hash
+ * @param field buffer containing field
+ * @param flen length of field
+ * @param vlen output, length of the value
+ * @return const char* value bytes (valid until the hash is modified), NULL if not found
+ */
+const char *hash_get(Hash *hash, const char *field, size_t flen, size_t *vlen);
+
+/**
+ * @brief set the value of a field
+ *
+ * @param hash target hash
+ * @param field buffer containing field
+ * @param flen length of field
+ * @param val buffer containing value
+ * @param vlen length of value
+ * @return bool true if the field is new
+ */
+bool hash_set(Hash *hash, const char *field, size_t flen, const char *val, size_t vlen);
+
+/**
+ * @brief remove a field
+ *
+ * @param hash target hash
+ * @param field buffer containing field
+ * @param flen length of field
+ * @return bool true if the field existed
+ */
+bool hash_del(Hash *hash, const char *field, size_t flen);
+
+/**
+ * @brief call `f` on every field
+ *
+ * @param hash target hash
+ * @param f callback taking (field, flen, value, vlen, arg)
+ * @param arg argument to callback
+ */
+void hash_scan(Hash *hash, void (*f)(const char *, size_t, const char *, size_t, void *), void *arg);
+
+/**
+ * @brief free all fields, leaving the hash empty
+ *
+ * @param hash target hash
+ */
+void hash_dispose(Hash *hash);
+
+/**
+ * @brief serialize a hash as (4b length, field, 4b length, value) per field
+ *
+ * @param hash source hash
+ * @param out output buf
+ */
+void hash_encode(Hash *hash, std::string &out);
+
+/**
+ * @brief fill an empty hash from the output of `hash_encode`
+ *
+ * @param hash target hash, must be empty
+ * @param data serialized fields
+ * @param len length of data
+ * @return bool false if the data is malformed
+ */
+bool hash_decode(Hash *hash, const char *data, size_t len);
@@ -11,8 +11,8 @@ struct HNode {
 
 struct HTab {
     HNode **tab = NULL; // array of `HNode *`
-    size_t mask; // 2^n - 1
-    size_t size;
+    size_t mask = 0; // 2^n - 1
+    size_t size = 0;
 };
 
 struct HMap { // use two tables for progressive resizing
@@ -50,7 +50,7 @@ void h_insert(HTab *htab, HNode *new_node);
  * 
  * @param htab pointer to a hashtable struct
  * @param key key node to lookup
- * @param eq callback decide whether keys of two nodes are the same
+ * @param eq callback decide whether keys of two nodes are the same, called as eq(node in table, key)
  * @return HNode** incoming pointer of a `pointer to HNode`
  */
 HNode** h_lookup(HTab *htab, HNode *key, bool (*eq)(HNode *, HNode *));
@@ -135,3 +135,19 @@ HNode *hm_lookup(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *));
  */
 HNode *hm_pop(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *));
 
+
+/**
+ * @brief pick a random node, roughly uniformly (nodes in short chains are a bit favored)
+ * 
+ * @param hmap target hashmap
+ * @param rnd random bits
+ * @return HNode* a node, or NULL if the hashmap is empty
+ */
+HNode *hm_sample(HMap *hmap, uint64_t rnd);
+
+/**
+ * @brief free the tables of a hashmap (not the nodes) and reset it to empty
+ * 
+ * @param hmap target hashmap
+ */
+void hm_destroy(HMap *hmap);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// min-heap item, `ref` points back to the owner's copy of its position
+struct HeapItem {
+    uint64_t val = 0;
+    size_t *ref = NULL;
+};
+
+/**
+ * @brief restore the heap order after the item at `pos` was changed or added
+ *
+ * @param a heap array
+ * @param pos position of the changed item
+ * @param len number of items in the heap
+ */
+void heap_update(HeapItem *a, size_t pos, size_t len);
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * HyperLogLog cardinality estimator with 2^14 registers of 6 bits, which
+ * gives a standard error of 1.04 / sqrt(16384) = 0.81%. Elements are hashed
+ * to 64 bits: the low 14 bits pick a register, which keeps the highest rank
+ * (trailing zeros + 1) seen in the other 50.
+ *
+ * Small counters are SPARSE, a sorted array of their non-zero registers; once
+ * that takes more than `hll-sparse-max-bytes` they become DENSE, all registers
+ * packed into 12 KB. Counting unpacks registers into one byte each so that
+ * merging (byte-wise max) and the estimate run 32 registers per AVX2 step.
+ */
+
+const uint32_t k_hll_p = 14;
+const uint32_t k_hll_regs = 1u << k_hll_p;
+const uint32_t k_hll_q = 64 - k_hll_p;              // hash bits left for the rank, so ranks are 1..q+1
+const size_t k_hll_dense_bytes = k_hll_regs * 6 / 8;
+
+// encodings of a HyperLogLog
+enum {
+    HLL_SPARSE = 0,
+    HLL_DENSE = 1,
+};
+
+struct Hll {
+    uint32_t enc = HLL_SPARSE;
+    std::vector<uint32_t> sparse;   // HLL_SPARSE: (register << 6 | value), sorted by register
+    uint8_t *dense = NULL;          // HLL_DENSE: 6-bit registers packed LSB first, register 0 in the lowest bits
+    int64_t card = -1;              // cached estimate, -1 once the registers changed
+};
+
+/**
+ * @brief 64-bit hash of an element (MurmurHash64A)
+ *
+ * @param data element bytes
+ * @param len length of data
+ * @return uint64_t hash
+ */
+uint64_t hll_hash(const void *data, size_t len);
+
+/**
+ * @brief add an element
+ *
+ * @param h target counter
+ * @param data element bytes
+ * @param len length of data
+ * @return bool true if a register changed, i.e. the estimate may have changed
+ */
+bool hll_add(Hll *h, const char *data, size_t len);
+
+/**
+ * @brief estimated number of distinct elements added, cached until the next change
+ *
+ * @param h target counter
+ * @return uint64_t estimate
+ */
+uint64_t hll_count(Hll *h);
+
+/**
+ * @brief merge the registers of a counter into unpacked registers (byte-wise max)
+ *
+ * @param h source counter
+ * @param regs `k_hll_regs` registers of one byte each
+ */
+void hll_merge(const Hll *h, uint8_t *regs);
+
+/**
+ * @brief same as `hll_merge`, one register at a time
+ *
+ */
+void hll_merge_scalar(const Hll *h, uint8_t *regs);
+
+/**
+ * @brief estimate the cardinality of unpacked registers
+ *
+ * @param regs `k_hll_regs` registers of one byte each
+ * @return uint64_t estimate
+ */
+uint64_t hll_estimate(const uint8_t *regs);
+
+/**
+ * @brief same as `hll_estimate`, one register at a time
+ *
+ */
+uint64_t hll_estimate_scalar(const uint8_t *regs);
+
+/**
+ * @brief replace the registers of a counter, keeping it sparse if they fit
+ *
+ * @param h target counter
+ * @param regs `k_hll_regs` registers of one byte each
+ */
+void hll_store(Hll *h, const uint8_t *regs);
+
+/**
+ * @brief bytes allocated by a counter, for memory accounting
+ *
+ * @param h target counter
+ * @return size_t bytes
+ */
+size_t hll_mem(const Hll *h);
+
+/**
+ * @brief free the registers, leaving an empty sparse counter
+ *
+ * @param h target counter
+ */
+void hll_dispose(Hll *h);
+
+/**
+ * @brief serialize a counter as "HYLL", 1b encoding, 3b padding, then the sparse
+ *        entries (4b each) or the packed dense registers
+ *
+ * @param h source counter
+ * @param out output buf
+ */
+void hll_encode(const Hll *h, std::string &out);
+
+/**
+ * @brief fill an empty counter from the output of `hll_encode`
+ *
+ * @param h target counter, must be empty
+ * @param data serialized counter
+ * @param len length of data
+ * @return bool false if the data is malformed
+ */
+bool hll_decode(Hll *h, const char *data, size_t len);
+
+/**
+ * @brief name of the merge/estimate kernel picked for this CPU: "avx2" or "scalar"
+ *
+ * @return const char* kernel name
+ */
+const char *hll_kernel();
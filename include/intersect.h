@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Intersection of sorted arrays of unique integers. The int32 kernel compares
+ * 4x4 (SSSE3) or 8x8 (AVX2) blocks at a time and is picked at runtime by
+ * what the CPU supports; heavily skewed inputs use galloping search instead.
+ */
+
+/**
+ * @brief intersect two sorted int32 arrays with the best kernel for this CPU
+ *
+ * @param a first array
+ * @param na length of a
+ * @param b second array
+ * @param nb length of b
+ * @param out output, must have room for min(na, nb) + 8 members (kernels store whole vectors)
+ * @return size_t number of members written to `out`
+ */
+size_t intersect_i32(const int32_t *a, size_t na, const int32_t *b, size_t nb, int32_t *out);
+
+/**
+ * @brief same as `intersect_i32`, always using the plain merge loop
+ *
+ */
+size_t intersect_i32_scalar(const int32_t *a, size_t na, const int32_t *b, size_t nb, int32_t *out);
+
+/**
+ * @brief intersect two sorted int64 arrays (plain merge loop)
+ *
+ * @param out output, must have room for min(na, nb) members
+ */
+size_t intersect_i64(const int64_t *a, size_t na, const int64_t *b, size_t nb, int64_t *out);
+
+/**
+ * @brief name of the int32 kernel picked for this CPU: "avx2", "ssse3" or "scalar"
+ *
+ * @return const char* kernel name
+ */
+const char *intersect_kernel();
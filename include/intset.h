@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Sorted array of unique integers, all stored in the narrowest of int16/int32/int64
+ * that fits every member. Adding a wider value upgrades the whole array.
+ */
+struct IntSet {
+    uint8_t *data = NULL;
+    uint32_t width = 2;     // bytes per member: 2, 4 or 8
+    size_t n = 0;           // number of members
+    size_t cap = 0;         // members that fit in `data`
+};
+
+/**
+ * @brief read the member at a position
+ *
+ * @param is target set
+ * @param i position, < is->n
+ * @return int64_t member
+ */
+int64_t intset_get(const IntSet *is, size_t i);
+
+/**
+ * @brief binary search for a member
+ *
+ * @param is target set
+ * @param val value to find
+ * @param pos output, position of the member or where it would be inserted
+ * @return bool true if found
+ */
+bool intset_find(const IntSet *is, int64_t val, size_t *pos);
+
+/**
+ * @brief add a member
+ *
+ * @param is target set
+ * @param val value to add
+ * @return bool true if it was not a member yet
+ */
+bool intset_add(IntSet *is, int64_t val);
+
+/**
+ * @brief add many members at once with a single merge pass
+ *
+ * @param is target set
+ * @param vals values to add, sorted ascending (duplicates allowed)
+ * @param n number of values
+ * @return size_t number of values that were not members yet
+ */
+size_t intset_add_sorted(IntSet *is, const int64_t *vals, size_t n);
+
+/**
+ * @brief remove a member
+ *
+ * @param is target set
+ * @param val value to remove
+ * @return bool true if it was a member
+ */
+bool intset_del(IntSet *is, int64_t val);
+
+/**
+ * @brief free the array, leaving the set empty
+ *
+ * @param is target set
+ */
+void intset_dispose(IntSet *is);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * Hot and big key detection.
+ *
+ * Hot keys: with `hotkeys-sample-rate` N > 0, about one key lookup in N
+ * (randomized so periodic access patterns are not aliased) is fed to a
+ * Count-Min sketch of k_hot_depth x k_hot_width counters indexed by the key
+ * hash, and the keys with the highest estimates are kept in a top-k min-heap.
+ * A lookup costs one decrement when it is not sampled, so the overhead is
+ * bounded by the rate. Counters are halved every k_hot_decay samples, so the
+ * ranking follows the recent traffic.
+ *
+ * Big keys: `BIGKEYS SCAN` walks the buckets of the key space, at most
+ * k_big_step per event loop iteration, and keeps the largest keys by
+ * accounted memory (`Entry::mem`) and the largest key of each type. Keys
+ * still in the mapped snapshot are not visited. The scan restarts when a
+ * resize starts under it, since the walked table would be walked again;
+ * keys moved by an ongoing resize into buckets already walked are missed,
+ * so the result is a survey, not an exact census.
+ */
+
+const size_t k_hot_depth = 4;
+const size_t k_hot_width = 4096;        // power of 2
+const size_t k_hot_topk = 32;
+const uint64_t k_hot_decay = 1 << 17;   // samples between halvings
+const size_t k_big_top = 32;
+const size_t k_big_step = 1024;         // buckets scanned per loop iteration
+
+// lookups left before the next sample, UINT64_MAX when sampling is off
+extern uint64_t g_hot_countdown;
+
+void hotkeys_sample(const std::string &key, uint64_t hcode);
+
+// count a key lookup, one decrement unless it is sampled
+inline void hotkeys_check(const std::string &key, uint64_t hcode){
+    if (--g_hot_countdown == 0){
+        hotkeys_sample(key, hcode);
+    }
+}
+
+/**
+ * @brief follow `hotkeys-sample-rate` and advance a running big-key scan, once per loop iteration
+ *
+ */
+void keystats_tick();
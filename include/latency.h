@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "utils.h"
+
+/**
+ * Service time histograms. Durations are taken with the TSC (a couple of ns
+ * per read instead of a clock_gettime) and kept in cycles; they are turned
+ * into time only when reported, with a cycles-per-ns ratio measured against
+ * the monotonic clock over the whole uptime.
+ *
+ * Buckets are log-linear, as in HdrHistogram: values below 2^k_lat_sub_bits
+ * get a bucket each, then every power of two is split in 2^k_lat_sub_bits
+ * linear buckets, so any value is known within 1/16 (6.25%) with 16 buckets
+ * per doubling. Values up to 2^k_lat_max_bits cycles (minutes) are kept,
+ * longer ones land in the last bucket; the exact maximum is kept aside.
+ *
+ * Latency events: stalls of the event loop are also tracked by cause. Each
+ * class keeps its worst duration ever and, once `latency-monitor-threshold`
+ * ms is reached, a history of the last k_lat_history samples, so a p999
+ * spike can be matched with a resize, an expiry cycle or a slow command.
+ * `lat_event` costs one compare unless it has something to record. The loop
+ * itself gets a histogram of its busy time per iteration, and an optional
+ * watchdog (`watchdog-period` ms) prints a backtrace from a SIGALRM sent to
+ * the event loop thread when an iteration runs longer.
+ */
+
+const uint32_t k_lat_sub_bits = 4;
+const uint32_t k_lat_max_bits = 40;
+const size_t k_lat_buckets = (k_lat_max_bits - k_lat_sub_bits + 1) << k_lat_sub_bits;
+
+struct LatHist {
+    uint64_t count = 0;
+    uint64_t sum = 0;                   // in cycles
+    uint64_t max = 0;                   // in cycles
+    uint64_t buckets[k_lat_buckets] = {};
+};
+
+// a timestamp in cycles
+inline uint64_t lat_now(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return get_mono_ns();
+#endif
+}
+
+inline size_t lat_bucket(uint64_t v){
+    if (v < (1ull << k_lat_sub_bits)) return (size_t)v;
+    uint32_t e = 63 - (uint32_t)__builtin_clzll(v);     // >= k_lat_sub_bits
+    if (e >= k_lat_max_bits) return k_lat_buckets - 1;
+    uint64_t sub = (v >> (e - k_lat_sub_bits)) & ((1ull << k_lat_sub_bits) - 1);
+    return ((size_t)(e - k_lat_sub_bits + 1) << k_lat_sub_bits) + (size_t)sub;
+}
+
+// record a duration, a few ns
+inline void lat_add(LatHist *h, uint64_t cycles){
+    h->count++;
+    h->sum += cycles;
+    h->buckets[lat_bucket(cycles)]++;
+    if (cycles > h->max) h->max = cycles;
+}
+
+// classes of latency events
+enum {
+    LAT_EV_LOOP = 0,        // busy time of one event loop iteration
+    LAT_EV_COMMAND = 1,     // a command handler
+    LAT_EV_EXPIRE = 2,      // one run of active expiry
+    LAT_EV_RESIZE = 3,      // allocating the bigger table of a hashtable
+    LAT_EV_EVICTION = 4,    // making room for a write under maxmemory
+    LAT_EV_PERSISTENCE = 5, // writing or loading a snapshot
+    LAT_EV_COUNT = 6,
+};
+
+const size_t k_lat_history = 160;
+
+// per class, the cycles from which `lat_event` records anything
+extern uint64_t g_lat_floor[LAT_EV_COUNT];
+
+// thread-local, set on helper threads (snapshot loaders) whose work must not touch the event loop's latency state
+extern thread_local bool g_lat_quiet;
+
+void lat_event_push(uint32_t ev, uint64_t cycles);
+
+// report a duration of an event class
+inline void lat_event(uint32_t ev, uint64_t cycles){
+    if (!g_lat_quiet && cycles >= g_lat_floor[ev]){
+        lat_event_push(ev, cycles);
+    }
+}
+
+/**
+ * @brief mark the start of an event loop iteration's work, arming the watchdog
+ *
+ */
+void lat_loop_begin();
+
+/**
+ * @brief mark the end of an event loop iteration's work
+ *
+ * @param n_events events returned by epoll for it
+ */
+void lat_loop_end(size_t n_events);
+
+/**
+ * @brief start measuring the cycles-per-ns ratio, call once at startup
+ *
+ */
+void lat_init();
+
+/**
+ * @brief convert a number of cycles into ns
+ *
+ */
+double lat_cycles_ns(uint64_t cycles);
+
+/**
+ * @brief the value below which a fraction of the recorded durations fall
+ *
+ * @param h histogram
+ * @param q quantile in [0, 1]
+ * @return uint64_t cycles, the upper end of the bucket holding the quantile (at most the maximum)
+ */
+uint64_t lat_quantile(const LatHist *h, double q);
+
+/**
+ * @brief cumulative counts at increasing bounds, in one pass over the buckets
+ *
+ * @param h histogram
+ * @param bounds upper bounds in cycles, increasing
+ * @param n number of bounds
+ * @param counts output, the values in buckets that end at or below each bound
+ */
+void lat_cumulative(const LatHist *h, const uint64_t *bounds, size_t n, uint64_t *counts);
+
+/**
+ * @brief the histogram of the event loop's busy time per iteration
+ *
+ */
+const LatHist *lat_loop_hist();
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "server_utils.h"
+
+/**
+ * Lazy freeing: an entry already detached from the keyspace whose value is
+ * expensive to release is pushed onto a lock-free stack (linked through the
+ * now unused `Entry::node.next`) and released on a background thread, so
+ * deleting a value of any size costs the event loop O(1).
+ *
+ * The event loop is the only producer and the reclamation thread takes the
+ * whole stack at once with an exchange, so plain CAS pushes are ABA-free.
+ */
+
+/**
+ * @brief start the reclamation thread
+ *
+ */
+void lazyfree_init();
+
+/**
+ * @brief hand a detached entry over to the reclamation thread
+ *
+ * @param ent entry that is no longer reachable from the keyspace, its memory already unaccounted
+ */
+void lazyfree_push(Entry *ent);
+
+/**
+ * @brief number of entries waiting to be freed
+ *
+ * @return size_t entries
+ */
+size_t lazyfree_pending();
+
+/**
+ * @brief how much work freeing an entry takes, roughly its number of allocations, or of pages for flat values
+ *
+ * @param ent target entry
+ * @return size_t effort, compared against `lazyfree-threshold`
+ */
+size_t entry_free_effort(Entry *ent);
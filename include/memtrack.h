@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <atomic>
+
+/**
+ * Allocation accounting by category. The raw allocations that are not part
+ * of a single value's estimate (hashtable bucket arrays, zset nodes, client
+ * connections and their buffers) go through these wrappers, which count the
+ * bytes the allocator really handed out (`malloc_usable_size`, so the size
+ * class rounding is included) per category. Counters are relaxed atomics as
+ * the lazyfree thread and the parallel snapshot load allocate and free too.
+ */
+
+enum {
+    MEM_HTAB = 0,       // bucket arrays of every HMap (the key space and the values' indexes)
+    MEM_ZNODE = 1,      // zset nodes
+    MEM_CONN = 2,       // Conn structs and their read/write buffers
+    MEM_CAT_COUNT = 3,
+};
+
+struct MemCat {
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> allocs{0};
+};
+
+extern MemCat g_mem[MEM_CAT_COUNT];
+
+// bytes usable in a block from malloc, 0 for NULL
+inline size_t mem_size(const void *p){
+    return p ? malloc_usable_size(const_cast<void *>(p)) : 0;
+}
+
+inline void mem_count(uint32_t cat, void *p){
+    g_mem[cat].bytes.fetch_add(mem_size(p), std::memory_order_relaxed);
+    g_mem[cat].allocs.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void *mem_malloc(size_t n, uint32_t cat){
+    void *p = malloc(n);
+    if (p) mem_count(cat, p);
+    return p;
+}
+
+inline void *mem_calloc(size_t n, size_t size, uint32_t cat){
+    void *p = calloc(n, size);
+    if (p) mem_count(cat, p);
+    return p;
+}
+
+// like realloc, the old block stays valid (and counted) when it fails
+inline void *mem_realloc(void *p, size_t n, uint32_t cat){
+    size_t old = mem_size(p);
+    void *q = realloc(p, n);
+    if (!q) return NULL;
+    if (!p){
+        mem_count(cat, q);
+    } else {
+        g_mem[cat].bytes.fetch_add(mem_size(q) - old, std::memory_order_relaxed);   // wraps when shrinking
+    }
+    return q;
+}
+
+inline void mem_free(void *p, uint32_t cat){
+    if (!p) return;
+    g_mem[cat].bytes.fetch_sub(mem_size(p), std::memory_order_relaxed);
+    g_mem[cat].allocs.fetch_sub(1, std::memory_order_relaxed);
+    free(p);
+}
+
+/**
+ * @brief resident set size of the process, from /proc/self/statm
+ *
+ * @return size_t bytes, 0 if unknown
+ */
+size_t mem_rss();
+
+/**
+ * @brief totals of the allocator (glibc malloc), both 0 if unknown
+ *
+ * @param allocated bytes in blocks handed out
+ * @param active bytes the allocator holds from the system, free chunks included
+ */
+void mem_allocator(size_t &allocated, size_t &active);
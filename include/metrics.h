@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Prometheus endpoint. With `metrics-port` set at startup, a second listening
+ * socket joins the event loop and answers `GET /metrics` with the counters
+ * and gauges of INFO plus the per-command and event loop latency histograms,
+ * in the Prometheus text format.
+ *
+ * Scrapes share the loop with commands, so nothing blocks: sockets are
+ * non-blocking, at most k_metrics_conns scrapes are served at once (more are
+ * closed on accept), each one reads its request into and renders its reply
+ * from fixed buffers of its slot, and a slot idle for k_metrics_idle_ms is
+ * dropped. Every response closes its connection.
+ */
+
+const size_t k_metrics_conns = 4;
+const size_t k_metrics_req_max = 4096;
+const size_t k_metrics_buf = 256 << 10;
+const uint64_t k_metrics_idle_ms = 5000;
+
+/**
+ * @brief open the metrics listener if `metrics-port` is set
+ *
+ * @param epfd epoll fd
+ * @return int32_t 0 on success or when disabled, -1 if the port cannot be bound
+ */
+int32_t metrics_init(int epfd);
+
+/**
+ * @brief handle an epoll event if its fd is the metrics listener or a scrape
+ *
+ * @param fd fd of the event
+ * @param events epoll event flags
+ * @param epfd epoll fd
+ * @return bool false if the fd is not for metrics
+ */
+bool metrics_handle(int fd, uint32_t events, int epfd);
+
+/**
+ * @brief drop scrapes idle for too long, once per loop iteration
+ *
+ * @param epfd epoll fd
+ */
+void metrics_tick(int epfd);
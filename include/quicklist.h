@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * List stored as a doubly-linked list of chunks, each a byte array of packed
+ * items:
+ *
+ *   | len | bytes | len |
+ *
+ * where `len` is 1 byte (< 0x80) or 0x80 + 4 bytes (trailing copy mirrored),
+ * so an item can be stepped over in both directions. Items sit in the middle
+ * of a chunk between `head` and `tail` offsets; a chunk created by a push to the
+ * front fills from its end, one created by a push to the back from its start,
+ * so push/pop at both ends are O(1) memmove-free writes into the end chunks.
+ * The first chunk of a list is sized to its first item and doubles as it
+ * fills, moving its items, up to k_qchunk_bytes, so short lists stay small;
+ * chunks added after it start at k_qchunk_bytes.
+ */
+
+const uint32_t k_qchunk_bytes = 8192 - 32;  // chunk capacity, the header rounds it to 8 KB
+
+struct QChunk {
+    QChunk *prev = NULL;
+    QChunk *next = NULL;
+    uint32_t cap = 0;       // bytes of `data`
+    uint32_t n = 0;         // number of items
+    uint32_t head = 0;      // offset of the first item
+    uint32_t tail = 0;      // offset past the last item
+    uint8_t data[0];
+};
+
+struct QList {
+    QChunk *first = NULL;
+    QChunk *last = NULL;
+    size_t n = 0;           // number of items
+    size_t n_chunks = 0;
+    size_t bytes = 0;       // bytes of all chunk allocations, for memory accounting
+};
+
+// position of an item
+struct QIter {
+    QChunk *chunk = NULL;
+    uint32_t off = 0;       // offset of the item in the chunk
+};
+
+/**
+ * @brief add an item at one end
+ *
+ * @param ql target list
+ * @param front push to the front instead of the back
+ * @param data item bytes
+ * @param len length of item
+ */
+void ql_push(QList *ql, bool front, const char *data, size_t len);
+
+/**
+ * @brief remove an item from one end
+ *
+ * @param ql target list
+ * @param front pop from the front instead of the back
+ * @param out output, gets the item bytes
+ * @return bool false if the list is empty
+ */
+bool ql_pop(QList *ql, bool front, std::string &out);
+
+/**
+ * @brief find the item at an index, walking chunks from the nearer end
+ *
+ * @param ql target list
+ * @param idx index, 0 <= idx < ql->n
+ * @return QIter position of the item
+ */
+QIter ql_index(QList *ql, size_t idx);
+
+/**
+ * @brief read the item at a position
+ *
+ * @param it valid position
+ * @param len output, length of item
+ * @return const char* item bytes
+ */
+const char *ql_item(QIter it, size_t *len);
+
+/**
+ * @brief move to the next item
+ *
+ * @param it valid position, updated in place
+ * @return bool false if there is no next item
+ */
+bool ql_next(QIter *it);
+
+/**
+ * @brief free all chunks, leaving the list empty
+ *
+ * @param ql target list
+ */
+void ql_dispose(QList *ql);
+
+/**
+ * @brief serialize a list as (4b length, bytes) per item
+ *
+ * @param ql source list
+ * @param out output buf
+ */
+void ql_encode(QList *ql, std::string &out);
+
+/**
+ * @brief fill an empty list from the output of `ql_encode`
+ *
+ * @param ql target list, must be empty
+ * @param data serialized items
+ * @param len length of data
+ * @return bool false if the data is malformed
+ */
+bool ql_decode(QList *ql, const char *data, size_t len);
@@ -11,9 +11,22 @@
 #include <string>
 
 #include "hashtable.h"
+#include "heap.h"
+#include "zset.h"
+#include "quicklist.h"
+#include "hash.h"
+#include "set.h"
+#include "hll.h"
+#include "bloom.h"
+#include "cuckoo.h"
+#include "stream.h"
+#include "latency.h"
+#include "snapshot.h"
 #include "utils.h"
 
-const size_t k_max_msg = 4096;
+const size_t k_max_msg = 32 << 20;         // big enough for a 16 MB value in either direction
+const size_t k_conn_buf_init = 4 + 4096;    // connection buffers start here and grow on demand
+const size_t k_conn_buf_idle = 64 << 10;    // bigger buffers are released once drained
 
 
 
@@ -22,6 +35,7 @@ enum {
     STATE_REQ = 0,
     STATE_RES = 1,
     STATE_END = 2,
+    STATE_BLOCKED = 3,  // parked by a blocking command, see blocking.h
 };
 
 struct Conn {
@@ -29,31 +43,81 @@ struct Conn {
     uint32_t state = 0; // default as STATE_REQ
     // buffer for reading
     size_t rbuf_size = 0;
-    uint8_t rbuf[4 + k_max_msg];
+    size_t rbuf_cap = 0;
+    uint8_t *rbuf = NULL;
     // buffer for writing
     size_t wbuf_size = 0;
     size_t wbuf_sent = 0;
-    uint8_t wbuf[4 + k_max_msg];
+    size_t wbuf_cap = 0;
+    uint8_t *wbuf = NULL;
+    // set while in STATE_BLOCKED
+    struct BlockState *blocked = NULL;
 };
 
 
 
 
+// value types of an entry, numbered as in the snapshot
+enum {
+    T_STR = SNAP_T_STR,
+    T_ZSET = SNAP_T_ZSET,
+    T_LIST = SNAP_T_LIST,
+    T_HASH = SNAP_T_HASH,
+    T_SET = SNAP_T_SET,
+    T_HLL = SNAP_T_HLL,
+    T_BLOOM = SNAP_T_BLOOM,
+    T_CUCKOO = SNAP_T_CUCKOO,
+    T_STREAM = SNAP_T_STREAM,
+};
+
+// encodings of a string value
+enum {
+    ENC_RAW = 0,    // `val` holds the bytes as-is
+    ENC_LZ = 1,     // `val` holds an lz block of `raw_len` bytes
+    ENC_INT = 2,    // the value is the decimal form of `ival`, `val` is empty
+};
+
 // structure for key-val node
 struct Entry {
     struct HNode node;
     std::string key;
-    std::string val;
+    std::string val;            // T_STR value
+    union {                     // aggregate value, by `type`
+        ZSet *zset = NULL;      // T_ZSET
+        int64_t ival;           // T_STR with ENC_INT
+        QList *list;            // T_LIST
+        Hash *hash;             // T_HASH
+        Set *set;               // T_SET
+        Hll *hll;               // T_HLL
+        Bloom *bf;              // T_BLOOM
+        Cuckoo *cf;             // T_CUCKOO
+        Stream *stream;         // T_STREAM
+    };
+    uint32_t type = T_STR;
+    uint32_t enc = ENC_RAW;
+    uint32_t raw_len = 0;
+    uint32_t lru = 0;           // access clock (LRU) or decay time + log counter (LFU), see evict.h
+    size_t heap_idx = -1;       // position in the TTL heap, -1 if the key has no TTL
+    size_t mem = 0;             // bytes accounted to this entry in `g_data.used_memory`
 };
 
 // data structure for the key space
-struct {
+struct GlobalData {
     struct HMap db;
-} g_data;
+    struct Snapshot snap;       // mapped snapshot, serves keys not yet migrated into `db`
+    std::vector<HeapItem> heap; // TTL heap, keyed by expiry time in ms since epoch
+    size_t used_memory = 0;     // sum of `Entry::mem`
+    uint64_t now_ms = 0;        // wall clock, refreshed once per event loop iteration
+};
+
+extern GlobalData g_data;
 
 // put a new connection state to fd2conn
 void conn_put(std::vector<Conn*> &fd2conn, struct Conn *conn);
 
+// release a connection and its buffers, the fd must be closed by the caller
+void conn_free(Conn *conn);
+
 // accept a new connection and register a Struct Conn for it
 int32_t accept_new_conn(std::vector<Conn*> &fd2conn, int fd, int epfd);
 
@@ -63,6 +127,9 @@ void connection_io(Conn* conn, int epfd);
 // handle incoming byte stream (parse with our pre-defined protocol)
 bool try_one_request(Conn *conn, int epfd);
 
+// queue a response and switch the connection to STATE_RES, writing once the socket is writable
+void conn_reply(Conn *conn, std::string &out, int epfd);
+
 
 
 
@@ -83,7 +150,9 @@ void fd_set_nb(int fd);
 // Data Encoding Scheme
 void out_nil(std::string &out);
 void out_str(std::string &out, const std::string &val);
+void out_str(std::string &out, const char *val, size_t len);
 void out_int(std::string &out, int64_t val);
+void out_dbl(std::string &out, double val);
 void out_err(std::string &out, int32_t code, const std::string &msg);
 void out_arr(std::string &out, uint32_t n);
 
@@ -91,12 +160,192 @@ void out_arr(std::string &out, uint32_t n);
 int32_t parse_req(const uint8_t *data, size_t len, std::vector<std::string>& out);
 bool cmd_is(const std::string &word, const char *cmd);
 
-// process the request
-void do_request(std::vector<std::string>& cmd, std::string &out);
+// command flags
+enum {
+    CMD_WRITE = 1,      // modifies the keyspace
+    CMD_DENYOOM = 2,    // may grow memory, evicts first and is refused when nothing can be evicted
+};
+
+struct Command {
+    const char *name;
+    int32_t arity;      // exact number of args (including the name) if > 0, the minimum if < 0
+    uint32_t flags;
+    void (*fn)(std::vector<std::string>& cmd, std::string &out);
+    uint64_t calls = 0;     // for INFO commandstats
+    uint64_t cycles = 0;    // total time spent in `fn`
+    LatHist *hist = NULL;   // service times, allocated on the first call
+};
+
+// find a command by (case-insensitive) name
+Command *cmd_lookup(const std::string &name);
+
+// the command table, sorted by name
+Command *cmd_table(size_t *n);
+
+// process the request, returning the cycles spent in its handler
+uint64_t do_request(std::vector<std::string>& cmd, std::string &out);
 void do_get(std::vector<std::string>& cmd, std::string &out);
 void do_set(std::vector<std::string>& cmd, std::string &out);
 void do_del(std::vector<std::string>& cmd, std::string &out);
+void do_unlink(std::vector<std::string>& cmd, std::string &out);
 void do_keys(std::vector<std::string>& cmd, std::string &out);
+void do_save(std::vector<std::string>& cmd, std::string &out);
+void do_config(std::vector<std::string>& cmd, std::string &out);
+void do_info(std::vector<std::string>& cmd, std::string &out);
+void do_latency(std::vector<std::string>& cmd, std::string &out);
+void do_slowlog(std::vector<std::string>& cmd, std::string &out);
+void do_hotkeys(std::vector<std::string>& cmd, std::string &out);
+void do_bigkeys(std::vector<std::string>& cmd, std::string &out);
+void do_memory(std::vector<std::string>& cmd, std::string &out);
+void do_expire(std::vector<std::string>& cmd, std::string &out);
+void do_pexpire(std::vector<std::string>& cmd, std::string &out);
+void do_ttl(std::vector<std::string>& cmd, std::string &out);
+void do_pttl(std::vector<std::string>& cmd, std::string &out);
+void do_persist(std::vector<std::string>& cmd, std::string &out);
+void do_zadd(std::vector<std::string>& cmd, std::string &out);
+void do_zrem(std::vector<std::string>& cmd, std::string &out);
+void do_zscore(std::vector<std::string>& cmd, std::string &out);
+void do_zcard(std::vector<std::string>& cmd, std::string &out);
+void do_zquery(std::vector<std::string>& cmd, std::string &out);
+void do_zrange(std::vector<std::string>& cmd, std::string &out);
+void do_zpopmin(std::vector<std::string>& cmd, std::string &out);
+void do_zpopmax(std::vector<std::string>& cmd, std::string &out);
+void do_bzpopmin(std::vector<std::string>& cmd, std::string &out);
+void do_bzpopmax(std::vector<std::string>& cmd, std::string &out);
+void do_lpush(std::vector<std::string>& cmd, std::string &out);
+void do_rpush(std::vector<std::string>& cmd, std::string &out);
+void do_lpop(std::vector<std::string>& cmd, std::string &out);
+void do_rpop(std::vector<std::string>& cmd, std::string &out);
+void do_blpop(std::vector<std::string>& cmd, std::string &out);
+void do_brpop(std::vector<std::string>& cmd, std::string &out);
+void do_lrange(std::vector<std::string>& cmd, std::string &out);
+void do_lindex(std::vector<std::string>& cmd, std::string &out);
+void do_llen(std::vector<std::string>& cmd, std::string &out);
+void do_hset(std::vector<std::string>& cmd, std::string &out);
+void do_hget(std::vector<std::string>& cmd, std::string &out);
+void do_hdel(std::vector<std::string>& cmd, std::string &out);
+void do_hgetall(std::vector<std::string>& cmd, std::string &out);
+void do_hincrby(std::vector<std::string>& cmd, std::string &out);
+void do_hlen(std::vector<std::string>& cmd, std::string &out);
+void do_sadd(std::vector<std::string>& cmd, std::string &out);
+void do_srem(std::vector<std::string>& cmd, std::string &out);
+void do_sismember(std::vector<std::string>& cmd, std::string &out);
+void do_scard(std::vector<std::string>& cmd, std::string &out);
+void do_smembers(std::vector<std::string>& cmd, std::string &out);
+void do_sinter(std::vector<std::string>& cmd, std::string &out);
+void do_sunion(std::vector<std::string>& cmd, std::string &out);
+void do_incr(std::vector<std::string>& cmd, std::string &out);
+void do_decr(std::vector<std::string>& cmd, std::string &out);
+void do_incrby(std::vector<std::string>& cmd, std::string &out);
+void do_decrby(std::vector<std::string>& cmd, std::string &out);
+void do_incrbyfloat(std::vector<std::string>& cmd, std::string &out);
+void do_setbit(std::vector<std::string>& cmd, std::string &out);
+void do_getbit(std::vector<std::string>& cmd, std::string &out);
+void do_bitcount(std::vector<std::string>& cmd, std::string &out);
+void do_bitpos(std::vector<std::string>& cmd, std::string &out);
+void do_bitop(std::vector<std::string>& cmd, std::string &out);
+void do_pfadd(std::vector<std::string>& cmd, std::string &out);
+void do_pfcount(std::vector<std::string>& cmd, std::string &out);
+void do_pfmerge(std::vector<std::string>& cmd, std::string &out);
+void do_bf_reserve(std::vector<std::string>& cmd, std::string &out);
+void do_bf_add(std::vector<std::string>& cmd, std::string &out);
+void do_bf_madd(std::vector<std::string>& cmd, std::string &out);
+void do_bf_exists(std::vector<std::string>& cmd, std::string &out);
+void do_bf_mexists(std::vector<std::string>& cmd, std::string &out);
+void do_cf_reserve(std::vector<std::string>& cmd, std::string &out);
+void do_cf_add(std::vector<std::string>& cmd, std::string &out);
+void do_cf_addnx(std::vector<std::string>& cmd, std::string &out);
+void do_cf_exists(std::vector<std::string>& cmd, std::string &out);
+void do_cf_del(std::vector<std::string>& cmd, std::string &out);
+void do_cf_count(std::vector<std::string>& cmd, std::string &out);
+void do_xadd(std::vector<std::string>& cmd, std::string &out);
+void do_xrange(std::vector<std::string>& cmd, std::string &out);
+void do_xread(std::vector<std::string>& cmd, std::string &out);
+void do_xtrim(std::vector<std::string>& cmd, std::string &out);
+void do_xlen(std::vector<std::string>& cmd, std::string &out);
+void do_geoadd(std::vector<std::string>& cmd, std::string &out);
+void do_geopos(std::vector<std::string>& cmd, std::string &out);
+void do_geodist(std::vector<std::string>& cmd, std::string &out);
+void do_geosearch(std::vector<std::string>& cmd, std::string &out);
+
+// parse a whole argument as a number
+bool parse_int(const std::string &s, int64_t &out);
+bool parse_dbl(const std::string &s, double &out);
+
+// lookup a key in heap storage, lazily deleting it if its TTL has passed
+Entry *entry_lookup(Entry *key);
+
+// lookup a key still living in the mapped snapshot, lazily killing it if its TTL has passed
+SnapRecord *snap_entry_lookup(Entry *key);
+
+// lookup a key for modification, migrating it from the mapped snapshot into heap storage
+Entry *entry_lookup_mut(Entry *key);
+
+// lookup a key for a command on values of `type` (migrating it from the snapshot),
+// false with the error in `out` if the key holds another type; `key` is kept for `entry_create`
+bool entry_find(std::string &name, uint32_t type, Entry &key, Entry *&ent, std::string &out);
+
+// set a key to a string value (taking over `val`), replacing a value of another type and dropping the TTL
+void entry_put_str(std::string &name, std::string &val);
+
+// delete a key from heap storage or the mapped snapshot, returns whether it existed
+bool del_key(std::string &name, bool lazy);
+
+// add a key holding an empty value of `type` (an empty string for T_STR), the key must not exist
+Entry *entry_create(Entry &key, uint32_t type);
+
+// after a removal from an aggregate value: delete the key if it has become empty, or refresh its accounting
+void entry_account_or_drop(Entry *ent);
+
+// set the TTL of an entry in ms from now, or remove it with a negative TTL
+void entry_set_ttl(Entry *ent, int64_t ttl_ms);
+
+// set the absolute expiry time of an entry, in ms since epoch
+void entry_set_ttl_at(Entry *ent, uint64_t expire_at);
+
+// absolute expiry time of an entry in ms since epoch, -1 if it has no TTL
+int64_t entry_expire_at(Entry *ent);
+
+// bytes used by an entry, exact (as handed out by malloc) for the blocks it can see
+size_t entry_mem(Entry *ent);
+
+// refresh the accounted memory of an entry after it was modified
+void entry_account(Entry *ent);
+
+// release an entry that is already detached from the keyspace, freeing big values
+// on the reclamation thread if `lazy` (see lazyfree.h)
+void entry_del(Entry *ent, bool lazy);
+
+// same, lazily if the `lazyfree` option is on
+void entry_del(Entry *ent);
+
+// free an entry and its value with no bookkeeping, safe to call off the event loop
+void entry_free(Entry *ent);
+
+// delete keys whose TTL has passed, bounded amount of work per call
+void expire_run();
+
+// timeout for the event loop, so the next TTL fires on time
+int32_t next_timer_ms();
+
+// store a string value (taking over `val`), as an integer when it is the canonical form of one,
+// else compressed when `value-compression` is on and it pays off
+void entry_set_str(Entry *ent, std::string &val);
+
+// store an integer value in place, no string is allocated
+void entry_set_int(Entry *ent, int64_t val);
+
+// get the plain bytes of a string value, `buf` is scratch space for decompression or formatting
+const std::string &entry_get_str(Entry *ent, std::string &buf);
+
+// the plain bytes of a string value for in-place modification, decoding it to ENC_RAW first
+std::string &entry_str_mut(Entry *ent);
+
+// serialized value of an entry as stored in a snapshot record, `buf` is scratch space
+const std::string &entry_dump(Entry *ent, std::string &buf);
+
+// set the value of a new entry from a serialized value of the given type, false if it is malformed
+bool entry_restore(Entry *ent, uint32_t type, const char *val, size_t len);
 
 // calculate hash value of a string
 uint64_t str_hash(const uint8_t *data, size_t len);
@@ -104,18 +353,35 @@ uint64_t str_hash(const uint8_t *data, size_t len);
 // determine whether two keys are equal
 bool entry_eq(HNode *lhs, HNode *rhs);
 
+// determine whether two nodes are the same node
+bool hnode_same(HNode *lhs, HNode *rhs);
+
 
 
 
 // Scan callbacks
+// output of a KEYS scan
+struct KeysScan {
+    std::string out;
+    uint32_t n = 0;
+};
+
 /**
- * @brief Scan callback: extract key and put in the outbuf passed through $arg
+ * @brief Scan callback: extract key of a live entry and put in the outbuf passed through $arg
  * 
  * @param node node to be scaned
- * @param arg should be of ref type `std::string&`, used as output buf
+ * @param arg should be of ref type `KeysScan&`, used as output buf
  */
 void cb_scan(HNode *node, void *arg);
 
+/**
+ * @brief Scan callback: same as `cb_scan`, for keys still living in the mapped snapshot
+ * 
+ * @param rec live snapshot record
+ * @param arg should be of ref type `KeysScan&`, used as output buf
+ */
+void cb_scan_snap(SnapRecord *rec, void *arg);
+
 
 
 
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "hashtable.h"
+#include "intset.h"
+
+/**
+ * Set of strings. While every member is a canonical int64 (as printed by
+ * `std::to_string`) and there are at most `set-max-intset-entries` of them,
+ * it is an `IntSet`; otherwise an `HMap` of `SMember`s.
+ */
+
+// encodings of a set
+enum {
+    SET_INTSET = 0,
+    SET_HMAP = 1,
+};
+
+struct SMember {
+    HNode node;
+    std::string name;
+};
+
+struct Set {
+    uint32_t enc = SET_INTSET;
+    IntSet is;              // SET_INTSET members
+    HMap hmap;              // SET_HMAP members
+    size_t bytes = 0;       // bytes of all SMember allocations, for memory accounting
+};
+
+/**
+ * @brief parse a member that is an integer in canonical form
+ *
+ * @param data member bytes
+ * @param len length of member
+ * @param val output
+ * @return bool false if the member is not a canonical int64
+ */
+bool str_to_int(const char *data, size_t len, int64_t *val);
+
+/**
+ * @brief number of members
+ *
+ * @param set target set
+ * @return size_t members
+ */
+size_t set_size(Set *set);
+
+/**
+ * @brief add a member
+ *
+ * @return bool true if it was not a member yet
+ */
+bool set_add(Set *set, const char *name, size_t len);
+
+/**
+ * @brief add many members at once, integers of an intset are merged in one pass
+ *
+ * @param set target set
+ * @param names members to add
+ * @param n number of members
+ * @return size_t number of members that were not members yet
+ */
+size_t set_add_many(Set *set, const std::string *names, size_t n);
+
+/**
+ * @brief remove a member
+ *
+ * @return bool true if it was a member
+ */
+bool set_del(Set *set, const char *name, size_t len);
+
+/**
+ * @brief check membership
+ *
+ * @return bool true if it is a member
+ */
+bool set_has(Set *set, const char *name, size_t len);
+
+/**
+ * @brief call `f` on every member (integers are formatted into a scratch buffer)
+ *
+ * @param set target set
+ * @param f callback taking (member, len, arg)
+ * @param arg argument to callback
+ */
+void set_scan(Set *set, void (*f)(const char *, size_t, void *), void *arg);
+
+/**
+ * @brief free all members, leaving the set empty
+ *
+ * @param set target set
+ */
+void set_dispose(Set *set);
+
+/**
+ * @brief serialize a set as (4b length, member) per member
+ *
+ * @param set source set
+ * @param out output buf
+ */
+void set_encode(Set *set, std::string &out);
+
+/**
+ * @brief fill an empty set from the output of `set_encode`
+ *
+ * @param set target set, must be empty
+ * @param data serialized members
+ * @param len length of data
+ * @return bool false if the data is malformed
+ */
+bool set_decode(Set *set, const char *data, size_t len);
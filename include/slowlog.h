@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Slow log: the last `slowlog-max-len` requests whose handler ran for at
+ * least `slowlog-log-slower-than` µs (negative: off, 0: every request), kept
+ * in a ring. The check against a threshold precomputed in cycles is the only
+ * cost of a fast request; arguments are copied, from the raw request still in
+ * the read buffer, only for a slow one.
+ */
+
+const size_t k_slowlog_max_args = 32;       // more are summarized as "... (n more arguments)"
+const size_t k_slowlog_max_arg_len = 128;   // longer ones are cut, "... (n more bytes)"
+const int64_t k_slowlog_max_len = 1 << 14;  // highest slowlog-max-len, up to ~70 MB of arguments
+
+struct SlowEntry {
+    uint64_t id = 0;
+    uint64_t time_ms = 0;   // wall clock when it was logged
+    uint64_t usec = 0;      // duration
+    int fd = -1;            // client connection
+    std::vector<std::string> args;
+};
+
+// handler cycles from which a request is logged, UINT64_MAX when the log is off
+extern uint64_t g_slowlog_cycles;
+
+/**
+ * @brief log a request if it was slow, a compare when it wasn't
+ *
+ * @param req raw request (the payload after its length)
+ * @param len length of req
+ * @param cycles handler duration
+ * @param fd client connection
+ */
+void slowlog_push(const uint8_t *req, size_t len, uint64_t cycles, int fd);
+
+inline void slowlog_check(const uint8_t *req, size_t len, uint64_t cycles, int fd){
+    if (cycles >= g_slowlog_cycles){
+        slowlog_push(req, len, cycles, fd);
+    }
+}
+
+/**
+ * @brief follow the slowlog settings, once per loop iteration
+ *
+ */
+void slowlog_tick();
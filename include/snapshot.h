@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hashtable.h"
+
+/**
+ * On-disk snapshot, laid out so the file can be mmap'd and served as-is:
+ *
+ *   | SnapHeader | SnapRecord ... | SnapChunk x n_chunks | bucket index (uint64_t x n_buckets) |
+ *
+ * Every record is 8-byte aligned and carries the precomputed `str_hash` of
+ * its key; the bucket index holds the file offset of the first record of each
+ * hash chain and `SnapRecord::next` links the rest, so a lookup is one index
+ * read plus a short chain walk with no parsing up front.
+ *
+ * Records are also grouped into chunks of roughly `k_snap_chunk_bytes`, each
+ * of which can be decoded on its own, so a full load can be spread over threads.
+ * With SNAP_F_LZ the chunks are lz blocks instead; such a file has an empty
+ * bucket index and can only be loaded into heap storage.
+ */
+
+const uint32_t k_snap_version = 4;
+const size_t k_snap_chunk_bytes = 4 << 20;
+
+struct SnapHeader {
+    char magic[8];          // "NRSNAP\0\0"
+    uint32_t version;
+    uint32_t flags;
+    uint64_t n_entries;     // number of records
+    uint64_t n_buckets;     // size of bucket index, 2^n
+    uint64_t data_off;      // offset of the first record
+    uint64_t chunk_off;     // offset of the chunk index, also the end of records
+    uint64_t n_chunks;
+    uint64_t index_off;     // offset of the bucket index
+    uint64_t file_size;
+};
+
+// flags of a snapshot
+enum {
+    SNAP_F_LZ = 1,      // chunks are compressed
+};
+
+// a run of whole records
+struct SnapChunk {
+    uint64_t off;
+    uint64_t len;       // bytes in the file
+    uint64_t n_records;
+    uint64_t raw_len;   // decompressed size, 0 if the chunk is stored as-is
+};
+
+// flags of a record
+enum {
+    SNAP_REC_DEAD = 1,  // migrated to heap or deleted (only ever set in the private mapping)
+};
+
+// value types of a record
+enum {
+    SNAP_T_STR = 0,
+    SNAP_T_ZSET = 1,    // pairs as written by `zset_encode`
+    SNAP_T_LIST = 2,    // items as written by `ql_encode`
+    SNAP_T_HASH = 3,    // fields as written by `hash_encode`
+    SNAP_T_SET = 4,     // members as written by `set_encode`
+    SNAP_T_HLL = 5,     // registers as written by `hll_encode`
+    SNAP_T_BLOOM = 6,   // bit array as written by `bf_encode`
+    SNAP_T_CUCKOO = 7,  // fingerprints as written by `cf_encode`
+    SNAP_T_STREAM = 8,  // entries as written by `stream_encode`
+};
+
+struct SnapRecord {
+    uint64_t next = 0;      // offset of next record in the same bucket, 0 if last
+    uint64_t hcode = 0;
+    uint32_t klen = 0;
+    uint32_t vlen = 0;
+    uint32_t type = 0;
+    uint32_t flags = 0;
+    int64_t expire_at = -1; // ms since epoch, -1 if no TTL
+    char data[0];           // key bytes followed by value bytes
+};
+
+// a mapped snapshot file
+struct Snapshot {
+    uint8_t *base = NULL;
+    size_t size = 0;
+    SnapHeader *hdr = NULL;
+    SnapChunk *chunks = NULL;
+    uint64_t *index = NULL;
+    size_t n_live = 0;      // records not yet dead
+};
+
+/**
+ * @brief write all keys of the heap keyspace plus the live records of a mapped snapshot
+ * into a new snapshot file (written to a temp file, then renamed over `path`)
+ *
+ * @param path target file
+ * @param db heap keyspace
+ * @param snap currently mapped snapshot, may be NULL
+ * @param compress write lz-compressed chunks
+ * @return int32_t 0 on success, -1 on I/O error
+ */
+int32_t snap_save(const char *path, HMap *db, Snapshot *snap, bool compress);
+
+/**
+ * @brief map a snapshot file; only the header is validated, records are checked when touched
+ *
+ * @param path snapshot file
+ * @param snap output
+ * @return int32_t 0 if mapped, 1 if the file does not exist, 2 if it was written in another format version,
+ *                 -1 if it is not a valid snapshot
+ */
+int32_t snap_open(const char *path, Snapshot *snap);
+
+/**
+ * @brief unmap a snapshot
+ *
+ * @param snap target snapshot
+ */
+void snap_close(Snapshot *snap);
+
+/**
+ * @brief lookup a live record by key, using the prebuilt bucket index
+ *
+ * @param snap mapped snapshot
+ * @param key buffer containing key
+ * @param len length of key
+ * @param hcode `str_hash` of key
+ * @return SnapRecord* the record, or NULL if not found / already dead
+ */
+SnapRecord *snap_lookup(Snapshot *snap, const char *key, size_t len, uint64_t hcode);
+
+/**
+ * @brief mark a record dead, so the heap copy (or its absence) takes over
+ *
+ * @param snap mapped snapshot
+ * @param rec live record
+ */
+void snap_kill(Snapshot *snap, SnapRecord *rec);
+
+/**
+ * @brief scan all live records in file order
+ *
+ * @param snap mapped snapshot
+ * @param f callback to call on each record
+ * @param arg argument to callback
+ */
+void snap_scan(Snapshot *snap, void (*f)(SnapRecord *, void *), void *arg);
+
+/**
+ * @brief copy every record of a freshly mapped snapshot into an empty heap keyspace.
+ * Chunks are decoded on `n_threads` workers, then linked straight into a pre-sized table.
+ *
+ * @param snap mapped snapshot, can be closed afterwards
+ * @param db heap keyspace, must be empty (TTLs and memory are accounted in `g_data`)
+ * @param n_threads number of loader threads
+ * @return int32_t 0 on success, -1 if a chunk is corrupted
+ */
+int32_t snap_load_all(Snapshot *snap, HMap *db, size_t n_threads);
+
+inline const char *rec_key(SnapRecord *rec){
+    return &rec->data[0];
+}
+
+inline const char *rec_val(SnapRecord *rec){
+    return &rec->data[rec->klen];
+}
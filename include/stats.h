@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Always-on server counters for INFO. Everything here is a plain increment
+ * on the event loop thread; per-command call counts and time live in the
+ * command table itself (`Command::calls`, `Command::cycles`). Instantaneous
+ * rates come from samples taken every k_stats_sample_ms by `stats_tick`.
+ */
+
+const uint64_t k_stats_sample_ms = 100;
+const size_t k_stats_samples = 16;     // rates are averaged over the last 1.6 s
+
+struct Stats {
+    uint64_t start_ms = 0;          // wall clock at startup
+    uint64_t conns = 0;             // connected clients
+    uint64_t total_conns = 0;       // accepted since startup
+    uint64_t commands = 0;          // requests processed, including rejected ones
+    uint64_t rejected = 0;          // unknown commands, wrong arity, refused by maxmemory
+    uint64_t net_in = 0;            // bytes read from clients
+    uint64_t net_out = 0;           // bytes written to clients
+};
+
+extern Stats g_stats;
+
+/**
+ * @brief take a rate sample if k_stats_sample_ms passed since the last one, once per loop iteration
+ *
+ */
+void stats_tick();
+
+/**
+ * @brief zero the counters that accumulate (commands, bytes, per-command stats), keeping gauges
+ *
+ */
+void stats_reset();
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * Append-only log of entries, each a 128-bit ID (ms, seq) and a list of
+ * field/value strings. IDs only grow, so entries live in packed blocks kept
+ * in ID order:
+ *
+ *   | ms - base_ms | seq | payload | n_items | len | bytes | len | bytes | ...
+ *
+ * with every number a varint and `payload` the bytes from `n_items` on, so a
+ * scan for an ID steps over entries without decoding their fields. A block
+ * is closed once it holds k_sblock_entries entries or k_sblock_bytes bytes.
+ * Seeking an ID is a binary search over the blocks then a scan of at most
+ * one block; trimming frees whole blocks from the front and, when exact,
+ * moves the start of the first remaining block past the dropped entries.
+ */
+
+const uint32_t k_sblock_bytes = 4096 - 64;  // default capacity, the header rounds it to 4 KB
+const uint32_t k_sblock_entries = 128;
+
+struct StreamId {
+    uint64_t ms = 0;
+    uint64_t seq = 0;
+};
+
+inline int sid_cmp(const StreamId &a, const StreamId &b){
+    if (a.ms != b.ms) return a.ms < b.ms ? -1 : 1;
+    if (a.seq != b.seq) return a.seq < b.seq ? -1 : 1;
+    return 0;
+}
+
+struct SBlock {
+    StreamId first;         // ID of the first live entry
+    StreamId last;          // ID of the last entry
+    uint64_t base_ms = 0;   // entries store their ms relative to it
+    uint32_t cap = 0;       // bytes of `data`
+    uint32_t n = 0;         // number of live entries
+    uint32_t head = 0;      // offset of the first live entry
+    uint32_t tail = 0;      // offset past the last entry
+    uint8_t data[0];
+};
+
+struct Stream {
+    std::deque<SBlock *> blocks;
+    uint64_t n = 0;         // number of entries
+    StreamId last_id;       // of the last entry ever added, new IDs must be greater even after trimming
+    size_t bytes = 0;       // bytes of all block allocations, for memory accounting
+};
+
+// position of an entry
+struct SIter {
+    size_t block = 0;       // index into `blocks`, `blocks.size()` past the end
+    uint32_t off = 0;       // offset of the entry in the block
+};
+
+// an entry read in place, the fields point into its block
+struct SEntry {
+    StreamId id;
+    std::vector<std::pair<const char *, size_t>> items;    // field, value, field, value, ...
+};
+
+/**
+ * @brief append an entry
+ *
+ * @param s target stream
+ * @param id entry ID, must be greater than `s->last_id`
+ * @param items field/value strings
+ * @param n_items number of strings, even
+ */
+void stream_add(Stream *s, StreamId id, const std::string *items, size_t n_items);
+
+/**
+ * @brief find the first entry with an ID >= `id`, O(log blocks)
+ *
+ * @param s target stream
+ * @param id lower bound
+ * @return SIter position of the entry, or past the end
+ */
+SIter stream_seek(const Stream *s, StreamId id);
+
+/**
+ * @brief read the entry at a position and move past it
+ *
+ * @param s target stream
+ * @param it position, updated in place
+ * @param ent output entry
+ * @return bool false if the position is past the end
+ */
+bool stream_next(const Stream *s, SIter *it, SEntry *ent);
+
+/**
+ * @brief remove the oldest entries until at most `maxlen` are left
+ *
+ * @param s target stream
+ * @param maxlen number of entries to keep
+ * @param approx only free whole blocks, possibly keeping a few more entries
+ * @return size_t number of removed entries
+ */
+size_t stream_trim_maxlen(Stream *s, uint64_t maxlen, bool approx);
+
+/**
+ * @brief remove the entries with an ID lower than `minid`
+ *
+ * @param s target stream
+ * @param minid lowest ID to keep
+ * @param approx only free whole blocks, possibly keeping a few lower entries
+ * @return size_t number of removed entries
+ */
+size_t stream_trim_minid(Stream *s, StreamId minid, bool approx);
+
+/**
+ * @brief free all blocks, leaving the stream empty
+ *
+ * @param s target stream
+ */
+void stream_dispose(Stream *s);
+
+/**
+ * @brief serialize a stream as its last ID then (8b ms, 8b seq, 4b items, (4b length, bytes) per item) per entry
+ *
+ * @param s source stream
+ * @param out output buf
+ */
+void stream_encode(const Stream *s, std::string &out);
+
+/**
+ * @brief fill an empty stream from the output of `stream_encode`
+ *
+ * @param s target stream, must be empty
+ * @param data serialized entries
+ * @param len length of data
+ * @return bool false if the data is malformed
+ */
+bool stream_decode(Stream *s, const char *data, size_t len);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <pthread.h>
+#include <vector>
+#include <deque>
+
+struct Work {
+    void (*f)(void *) = NULL;
+    void *arg = NULL;
+};
+
+struct ThreadPool {
+    std::vector<pthread_t> threads;
+    std::deque<Work> queue;
+    size_t n_busy = 0;          // works taken off the queue but not finished
+    bool stopping = false;
+    pthread_mutex_t mu;
+    pthread_cond_t not_empty;   // signaled when work is queued or the pool stops
+    pthread_cond_t idle;        // signaled when the queue drains and no work is running
+};
+
+/**
+ * @brief start the worker threads
+ *
+ * @param tp pool to initialize
+ * @param num_threads number of workers, must be > 0
+ */
+void thread_pool_init(ThreadPool *tp, size_t num_threads);
+
+/**
+ * @brief queue a work item, it will be run by one of the workers
+ *
+ * @param tp target pool
+ * @param f work function
+ * @param arg argument to work function
+ */
+void thread_pool_queue(ThreadPool *tp, void (*f)(void *), void *arg);
+
+/**
+ * @brief block until every queued work item has finished
+ *
+ * @param tp target pool
+ */
+void thread_pool_wait(ThreadPool *tp);
+
+/**
+ * @brief finish the queued work, then join and release the workers
+ *
+ * @param tp target pool
+ */
+void thread_pool_destroy(ThreadPool *tp);
+
+/**
+ * @brief number of online CPUs, at least 1
+ */
+size_t cpu_count();
@@ -0,0 +1,37 @@
+#pragma once
+
+/**
+ * USDT tracepoints, provider `nanoredis`. With <sys/sdt.h> (systemtap-sdt-dev)
+ * found at configure time and the NANOREDIS_USDT CMake option on (the
+ * default), each TRACE site compiles to a single nop plus a note in the ELF
+ * that perf/bpftrace patch into a breakpoint when attached:
+ *
+ *   bpftrace -l 'usdt:./build/server:nanoredis:*'
+ *   bpftrace -e 'usdt:./build/server:nanoredis:command_done { @[str(arg0)] = hist(arg1); }'
+ *
+ * Without the header or with the option off, the macros expand to nothing and
+ * their arguments are not evaluated. When compiled in, arguments are computed
+ * even if nobody listens, so sites only pass values already at hand.
+ *
+ * Probes and their arguments:
+ *   command_start   name, argc
+ *   command_done    name, cycles in the handler
+ *   resize_start    hmap, buckets of the table being replaced, keys
+ *   resize_step     hmap, keys moved by this step, keys left in the old table
+ *   resize_done     hmap
+ *   conn_accept     fd
+ *   conn_read       fd, bytes
+ *   conn_write      fd, bytes
+ *   conn_close      fd
+ */
+
+#if defined(NANOREDIS_USDT)
+#include <sys/sdt.h>
+#define TRACE1(probe, a) DTRACE_PROBE1(nanoredis, probe, a)
+#define TRACE2(probe, a, b) DTRACE_PROBE2(nanoredis, probe, a, b)
+#define TRACE3(probe, a, b, c) DTRACE_PROBE3(nanoredis, probe, a, b, c)
+#else
+#define TRACE1(probe, a) do {} while (0)
+#define TRACE2(probe, a, b) do {} while (0)
+#define TRACE3(probe, a, b, c) do {} while (0)
+#endif
@@ -20,6 +20,7 @@ enum {
     SER_STR = 2,    // string
     SER_INT = 3,    // int64
     SER_ARR = 4,    // Array
+    SER_DBL = 5,    // double
 };
 
 /**
@@ -29,6 +30,10 @@ enum {
 enum {
     ERR_2BIG = 0,
     ERR_UNKNOWN = 1,
+    ERR_IO = 2,
+    ERR_ARG = 3,
+    ERR_OOM = 4,
+    ERR_TYPE = 5,   // operation against a key holding the wrong kind of value
 };
 
 // for intrusive data structure
@@ -46,4 +51,10 @@ void die(char const *msg);
 
 uint64_t str_hash(const uint8_t *data, size_t len);
 
+// wall clock in ms since epoch
+uint64_t get_wall_ms();
+
+// monotonic clock in ns, for measuring durations
+uint64_t get_mono_ns();
+
 #endif //MY_REDIS_UTILS_H
@@ -7,10 +7,12 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <cstring>
+#include <string>
 
 typedef struct ZSet { // put two indexes together
     AVLNode *tree = NULL;
     HMap hmap;
+    size_t bytes = 0; // bytes of all node allocations, for memory accounting
 } ZSet;
 
 typedef struct ZNode {
@@ -85,6 +87,59 @@ void znode_del(ZNode *node);
  * 
  */
 
+/**
+ * @brief find the first pair that is >= (score, name)
+ * 
+ * @param zset target sorted set
+ * @param score score to seek
+ * @param name buffer containing name to seek
+ * @param len length of name
+ * @return ZNode* the pair, or NULL if every pair is smaller
+ */
+ZNode *zset_seekge(ZSet *zset, double score, const char *name, size_t len);
+
+/**
+ * @brief walk to the pair `offset` positions away in sorted order
+ * 
+ * @param node starting pair
+ * @param offset offset relative to `node`, may be negative
+ * @return ZNode* the pair, or NULL if out of range
+ */
+ZNode *znode_offset(ZNode *node, int64_t offset);
+
+/**
+ * @brief number of pairs in a sorted set
+ * 
+ * @param zset target sorted set
+ * @return size_t number of pairs
+ */
+size_t zset_size(ZSet *zset);
+
+/**
+ * @brief deallocate every node and the hashtable of a sorted set, leaving it empty
+ * 
+ * @param zset target sorted set
+ */
+void zset_dispose(ZSet *zset);
+
+/**
+ * @brief serialize a sorted set as (8b score, 4b name length, name) in sorted order
+ * 
+ * @param zset source sorted set
+ * @param out output buf
+ */
+void zset_encode(ZSet *zset, std::string &out);
+
+/**
+ * @brief fill an empty sorted set from the output of `zset_encode`
+ * 
+ * @param zset target sorted set, must be empty
+ * @param data serialized pairs
+ * @param len length of data
+ * @return bool false if the data is malformed
+ */
+bool zset_decode(ZSet *zset, const char *data, size_t len);
+
 
 
 /**
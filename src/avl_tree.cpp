@@ -12,7 +12,7 @@ static uint32_t _abs(uint32_t n){
 
 
 void avl_init(AVLNode *node){
-    node->height = 0;
+    node->height = 1;
     node->cnt = 1;
     node->left = node->right = node->parent = NULL;
 }
@@ -83,9 +83,9 @@ AVLNode *avl_fix(AVLNode *node){ // fix imbalanced nodes and maintain invariants
             from = (p->left == node) ? &p->left : &p->right;
         }
         // balance this node
-        if(lh - rh > 1){ // heavier left tree
+        if(lh > rh + 1){ // heavier left tree
             node = avl_fix_left(node);
-        }else if(lh - rh < -1){
+        }else if(rh > lh + 1){
             node = avl_fix_right(node);
         }
         // process the parent
@@ -217,10 +217,10 @@ AVLNode *rot_right(AVLNode *node){
  * @brief get height of node
  * 
  * @param node an AVLNode
- * @return uint32_t height of node; return -1 if node is NULL
+ * @return uint32_t height of node; return 0 if node is NULL
  */
 uint32_t avl_height(AVLNode *node){
-    return node ? node->height : -1;
+    return node ? node->height : 0;
 }
 
 /**
@@ -244,6 +244,42 @@ void avl_update(AVLNode *node){
 }
 
 
+/**
+ * @brief find the node at given offset ranking, walking up and down by subtree counts
+ * 
+ * @param node starting node
+ * @param offset offset relative to `node` in sorted order, may be negative
+ * @return AVLNode* the node, or NULL if out of range
+ */
+AVLNode *avl_offset(AVLNode *node, int64_t offset){
+    int64_t pos = 0; // relative to the starting node
+    while (offset != pos){
+        if (pos < offset && pos + avl_cnt(node->right) >= offset){
+            // the target is inside the right subtree
+            node = node->right;
+            pos += avl_cnt(node->left) + 1;
+        } else if (pos > offset && pos - avl_cnt(node->left) <= offset){
+            // the target is inside the left subtree
+            node = node->left;
+            pos -= avl_cnt(node->right) + 1;
+        } else {
+            // go to the parent
+            AVLNode *parent = node->parent;
+            if (!parent){
+                return NULL;
+            }
+            if (parent->right == node){
+                pos -= avl_cnt(node->left) + 1;
+            } else {
+                pos += avl_cnt(node->right) + 1;
+            }
+            node = parent;
+        }
+    }
+    return node;
+}
+
+
 // util function
 /**
  * @brief pick larger value of two int numericals
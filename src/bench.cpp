@@ -0,0 +1,478 @@
+//
+// Load generator: N connections spread over M threads, each thread driving its
+// connections from one epoll loop with up to P requests in flight per connection.
+// Reports throughput and latency percentiles per command.
+//
+// Without --rate the load is closed-loop (a new request as soon as one returns).
+// With --rate, each connection follows a fixed schedule and latency is measured
+// from when a request should have been sent, not when it was, so a stalled server
+// is charged for the requests it kept the client from sending (coordinated omission).
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils.h"
+#include "latency.h"
+#include "server_utils.h"
+
+enum {
+    OP_GET = 0,
+    OP_SET = 1,
+    OP_ZADD = 2,
+    OP_COUNT = 3,
+};
+
+static const char *const k_op_names[OP_COUNT] = {"get", "set", "zadd"};
+const size_t k_zset_keys = 100;     // ZADD spreads its members over this many zsets
+
+struct BenchOpts {
+    std::string host = "127.0.0.1";
+    int port = 1234;
+    size_t conns = 50;
+    size_t threads = 4;
+    uint64_t requests = 100000;     // total, unless `duration` is set
+    double duration = 0;            // seconds
+    size_t pipeline = 1;
+    uint64_t keys = 100000;
+    bool zipf = false;
+    double zipf_s = 0.99;
+    uint32_t mix[OP_COUNT] = {80, 20, 0};
+    size_t value_size = 16;
+    double rate = 0;                // requests per second over all connections, 0 = closed loop
+};
+
+static BenchOpts g_opts;
+
+// Zipfian ranks in [0, n), as in YCSB (Gray et al.), rank 0 being the hottest
+struct Zipf {
+    uint64_t n = 0;
+    double theta = 0;
+    double alpha = 0;
+    double zetan = 0;
+    double eta = 0;
+};
+
+static double zeta(uint64_t n, double theta){
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; ++i){
+        sum += 1.0 / pow((double)i, theta);
+    }
+    return sum;
+}
+
+static void zipf_init(Zipf &z, uint64_t n, double theta){
+    z.n = n;
+    z.theta = theta;
+    z.alpha = 1.0 / (1.0 - theta);
+    z.zetan = zeta(n, theta);
+    z.eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta(2, theta) / z.zetan);
+}
+
+static uint64_t zipf_next(const Zipf &z, double u){
+    double uz = u * z.zetan;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + pow(0.5, z.theta)) return 1;
+    uint64_t r = (uint64_t)((double)z.n * pow(z.eta * u - z.eta + 1.0, z.alpha));
+    return r < z.n ? r : z.n - 1;
+}
+
+static Zipf g_zipf;
+
+// a request on the wire, waiting for its reply
+struct Pending {
+    uint64_t intended_ns = 0;   // when the schedule wanted it sent
+    uint64_t sent_ns = 0;
+    uint32_t op = 0;
+};
+
+struct BenchConn {
+    int fd = -1;
+    std::deque<Pending> inflight;
+    std::string wbuf;
+    size_t wsent = 0;
+    std::vector<uint8_t> rbuf;
+    size_t rlen = 0;
+    uint64_t budget = 0;        // requests left to send, UINT64_MAX until the deadline
+    uint64_t next_ns = 0;       // next scheduled send with --rate
+    uint64_t interval_ns = 0;
+    bool want_out = false;      // EPOLLOUT is armed
+};
+
+struct BenchResult {
+    LatHist service[OP_COUNT];      // from the actual send
+    LatHist corrected[OP_COUNT];    // from the scheduled send
+    uint64_t done = 0;
+    uint64_t errors = 0;
+};
+
+struct BenchThread {
+    std::vector<BenchConn> conns;
+    BenchResult res;
+    uint64_t rng = 0;
+};
+
+static uint64_t bench_rand(uint64_t &s){
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+static uint64_t next_key(uint64_t &rng){
+    if (g_opts.zipf){
+        return zipf_next(g_zipf, (double)(bench_rand(rng) >> 11) / (double)(1ull << 53));
+    }
+    return bench_rand(rng) % g_opts.keys;
+}
+
+static uint32_t next_op(uint64_t &rng){
+    uint32_t total = g_opts.mix[OP_GET] + g_opts.mix[OP_SET] + g_opts.mix[OP_ZADD];
+    uint32_t r = (uint32_t)(bench_rand(rng) % total);
+    for (uint32_t op = 0; op < OP_COUNT; ++op){
+        if (r < g_opts.mix[op]) return op;
+        r -= g_opts.mix[op];
+    }
+    return OP_GET;
+}
+
+// append one request in the server's framing
+static void put_req(std::string &w, const std::vector<std::string> &args){
+    uint32_t len = 4;
+    for (const std::string &a : args){
+        len += 4 + (uint32_t)a.size();
+    }
+    uint32_t n = (uint32_t)args.size();
+    w.append((const char *)&len, 4);
+    w.append((const char *)&n, 4);
+    for (const std::string &a : args){
+        uint32_t sz = (uint32_t)a.size();
+        w.append((const char *)&sz, 4);
+        w.append(a);
+    }
+}
+
+static void queue_req(BenchConn &c, uint64_t &rng, const std::string &value, uint64_t intended, uint64_t now){
+    static thread_local std::vector<std::string> args;
+    char key[32];
+    uint64_t k = next_key(rng);
+    uint32_t op = next_op(rng);
+    args.clear();
+    if (op == OP_GET){
+        snprintf(key, sizeof(key), "key:%010llu", (unsigned long long)k);
+        args = {"get", key};
+    } else if (op == OP_SET){
+        snprintf(key, sizeof(key), "key:%010llu", (unsigned long long)k);
+        args = {"set", key, value};
+    } else {
+        char member[32];
+        snprintf(key, sizeof(key), "zset:%03llu", (unsigned long long)(k % k_zset_keys));
+        snprintf(member, sizeof(member), "member:%010llu", (unsigned long long)k);
+        args = {"zadd", key, std::to_string(bench_rand(rng) % 1000000), member};
+    }
+    put_req(c.wbuf, args);
+    Pending p;
+    p.intended_ns = intended;
+    p.sent_ns = now;
+    p.op = op;
+    c.inflight.push_back(p);
+    c.budget--;
+}
+
+static void set_out(BenchConn &c, int epfd, bool on){
+    if (c.want_out == on) return;
+    c.want_out = on;
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | (on ? (uint32_t)EPOLLOUT : 0);
+    ev.data.ptr = &c;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+static void flush(BenchConn &c, int epfd){
+    while (c.wsent < c.wbuf.size()){
+        ssize_t rv = write(c.fd, c.wbuf.data() + c.wsent, c.wbuf.size() - c.wsent);
+        if (rv < 0 && errno == EINTR) continue;
+        if (rv < 0 && errno == EAGAIN){
+            return set_out(c, epfd, true);
+        }
+        if (rv <= 0) die("write() to server");
+        c.wsent += (size_t)rv;
+    }
+    c.wbuf.clear();
+    c.wsent = 0;
+    set_out(c, epfd, false);
+}
+
+// send what the pipeline and the schedule allow, in one write
+static void issue(BenchConn &c, int epfd, uint64_t &rng, const std::string &value, uint64_t now){
+    size_t before = c.inflight.size();
+    while (c.budget && c.inflight.size() < g_opts.pipeline){
+        if (c.interval_ns){
+            if (c.next_ns > now) break;
+            queue_req(c, rng, value, c.next_ns, now);
+            c.next_ns += c.interval_ns;
+        } else {
+            queue_req(c, rng, value, now, now);
+        }
+    }
+    if (c.inflight.size() != before){
+        flush(c, epfd);
+    }
+}
+
+static void on_readable(BenchConn &c, BenchResult &res){
+    while (true){
+        if (c.rbuf.size() - c.rlen < 4096){
+            c.rbuf.resize(c.rbuf.size() * 2);
+        }
+        ssize_t rv = read(c.fd, c.rbuf.data() + c.rlen, c.rbuf.size() - c.rlen);
+        if (rv < 0 && errno == EINTR) continue;
+        if (rv < 0 && errno == EAGAIN) break;
+        if (rv <= 0) die("read() from server");
+        c.rlen += (size_t)rv;
+    }
+    uint64_t now = get_mono_ns();
+    size_t pos = 0;
+    while (c.rlen - pos >= 4){
+        uint32_t len = 0;
+        memcpy(&len, &c.rbuf[pos], 4);
+        if (c.rlen - pos - 4 < len) break;
+        if (c.inflight.empty()) die("reply without a request");
+        const Pending &p = c.inflight.front();
+        lat_add(&res.service[p.op], now - p.sent_ns);
+        lat_add(&res.corrected[p.op], now - p.intended_ns);
+        if (len && c.rbuf[pos + 4] == SER_ERR) res.errors++;
+        res.done++;
+        c.inflight.pop_front();
+        pos += 4 + len;
+    }
+    if (pos){
+        memmove(c.rbuf.data(), c.rbuf.data() + pos, c.rlen - pos);
+        c.rlen -= pos;
+    }
+}
+
+static int bench_connect(){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) die("socket()");
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)g_opts.port);
+    if (inet_pton(AF_INET, g_opts.host.c_str(), &addr.sin_addr) != 1) die("bad --host");
+    if (connect(fd, (const struct sockaddr *)&addr, sizeof(addr))) die("connect()");
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fd_set_nb(fd);
+    return fd;
+}
+
+static void bench_thread(BenchThread *t, uint64_t start_ns, uint64_t end_ns){
+    int epfd = epoll_create1(0);
+    if (epfd < 0) die("epoll_create1()");
+    std::string value(g_opts.value_size, 'x');
+    for (BenchConn &c : t->conns){
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &c;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+        c.next_ns = start_ns;
+    }
+
+    struct epoll_event events[64];
+    while (true){
+        uint64_t now = get_mono_ns();
+        bool active = false;
+        uint64_t wake_ns = UINT64_MAX;
+        for (BenchConn &c : t->conns){
+            if (end_ns && now >= end_ns) c.budget = 0;
+            issue(c, epfd, t->rng, value, now);
+            if (c.budget || !c.inflight.empty()) active = true;
+            if (c.budget && c.interval_ns && c.inflight.size() < g_opts.pipeline && c.next_ns < wake_ns){
+                wake_ns = c.next_ns;
+            }
+        }
+        if (!active) break;
+        int timeout = -1;
+        if (wake_ns != UINT64_MAX){ // spin the last ms before a scheduled send
+            timeout = wake_ns > now ? (int)((wake_ns - now) / 1000000) : 0;
+        }
+        if (end_ns){
+            uint64_t left = end_ns > now ? (end_ns - now) / 1000000 + 1 : 0;
+            if (timeout < 0 || (uint64_t)timeout > left) timeout = (int)left;
+        }
+        int n = epoll_wait(epfd, events, 64, timeout);
+        for (int i = 0; i < n; ++i){
+            BenchConn &c = *(BenchConn *)events[i].data.ptr;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) die("server closed the connection");
+            if (events[i].events & EPOLLOUT) flush(c, epfd);
+            if (events[i].events & EPOLLIN) on_readable(c, t->res);
+        }
+    }
+    close(epfd);
+}
+
+static void merge(LatHist &into, const LatHist &h){
+    into.count += h.count;
+    into.sum += h.sum;
+    if (h.max > into.max) into.max = h.max;
+    for (size_t i = 0; i < k_lat_buckets; ++i){
+        into.buckets[i] += h.buckets[i];
+    }
+}
+
+static void print_table(const char *title, const LatHist *hists){
+    printf("\n%s\n", title);
+    printf("%-8s %10s %9s %9s %9s %9s %9s %9s %9s\n", "latency", "count", "mean", "p50", "p90", "p99",
+           "p99.9", "p99.99", "max");
+    static LatHist all;
+    all = LatHist();
+    for (uint32_t op = 0; op <= OP_COUNT; ++op){
+        const LatHist *h = op < OP_COUNT ? &hists[op] : &all;
+        if (op < OP_COUNT) merge(all, *h);
+        if (!h->count) continue;
+        printf("%-8s %10llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", op < OP_COUNT ? k_op_names[op] : "all",
+               (unsigned long long)h->count, (double)h->sum / (double)h->count / 1000,
+               (double)lat_quantile(h, 0.5) / 1000, (double)lat_quantile(h, 0.9) / 1000,
+               (double)lat_quantile(h, 0.99) / 1000, (double)lat_quantile(h, 0.999) / 1000,
+               (double)lat_quantile(h, 0.9999) / 1000, (double)h->max / 1000);
+    }
+}
+
+static void usage(){
+    fprintf(stderr,
+        "usage: bench [--host 127.0.0.1] [--port 1234] [--clients 50] [--threads 4]\n"
+        "             [--requests 100000 | --duration seconds] [--pipeline 1]\n"
+        "             [--keys 100000] [--dist uniform|zipf] [--zipf-s 0.99]\n"
+        "             [--mix get=80,set=20,zadd=0] [--value-size 16] [--rate requests/s]\n");
+    exit(2);
+}
+
+static bool parse_mix(const char *s){
+    uint32_t mix[OP_COUNT] = {};
+    std::string str(s);
+    size_t pos = 0;
+    while (pos < str.size()){
+        size_t end = str.find(',', pos);
+        if (end == std::string::npos) end = str.size();
+        std::string item = str.substr(pos, end - pos);
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        std::string name = item.substr(0, eq);
+        uint32_t op = 0;
+        while (op < OP_COUNT && name != k_op_names[op]) op++;
+        if (op == OP_COUNT) return false;
+        mix[op] = (uint32_t)atoi(item.c_str() + eq + 1);
+        pos = end + 1;
+    }
+    if (!mix[OP_GET] && !mix[OP_SET] && !mix[OP_ZADD]) return false;
+    memcpy(g_opts.mix, mix, sizeof(mix));
+    return true;
+}
+
+static void parse_args(int argc, char **argv){
+    for (int i = 1; i < argc; i += 2){
+        if (i + 1 >= argc) usage();
+        const char *name = argv[i];
+        const char *val = argv[i + 1];
+        if (!strcmp(name, "--host")) g_opts.host = val;
+        else if (!strcmp(name, "--port")) g_opts.port = atoi(val);
+        else if (!strcmp(name, "--clients")) g_opts.conns = (size_t)atol(val);
+        else if (!strcmp(name, "--threads")) g_opts.threads = (size_t)atol(val);
+        else if (!strcmp(name, "--requests")) g_opts.requests = (uint64_t)atoll(val);
+        else if (!strcmp(name, "--duration")) g_opts.duration = atof(val);
+        else if (!strcmp(name, "--pipeline")) g_opts.pipeline = (size_t)atol(val);
+        else if (!strcmp(name, "--keys")) g_opts.keys = (uint64_t)atoll(val);
+        else if (!strcmp(name, "--dist") && !strcmp(val, "uniform")) g_opts.zipf = false;
+        else if (!strcmp(name, "--dist") && !strcmp(val, "zipf")) g_opts.zipf = true;
+        else if (!strcmp(name, "--zipf-s")) g_opts.zipf_s = atof(val);
+        else if (!strcmp(name, "--mix")){
+            if (!parse_mix(val)) usage();
+        }
+        else if (!strcmp(name, "--value-size")) g_opts.value_size = (size_t)atol(val);
+        else if (!strcmp(name, "--rate")) g_opts.rate = atof(val);
+        else usage();
+    }
+    if (!g_opts.conns || !g_opts.threads || !g_opts.pipeline || !g_opts.keys || g_opts.port <= 0
+        || (!g_opts.requests && g_opts.duration <= 0) || g_opts.rate < 0
+        || g_opts.zipf_s <= 0 || g_opts.zipf_s == 1){
+        usage();
+    }
+    if (g_opts.threads > g_opts.conns) g_opts.threads = g_opts.conns;
+}
+
+int main(int argc, char **argv){
+    parse_args(argc, argv);
+    if (g_opts.zipf){
+        zipf_init(g_zipf, g_opts.keys, g_opts.zipf_s);
+    }
+
+    std::vector<BenchThread> threads(g_opts.threads);
+    for (size_t i = 0; i < g_opts.conns; ++i){
+        BenchConn c;
+        c.fd = bench_connect();
+        c.rbuf.resize(64 << 10);
+        // split the requests evenly, the first connections take the remainder
+        c.budget = g_opts.duration > 0 ? UINT64_MAX
+                 : g_opts.requests / g_opts.conns + (i < g_opts.requests % g_opts.conns ? 1 : 0);
+        c.interval_ns = g_opts.rate > 0 ? (uint64_t)(1e9 * (double)g_opts.conns / g_opts.rate) : 0;
+        threads[i % g_opts.threads].conns.push_back(std::move(c));
+    }
+    for (size_t i = 0; i < threads.size(); ++i){
+        threads[i].rng = 0x9E3779B97F4A7C15ull * (i + 1);
+    }
+
+    uint64_t start = get_mono_ns();
+    uint64_t end = g_opts.duration > 0 ? start + (uint64_t)(g_opts.duration * 1e9) : 0;
+    std::vector<std::thread> workers;
+    for (BenchThread &t : threads){
+        workers.emplace_back(bench_thread, &t, start, end);
+    }
+    for (std::thread &w : workers){
+        w.join();
+    }
+    double elapsed = (double)(get_mono_ns() - start) / 1e9;
+
+    static BenchResult total;
+    for (BenchThread &t : threads){
+        for (uint32_t op = 0; op < OP_COUNT; ++op){
+            merge(total.service[op], t.res.service[op]);
+            merge(total.corrected[op], t.res.corrected[op]);
+        }
+        total.done += t.res.done;
+        total.errors += t.res.errors;
+        for (BenchConn &c : t.conns){
+            close(c.fd);
+        }
+    }
+
+    printf("%zu connections on %zu threads, pipeline %zu, %llu keys %s", g_opts.conns, g_opts.threads,
+           g_opts.pipeline, (unsigned long long)g_opts.keys, g_opts.zipf ? "zipf" : "uniform");
+    if (g_opts.zipf) printf(" (s=%.2f)", g_opts.zipf_s);
+    printf(", get %u set %u zadd %u, %zu-byte values\n", g_opts.mix[OP_GET], g_opts.mix[OP_SET],
+           g_opts.mix[OP_ZADD], g_opts.value_size);
+    printf("%llu requests in %.3f s: %.0f ops/sec, %llu errors", (unsigned long long)total.done, elapsed,
+           (double)total.done / elapsed, (unsigned long long)total.errors);
+    if (g_opts.rate > 0) printf(", target %.0f ops/sec", g_opts.rate);
+    printf("\n");
+    if (g_opts.rate > 0){
+        print_table("µs from the scheduled send (corrected for coordinated omission)", total.corrected);
+        print_table("µs from the actual send (service time)", total.service);
+    } else {
+        print_table("µs from send to reply (closed loop)", total.service);
+    }
+    return 0;
+}
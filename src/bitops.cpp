@@ -0,0 +1,205 @@
+#include "bitops.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+static uint64_t load64(const uint8_t *p){
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static void store64(uint8_t *p, uint64_t v){
+    memcpy(p, &v, 8);
+}
+
+uint64_t bit_count_scalar(const uint8_t *p, size_t n){
+    uint64_t total = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        total += (uint64_t)__builtin_popcountll(load64(p + i));
+    }
+    for (; i < n; ++i){
+        total += (uint64_t)__builtin_popcount(p[i]);
+    }
+    return total;
+}
+
+__attribute__((target("popcnt")))
+static uint64_t bit_count_popcnt(const uint8_t *p, size_t n){
+    // independent accumulators, so the popcnts don't wait on each other
+    uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32){
+        c0 += (uint64_t)_mm_popcnt_u64(load64(p + i));
+        c1 += (uint64_t)_mm_popcnt_u64(load64(p + i + 8));
+        c2 += (uint64_t)_mm_popcnt_u64(load64(p + i + 16));
+        c3 += (uint64_t)_mm_popcnt_u64(load64(p + i + 24));
+    }
+    for (; i + 8 <= n; i += 8){
+        c0 += (uint64_t)_mm_popcnt_u64(load64(p + i));
+    }
+    for (; i < n; ++i){
+        c0 += (uint64_t)_mm_popcnt_u32(p[i]);
+    }
+    return c0 + c1 + c2 + c3;
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t bit_count_avx2(const uint8_t *p, size_t n){
+    // bits set in each nibble value, looked up with a byte shuffle
+    const __m256i lut = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    size_t i = 0;
+    while (i + 32 <= n){
+        // per-byte counts reach at most 8 a block, so 31 blocks fit before widening
+        __m256i local = zero;
+        for (int k = 0; k < 31 && i + 32 <= n; ++k, i += 32){
+            __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+            __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low));
+            __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+            local = _mm256_add_epi8(local, _mm256_add_epi8(lo, hi));
+        }
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(local, zero));
+    }
+    uint64_t total = (uint64_t)_mm256_extract_epi64(acc, 0) + (uint64_t)_mm256_extract_epi64(acc, 1)
+        + (uint64_t)_mm256_extract_epi64(acc, 2) + (uint64_t)_mm256_extract_epi64(acc, 3);
+    return total + bit_count_popcnt(p + i, n - i);
+}
+
+template <uint32_t op>
+static uint64_t word_op(uint64_t a, uint64_t b){
+    switch (op){
+        case BIT_AND: return a & b;
+        case BIT_OR: return a | b;
+        case BIT_XOR: return a ^ b;
+        default: return ~a;
+    }
+}
+
+template <uint32_t op>
+static void bit_op_words(uint8_t *dst, const uint8_t *src, size_t n){
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        store64(dst + i, word_op<op>(load64(dst + i), op == BIT_NOT ? 0 : load64(src + i)));
+    }
+    for (; i < n; ++i){
+        dst[i] = (uint8_t)word_op<op>(dst[i], op == BIT_NOT ? 0 : src[i]);
+    }
+}
+
+void bit_op_scalar(uint32_t op, uint8_t *dst, const uint8_t *src, size_t n){
+    switch (op){
+        case BIT_AND: return bit_op_words<BIT_AND>(dst, src, n);
+        case BIT_OR: return bit_op_words<BIT_OR>(dst, src, n);
+        case BIT_XOR: return bit_op_words<BIT_XOR>(dst, src, n);
+        default: return bit_op_words<BIT_NOT>(dst, src, n);
+    }
+}
+
+template <uint32_t op>
+__attribute__((target("avx2")))
+static void bit_op_avx2_t(uint8_t *dst, const uint8_t *src, size_t n){
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32){
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i r;
+        if (op == BIT_NOT){
+            r = _mm256_xor_si256(a, ones);
+        } else {
+            __m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+            r = op == BIT_AND ? _mm256_and_si256(a, b) : op == BIT_OR ? _mm256_or_si256(a, b) : _mm256_xor_si256(a, b);
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i), r);
+    }
+    bit_op_words<op>(dst + i, op == BIT_NOT ? NULL : src + i, n - i);
+}
+
+static void bit_op_avx2(uint32_t op, uint8_t *dst, const uint8_t *src, size_t n){
+    switch (op){
+        case BIT_AND: return bit_op_avx2_t<BIT_AND>(dst, src, n);
+        case BIT_OR: return bit_op_avx2_t<BIT_OR>(dst, src, n);
+        case BIT_XOR: return bit_op_avx2_t<BIT_XOR>(dst, src, n);
+        default: return bit_op_avx2_t<BIT_NOT>(dst, src, n);
+    }
+}
+
+// first bit equal to `bit` a word at a time, bytes are read big-endian so the bit order matches clz
+static int64_t bit_pos_words(const uint8_t *p, size_t n, bool bit, size_t i){
+    for (; i + 8 <= n; i += 8){
+        uint64_t w = __builtin_bswap64(load64(p + i));
+        if (!bit) w = ~w;
+        if (w) return (int64_t)(i * 8 + (size_t)__builtin_clzll(w));
+    }
+    for (; i < n; ++i){
+        uint32_t b = bit ? p[i] : (uint8_t)~p[i];
+        if (b) return (int64_t)(i * 8 + (size_t)__builtin_clz(b) - 24);
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+static int64_t bit_pos_avx2(const uint8_t *p, size_t n, bool bit){
+    // skip 32 bytes at a time while they are all 0 (looking for a 1) or all 1 (looking for a 0)
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32){
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        bool skip = bit ? _mm256_testz_si256(v, v) : _mm256_testc_si256(v, ones);
+        if (!skip) break;
+    }
+    return bit_pos_words(p, n, bit, i);
+}
+
+static int64_t bit_pos_plain(const uint8_t *p, size_t n, bool bit){
+    return bit_pos_words(p, n, bit, 0);
+}
+
+typedef uint64_t (*CountFn)(const uint8_t *, size_t);
+typedef void (*OpFn)(uint32_t, uint8_t *, const uint8_t *, size_t);
+typedef int64_t (*PosFn)(const uint8_t *, size_t, bool);
+
+static CountFn g_count = NULL;
+static OpFn g_op = &bit_op_scalar;
+static PosFn g_pos = &bit_pos_plain;
+static const char *g_kernel_name = "scalar";
+
+static void pick_kernels(){
+    if (g_count) return;
+    __builtin_cpu_init();
+    g_count = &bit_count_scalar;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")){
+        g_count = &bit_count_avx2;
+        g_op = &bit_op_avx2;
+        g_pos = &bit_pos_avx2;
+        g_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("popcnt")){
+        g_count = &bit_count_popcnt;
+        g_kernel_name = "popcnt";
+    }
+}
+
+uint64_t bit_count(const uint8_t *p, size_t n){
+    pick_kernels();
+    return g_count(p, n);
+}
+
+void bit_op(uint32_t op, uint8_t *dst, const uint8_t *src, size_t n){
+    pick_kernels();
+    g_op(op, dst, src, n);
+}
+
+int64_t bit_pos(const uint8_t *p, size_t n, bool bit){
+    pick_kernels();
+    return g_pos(p, n, bit);
+}
+
+const char *bitops_kernel(){
+    pick_kernels();
+    return g_kernel_name;
+}
@@ -0,0 +1,173 @@
+#include "blocking.h"
+#include "heap.h"
+#include "utils.h"
+
+#include <sys/epoll.h>
+#include <math.h>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+// the wait asked by the running command, taken by `block_park`
+static struct {
+    bool on = false;
+    std::vector<std::string> cmd;
+    size_t first_key = 0;
+    size_t n_keys = 0;
+    uint64_t timeout_ms = 0;
+    bool consume = true;
+} g_pending;
+
+static std::unordered_map<std::string, std::deque<Conn *>> g_waiters;  // FIFO of blocked connections per key
+static std::vector<std::string> g_ready;                                // keys signaled since the last `block_run`
+static std::unordered_set<std::string> g_ready_set;
+static std::vector<HeapItem> g_deadlines;                               // keyed by deadline in ms since epoch
+static size_t g_blocked = 0;
+
+void block_wait(const std::vector<std::string> &cmd, size_t first_key, size_t n_keys, uint64_t timeout_ms,
+                bool consume){
+    g_pending.on = true;
+    g_pending.consume = consume;
+    g_pending.cmd = cmd;
+    g_pending.first_key = first_key;
+    g_pending.n_keys = n_keys;
+    g_pending.timeout_ms = timeout_ms;
+}
+
+bool block_parse_timeout(const std::string &s, double unit_ms, uint64_t &ms){
+    double v = 0;
+    if (!parse_dbl(s, v) || !(v >= 0) || v * unit_ms > 1e15){
+        return false;
+    }
+    ms = (uint64_t)ceil(v * unit_ms);
+    return true;
+}
+
+bool block_park(Conn *conn, int epfd){
+    if (!g_pending.on){
+        return false;
+    }
+    g_pending.on = false;
+    BlockState *b = new BlockState();
+    b->conn = conn;
+    b->cmd.swap(g_pending.cmd);
+    b->consume = g_pending.consume;
+    for (size_t i = 0; i < g_pending.n_keys; ++i){
+        const std::string &key = b->cmd[g_pending.first_key + i];
+        std::deque<Conn *> &q = g_waiters[key];
+        if (q.empty() || q.back() != conn){ // a key listed twice waits once
+            q.push_back(conn);
+            b->keys.push_back(key);
+        }
+    }
+    if (g_pending.timeout_ms){
+        HeapItem item;
+        item.val = g_data.now_ms + g_pending.timeout_ms;
+        item.ref = &b->heap_idx;
+        g_deadlines.push_back(item);
+        b->heap_idx = g_deadlines.size() - 1;
+        heap_update(g_deadlines.data(), b->heap_idx, g_deadlines.size());
+    }
+    conn->blocked = b;
+    conn->state = STATE_BLOCKED;
+    g_blocked++;
+
+    // stop reading, pipelined requests wait in the socket; a hangup is still reported
+    struct epoll_event ev = {};
+    ev.events = EPOLLRDHUP;
+    ev.data.fd = conn->fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+    return true;
+}
+
+void block_signal(const std::string &key){
+    if (g_waiters.empty() || !g_waiters.count(key) || g_ready_set.count(key)){
+        return;
+    }
+    g_ready_set.insert(key);
+    g_ready.push_back(key);
+}
+
+// drop a connection from its queues and the deadline heap
+static void block_detach(BlockState *b){
+    for (const std::string &key : b->keys){
+        auto it = g_waiters.find(key);
+        std::deque<Conn *> &q = it->second;
+        for (auto qit = q.begin(); qit != q.end(); ++qit){
+            if (*qit == b->conn){
+                q.erase(qit);
+                break;
+            }
+        }
+        if (q.empty()){
+            g_waiters.erase(it);
+        }
+    }
+    if (b->heap_idx != (size_t)-1){
+        size_t pos = b->heap_idx;
+        g_deadlines[pos] = g_deadlines.back();
+        g_deadlines.pop_back();
+        if (pos < g_deadlines.size()){
+            heap_update(g_deadlines.data(), pos, g_deadlines.size());
+        }
+    }
+    b->conn->blocked = NULL;
+    g_blocked--;
+    delete b;
+}
+
+// answer a blocked connection and let it write
+static void block_wake(Conn *conn, std::string &out, int epfd){
+    block_detach(conn->blocked);
+    conn_reply(conn, out, epfd);
+}
+
+void block_run(int epfd){
+    while (!g_ready.empty()){
+        std::vector<std::string> keys;
+        keys.swap(g_ready);
+        g_ready_set.clear();
+        for (const std::string &key : keys){
+            auto it = g_waiters.find(key);
+            if (it == g_waiters.end()) continue;
+            // the queue shrinks as waiters are woken, walk a copy
+            std::vector<Conn *> queue(it->second.begin(), it->second.end());
+            for (Conn *conn : queue){
+                if (!conn->blocked) continue; // woken through another of its keys
+                std::vector<std::string> cmd = conn->blocked->cmd;
+                std::string out;
+                do_request(cmd, out);
+                if (g_pending.on){ // it keeps waiting, at its place
+                    g_pending.on = false;
+                    g_pending.cmd.clear();
+                    if (conn->blocked->consume){
+                        break; // nothing left for the ones queued behind either
+                    }
+                    continue;
+                }
+                block_wake(conn, out, epfd);
+            }
+        }
+    }
+
+    while (!g_deadlines.empty() && g_deadlines[0].val <= g_data.now_ms){
+        BlockState *b = container_of(g_deadlines[0].ref, BlockState, heap_idx);
+        std::string out;
+        out_nil(out);
+        block_wake(b->conn, out, epfd);
+    }
+}
+
+uint64_t block_next_ms(){
+    return g_deadlines.empty() ? UINT64_MAX : g_deadlines[0].val;
+}
+
+void block_cancel(Conn *conn){
+    if (conn->blocked){
+        block_detach(conn->blocked);
+    }
+}
+
+size_t block_count(){
+    return g_blocked;
+}
@@ -17,7 +17,7 @@
 
 #include "utils.h"
 
-const size_t k_max_msg = 4096;
+const size_t k_max_msg = 32 << 20;
 
 static int32_t send_req(int fd, const std::vector<std::string> &cmd);
 static int32_t read_res(int fd);
@@ -65,7 +65,8 @@ static int32_t send_req(int fd, const std::vector<std::string> &cmd) {
         return -1;
     }
 
-    char wbuf[4 + k_max_msg];
+    std::vector<char> buf(4 + len);
+    char *wbuf = buf.data();
     memcpy(&wbuf[0], &len, 4);  // assume little endian
     uint32_t n = cmd.size();
     memcpy(&wbuf[4], &n, 4);
@@ -81,9 +82,9 @@ static int32_t send_req(int fd, const std::vector<std::string> &cmd) {
 
 static int32_t read_res(int fd) {
     // 4 bytes header
-    char rbuf[4 + k_max_msg + 1];
+    std::vector<char> buf(4);
     errno = 0;
-    int32_t err = read_full(fd, rbuf, 4);
+    int32_t err = read_full(fd, buf.data(), 4);
     if (err) {
         if (errno == 0) {
             msg("EOF");
@@ -94,11 +95,13 @@ static int32_t read_res(int fd) {
     }
 
     uint32_t len = 0;
-    memcpy(&len, rbuf, 4);  // assume little endian
+    memcpy(&len, buf.data(), 4);  // assume little endian
     if (len > k_max_msg) {
         msg("too long");
         return -1;
     }
+    buf.resize(4 + len + 1);
+    char *rbuf = buf.data();
 
     // reply body
     err = read_full(fd, &rbuf[4], len);
@@ -163,16 +166,31 @@ static int32_t on_response(const uint8_t *data, size_t size){
 
         case SER_INT:
             // 1b - SER_INT
-            // 4b - val
-            if(size - 1 < 4) {
+            // 8b - val
+            if(size - 1 < 8) {
+                msg("bad response");
+                return -1;
+            }
+            {
+                int64_t val;
+                memcpy(&val, &data[1], 8);
+                printf("(int) val = %lld\n", (long long)val);
+                return 9;
+            }
+
+
+        case SER_DBL:
+            // 1b - SER_DBL
+            // 8b - val
+            if(size - 1 < 8) {
                 msg("bad response");
                 return -1;
             }
             {
-                int32_t val;
-                memcpy(&val, &data[1], 4);
-                printf("(int) val = %d\n", val);
-                return 5;
+                double val;
+                memcpy(&val, &data[1], 8);
+                printf("(dbl) val = %g\n", val);
+                return 9;
             }
 
 
@@ -0,0 +1,262 @@
+//
+// Bitmap commands on string values, bit 0 is the most significant bit of the first byte
+//
+
+#include "server_utils.h"
+#include "bitops.h"
+#include "config.h"
+#include "evict.h"
+#include "utils.h"
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+const int64_t k_bitmap_max_bits = (int64_t)1 << 32;   // 512 MB per bitmap
+
+// read-only view of a string value, served from the mapped snapshot when the key wasn't migrated;
+// false with the error in `out` if the key holds another type, an empty view if it doesn't exist
+static bool str_view(std::string &name, const uint8_t *&data, size_t &len, std::string &buf, std::string &out){
+    Entry key;
+    key.key.swap(name);
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    data = NULL;
+    len = 0;
+    Entry *ent = entry_lookup(&key);
+    if (ent){
+        if (ent->type != T_STR){
+            out_err(out, ERR_TYPE, "WRONGTYPE");
+            return false;
+        }
+        entry_touch(ent);
+        const std::string &val = entry_get_str(ent, buf);
+        data = (const uint8_t *)val.data();
+        len = val.size();
+        return true;
+    }
+    SnapRecord *rec = snap_entry_lookup(&key);
+    if (rec){
+        if (rec->type != SNAP_T_STR){
+            out_err(out, ERR_TYPE, "WRONGTYPE");
+            return false;
+        }
+        data = (const uint8_t *)rec_val(rec);
+        len = rec->vlen;
+    }
+    return true;
+}
+
+static bool parse_bit(const std::string &s, int64_t &bit, std::string &out){
+    if (!parse_int(s, bit) || (bit != 0 && bit != 1)){
+        out_err(out, ERR_ARG, "bit is not 0 or 1");
+        return false;
+    }
+    return true;
+}
+
+static bool parse_offset(const std::string &s, int64_t &off, std::string &out){
+    if (!parse_int(s, off) || off < 0 || off >= k_bitmap_max_bits){
+        out_err(out, ERR_ARG, "bit offset is not an integer or out of range");
+        return false;
+    }
+    return true;
+}
+
+// optional `start end [BYTE|BIT]` arguments from `first` on
+static bool parse_range(std::vector<std::string>& cmd, size_t first, int64_t &start, int64_t &end, bool &in_bits,
+                        std::string &out){
+    start = 0;
+    end = -1;
+    in_bits = false;
+    if ((cmd.size() > first && !parse_int(cmd[first], start))
+        || (cmd.size() > first + 1 && !parse_int(cmd[first + 1], end))){
+        out_err(out, ERR_ARG, "expect int");
+        return false;
+    }
+    if (cmd.size() > first + 2){
+        if (cmd_is(cmd[first + 2], "bit")){
+            in_bits = true;
+        } else if (!cmd_is(cmd[first + 2], "byte")){
+            out_err(out, ERR_ARG, "expect BYTE or BIT");
+            return false;
+        }
+    }
+    return true;
+}
+
+// clamp an inclusive range with negative indexes from the end, false if it is empty
+static bool norm_range(int64_t &start, int64_t &end, int64_t len){
+    if (start < 0) start += len;
+    if (end < 0) end += len;
+    start = std::max(start, (int64_t)0);
+    end = std::min(end, len - 1);
+    return start <= end;
+}
+
+static bool get_bit(const uint8_t *p, int64_t off){
+    return (p[off >> 3] >> (7 - (off & 7))) & 1;
+}
+
+void do_setbit(std::vector<std::string>& cmd, std::string &out){
+    int64_t off = 0;
+    int64_t bit = 0;
+    if (!parse_offset(cmd[2], off, out) || !parse_bit(cmd[3], bit, out)) return;
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_STR, key, ent, out)) return;
+    if (!ent){
+        ent = entry_create(key, T_STR);
+    }
+    std::string &val = entry_str_mut(ent);
+    size_t pos = (size_t)(off >> 3);
+    if (val.size() <= pos){
+        val.resize(pos + 1, '\0'); // grows the capacity geometrically
+    }
+    uint8_t mask = (uint8_t)(0x80 >> (off & 7));
+    int64_t old = (val[pos] & mask) != 0;
+    if (bit){
+        val[pos] = (char)(val[pos] | mask);
+    } else {
+        val[pos] = (char)(val[pos] & ~mask);
+    }
+    entry_account(ent);
+    out_int(out, old);
+}
+
+void do_getbit(std::vector<std::string>& cmd, std::string &out){
+    int64_t off = 0;
+    if (!parse_offset(cmd[2], off, out)) return;
+    const uint8_t *data = NULL;
+    size_t len = 0;
+    std::string buf;
+    if (!str_view(cmd[1], data, len, buf, out)) return;
+    out_int(out, (size_t)(off >> 3) < len ? get_bit(data, off) : 0);
+}
+
+void do_bitcount(std::vector<std::string>& cmd, std::string &out){
+    if (cmd.size() == 3 || cmd.size() > 5){
+        return out_err(out, ERR_ARG, "expect BITCOUNT key [start end [BYTE|BIT]]");
+    }
+    int64_t start, end;
+    bool in_bits;
+    if (!parse_range(cmd, 2, start, end, in_bits, out)) return;
+    const uint8_t *data = NULL;
+    size_t len = 0;
+    std::string buf;
+    if (!str_view(cmd[1], data, len, buf, out)) return;
+    if (!norm_range(start, end, (int64_t)len * (in_bits ? 8 : 1))){
+        return out_int(out, 0);
+    }
+    if (!in_bits){
+        return out_int(out, (int64_t)bit_count(data + start, (size_t)(end - start + 1)));
+    }
+    // whole bytes, minus the bits of the first and last byte outside the range
+    int64_t first = start >> 3;
+    int64_t last = end >> 3;
+    uint64_t n = bit_count(data + first, (size_t)(last - first + 1));
+    n -= (uint64_t)__builtin_popcount(data[first] & (0xFF00 >> (start & 7)) & 0xFF);
+    n -= (uint64_t)__builtin_popcount(data[last] & (0xFF >> ((end & 7) + 1)));
+    out_int(out, (int64_t)n);
+}
+
+// first bit equal to `bit` in the inclusive bit range [s, e], -1 if there is none
+static int64_t find_bit(const uint8_t *p, int64_t s, int64_t e, bool bit){
+    // unaligned bits one at a time, whole bytes with the kernel
+    int64_t i = s;
+    for (; i <= e && (i & 7); ++i){
+        if (get_bit(p, i) == bit) return i;
+    }
+    if (i <= e){
+        int64_t n_bytes = (e + 1 - i) >> 3;
+        int64_t pos = bit_pos(p + (i >> 3), (size_t)n_bytes, bit);
+        if (pos >= 0) return i + pos;
+        i += n_bytes * 8;
+    }
+    for (; i <= e; ++i){
+        if (get_bit(p, i) == bit) return i;
+    }
+    return -1;
+}
+
+void do_bitpos(std::vector<std::string>& cmd, std::string &out){
+    if (cmd.size() > 6){
+        return out_err(out, ERR_ARG, "expect BITPOS key bit [start [end [BYTE|BIT]]]");
+    }
+    int64_t bit = 0;
+    if (!parse_bit(cmd[2], bit, out)) return;
+    int64_t start, end;
+    bool in_bits;
+    if (!parse_range(cmd, 3, start, end, in_bits, out)) return;
+    bool end_given = cmd.size() > 4;
+    const uint8_t *data = NULL;
+    size_t len = 0;
+    std::string buf;
+    if (!str_view(cmd[1], data, len, buf, out)) return;
+    if (len == 0){ // a missing key is all zeros
+        return out_int(out, bit ? -1 : 0);
+    }
+    if (!norm_range(start, end, (int64_t)len * (in_bits ? 8 : 1))){
+        return out_int(out, -1);
+    }
+    int64_t s = in_bits ? start : start * 8;
+    int64_t e = in_bits ? end : end * 8 + 7;
+    int64_t pos = find_bit(data, s, e, bit != 0);
+    if (pos < 0 && !bit && !end_given){
+        pos = e + 1; // the value is padded with zeros to the right
+    }
+    out_int(out, pos);
+}
+
+void do_bitop(std::vector<std::string>& cmd, std::string &out){
+    uint32_t op = 0;
+    if (cmd_is(cmd[1], "and")){
+        op = BIT_AND;
+    } else if (cmd_is(cmd[1], "or")){
+        op = BIT_OR;
+    } else if (cmd_is(cmd[1], "xor")){
+        op = BIT_XOR;
+    } else if (cmd_is(cmd[1], "not")){
+        op = BIT_NOT;
+    } else {
+        return out_err(out, ERR_ARG, "expect BITOP AND|OR|XOR|NOT destkey key [key ...]");
+    }
+    if (op == BIT_NOT && cmd.size() != 4){
+        return out_err(out, ERR_ARG, "BITOP NOT takes a single source key");
+    }
+
+    size_t n_src = cmd.size() - 3;
+    std::vector<std::string> bufs(n_src);
+    std::vector<const uint8_t *> data(n_src);
+    std::vector<size_t> lens(n_src);
+    size_t max_len = 0;
+    for (size_t i = 0; i < n_src; ++i){
+        if (!str_view(cmd[3 + i], data[i], lens[i], bufs[i], out)) return;
+        max_len = std::max(max_len, lens[i]);
+    }
+
+    // shorter values count as zero-padded
+    std::string res(max_len, '\0');
+    if (max_len){
+        uint8_t *dst = (uint8_t *)&res[0];
+        if (lens[0]){
+            memcpy(dst, data[0], lens[0]);
+        }
+        for (size_t i = 1; i < n_src; ++i){
+            bit_op(op, dst, data[i], lens[i]);
+            if (op == BIT_AND){
+                memset(dst + lens[i], 0, max_len - lens[i]);
+            }
+        }
+        if (op == BIT_NOT){
+            bit_op(BIT_NOT, dst, NULL, max_len);
+        }
+    }
+
+    if (max_len == 0){ // nothing to store
+        del_key(cmd[2], g_config.lazyfree);
+    } else {
+        entry_put_str(cmd[2], res);
+    }
+    out_int(out, (int64_t)max_len);
+}
@@ -0,0 +1,181 @@
+//
+// Probabilistic membership commands: BF.* on `Bloom` values, CF.* on `Cuckoo` values
+//
+
+#include "server_utils.h"
+#include "bloom.h"
+#include "cuckoo.h"
+#include "config.h"
+#include "evict.h"
+#include "utils.h"
+
+#include <string>
+#include <vector>
+
+// a new filter of `bytes` must be under `cap` and, with maxmemory set, fit under it: it is allocated
+// in one go after eviction already ran for this command; false with the error in `out`
+static bool filter_fits(size_t bytes, size_t cap, std::string &out){
+    if (bytes > cap){
+        out_err(out, ERR_ARG, "filter too big, lower the capacity or raise the error rate");
+        return false;
+    }
+    if (g_config.maxmemory > 0 && used_memory() + bytes > (size_t)g_config.maxmemory){
+        out_err(out, ERR_OOM, "filter doesn't fit under maxmemory");
+        return false;
+    }
+    return true;
+}
+
+// the filter of a key, created with default sizing if missing; false with the error in `out`
+static bool bf_find_or_create(std::string &name, Entry *&ent, std::string &out){
+    Entry key;
+    if (!entry_find(name, T_BLOOM, key, ent, out)) return false;
+    if (ent) return true;
+    Bloom bf;
+    if (!bf_init(&bf, k_bf_default_capacity, k_bf_default_error)){
+        out_err(out, ERR_OOM, "can't allocate filter");
+        return false;
+    }
+    ent = entry_create(key, T_BLOOM);
+    *ent->bf = bf;
+    entry_account(ent);
+    return true;
+}
+
+void do_bf_reserve(std::vector<std::string>& cmd, std::string &out){
+    double error_rate = 0;
+    int64_t capacity = 0;
+    if (!parse_dbl(cmd[2], error_rate) || !(error_rate >= k_bf_min_error && error_rate < 1)){
+        return out_err(out, ERR_ARG, "error rate must be in [0.000001, 1)");
+    }
+    if (!parse_int(cmd[3], capacity) || capacity < 1 || (uint64_t)capacity > k_bf_max_capacity){
+        return out_err(out, ERR_ARG, "capacity is not an integer or out of range");
+    }
+    if (!filter_fits(bf_bytes((uint64_t)capacity, error_rate), k_bf_max_bytes, out)) return;
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_BLOOM, key, ent, out)) return;
+    if (ent){
+        return out_err(out, ERR_ARG, "item exists");
+    }
+    Bloom bf;
+    if (!bf_init(&bf, (uint64_t)capacity, error_rate)){
+        return out_err(out, ERR_OOM, "can't allocate filter");
+    }
+    ent = entry_create(key, T_BLOOM);
+    *ent->bf = bf;
+    entry_account(ent);
+    out_nil(out);
+}
+
+void do_bf_add(std::vector<std::string>& cmd, std::string &out){
+    Entry *ent = NULL;
+    if (!bf_find_or_create(cmd[1], ent, out)) return;
+    out_int(out, bf_add(ent->bf, cmd[2].data(), cmd[2].size()));
+}
+
+void do_bf_madd(std::vector<std::string>& cmd, std::string &out){
+    Entry *ent = NULL;
+    if (!bf_find_or_create(cmd[1], ent, out)) return;
+    out_arr(out, (uint32_t)(cmd.size() - 2));
+    for (size_t i = 2; i < cmd.size(); ++i){
+        out_int(out, bf_add(ent->bf, cmd[i].data(), cmd[i].size()));
+    }
+}
+
+void do_bf_exists(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_BLOOM, key, ent, out)) return;
+    out_int(out, ent && bf_exists(ent->bf, cmd[2].data(), cmd[2].size()));
+}
+
+void do_bf_mexists(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_BLOOM, key, ent, out)) return;
+    out_arr(out, (uint32_t)(cmd.size() - 2));
+    for (size_t i = 2; i < cmd.size(); ++i){
+        out_int(out, ent && bf_exists(ent->bf, cmd[i].data(), cmd[i].size()));
+    }
+}
+
+static bool cf_find_or_create(std::string &name, Entry *&ent, std::string &out){
+    Entry key;
+    if (!entry_find(name, T_CUCKOO, key, ent, out)) return false;
+    if (ent) return true;
+    Cuckoo cf;
+    if (!cf_init(&cf, k_cf_default_capacity)){
+        out_err(out, ERR_OOM, "can't allocate filter");
+        return false;
+    }
+    ent = entry_create(key, T_CUCKOO);
+    *ent->cf = cf;
+    entry_account(ent);
+    return true;
+}
+
+void do_cf_reserve(std::vector<std::string>& cmd, std::string &out){
+    int64_t capacity = 0;
+    if (!parse_int(cmd[2], capacity) || capacity < 1 || (uint64_t)capacity > k_cf_max_capacity){
+        return out_err(out, ERR_ARG, "capacity is not an integer or out of range");
+    }
+    if (!filter_fits(cf_bytes((uint64_t)capacity), k_cf_max_bytes, out)) return;
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_CUCKOO, key, ent, out)) return;
+    if (ent){
+        return out_err(out, ERR_ARG, "item exists");
+    }
+    Cuckoo cf;
+    if (!cf_init(&cf, (uint64_t)capacity)){
+        return out_err(out, ERR_OOM, "can't allocate filter");
+    }
+    ent = entry_create(key, T_CUCKOO);
+    *ent->cf = cf;
+    entry_account(ent);
+    out_nil(out);
+}
+
+void do_cf_add(std::vector<std::string>& cmd, std::string &out){
+    Entry *ent = NULL;
+    if (!cf_find_or_create(cmd[1], ent, out)) return;
+    if (!cf_add(ent->cf, cmd[2].data(), cmd[2].size())){
+        return out_err(out, ERR_ARG, "filter is full");
+    }
+    out_int(out, 1);
+}
+
+void do_cf_addnx(std::vector<std::string>& cmd, std::string &out){
+    Entry *ent = NULL;
+    if (!cf_find_or_create(cmd[1], ent, out)) return;
+    if (cf_exists(ent->cf, cmd[2].data(), cmd[2].size())){
+        return out_int(out, 0);
+    }
+    if (!cf_add(ent->cf, cmd[2].data(), cmd[2].size())){
+        return out_err(out, ERR_ARG, "filter is full");
+    }
+    out_int(out, 1);
+}
+
+void do_cf_exists(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_CUCKOO, key, ent, out)) return;
+    out_int(out, ent && cf_exists(ent->cf, cmd[2].data(), cmd[2].size()));
+}
+
+// deleting an element that was never added may remove another one sharing its fingerprint
+void do_cf_del(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_CUCKOO, key, ent, out)) return;
+    out_int(out, ent && cf_del(ent->cf, cmd[2].data(), cmd[2].size()));
+}
+
+void do_cf_count(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_CUCKOO, key, ent, out)) return;
+    out_int(out, ent ? cf_count(ent->cf, cmd[2].data(), cmd[2].size()) : 0);
+}
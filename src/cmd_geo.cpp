@@ -0,0 +1,286 @@
+//
+// Geo commands, values are `ZSet`s scored by 52-bit geohashes (see geo.h)
+//
+
+#include "server_utils.h"
+#include "geo.h"
+#include "zset.h"
+#include "blocking.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// meters per unit, false if `s` is no unit
+static bool parse_unit(const std::string &s, double &factor){
+    if (cmd_is(s, "m")){
+        factor = 1;
+    } else if (cmd_is(s, "km")){
+        factor = 1000;
+    } else if (cmd_is(s, "ft")){
+        factor = 0.3048;
+    } else if (cmd_is(s, "mi")){
+        factor = 1609.34;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_lonlat(const std::string &slon, const std::string &slat, double &lon, double &lat, std::string &out){
+    if (!parse_dbl(slon, lon) || !parse_dbl(slat, lat)
+        || !(lon >= k_geo_lon_min && lon <= k_geo_lon_max) || !(lat >= k_geo_lat_min && lat <= k_geo_lat_max)){
+        out_err(out, ERR_ARG, "invalid longitude,latitude pair");
+        return false;
+    }
+    return true;
+}
+
+// GEOADD key [NX|XX] [CH] lon lat member [lon lat member ...]
+void do_geoadd(std::vector<std::string>& cmd, std::string &out){
+    size_t i = 2;
+    bool nx = false, xx = false, ch = false;
+    for (; i < cmd.size(); ++i){
+        if (cmd_is(cmd[i], "nx")){
+            nx = true;
+        } else if (cmd_is(cmd[i], "xx")){
+            xx = true;
+        } else if (cmd_is(cmd[i], "ch")){
+            ch = true;
+        } else {
+            break;
+        }
+    }
+    if (nx && xx){
+        return out_err(out, ERR_ARG, "NX and XX are exclusive");
+    }
+    if (i == cmd.size() || (cmd.size() - i) % 3){
+        return out_err(out, ERR_ARG, "expect GEOADD key [NX|XX] [CH] lon lat member [lon lat member ...]");
+    }
+    std::vector<double> scores;
+    for (size_t j = i; j < cmd.size(); j += 3){
+        double lon = 0, lat = 0;
+        if (!parse_lonlat(cmd[j], cmd[j + 1], lon, lat, out)) return;
+        scores.push_back((double)geo_encode(lon, lat, k_geo_step));
+    }
+
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    if (!ent){
+        if (xx){
+            return out_int(out, 0);
+        }
+        ent = entry_create(key, T_ZSET);
+    }
+    int64_t added = 0, changed = 0;
+    for (size_t k = 0; k < scores.size(); ++k){
+        const std::string &name = cmd[i + 3 * k + 2];
+        ZNode *znode = zset_lookup(ent->zset, name.data(), name.size());
+        if (znode){
+            if (!nx && znode->score != scores[k]){
+                zset_update(ent->zset, znode, scores[k]);
+                changed++;
+            }
+        } else if (!xx){
+            zset_add(ent->zset, name.data(), name.size(), scores[k]);
+            added++;
+        }
+    }
+    if (added){
+        block_signal(ent->key);
+    }
+    entry_account_or_drop(ent);
+    out_int(out, ch ? added + changed : added);
+}
+
+// GEOPOS key member [member ...], [lon, lat] or nil per member
+void do_geopos(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    out_arr(out, (uint32_t)(cmd.size() - 2));
+    for (size_t i = 2; i < cmd.size(); ++i){
+        ZNode *znode = ent ? zset_lookup(ent->zset, cmd[i].data(), cmd[i].size()) : NULL;
+        if (!znode){
+            out_nil(out);
+            continue;
+        }
+        double lon = 0, lat = 0;
+        geo_decode((uint64_t)znode->score, &lon, &lat);
+        out_arr(out, 2);
+        out_dbl(out, lon);
+        out_dbl(out, lat);
+    }
+}
+
+// GEODIST key member1 member2 [M|KM|FT|MI]
+void do_geodist(std::vector<std::string>& cmd, std::string &out){
+    double factor = 1;
+    if (cmd.size() > 5 || (cmd.size() == 5 && !parse_unit(cmd[4], factor))){
+        return out_err(out, ERR_ARG, "expect GEODIST key member1 member2 [M|KM|FT|MI]");
+    }
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    ZNode *a = ent ? zset_lookup(ent->zset, cmd[2].data(), cmd[2].size()) : NULL;
+    ZNode *b = ent ? zset_lookup(ent->zset, cmd[3].data(), cmd[3].size()) : NULL;
+    if (!a || !b){
+        return out_nil(out);
+    }
+    double lon1 = 0, lat1 = 0, lon2 = 0, lat2 = 0;
+    geo_decode((uint64_t)a->score, &lon1, &lat1);
+    geo_decode((uint64_t)b->score, &lon2, &lat2);
+    out_dbl(out, geo_dist(lon1, lat1, lon2, lat2) / factor);
+}
+
+struct GeoHit {
+    ZNode *node;
+    double dist;
+    double lon;
+    double lat;
+};
+
+// append the points of a zset inside an area to `hits`, stopping at `limit` of them if not 0
+static void geo_collect(ZSet *zset, GeoShape *shape, size_t limit, std::vector<GeoHit> &hits){
+    geo_bound(shape);
+    GeoRange ranges[k_geo_max_cells];
+    size_t n_ranges = geo_cover(shape, ranges);
+    for (size_t r = 0; r < n_ranges; ++r){
+        ZNode *znode = zset_seekge(zset, (double)ranges[r].min, "", 0);
+        for (; znode && znode->score < (double)ranges[r].max; znode = znode_offset(znode, 1)){
+            GeoHit hit;
+            hit.node = znode;
+            geo_decode((uint64_t)znode->score, &hit.lon, &hit.lat);
+            if (!geo_match(shape, hit.lon, hit.lat, &hit.dist)) continue;
+            hits.push_back(hit);
+            if (limit && hits.size() >= limit) return;
+        }
+    }
+}
+
+// GEOSEARCH key FROMMEMBER member | FROMLONLAT lon lat  BYRADIUS radius unit | BYBOX width height unit
+//           [ASC|DESC] [COUNT count [ANY]] [WITHCOORD] [WITHDIST] [WITHHASH]
+void do_geosearch(std::vector<std::string>& cmd, std::string &out){
+    const std::string *from_member = NULL;
+    bool from_lonlat = false, by = false, any = false;
+    bool with_coord = false, with_dist = false, with_hash = false;
+    int sort = 0;   // -1 descending, 1 ascending
+    int64_t count = 0;
+    double factor = 1;
+    GeoShape shape;
+    const char *usage = "expect GEOSEARCH key FROMMEMBER member|FROMLONLAT lon lat BYRADIUS radius unit|"
+                        "BYBOX width height unit [ASC|DESC] [COUNT count [ANY]] [WITHCOORD] [WITHDIST] [WITHHASH]";
+    for (size_t i = 2; i < cmd.size(); ++i){
+        size_t left = cmd.size() - i - 1;
+        if (cmd_is(cmd[i], "frommember") && left >= 1){
+            from_member = &cmd[++i];
+        } else if (cmd_is(cmd[i], "fromlonlat") && left >= 2){
+            if (!parse_lonlat(cmd[i + 1], cmd[i + 2], shape.lon, shape.lat, out)) return;
+            from_lonlat = true;
+            i += 2;
+        } else if (cmd_is(cmd[i], "byradius") && left >= 2){
+            if (!parse_dbl(cmd[i + 1], shape.radius) || !(shape.radius >= 0) || !parse_unit(cmd[i + 2], factor)){
+                return out_err(out, ERR_ARG, usage);
+            }
+            shape.radius *= factor;
+            by = true;
+            i += 2;
+        } else if (cmd_is(cmd[i], "bybox") && left >= 3){
+            if (!parse_dbl(cmd[i + 1], shape.width) || !(shape.width >= 0) || !parse_dbl(cmd[i + 2], shape.height)
+                || !(shape.height >= 0) || !parse_unit(cmd[i + 3], factor)){
+                return out_err(out, ERR_ARG, usage);
+            }
+            shape.box = true;
+            shape.width *= factor;
+            shape.height *= factor;
+            by = true;
+            i += 3;
+        } else if (cmd_is(cmd[i], "asc")){
+            sort = 1;
+        } else if (cmd_is(cmd[i], "desc")){
+            sort = -1;
+        } else if (cmd_is(cmd[i], "count") && left >= 1){
+            if (!parse_int(cmd[++i], count) || count <= 0){
+                return out_err(out, ERR_ARG, "COUNT must be > 0");
+            }
+            if (i + 1 < cmd.size() && cmd_is(cmd[i + 1], "any")){
+                any = true;
+                i++;
+            }
+        } else if (cmd_is(cmd[i], "withcoord")){
+            with_coord = true;
+        } else if (cmd_is(cmd[i], "withdist")){
+            with_dist = true;
+        } else if (cmd_is(cmd[i], "withhash")){
+            with_hash = true;
+        } else {
+            return out_err(out, ERR_ARG, usage);
+        }
+    }
+    if (!from_member == !from_lonlat || !by){
+        return out_err(out, ERR_ARG, usage);
+    }
+    if (count && !any && !sort){
+        sort = 1;   // the nearest `count`, not any `count`
+    }
+
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    if (!ent){
+        return out_arr(out, 0);
+    }
+    if (from_member){
+        ZNode *center = zset_lookup(ent->zset, from_member->data(), from_member->size());
+        if (!center){
+            return out_err(out, ERR_ARG, "could not decode requested zset member");
+        }
+        geo_decode((uint64_t)center->score, &shape.lon, &shape.lat);
+    }
+
+    std::vector<GeoHit> hits;
+    bool done = false;
+    if (count && !any && sort > 0 && !shape.box){
+        // the nearest `count`: when a smaller circle already holds that many, they are the answer
+        for (double scale = 1.0 / 16; scale < 1 && !done; scale *= 4){
+            GeoShape inner = shape;
+            inner.radius *= scale;
+            hits.clear();
+            geo_collect(ent->zset, &inner, 0, hits);
+            done = (int64_t)hits.size() >= count;
+        }
+    }
+    if (!done){
+        hits.clear();
+        geo_collect(ent->zset, &shape, any ? (size_t)count : 0, hits);
+    }
+    size_t n_out = count && (int64_t)hits.size() > count ? (size_t)count : hits.size();
+    if (sort){
+        std::partial_sort(hits.begin(), hits.begin() + n_out, hits.end(), [sort](const GeoHit &a, const GeoHit &b){
+            return sort > 0 ? a.dist < b.dist : a.dist > b.dist;
+        });
+    }
+    hits.resize(n_out);
+
+    uint32_t n_fields = 1 + with_dist + with_hash + with_coord;
+    out_arr(out, (uint32_t)hits.size());
+    for (const GeoHit &hit : hits){
+        if (n_fields > 1){
+            out_arr(out, n_fields);
+        }
+        out_str(out, hit.node->name, hit.node->len);
+        if (with_dist){
+            out_dbl(out, hit.dist / factor);
+        }
+        if (with_hash){
+            out_int(out, (int64_t)hit.node->score);
+        }
+        if (with_coord){
+            out_arr(out, 2);
+            out_dbl(out, hit.lon);
+            out_dbl(out, hit.lat);
+        }
+    }
+}
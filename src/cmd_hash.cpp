@@ -0,0 +1,109 @@
+//
+// Hash commands, values are `Hash`es (packed pairs, or an HMap of fields once big)
+//
+
+#include "server_utils.h"
+#include "hash.h"
+#include "utils.h"
+
+#include <string>
+#include <vector>
+
+void do_hset(std::vector<std::string>& cmd, std::string &out){
+    if (cmd.size() % 2 != 0){
+        return out_err(out, ERR_ARG, "expect HSET key field value [field value ...]");
+    }
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_HASH, key, ent, out)) return;
+    if (!ent){
+        ent = entry_create(key, T_HASH);
+    }
+    int64_t added = 0;
+    for (size_t i = 2; i < cmd.size(); i += 2){
+        added += hash_set(ent->hash, cmd[i].data(), cmd[i].size(), cmd[i + 1].data(), cmd[i + 1].size());
+    }
+    entry_account(ent);
+    out_int(out, added);
+}
+
+void do_hget(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_HASH, key, ent, out)) return;
+    size_t vlen = 0;
+    const char *val = ent ? hash_get(ent->hash, cmd[2].data(), cmd[2].size(), &vlen) : NULL;
+    if (!val){
+        return out_nil(out);
+    }
+    out_str(out, val, vlen);
+}
+
+void do_hdel(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_HASH, key, ent, out)) return;
+    if (!ent){
+        return out_int(out, 0);
+    }
+    int64_t removed = 0;
+    for (size_t i = 2; i < cmd.size(); ++i){
+        removed += hash_del(ent->hash, cmd[i].data(), cmd[i].size());
+    }
+    entry_account_or_drop(ent);
+    out_int(out, removed);
+}
+
+static void cb_getall(const char *field, size_t flen, const char *val, size_t vlen, void *arg){
+    std::string &out = *(std::string *)arg;
+    if (4 + out.size() > k_max_msg) return; // the reply gets replaced by ERR_2BIG anyway
+    out_str(out, field, flen);
+    out_str(out, val, vlen);
+}
+
+void do_hgetall(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_HASH, key, ent, out)) return;
+    if (!ent){
+        return out_arr(out, 0);
+    }
+    out_arr(out, (uint32_t)(ent->hash->n * 2));
+    hash_scan(ent->hash, &cb_getall, &out);
+}
+
+void do_hincrby(std::vector<std::string>& cmd, std::string &out){
+    int64_t incr = 0;
+    if (!parse_int(cmd[3], incr)){
+        return out_err(out, ERR_ARG, "expect int");
+    }
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_HASH, key, ent, out)) return;
+
+    int64_t val = 0;
+    size_t vlen = 0;
+    const char *cur = ent ? hash_get(ent->hash, cmd[2].data(), cmd[2].size(), &vlen) : NULL;
+    if (cur && !parse_int(std::string(cur, vlen), val)){
+        return out_err(out, ERR_ARG, "hash value is not an integer");
+    }
+    if ((incr > 0 && val > INT64_MAX - incr) || (incr < 0 && val < INT64_MIN - incr)){
+        return out_err(out, ERR_ARG, "increment would overflow");
+    }
+    val += incr;
+
+    if (!ent){
+        ent = entry_create(key, T_HASH);
+    }
+    std::string s = std::to_string(val);
+    hash_set(ent->hash, cmd[2].data(), cmd[2].size(), s.data(), s.size());
+    entry_account(ent);
+    out_int(out, val);
+}
+
+void do_hlen(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_HASH, key, ent, out)) return;
+    out_int(out, ent ? (int64_t)ent->hash->n : 0);
+}
@@ -0,0 +1,70 @@
+//
+// HyperLogLog commands, values are `Hll`s (sparse registers, or all of them packed once big)
+//
+
+#include "server_utils.h"
+#include "hll.h"
+#include "utils.h"
+
+#include <string>
+#include <vector>
+
+void do_pfadd(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_HLL, key, ent, out)) return;
+    bool changed = false;
+    if (!ent){ // creating the key counts as a change, even with no elements
+        ent = entry_create(key, T_HLL);
+        changed = true;
+    }
+    for (size_t i = 2; i < cmd.size(); ++i){
+        changed = hll_add(ent->hll, cmd[i].data(), cmd[i].size()) || changed;
+    }
+    if (changed){
+        entry_account(ent);
+    }
+    out_int(out, changed);
+}
+
+// merge the registers of the keys cmd[first..] into `regs`, false with the error in `out` on a wrong type
+static bool merge_keys(std::vector<std::string>& cmd, size_t first, uint8_t *regs, std::string &out){
+    for (size_t i = first; i < cmd.size(); ++i){
+        Entry key;
+        Entry *ent = NULL;
+        if (!entry_find(cmd[i], T_HLL, key, ent, out)) return false;
+        if (ent){
+            hll_merge(ent->hll, regs);
+        }
+    }
+    return true;
+}
+
+void do_pfcount(std::vector<std::string>& cmd, std::string &out){
+    if (cmd.size() == 2){ // a single key uses its cached estimate
+        Entry key;
+        Entry *ent = NULL;
+        if (!entry_find(cmd[1], T_HLL, key, ent, out)) return;
+        return out_int(out, ent ? (int64_t)hll_count(ent->hll) : 0);
+    }
+    // the union of several keys is estimated from a temporary merge
+    std::vector<uint8_t> regs(k_hll_regs, 0);
+    if (!merge_keys(cmd, 1, regs.data(), out)) return;
+    out_int(out, (int64_t)hll_estimate(regs.data()));
+}
+
+void do_pfmerge(std::vector<std::string>& cmd, std::string &out){
+    std::vector<uint8_t> regs(k_hll_regs, 0);
+    if (!merge_keys(cmd, 2, regs.data(), out)) return;
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_HLL, key, ent, out)) return;
+    if (!ent){
+        ent = entry_create(key, T_HLL);
+    } else {
+        hll_merge(ent->hll, regs.data());
+    }
+    hll_store(ent->hll, regs.data());
+    entry_account(ent);
+    out_nil(out);
+}
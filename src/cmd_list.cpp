@@ -0,0 +1,162 @@
+//
+// List commands, values are `QList`s (linked chunks of packed items)
+//
+
+#include "server_utils.h"
+#include "quicklist.h"
+#include "blocking.h"
+#include "utils.h"
+
+#include <string>
+#include <vector>
+
+static void push_generic(std::vector<std::string>& cmd, std::string &out, bool front){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_LIST, key, ent, out)) return;
+    if (!ent){
+        ent = entry_create(key, T_LIST);
+    }
+    for (size_t i = 2; i < cmd.size(); ++i){
+        ql_push(ent->list, front, cmd[i].data(), cmd[i].size());
+    }
+    entry_account(ent);
+    block_signal(ent->key);
+    out_int(out, (int64_t)ent->list->n);
+}
+
+void do_lpush(std::vector<std::string>& cmd, std::string &out){
+    push_generic(cmd, out, true);
+}
+
+void do_rpush(std::vector<std::string>& cmd, std::string &out){
+    push_generic(cmd, out, false);
+}
+
+// LPOP/RPOP key [count]
+static void pop_generic(std::vector<std::string>& cmd, std::string &out, bool front){
+    int64_t count = 1;
+    if (cmd.size() > 3 || (cmd.size() == 3 && (!parse_int(cmd[2], count) || count < 0))){
+        return out_err(out, ERR_ARG, "expect POP key [count]");
+    }
+    bool with_count = cmd.size() == 3;
+
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_LIST, key, ent, out)) return;
+    if (!ent){
+        return out_nil(out);
+    }
+
+    std::string item;
+    if (!with_count){
+        ql_pop(ent->list, front, item);
+        out_str(out, item);
+    } else {
+        uint32_t n = (uint32_t)(count < (int64_t)ent->list->n ? count : (int64_t)ent->list->n);
+        out_arr(out, n);
+        for (uint32_t i = 0; i < n; ++i){
+            ql_pop(ent->list, front, item);
+            out_str(out, item);
+        }
+    }
+    entry_account_or_drop(ent);
+}
+
+void do_lpop(std::vector<std::string>& cmd, std::string &out){
+    pop_generic(cmd, out, true);
+}
+
+void do_rpop(std::vector<std::string>& cmd, std::string &out){
+    pop_generic(cmd, out, false);
+}
+
+// BLPOP/BRPOP key [key ...] timeout, [key, item] from the first non-empty list, else waits for a push
+static void bpop_generic(std::vector<std::string>& cmd, std::string &out, bool front){
+    uint64_t timeout_ms = 0;
+    if (!block_parse_timeout(cmd.back(), 1000, timeout_ms)){
+        return out_err(out, ERR_ARG, "timeout is not a non-negative number");
+    }
+    for (size_t i = 1; i + 1 < cmd.size(); ++i){
+        std::string name = cmd[i]; // the command is kept whole for a retry
+        Entry key;
+        Entry *ent = NULL;
+        if (!entry_find(name, T_LIST, key, ent, out)) return;
+        if (!ent) continue;
+        std::string item;
+        ql_pop(ent->list, front, item);
+        entry_account_or_drop(ent);
+        out_arr(out, 2);
+        out_str(out, cmd[i]);
+        out_str(out, item);
+        return;
+    }
+    block_wait(cmd, 1, cmd.size() - 2, timeout_ms);
+}
+
+void do_blpop(std::vector<std::string>& cmd, std::string &out){
+    bpop_generic(cmd, out, true);
+}
+
+void do_brpop(std::vector<std::string>& cmd, std::string &out){
+    bpop_generic(cmd, out, false);
+}
+
+// LRANGE key start stop, negative indexes count from the end
+void do_lrange(std::vector<std::string>& cmd, std::string &out){
+    int64_t start = 0;
+    int64_t stop = 0;
+    if (!parse_int(cmd[2], start) || !parse_int(cmd[3], stop)){
+        return out_err(out, ERR_ARG, "expect int");
+    }
+
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_LIST, key, ent, out)) return;
+    int64_t size = ent ? (int64_t)ent->list->n : 0;
+    if (start < 0) start += size;
+    if (stop < 0) stop += size;
+    if (start < 0) start = 0;
+    if (stop >= size) stop = size - 1;
+    if (start > stop){
+        return out_arr(out, 0);
+    }
+
+    out_arr(out, (uint32_t)(stop - start + 1));
+    QIter it = ql_index(ent->list, (size_t)start);
+    for (int64_t i = start; i <= stop; ++i){
+        size_t len = 0;
+        const char *item = ql_item(it, &len);
+        out_str(out, item, len);
+        if (4 + out.size() > k_max_msg){
+            break; // the reply gets replaced by ERR_2BIG anyway
+        }
+        ql_next(&it);
+    }
+}
+
+void do_lindex(std::vector<std::string>& cmd, std::string &out){
+    int64_t idx = 0;
+    if (!parse_int(cmd[2], idx)){
+        return out_err(out, ERR_ARG, "expect int");
+    }
+
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_LIST, key, ent, out)) return;
+    int64_t size = ent ? (int64_t)ent->list->n : 0;
+    if (idx < 0) idx += size;
+    if (idx < 0 || idx >= size){
+        return out_nil(out);
+    }
+    size_t len = 0;
+    const char *item = ql_item(ql_index(ent->list, (size_t)idx), &len);
+    out_str(out, item, len);
+}
+
+void do_llen(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_LIST, key, ent, out)) return;
+    out_int(out, ent ? (int64_t)ent->list->n : 0);
+}
@@ -0,0 +1,226 @@
+//
+// Set commands, values are `Set`s (an intset while all members are integers, else an HMap)
+//
+
+#include "server_utils.h"
+#include "intersect.h"
+#include "set.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+void do_sadd(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_SET, key, ent, out)) return;
+    if (!ent){
+        ent = entry_create(key, T_SET);
+    }
+    size_t added = set_add_many(ent->set, &cmd[2], cmd.size() - 2);
+    entry_account(ent);
+    out_int(out, (int64_t)added);
+}
+
+void do_srem(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_SET, key, ent, out)) return;
+    if (!ent){
+        return out_int(out, 0);
+    }
+    int64_t removed = 0;
+    for (size_t i = 2; i < cmd.size(); ++i){
+        removed += set_del(ent->set, cmd[i].data(), cmd[i].size());
+    }
+    entry_account_or_drop(ent);
+    out_int(out, removed);
+}
+
+void do_sismember(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_SET, key, ent, out)) return;
+    out_int(out, ent && set_has(ent->set, cmd[2].data(), cmd[2].size()) ? 1 : 0);
+}
+
+void do_scard(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_SET, key, ent, out)) return;
+    out_int(out, ent ? (int64_t)set_size(ent->set) : 0);
+}
+
+// output of a set scan
+struct MembersScan {
+    std::string out;
+    uint32_t n = 0;
+};
+
+static void cb_members(const char *name, size_t len, void *arg){
+    MembersScan &scan = *(MembersScan *)arg;
+    if (4 + scan.out.size() > k_max_msg) return; // the reply gets replaced by ERR_2BIG anyway
+    out_str(scan.out, name, len);
+    scan.n++;
+}
+
+static void out_members(std::string &out, Set *set){
+    MembersScan scan;
+    set_scan(set, &cb_members, &scan);
+    out_arr(out, scan.n);
+    out.append(scan.out);
+}
+
+void do_smembers(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_SET, key, ent, out)) return;
+    if (!ent){
+        return out_arr(out, 0);
+    }
+    out_members(out, ent->set);
+}
+
+/**
+ * @brief collect the sets named by cmd[1..]
+ *
+ * @param cmd command, keys are consumed
+ * @param sets output, one per existing key
+ * @param out output buf, gets the error if a key holds another type
+ * @return int32_t number of missing keys, -1 on a type error
+ */
+static int32_t collect_sets(std::vector<std::string>& cmd, std::vector<Set *> &sets, std::string &out){
+    int32_t missing = 0;
+    for (size_t i = 1; i < cmd.size(); ++i){
+        Entry key;
+        Entry *ent = NULL;
+        if (!entry_find(cmd[i], T_SET, key, ent, out)) return -1;
+        if (ent){
+            sets.push_back(ent->set);
+        } else {
+            missing++;
+        }
+    }
+    return missing;
+}
+
+static void out_ints(std::string &out, const int32_t *vals, size_t n){
+    out_arr(out, (uint32_t)n);
+    char buf[32];
+    for (size_t i = 0; i < n && 4 + out.size() <= k_max_msg; ++i){
+        int len = snprintf(buf, sizeof(buf), "%d", vals[i]);
+        out_str(out, buf, (size_t)len);
+    }
+}
+
+// members of an int16/int32 intset as int32, `buf` is used if they have to be widened
+static const int32_t *intset_i32(Set *set, std::vector<int32_t> &buf){
+    if (set->is.width == 4){
+        return (const int32_t *)set->is.data;
+    }
+    buf.resize(set->is.n);
+    for (size_t i = 0; i < set->is.n; ++i){
+        buf[i] = (int32_t)intset_get(&set->is, i);
+    }
+    return buf.data();
+}
+
+// intersection of int16/int32 intsets, two at a time starting from the smallest
+static void sinter_i32(std::vector<Set *> &sets, std::string &out){
+    std::vector<int32_t> cur, tmp, wide;
+    const int32_t *first = intset_i32(sets[0], wide);
+    cur.assign(first, first + sets[0]->is.n);
+    for (size_t i = 1; i < sets.size() && !cur.empty(); ++i){
+        const int32_t *other = intset_i32(sets[i], wide);
+        tmp.resize(cur.size() + 8);
+        size_t n = intersect_i32(cur.data(), cur.size(), other, sets[i]->is.n, tmp.data());
+        tmp.resize(n);
+        cur.swap(tmp);
+    }
+    out_ints(out, cur.data(), cur.size());
+}
+
+static void sinter_i64(std::vector<Set *> &sets, std::string &out){
+    std::vector<int64_t> cur, tmp, other;
+    for (size_t i = 0; i < sets.size(); ++i){
+        other.resize(sets[i]->is.n);
+        for (size_t j = 0; j < other.size(); ++j){
+            other[j] = intset_get(&sets[i]->is, j);
+        }
+        if (i == 0){
+            cur.swap(other);
+            continue;
+        }
+        tmp.resize(cur.size());
+        tmp.resize(intersect_i64(cur.data(), cur.size(), other.data(), other.size(), tmp.data()));
+        cur.swap(tmp);
+    }
+    out_arr(out, (uint32_t)cur.size());
+    for (size_t i = 0; i < cur.size() && 4 + out.size() <= k_max_msg; ++i){
+        std::string s = std::to_string(cur[i]);
+        out_str(out, s);
+    }
+}
+
+// generic intersection: probe every member of the smallest set in the others
+struct InterScan {
+    std::vector<Set *> *sets;
+    MembersScan result;
+};
+
+static void cb_inter(const char *name, size_t len, void *arg){
+    InterScan &scan = *(InterScan *)arg;
+    for (size_t i = 1; i < scan.sets->size(); ++i){
+        if (!set_has((*scan.sets)[i], name, len)) return;
+    }
+    cb_members(name, len, &scan.result);
+}
+
+static bool set_smaller(Set *a, Set *b){
+    return set_size(a) < set_size(b);
+}
+
+void do_sinter(std::vector<std::string>& cmd, std::string &out){
+    std::vector<Set *> sets;
+    int32_t missing = collect_sets(cmd, sets, out);
+    if (missing < 0) return;
+    if (missing > 0){
+        return out_arr(out, 0); // a missing key is an empty set
+    }
+    std::sort(sets.begin(), sets.end(), &set_smaller);
+
+    bool all_int = true;
+    uint32_t width = 2;
+    for (Set *set : sets){
+        all_int = all_int && set->enc == SET_INTSET;
+        width = std::max(width, set->is.width);
+    }
+    if (all_int && width <= 4){
+        return sinter_i32(sets, out);
+    }
+    if (all_int){
+        return sinter_i64(sets, out);
+    }
+    InterScan scan;
+    scan.sets = &sets;
+    set_scan(sets[0], &cb_inter, &scan);
+    out_arr(out, scan.result.n);
+    out.append(scan.result.out);
+}
+
+static void cb_union(const char *name, size_t len, void *arg){
+    set_add((Set *)arg, name, len);
+}
+
+void do_sunion(std::vector<std::string>& cmd, std::string &out){
+    std::vector<Set *> sets;
+    if (collect_sets(cmd, sets, out) < 0) return;
+    Set result;
+    for (Set *set : sets){
+        set_scan(set, &cb_union, &result);
+    }
+    out_members(out, &result);
+    set_dispose(&result);
+}
@@ -0,0 +1,345 @@
+//
+// Stream commands, values are `Stream`s (packed blocks of entries in ID order)
+//
+
+#include "server_utils.h"
+#include "stream.h"
+#include "blocking.h"
+#include "utils.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// decimal digits only, false on overflow
+static bool parse_u64(const char *p, size_t len, uint64_t &out){
+    if (len == 0 || len > 20) return false;
+    uint64_t v = 0;
+    for (size_t i = 0; i < len; ++i){
+        if (p[i] < '0' || p[i] > '9') return false;
+        uint64_t d = (uint64_t)(p[i] - '0');
+        if (v > (UINT64_MAX - d) / 10) return false;
+        v = v * 10 + d;
+    }
+    out = v;
+    return true;
+}
+
+// `ms-seq` or just `ms`, in which case the seq is `missing_seq`
+static bool parse_id(const std::string &s, uint64_t missing_seq, StreamId &id){
+    size_t dash = s.find('-');
+    if (dash == std::string::npos){
+        id.seq = missing_seq;
+        return parse_u64(s.data(), s.size(), id.ms);
+    }
+    return parse_u64(s.data(), dash, id.ms) && parse_u64(s.data() + dash + 1, s.size() - dash - 1, id.seq);
+}
+
+static bool id_incr(StreamId &id){
+    if (id.seq != UINT64_MAX){
+        id.seq++;
+        return true;
+    }
+    if (id.ms == UINT64_MAX) return false;
+    id.ms++;
+    id.seq = 0;
+    return true;
+}
+
+static bool id_decr(StreamId &id){
+    if (id.seq != 0){
+        id.seq--;
+        return true;
+    }
+    if (id.ms == 0) return false;
+    id.ms--;
+    id.seq = UINT64_MAX;
+    return true;
+}
+
+static std::string id_str(StreamId id){
+    return std::to_string(id.ms) + "-" + std::to_string(id.seq);
+}
+
+static void out_entry(std::string &out, const SEntry &ent){
+    out_arr(out, 2);
+    out_str(out, id_str(ent.id));
+    out_arr(out, (uint32_t)ent.items.size());
+    for (auto &item : ent.items){
+        out_str(out, item.first, item.second);
+    }
+}
+
+enum {
+    TRIM_NONE = 0,
+    TRIM_MAXLEN = 1,
+    TRIM_MINID = 2,
+};
+
+struct TrimSpec {
+    uint32_t kind = TRIM_NONE;
+    bool approx = false;
+    uint64_t maxlen = 0;
+    StreamId minid;
+};
+
+// `MAXLEN|MINID [=|~] threshold` at cmd[i], moving `i` past it
+static bool parse_trim(std::vector<std::string>& cmd, size_t &i, TrimSpec &trim, std::string &out){
+    trim.kind = cmd_is(cmd[i], "maxlen") ? TRIM_MAXLEN : TRIM_MINID;
+    i++;
+    if (i < cmd.size() && (cmd[i] == "~" || cmd[i] == "=")){
+        trim.approx = cmd[i] == "~";
+        i++;
+    }
+    if (i >= cmd.size()){
+        out_err(out, ERR_ARG, "syntax error");
+        return false;
+    }
+    int64_t maxlen = 0;
+    if (trim.kind == TRIM_MAXLEN && (!parse_int(cmd[i], maxlen) || maxlen < 0)){
+        out_err(out, ERR_ARG, "MAXLEN is not a non-negative integer");
+        return false;
+    }
+    if (trim.kind == TRIM_MINID && !parse_id(cmd[i], 0, trim.minid)){
+        out_err(out, ERR_ARG, "invalid stream ID");
+        return false;
+    }
+    trim.maxlen = (uint64_t)maxlen;
+    i++;
+    return true;
+}
+
+static size_t apply_trim(Stream *s, const TrimSpec &trim){
+    if (trim.kind == TRIM_MAXLEN) return stream_trim_maxlen(s, trim.maxlen, trim.approx);
+    if (trim.kind == TRIM_MINID) return stream_trim_minid(s, trim.minid, trim.approx);
+    return 0;
+}
+
+// XADD key [NOMKSTREAM] [MAXLEN|MINID [=|~] threshold] *|ms-*|ms[-seq] field value [field value ...]
+void do_xadd(std::vector<std::string>& cmd, std::string &out){
+    size_t i = 2;
+    bool nomkstream = false;
+    TrimSpec trim;
+    while (i < cmd.size()){
+        if (cmd_is(cmd[i], "nomkstream")){
+            nomkstream = true;
+            i++;
+        } else if (cmd_is(cmd[i], "maxlen") || cmd_is(cmd[i], "minid")){
+            if (!parse_trim(cmd, i, trim, out)) return;
+        } else {
+            break;
+        }
+    }
+    size_t n_items = i < cmd.size() ? cmd.size() - i - 1 : 0;
+    if (n_items == 0 || n_items % 2){
+        return out_err(out, ERR_ARG, "expect XADD key [options] id field value [field value ...]");
+    }
+    const std::string &spec = cmd[i];
+    bool auto_ms = spec == "*";
+    bool auto_seq = auto_ms || (spec.size() > 2 && spec.compare(spec.size() - 2, 2, "-*") == 0);
+    StreamId id;
+    if (!auto_ms && !(auto_seq ? parse_u64(spec.data(), spec.size() - 2, id.ms) : parse_id(spec, 0, id))){
+        return out_err(out, ERR_ARG, "invalid stream ID");
+    }
+
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_STREAM, key, ent, out)) return;
+    if (!ent && nomkstream){
+        return out_nil(out);
+    }
+    StreamId last = ent ? ent->stream->last_id : StreamId();
+    if (auto_ms){ // the clock may go backwards, IDs don't
+        id.ms = g_data.now_ms > last.ms ? g_data.now_ms : last.ms;
+    }
+    if (auto_seq){
+        if (id.ms == last.ms){
+            id = last;
+            if (!id_incr(id)){
+                return out_err(out, ERR_ARG, "the stream has exhausted the last possible ID");
+            }
+        } else {
+            id.seq = 0;
+        }
+    }
+    if (id.ms == 0 && id.seq == 0){
+        return out_err(out, ERR_ARG, "the ID must be greater than 0-0");
+    }
+    if (sid_cmp(id, last) <= 0){
+        return out_err(out, ERR_ARG, "the ID is equal or smaller than the stream top item");
+    }
+
+    if (!ent){
+        ent = entry_create(key, T_STREAM);
+    }
+    stream_add(ent->stream, id, &cmd[i + 1], n_items);
+    apply_trim(ent->stream, trim);
+    entry_account(ent);
+    block_signal(ent->key);
+    out_str(out, id_str(id));
+}
+
+// XRANGE key start end [COUNT count], bounds are IDs, `-`, `+`, or `(` before an ID for an exclusive bound
+void do_xrange(std::vector<std::string>& cmd, std::string &out){
+    int64_t count = -1;
+    if (cmd.size() == 6 && cmd_is(cmd[4], "count")){
+        if (!parse_int(cmd[5], count) || count < 0){
+            return out_err(out, ERR_ARG, "COUNT is not a non-negative integer");
+        }
+    } else if (cmd.size() != 4){
+        return out_err(out, ERR_ARG, "expect XRANGE key start end [COUNT count]");
+    }
+    StreamId start, end;
+    end.ms = end.seq = UINT64_MAX;
+    bool empty = false;
+    for (int b = 0; b < 2; ++b){
+        const std::string &s = cmd[2 + b];
+        StreamId &id = b == 0 ? start : end;
+        if (s == "-" || s == "+"){
+            id.ms = id.seq = s == "-" ? 0 : UINT64_MAX;
+            continue;
+        }
+        bool excl = !s.empty() && s[0] == '(';
+        if (!parse_id(excl ? s.substr(1) : s, b == 0 ? 0 : UINT64_MAX, id)){
+            return out_err(out, ERR_ARG, "invalid stream ID");
+        }
+        if (excl){
+            empty = empty || !(b == 0 ? id_incr(id) : id_decr(id));
+        }
+    }
+
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_STREAM, key, ent, out)) return;
+    std::string items;
+    uint32_t n = 0;
+    if (ent && !empty){
+        SIter it = stream_seek(ent->stream, start);
+        SEntry e;
+        while ((count < 0 || (int64_t)n < count) && stream_next(ent->stream, &it, &e)
+               && sid_cmp(e.id, end) <= 0){
+            out_entry(items, e);
+            n++;
+            if (4 + out.size() + items.size() > k_max_msg){
+                break; // the reply gets replaced by ERR_2BIG anyway
+            }
+        }
+    }
+    out_arr(out, n);
+    out.append(items);
+}
+
+// XREAD [COUNT count] [BLOCK ms] STREAMS key [key ...] id [id ...], entries after each ID (`$`: the last one)
+void do_xread(std::vector<std::string>& cmd, std::string &out){
+    size_t i = 1;
+    int64_t count = -1;
+    bool block = false;
+    uint64_t timeout_ms = 0;
+    for (; i + 1 < cmd.size() && !cmd_is(cmd[i], "streams"); i += 2){
+        if (cmd_is(cmd[i], "count")){
+            if (!parse_int(cmd[i + 1], count) || count < 0){
+                return out_err(out, ERR_ARG, "COUNT is not a non-negative integer");
+            }
+        } else if (cmd_is(cmd[i], "block")){
+            if (!block_parse_timeout(cmd[i + 1], 1, timeout_ms)){
+                return out_err(out, ERR_ARG, "timeout is not a non-negative number");
+            }
+            block = true;
+        } else {
+            break;
+        }
+    }
+    if (i >= cmd.size() || !cmd_is(cmd[i], "streams") || (cmd.size() - i - 1) == 0 || (cmd.size() - i - 1) % 2){
+        return out_err(out, ERR_ARG, "expect XREAD [COUNT count] [BLOCK ms] STREAMS key [key ...] id [id ...]");
+    }
+    size_t first = i + 1;
+    size_t n_keys = (cmd.size() - first) / 2;
+
+    std::vector<std::string> names(cmd.begin() + first, cmd.begin() + first + n_keys);
+    std::vector<Stream *> streams(n_keys, NULL);
+    std::vector<StreamId> after(n_keys);
+    for (size_t k = 0; k < n_keys; ++k){
+        const std::string &s = cmd[first + n_keys + k];
+        if (s != "$" && !parse_id(s, 0, after[k])){
+            return out_err(out, ERR_ARG, "invalid stream ID");
+        }
+        Entry key;
+        Entry *ent = NULL;
+        if (!entry_find(cmd[first + k], T_STREAM, key, ent, out)) return;
+        streams[k] = ent ? ent->stream : NULL;
+        if (s == "$"){
+            after[k] = ent ? ent->stream->last_id : StreamId();
+        }
+    }
+
+    // serialized entries and their number per key
+    std::vector<std::string> found(n_keys);
+    std::vector<uint32_t> n_ents(n_keys, 0);
+    uint32_t n_found = 0;
+    size_t bytes = 0;
+    for (size_t k = 0; k < n_keys && 4 + out.size() + bytes <= k_max_msg; ++k){
+        StreamId start = after[k];
+        if (!streams[k] || !id_incr(start)) continue;
+        SIter it = stream_seek(streams[k], start);
+        SEntry e;
+        while ((count < 0 || (int64_t)n_ents[k] < count) && stream_next(streams[k], &it, &e)){
+            size_t before = found[k].size();
+            out_entry(found[k], e);
+            n_ents[k]++;
+            bytes += found[k].size() - before;
+            if (4 + out.size() + bytes > k_max_msg){
+                break; // the reply gets replaced by ERR_2BIG anyway
+            }
+        }
+        n_found += n_ents[k] > 0;
+    }
+    if (!n_found && block){
+        // wait for entries after the IDs as of now, `$` must not move to the entries it waits for
+        std::vector<std::string> retry(cmd.begin(), cmd.begin() + first);
+        retry.insert(retry.end(), names.begin(), names.end());
+        for (size_t k = 0; k < n_keys; ++k){
+            retry.push_back(id_str(after[k]));
+        }
+        return block_wait(retry, first, n_keys, timeout_ms, false);
+    }
+    if (!n_found){
+        return out_nil(out);
+    }
+    out_arr(out, n_found);
+    for (size_t k = 0; k < n_keys; ++k){
+        if (!n_ents[k]) continue;
+        out_arr(out, 2);
+        out_str(out, names[k]);
+        out_arr(out, n_ents[k]);
+        out.append(found[k]);
+    }
+}
+
+// XTRIM key MAXLEN|MINID [=|~] threshold
+void do_xtrim(std::vector<std::string>& cmd, std::string &out){
+    size_t i = 2;
+    TrimSpec trim;
+    if (!cmd_is(cmd[i], "maxlen") && !cmd_is(cmd[i], "minid")){
+        return out_err(out, ERR_ARG, "expect XTRIM key MAXLEN|MINID [=|~] threshold");
+    }
+    if (!parse_trim(cmd, i, trim, out)) return;
+    if (i != cmd.size()){
+        return out_err(out, ERR_ARG, "syntax error");
+    }
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_STREAM, key, ent, out)) return;
+    if (!ent){
+        return out_int(out, 0);
+    }
+    size_t removed = apply_trim(ent->stream, trim);
+    entry_account(ent);
+    out_int(out, (int64_t)removed);
+}
+
+void do_xlen(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_STREAM, key, ent, out)) return;
+    out_int(out, ent ? (int64_t)ent->stream->n : 0);
+}
@@ -0,0 +1,119 @@
+//
+// Counter commands on string values, integers are kept in the entry itself (ENC_INT)
+//
+
+#include "server_utils.h"
+#include "utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+static void incr_generic(std::vector<std::string>& cmd, std::string &out, int64_t incr){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_STR, key, ent, out)) return;
+    int64_t val = 0;
+    if (ent && ent->enc == ENC_INT){
+        val = ent->ival;
+    } else if (ent){
+        // only SETBIT leaves a canonical integer as raw bytes, anything else isn't a counter
+        std::string buf;
+        const std::string &str = entry_get_str(ent, buf);
+        if (!str_to_int(str.data(), str.size(), &val)){
+            return out_err(out, ERR_ARG, "value is not an integer");
+        }
+    }
+    if ((incr > 0 && val > INT64_MAX - incr) || (incr < 0 && val < INT64_MIN - incr)){
+        return out_err(out, ERR_ARG, "increment would overflow");
+    }
+    val += incr;
+
+    if (!ent){
+        ent = entry_create(key, T_STR);
+        entry_set_int(ent, val);
+        entry_account(ent);
+    } else if (ent->enc != ENC_INT){
+        entry_set_int(ent, val);
+        entry_account(ent);
+    } else {
+        ent->ival = val; // same size, nothing to account
+    }
+    out_int(out, val);
+}
+
+// shortest of %.15g / %.17g that reads back as the same double
+static std::string dbl_to_str(double val){
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%.15g", val);
+    if (strtod(buf, NULL) != val){
+        n = snprintf(buf, sizeof(buf), "%.17g", val);
+    }
+    return std::string(buf, (size_t)n);
+}
+
+static bool parse_incr(const std::string &s, std::string &out, int64_t &incr){
+    if (!parse_int(s, incr)){
+        out_err(out, ERR_ARG, "expect int");
+        return false;
+    }
+    return true;
+}
+
+void do_incr(std::vector<std::string>& cmd, std::string &out){
+    incr_generic(cmd, out, 1);
+}
+
+void do_decr(std::vector<std::string>& cmd, std::string &out){
+    incr_generic(cmd, out, -1);
+}
+
+void do_incrby(std::vector<std::string>& cmd, std::string &out){
+    int64_t incr = 0;
+    if (!parse_incr(cmd[2], out, incr)) return;
+    incr_generic(cmd, out, incr);
+}
+
+void do_decrby(std::vector<std::string>& cmd, std::string &out){
+    int64_t incr = 0;
+    if (!parse_incr(cmd[2], out, incr)) return;
+    if (incr == INT64_MIN){
+        return out_err(out, ERR_ARG, "decrement would overflow");
+    }
+    incr_generic(cmd, out, -incr);
+}
+
+void do_incrbyfloat(std::vector<std::string>& cmd, std::string &out){
+    double incr = 0;
+    if (!parse_dbl(cmd[2], incr)){
+        return out_err(out, ERR_ARG, "expect float");
+    }
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_STR, key, ent, out)) return;
+
+    double val = 0;
+    if (ent && ent->enc == ENC_INT){
+        val = (double)ent->ival;
+    } else if (ent){
+        std::string buf;
+        if (!parse_dbl(entry_get_str(ent, buf), val)){
+            return out_err(out, ERR_ARG, "value is not a valid float");
+        }
+    }
+    val += incr;
+    if (isinf(val)){
+        return out_err(out, ERR_ARG, "increment would produce Infinity");
+    }
+
+    if (!ent){
+        ent = entry_create(key, T_STR);
+    }
+    // stored as text, so whole results go back to the integer encoding
+    std::string s = dbl_to_str(val);
+    entry_set_str(ent, s);
+    entry_account(ent);
+    out_dbl(out, val);
+}
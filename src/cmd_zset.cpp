@@ -0,0 +1,232 @@
+//
+// Sorted set commands, values are `ZSet`s (hashtable by name + AVL tree by (score, name))
+//
+
+#include "server_utils.h"
+#include "zset.h"
+#include "blocking.h"
+#include "utils.h"
+
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+void do_zadd(std::vector<std::string>& cmd, std::string &out){
+    if (cmd.size() % 2 != 0){
+        return out_err(out, ERR_ARG, "expect ZADD key score name [score name ...]");
+    }
+    std::vector<double> scores(cmd.size() / 2 - 1);
+    for (size_t i = 0; i < scores.size(); ++i){
+        if (!parse_dbl(cmd[2 + 2 * i], scores[i])){
+            return out_err(out, ERR_ARG, "expect fp number");
+        }
+    }
+
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    if (!ent){ // create a new sorted set
+        ent = entry_create(key, T_ZSET);
+    }
+
+    int64_t added = 0;
+    for (size_t i = 0; i < scores.size(); ++i){
+        const std::string &name = cmd[3 + 2 * i];
+        added += zset_add(ent->zset, name.data(), name.size(), scores[i]);
+    }
+    entry_account(ent);
+    block_signal(ent->key);
+    out_int(out, added);
+}
+
+void do_zrem(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    if (!ent){
+        return out_int(out, 0);
+    }
+    int64_t removed = 0;
+    for (size_t i = 2; i < cmd.size(); ++i){
+        ZNode *znode = zset_pop(ent->zset, cmd[i].data(), cmd[i].size());
+        if (znode){
+            znode_del(znode);
+            removed++;
+        }
+    }
+    entry_account_or_drop(ent);
+    out_int(out, removed);
+}
+
+void do_zscore(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    ZNode *znode = ent ? zset_lookup(ent->zset, cmd[2].data(), cmd[2].size()) : NULL;
+    if (!znode){
+        return out_nil(out);
+    }
+    out_dbl(out, znode->score);
+}
+
+void do_zcard(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    out_int(out, ent ? (int64_t)zset_size(ent->zset) : 0);
+}
+
+// ZQUERY key score name offset limit
+// pairs from the first one >= (score, name), skipping `offset` of them
+void do_zquery(std::vector<std::string>& cmd, std::string &out){
+    double score = 0;
+    int64_t offset = 0;
+    int64_t limit = 0;
+    if (!parse_dbl(cmd[2], score)){
+        return out_err(out, ERR_ARG, "expect fp number");
+    }
+    if (!parse_int(cmd[4], offset) || !parse_int(cmd[5], limit)){
+        return out_err(out, ERR_ARG, "expect int");
+    }
+
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    if (!ent || limit <= 0){
+        return out_arr(out, 0);
+    }
+
+    const std::string &name = cmd[3];
+    ZNode *znode = zset_seekge(ent->zset, score, name.data(), name.size());
+    znode = znode_offset(znode, offset);
+
+    std::string items;
+    uint32_t n = 0;
+    while (znode && (int64_t)n < 2 * limit){
+        out_str(items, znode->name, znode->len);
+        out_dbl(items, znode->score);
+        n += 2;
+        if (4 + items.size() > k_max_msg){
+            break; // the reply gets replaced by ERR_2BIG anyway
+        }
+        znode = znode_offset(znode, 1);
+    }
+    out_arr(out, n);
+    out.append(items);
+}
+
+// ZRANGE key start stop [WITHSCORES]
+// pairs by rank, negative ranks count from the end
+void do_zrange(std::vector<std::string>& cmd, std::string &out){
+    int64_t start = 0;
+    int64_t stop = 0;
+    if (!parse_int(cmd[2], start) || !parse_int(cmd[3], stop)){
+        return out_err(out, ERR_ARG, "expect int");
+    }
+    bool with_scores = false;
+    if (cmd.size() == 5 && cmd_is(cmd[4], "withscores")){
+        with_scores = true;
+    } else if (cmd.size() != 4){
+        return out_err(out, ERR_ARG, "expect ZRANGE key start stop [WITHSCORES]");
+    }
+
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    int64_t size = ent ? (int64_t)zset_size(ent->zset) : 0;
+    if (start < 0) start += size;
+    if (stop < 0) stop += size;
+    if (start < 0) start = 0;
+    if (stop >= size) stop = size - 1;
+    if (start > stop){
+        return out_arr(out, 0);
+    }
+
+    // the root is at rank (size of its left subtree)
+    AVLNode *root = ent->zset->tree;
+    ZNode *znode = znode_offset(container_of(root, ZNode, tree), start - (int64_t)avl_cnt(root->left));
+    out_arr(out, (uint32_t)((stop - start + 1) * (with_scores ? 2 : 1)));
+    for (int64_t i = start; i <= stop && znode; ++i){
+        out_str(out, znode->name, znode->len);
+        if (with_scores){
+            out_dbl(out, znode->score);
+        }
+        if (4 + out.size() > k_max_msg){
+            break; // the reply gets replaced by ERR_2BIG anyway
+        }
+        znode = znode_offset(znode, 1);
+    }
+}
+
+// the member with the lowest or highest score, NULL if empty
+static ZNode *zset_edge(ZSet *zset, bool max){
+    ZNode *znode = zset_seekge(zset, -INFINITY, "", 0);
+    if (znode && max){
+        znode = znode_offset(znode, (int64_t)zset_size(zset) - 1);
+    }
+    return znode;
+}
+
+// ZPOPMIN/ZPOPMAX key [count], (name, score) pairs
+static void zpop_generic(std::vector<std::string>& cmd, std::string &out, bool max){
+    int64_t count = 1;
+    if (cmd.size() > 3 || (cmd.size() == 3 && (!parse_int(cmd[2], count) || count < 0))){
+        return out_err(out, ERR_ARG, "expect ZPOPMIN|ZPOPMAX key [count]");
+    }
+    Entry key;
+    Entry *ent = NULL;
+    if (!entry_find(cmd[1], T_ZSET, key, ent, out)) return;
+    if (!ent){
+        return out_arr(out, 0);
+    }
+    uint32_t n = (uint32_t)std::min(count, (int64_t)zset_size(ent->zset));
+    out_arr(out, 2 * n);
+    for (uint32_t i = 0; i < n; ++i){
+        ZNode *znode = zset_edge(ent->zset, max);
+        out_str(out, znode->name, znode->len);
+        out_dbl(out, znode->score);
+        znode_del(zset_pop(ent->zset, znode->name, znode->len));
+    }
+    entry_account_or_drop(ent);
+}
+
+void do_zpopmin(std::vector<std::string>& cmd, std::string &out){
+    zpop_generic(cmd, out, false);
+}
+
+void do_zpopmax(std::vector<std::string>& cmd, std::string &out){
+    zpop_generic(cmd, out, true);
+}
+
+// BZPOPMIN/BZPOPMAX key [key ...] timeout, [key, name, score] from the first non-empty set, else waits for an add
+static void bzpop_generic(std::vector<std::string>& cmd, std::string &out, bool max){
+    uint64_t timeout_ms = 0;
+    if (!block_parse_timeout(cmd.back(), 1000, timeout_ms)){
+        return out_err(out, ERR_ARG, "timeout is not a non-negative number");
+    }
+    for (size_t i = 1; i + 1 < cmd.size(); ++i){
+        std::string name = cmd[i]; // the command is kept whole for a retry
+        Entry key;
+        Entry *ent = NULL;
+        if (!entry_find(name, T_ZSET, key, ent, out)) return;
+        if (!ent) continue;
+        ZNode *znode = zset_edge(ent->zset, max);
+        out_arr(out, 3);
+        out_str(out, cmd[i]);
+        out_str(out, znode->name, znode->len);
+        out_dbl(out, znode->score);
+        znode_del(zset_pop(ent->zset, znode->name, znode->len));
+        entry_account_or_drop(ent);
+        return;
+    }
+    block_wait(cmd, 1, cmd.size() - 2, timeout_ms);
+}
+
+void do_bzpopmin(std::vector<std::string>& cmd, std::string &out){
+    bzpop_generic(cmd, out, false);
+}
+
+void do_bzpopmax(std::vector<std::string>& cmd, std::string &out){
+    bzpop_generic(cmd, out, true);
+}
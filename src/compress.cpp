@@ -0,0 +1,163 @@
+#include "compress.h"
+
+#include <string.h>
+
+const uint32_t k_lz_hash_log = 14;
+const size_t k_lz_max_offset = 65535;
+const size_t k_lz_last_literals = 5;    // a block always ends with at least this many literals
+const size_t k_lz_match_margin = 12;    // no match starts this close to the end
+
+static uint32_t read32(const uint8_t *p){
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t v, uint32_t bits){
+    return (v * 2654435761u) >> (32 - bits);
+}
+
+/**
+ * @brief append a run length: the part above 15 (already in the token) as 255-bytes + remainder
+ *
+ * @return bool false if out of capacity
+ */
+static bool put_len(uint8_t *dst, size_t cap, size_t &op, size_t n){
+    for (; n >= 255; n -= 255){
+        if (op >= cap) return false;
+        dst[op++] = 255;
+    }
+    if (op >= cap) return false;
+    dst[op++] = (uint8_t)n;
+    return true;
+}
+
+/**
+ * @brief emit one sequence; a `mlen` of 0 means the final literals-only sequence
+ *
+ * @return bool false if out of capacity
+ */
+static bool put_seq(uint8_t *dst, size_t cap, size_t &op,
+                    const uint8_t *lit, size_t nlit, size_t offset, size_t mlen){
+    if (op >= cap) return false;
+    size_t tok = op++;
+    uint8_t lit_nib = nlit >= 15 ? 15 : (uint8_t)nlit;
+    uint8_t match_nib = 0;
+    if (nlit >= 15 && !put_len(dst, cap, op, nlit - 15)) return false;
+    if (cap - op < nlit) return false;
+    memcpy(&dst[op], lit, nlit);
+    op += nlit;
+
+    if (mlen){
+        size_t m = mlen - k_lz_min_match;
+        match_nib = m >= 15 ? 15 : (uint8_t)m;
+        if (cap - op < 2) return false;
+        dst[op++] = (uint8_t)(offset & 0xff);
+        dst[op++] = (uint8_t)(offset >> 8);
+        if (m >= 15 && !put_len(dst, cap, op, m - 15)) return false;
+    }
+    dst[tok] = (uint8_t)(lit_nib << 4 | match_nib);
+    return true;
+}
+
+size_t lz_bound(size_t len){
+    return len + len / 255 + 16;
+}
+
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap){
+    size_t op = 0;
+    size_t anchor = 0;  // start of pending literals
+
+    if (len > k_lz_match_margin){
+        // positions of recently seen 4-byte sequences, small inputs only clear a small table
+        static thread_local uint32_t table[1 << k_lz_hash_log];
+        uint32_t bits = 8;
+        while (bits < k_lz_hash_log && ((size_t)1 << bits) < len){
+            bits++;
+        }
+        memset(table, 0, sizeof(uint32_t) << bits);
+
+        size_t limit = len - k_lz_match_margin;
+        size_t ip = 0;
+        while (ip < limit){
+            uint32_t seq = read32(&src[ip]);
+            uint32_t h = lz_hash(seq, bits);
+            size_t cand = table[h];
+            table[h] = (uint32_t)ip;
+
+            if (cand >= ip || ip - cand > k_lz_max_offset || read32(&src[cand]) != seq){
+                // skip faster through data that doesn't compress
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            size_t mlen = k_lz_min_match;
+            size_t mlimit = len - k_lz_last_literals;
+            while (ip + mlen < mlimit && src[cand + mlen] == src[ip + mlen]){
+                mlen++;
+            }
+            if (!put_seq(dst, cap, op, &src[anchor], ip - anchor, ip - cand, mlen)){
+                return 0;
+            }
+            ip += mlen;
+            anchor = ip;
+        }
+    }
+
+    if (!put_seq(dst, cap, op, &src[anchor], len - anchor, 0, 0)){
+        return 0;
+    }
+    return op;
+}
+
+/**
+ * @brief read a run length extension
+ *
+ * @return bool false if the input ends in the middle of it
+ */
+static bool get_len(const uint8_t *src, size_t len, size_t &ip, size_t &n){
+    uint8_t b;
+    do {
+        if (ip >= len) return false;
+        b = src[ip++];
+        n += b;
+    } while (b == 255);
+    return true;
+}
+
+int64_t lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap){
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < len){
+        uint8_t tok = src[ip++];
+
+        // literals
+        size_t nlit = tok >> 4;
+        if (nlit == 15 && !get_len(src, len, ip, nlit)) return -1;
+        if (len - ip < nlit || cap - op < nlit) return -1;
+        memcpy(&dst[op], &src[ip], nlit);
+        ip += nlit;
+        op += nlit;
+        if (ip == len) break; // last sequence
+
+        // match
+        if (len - ip < 2) return -1;
+        size_t offset = src[ip] | (size_t)src[ip + 1] << 8;
+        ip += 2;
+        size_t mlen = tok & 15;
+        if (mlen == 15 && !get_len(src, len, ip, mlen)) return -1;
+        mlen += k_lz_min_match;
+        if (offset == 0 || offset > op || cap - op < mlen) return -1;
+
+        const uint8_t *from = &dst[op - offset];
+        if (offset >= mlen){
+            memcpy(&dst[op], from, mlen);
+        } else { // overlapping copy repeats the last `offset` bytes
+            for (size_t i = 0; i < mlen; ++i){
+                dst[op + i] = from[i];
+            }
+        }
+        op += mlen;
+    }
+    return (int64_t)op;
+}
@@ -0,0 +1,157 @@
+#include "config.h"
+#include "slowlog.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <strings.h>
+
+Config g_config;
+
+// option table, one row per setting
+struct ConfigOpt {
+    const char *name;
+    uint32_t type;
+    void *ptr;
+    const char *const *names;   // CFG_ENUM values, NULL-terminated
+    int64_t min;                // CFG_INT and CFG_MEM values are rejected outside [min, max]
+    int64_t max;
+};
+
+static const char *const k_policy_names[] = {
+    "noeviction", "allkeys-lru", "allkeys-lfu", "allkeys-random",
+    "volatile-lru", "volatile-lfu", "volatile-random", "volatile-ttl", NULL,
+};
+
+static ConfigOpt g_opts[] = {
+    {"snapshot-path", CFG_STR, &g_config.snapshot_path, NULL, 0, 0},
+    {"snapshot-mmap", CFG_BOOL, &g_config.snapshot_mmap, NULL, 0, 0},
+    {"load-threads", CFG_INT, &g_config.load_threads, NULL, 0, 1024},
+    {"snapshot-compression", CFG_BOOL, &g_config.snapshot_compression, NULL, 0, 0},
+    {"value-compression", CFG_BOOL, &g_config.value_compression, NULL, 0, 0},
+    {"value-compression-threshold", CFG_INT, &g_config.value_compression_threshold, NULL, 0, INT64_MAX},
+    {"maxmemory", CFG_MEM, &g_config.maxmemory, NULL, 0, INT64_MAX},
+    {"maxmemory-policy", CFG_ENUM, &g_config.maxmemory_policy, k_policy_names, 0, 0},
+    {"maxmemory-samples", CFG_INT, &g_config.maxmemory_samples, NULL, 1, 64},
+    {"lfu-log-factor", CFG_INT, &g_config.lfu_log_factor, NULL, 0, INT32_MAX},
+    {"lfu-decay-time", CFG_INT, &g_config.lfu_decay_time, NULL, 0, INT32_MAX},
+    {"lazyfree", CFG_BOOL, &g_config.lazyfree, NULL, 0, 0},
+    {"lazyfree-threshold", CFG_INT, &g_config.lazyfree_threshold, NULL, 0, INT64_MAX},
+    {"hash-max-packed-entries", CFG_INT, &g_config.hash_max_packed_entries, NULL, 0, INT32_MAX},
+    {"hash-max-packed-value", CFG_INT, &g_config.hash_max_packed_value, NULL, 0, INT32_MAX},
+    {"set-max-intset-entries", CFG_INT, &g_config.set_max_intset_entries, NULL, 0, INT32_MAX},
+    {"hll-sparse-max-bytes", CFG_INT, &g_config.hll_sparse_max_bytes, NULL, 0, INT32_MAX},
+    {"slowlog-log-slower-than", CFG_INT, &g_config.slowlog_log_slower_than, NULL, INT64_MIN, INT32_MAX},
+    {"slowlog-max-len", CFG_INT, &g_config.slowlog_max_len, NULL, 0, k_slowlog_max_len},
+    {"latency-monitor-threshold", CFG_INT, &g_config.latency_monitor_threshold, NULL, 0, INT32_MAX},
+    {"watchdog-period", CFG_INT, &g_config.watchdog_period, NULL, 0, INT32_MAX},
+    {"hotkeys-sample-rate", CFG_INT, &g_config.hotkeys_sample_rate, NULL, 0, INT32_MAX},
+    {"metrics-port", CFG_INT, &g_config.metrics_port, NULL, 0, 65535},
+};
+
+static ConfigOpt *config_find(const std::string &name){
+    for (size_t i = 0; i < sizeof(g_opts) / sizeof(g_opts[0]); ++i){
+        if (0 == strcasecmp(g_opts[i].name, name.c_str())){
+            return &g_opts[i];
+        }
+    }
+    return NULL;
+}
+
+int32_t config_set(const std::string &name, const std::string &val){
+    ConfigOpt *opt = config_find(name);
+    if (!opt) return -1;
+
+    switch (opt->type){
+        case CFG_STR:
+            *(std::string *)opt->ptr = val;
+            return 0;
+        case CFG_INT: {
+            char *end = NULL;
+            errno = 0;
+            long long v = strtoll(val.c_str(), &end, 10);
+            if (errno || val.empty() || *end != '\0') return -1;
+            if (v < opt->min || v > opt->max) return -1;
+            *(int64_t *)opt->ptr = (int64_t)v;
+            return 0;
+        }
+        case CFG_MEM: {
+            char *end = NULL;
+            errno = 0;
+            long long v = strtoll(val.c_str(), &end, 10);
+            if (errno || val.empty() || v < 0) return -1;
+            int64_t unit = 1;
+            if (0 == strcasecmp(end, "kb")){
+                unit = 1 << 10;
+            } else if (0 == strcasecmp(end, "mb")){
+                unit = 1 << 20;
+            } else if (0 == strcasecmp(end, "gb")){
+                unit = 1 << 30;
+            } else if (*end != '\0'){
+                return -1;
+            }
+            if ((int64_t)v > INT64_MAX / unit) return -1;
+            if ((int64_t)v * unit < opt->min || (int64_t)v * unit > opt->max) return -1;
+            *(int64_t *)opt->ptr = (int64_t)v * unit;
+            return 0;
+        }
+        case CFG_ENUM:
+            for (uint32_t i = 0; opt->names[i]; ++i){
+                if (0 == strcasecmp(opt->names[i], val.c_str())){
+                    *(uint32_t *)opt->ptr = i;
+                    return 0;
+                }
+            }
+            return -1;
+        case CFG_BOOL:
+            if (0 == strcasecmp(val.c_str(), "yes")){
+                *(bool *)opt->ptr = true;
+            } else if (0 == strcasecmp(val.c_str(), "no")){
+                *(bool *)opt->ptr = false;
+            } else {
+                return -1;
+            }
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+bool config_get(const std::string &name, std::string &out){
+    ConfigOpt *opt = config_find(name);
+    if (!opt) return false;
+
+    switch (opt->type){
+        case CFG_STR:
+            out = *(std::string *)opt->ptr;
+            return true;
+        case CFG_INT:
+        case CFG_MEM:
+            out = std::to_string(*(int64_t *)opt->ptr);
+            return true;
+        case CFG_ENUM:
+            out = opt->names[*(uint32_t *)opt->ptr];
+            return true;
+        case CFG_BOOL:
+            out = *(bool *)opt->ptr ? "yes" : "no";
+            return true;
+        default:
+            return false;
+    }
+}
+
+int32_t config_parse_args(int argc, char **argv){
+    for (int i = 1; i < argc; i += 2){
+        const char *arg = argv[i];
+        if (arg[0] != '-' || arg[1] != '-' || i + 1 >= argc){
+            fprintf(stderr, "bad argument: %s\n", arg);
+            return -1;
+        }
+        if (config_set(&arg[2], argv[i + 1])){
+            fprintf(stderr, "bad option: %s %s\n", arg, argv[i + 1]);
+            return -1;
+        }
+    }
+    return 0;
+}
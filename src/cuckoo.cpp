@@ -0,0 +1,181 @@
+#include "cuckoo.h"
+#include "hll.h"
+
+#include <emmintrin.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// buckets are kept under this load when sizing, fuller tables need long relocation chains
+const double k_cf_load = 0.95;
+
+static uint64_t next_pow2(uint64_t n){
+    uint64_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+static uint64_t cf_buckets(uint64_t capacity){
+    return next_pow2((uint64_t)ceil(capacity / (k_cf_load * k_cf_bucket_slots)));
+}
+
+size_t cf_bytes(uint64_t capacity){
+    return cf_buckets(capacity) * k_cf_bucket_slots * sizeof(uint16_t);
+}
+
+bool cf_init(Cuckoo *cf, uint64_t capacity){
+    if (cf_bytes(capacity) > k_cf_max_bytes) return false;
+    uint64_t n_buckets = cf_buckets(capacity);
+    uint16_t *slots = (uint16_t *)calloc(n_buckets * k_cf_bucket_slots, sizeof(uint16_t));
+    if (!slots) return false;
+    cf->slots = slots;
+    cf->n_buckets = n_buckets;
+    cf->n_items = 0;
+    return true;
+}
+
+struct CfKey {
+    uint16_t fp;
+    uint64_t i1, i2;
+};
+
+// the fingerprint comes from the high bits and the first bucket from the low ones, so they are independent
+static CfKey cf_key(const Cuckoo *cf, const char *data, size_t len){
+    uint64_t hash = hll_hash(data, len);
+    uint64_t mask = cf->n_buckets - 1;
+    CfKey k;
+    k.fp = (uint16_t)(hash >> 48);
+    k.fp += !k.fp;  // 0 marks an empty slot
+    k.i1 = hash & mask;
+    k.i2 = (k.i1 ^ ((uint64_t)k.fp * 0x5bd1e995u)) & mask;
+    return k;
+}
+
+// the other bucket of a fingerprint, an involution: alt(alt(i)) == i
+static uint64_t cf_alt(const Cuckoo *cf, uint64_t i, uint16_t fp){
+    return (i ^ ((uint64_t)fp * 0x5bd1e995u)) & (cf->n_buckets - 1);
+}
+
+// one bit pair per slot of both buckets (8 x 16 bits) holding `fp`
+static uint32_t cf_match(const Cuckoo *cf, const CfKey &k){
+    int64_t b1, b2;
+    memcpy(&b1, cf->slots + k.i1 * k_cf_bucket_slots, 8);
+    memcpy(&b2, cf->slots + k.i2 * k_cf_bucket_slots, 8);
+    if (k.i1 == k.i2) b2 = 0;  // don't count the same bucket twice
+    __m128i both = _mm_set_epi64x(b2, b1);
+    __m128i eq = _mm_cmpeq_epi16(both, _mm_set1_epi16((short)k.fp));
+    return (uint32_t)_mm_movemask_epi8(eq);
+}
+
+static bool bucket_put(Cuckoo *cf, uint64_t i, uint16_t fp){
+    uint16_t *b = cf->slots + i * k_cf_bucket_slots;
+    for (uint32_t j = 0; j < k_cf_bucket_slots; ++j){
+        if (!b[j]){
+            b[j] = fp;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t g_rng = 0x9e3779b97f4a7c15ull;
+
+static uint64_t xorshift(){
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+struct CfKick {
+    uint64_t i;
+    uint32_t j;
+};
+
+bool cf_add(Cuckoo *cf, const char *data, size_t len){
+    CfKey k = cf_key(cf, data, len);
+    if (bucket_put(cf, k.i1, k.fp) || bucket_put(cf, k.i2, k.fp)){
+        cf->n_items++;
+        return true;
+    }
+    // relocate: swap into a random slot and move the evicted fingerprint to its other bucket
+    CfKick path[k_cf_max_kicks];
+    uint16_t fp = k.fp;
+    uint64_t i = (xorshift() & 1) ? k.i1 : k.i2;
+    for (uint32_t n = 0; n < k_cf_max_kicks; ++n){
+        uint32_t j = (uint32_t)(xorshift() % k_cf_bucket_slots);
+        uint16_t &slot = cf->slots[i * k_cf_bucket_slots + j];
+        uint16_t victim = slot;
+        slot = fp;
+        path[n] = CfKick{i, j};
+        fp = victim;
+        i = cf_alt(cf, i, fp);
+        if (bucket_put(cf, i, fp)){
+            cf->n_items++;
+            return true;
+        }
+    }
+    // full: undo the swaps so every fingerprint is back where it was
+    for (uint32_t n = k_cf_max_kicks; n-- > 0;){
+        uint16_t &slot = cf->slots[path[n].i * k_cf_bucket_slots + path[n].j];
+        uint16_t prev = slot;
+        slot = fp;
+        fp = prev;
+    }
+    return false;
+}
+
+bool cf_exists(const Cuckoo *cf, const char *data, size_t len){
+    return cf_match(cf, cf_key(cf, data, len)) != 0;
+}
+
+bool cf_del(Cuckoo *cf, const char *data, size_t len){
+    CfKey k = cf_key(cf, data, len);
+    uint32_t m = cf_match(cf, k);
+    if (!m) return false;
+    uint32_t lane = (uint32_t)__builtin_ctz(m) / 2;
+    uint64_t i = lane < k_cf_bucket_slots ? k.i1 : k.i2;
+    cf->slots[i * k_cf_bucket_slots + lane % k_cf_bucket_slots] = 0;
+    cf->n_items--;
+    return true;
+}
+
+uint32_t cf_count(const Cuckoo *cf, const char *data, size_t len){
+    return (uint32_t)__builtin_popcount(cf_match(cf, cf_key(cf, data, len))) / 2;
+}
+
+size_t cf_mem(const Cuckoo *cf){
+    return cf->n_buckets * k_cf_bucket_slots * sizeof(uint16_t);
+}
+
+void cf_dispose(Cuckoo *cf){
+    free(cf->slots);
+    cf->slots = NULL;
+    cf->n_buckets = 0;
+    cf->n_items = 0;
+}
+
+void cf_encode(const Cuckoo *cf, std::string &out){
+    out.append((const char *)&cf->n_buckets, 8);
+    out.append((const char *)&cf->n_items, 8);
+    out.append((const char *)cf->slots, cf_mem(cf));
+}
+
+bool cf_decode(Cuckoo *cf, const char *data, size_t len){
+    if (len < 16) return false;
+    uint64_t n_buckets, n_items;
+    memcpy(&n_buckets, data, 8);
+    memcpy(&n_items, data + 8, 8);
+    if (n_buckets == 0 || (n_buckets & (n_buckets - 1))
+        || (len - 16) / (k_cf_bucket_slots * sizeof(uint16_t)) != n_buckets
+        || (len - 16) % (k_cf_bucket_slots * sizeof(uint16_t))){
+        return false;
+    }
+    uint16_t *slots = (uint16_t *)malloc(len - 16);
+    if (!slots) return false;
+    memcpy(slots, data + 16, len - 16);
+    cf->slots = slots;
+    cf->n_buckets = n_buckets;
+    cf->n_items = n_items;
+    return true;
+}
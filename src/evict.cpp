@@ -0,0 +1,187 @@
+#include "evict.h"
+#include "config.h"
+#include "hashtable.h"
+#include "latency.h"
+
+#include <string>
+
+// candidate for eviction, higher score = evict first
+struct EvictCand {
+    uint64_t score = 0;
+    uint64_t hcode = 0;
+    std::string key;
+};
+
+static EvictCand g_pool[k_evict_pool_size];
+static size_t g_pool_size = 0;
+
+static uint64_t g_rng = 0x2545F4914F6CDD1Dull;
+static uint64_t evict_rand(){
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+static bool is_lfu(){
+    return g_config.maxmemory_policy == EVICT_ALLKEYS_LFU
+        || g_config.maxmemory_policy == EVICT_VOLATILE_LFU;
+}
+
+static uint32_t lfu_minutes(){
+    return (uint32_t)(g_data.now_ms / 60000) & 0xFFFFFF;
+}
+
+void entry_init_lru(Entry *ent){
+    if (is_lfu()){
+        ent->lru = lfu_minutes() << 8 | k_lfu_init_val;
+    } else {
+        ent->lru = (uint32_t)g_data.now_ms;
+    }
+}
+
+uint32_t lfu_count(Entry *ent){
+    uint32_t counter = ent->lru & 0xFF;
+    if (g_config.lfu_decay_time <= 0) return counter;
+    uint32_t elapsed = (lfu_minutes() - (ent->lru >> 8)) & 0xFFFFFF;
+    uint64_t periods = elapsed / (uint64_t)g_config.lfu_decay_time;
+    return periods >= counter ? 0 : counter - (uint32_t)periods;
+}
+
+void entry_touch(Entry *ent){
+    if (!is_lfu()){
+        ent->lru = (uint32_t)g_data.now_ms;
+        return;
+    }
+    // the more hits a key has, the less likely another one bumps the counter
+    uint32_t counter = lfu_count(ent);
+    if (counter < 255){
+        double base = counter > k_lfu_init_val ? counter - k_lfu_init_val : 0;
+        double p = 1.0 / (base * (double)g_config.lfu_log_factor + 1);
+        double r = (double)(evict_rand() >> 11) / (double)(1ull << 53);
+        if (r < p){
+            counter++;
+        }
+    }
+    ent->lru = lfu_minutes() << 8 | counter;
+}
+
+size_t used_memory(){
+    size_t n = g_data.used_memory;
+    if (g_data.db.tb1.tab) n += (g_data.db.tb1.mask + 1) * sizeof(HNode *);
+    if (g_data.db.tb2.tab) n += (g_data.db.tb2.mask + 1) * sizeof(HNode *);
+    n += g_data.heap.capacity() * sizeof(HeapItem);
+    return n;
+}
+
+static bool is_volatile(){
+    return g_config.maxmemory_policy >= EVICT_VOLATILE_LRU;
+}
+
+// pick a random key of the eviction domain
+static Entry *evict_sample(){
+    if (is_volatile()){
+        if (g_data.heap.empty()) return NULL;
+        size_t *ref = g_data.heap[evict_rand() % g_data.heap.size()].ref;
+        return container_of(ref, Entry, heap_idx);
+    }
+    HNode *node = hm_sample(&g_data.db, evict_rand());
+    return node ? container_of(node, Entry, node) : NULL;
+}
+
+static uint64_t evict_score(Entry *ent){
+    if (is_lfu()){
+        return 255 - lfu_count(ent);
+    }
+    return (uint32_t)((uint32_t)g_data.now_ms - ent->lru); // idle time, wraps every ~49 days
+}
+
+// insert a sampled key into the pool, which is sorted by ascending score
+static void pool_insert(Entry *ent){
+    uint64_t score = evict_score(ent);
+    for (size_t i = 0; i < g_pool_size; ++i){
+        if (g_pool[i].hcode == ent->node.hcode && g_pool[i].key == ent->key){
+            return; // already a candidate
+        }
+    }
+    size_t pos = 0;
+    while (pos < g_pool_size && g_pool[pos].score < score){
+        pos++;
+    }
+    if (g_pool_size == k_evict_pool_size){
+        if (pos == 0) return; // worse than every candidate
+        // drop the worst candidate to make room, shifting the lower ones down
+        for (size_t i = 0; i + 1 < pos; ++i){
+            g_pool[i].key.swap(g_pool[i + 1].key);
+            g_pool[i].score = g_pool[i + 1].score;
+            g_pool[i].hcode = g_pool[i + 1].hcode;
+        }
+        pos--;
+    } else {
+        for (size_t i = g_pool_size; i > pos; --i){
+            g_pool[i].key.swap(g_pool[i - 1].key);
+            g_pool[i].score = g_pool[i - 1].score;
+            g_pool[i].hcode = g_pool[i - 1].hcode;
+        }
+        g_pool_size++;
+    }
+    g_pool[pos].score = score;
+    g_pool[pos].hcode = ent->node.hcode;
+    g_pool[pos].key.assign(ent->key); // reuses the slot's buffer
+}
+
+// take the best candidate out of the pool that still exists in the domain
+static Entry *pool_pop(){
+    while (g_pool_size > 0){
+        EvictCand &cand = g_pool[--g_pool_size];
+        Entry key;
+        key.key.swap(cand.key);
+        key.node.hcode = cand.hcode;
+        HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
+        cand.key.swap(key.key);
+        if (!node) continue; // deleted since it was sampled
+        Entry *ent = container_of(node, Entry, node);
+        if (is_volatile() && ent->heap_idx == (size_t)-1) continue;
+        return ent;
+    }
+    return NULL;
+}
+
+static Entry *evict_pick(){
+    switch (g_config.maxmemory_policy){
+        case EVICT_ALLKEYS_RANDOM:
+        case EVICT_VOLATILE_RANDOM:
+            return evict_sample();
+        case EVICT_VOLATILE_TTL: // the TTL heap knows the soonest expiry exactly
+            return g_data.heap.empty() ? NULL : container_of(g_data.heap[0].ref, Entry, heap_idx);
+        default:
+            for (int64_t i = 0; i < g_config.maxmemory_samples; ++i){
+                Entry *ent = evict_sample();
+                if (!ent) break;
+                pool_insert(ent);
+            }
+            return pool_pop();
+    }
+}
+
+bool evict_run(){
+    if (g_config.maxmemory <= 0 || used_memory() <= (size_t)g_config.maxmemory){
+        return true;
+    }
+    if (g_config.maxmemory_policy == EVICT_NOEVICTION){
+        return false;
+    }
+    uint64_t start = lat_now();
+    bool ok = true;
+    for (size_t n = 0; n < k_evict_max_keys && used_memory() > (size_t)g_config.maxmemory; ++n){
+        Entry *ent = evict_pick();
+        if (!ent){
+            ok = false; // nothing left to evict
+            break;
+        }
+        hm_pop(&g_data.db, &ent->node, &hnode_same);
+        entry_del(ent);
+    }
+    lat_event(LAT_EV_EVICTION, lat_now() - start);
+    return ok;
+}
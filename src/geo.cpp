@@ -0,0 +1,154 @@
+#include "geo.h"
+
+#include <math.h>
+#include <algorithm>
+
+static double deg_rad(double deg){
+    return deg * (M_PI / 180.0);
+}
+
+static double rad_deg(double rad){
+    return rad * (180.0 / M_PI);
+}
+
+// put the 32 bits of `x` in the even bits of the result
+static uint64_t spread(uint32_t x){
+    uint64_t v = x;
+    v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+    v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+    v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    v = (v | (v << 2)) & 0x3333333333333333ull;
+    v = (v | (v << 1)) & 0x5555555555555555ull;
+    return v;
+}
+
+// gather the even bits of `v`
+static uint32_t squash(uint64_t v){
+    v &= 0x5555555555555555ull;
+    v = (v | (v >> 1)) & 0x3333333333333333ull;
+    v = (v | (v >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+    v = (v | (v >> 4)) & 0x00FF00FF00FF00FFull;
+    v = (v | (v >> 8)) & 0x0000FFFF0000FFFFull;
+    v = (v | (v >> 16)) & 0x00000000FFFFFFFFull;
+    return (uint32_t)v;
+}
+
+static uint64_t interleave(uint32_t ilat, uint32_t ilon){
+    return spread(ilat) | (spread(ilon) << 1);
+}
+
+// cell index of a coordinate in [lo, hi] split in 2^step cells
+static uint32_t cell_index(double v, double lo, double hi, uint32_t step){
+    double cells = (double)(1ull << step);
+    double i = (v - lo) / (hi - lo) * cells;
+    if (i < 0) return 0;
+    if (i >= cells) return (uint32_t)(cells - 1);   // the upper bound belongs to the last cell
+    return (uint32_t)i;
+}
+
+uint64_t geo_encode(double lon, double lat, uint32_t step){
+    return interleave(cell_index(lat, k_geo_lat_min, k_geo_lat_max, step),
+                      cell_index(lon, k_geo_lon_min, k_geo_lon_max, step));
+}
+
+void geo_decode(uint64_t bits, double *lon, double *lat){
+    double cells = (double)(1ull << k_geo_step);
+    double lat_h = (k_geo_lat_max - k_geo_lat_min) / cells;
+    double lon_w = (k_geo_lon_max - k_geo_lon_min) / cells;
+    *lat = k_geo_lat_min + ((double)squash(bits) + 0.5) * lat_h;
+    *lon = k_geo_lon_min + ((double)squash(bits >> 1) + 0.5) * lon_w;
+}
+
+double geo_dist(double lon1, double lat1, double lon2, double lat2){
+    double lat1r = deg_rad(lat1);
+    double lat2r = deg_rad(lat2);
+    double u = sin((lat2r - lat1r) / 2);
+    double v = sin(deg_rad(lon2 - lon1) / 2);
+    return 2.0 * k_earth_radius_m * asin(sqrt(u * u + cos(lat1r) * cos(lat2r) * v * v));
+}
+
+void geo_bound(GeoShape *shape){
+    const double k_slack = 1e-9;    // degrees, about 0.1 mm, so rounding never drops a point on the edge
+    double half_w = shape->box ? shape->width / 2 : shape->radius;
+    double half_h = shape->box ? shape->height / 2 : shape->radius;
+    double lat_delta = rad_deg(half_h / k_earth_radius_m) + k_slack;
+    shape->min_lat = shape->lat - lat_delta;
+    shape->max_lat = shape->lat + lat_delta;
+    // the widest longitude difference of a point in the area, every longitude if it reaches a pole
+    double polar = std::max(fabs(shape->min_lat), fabs(shape->max_lat));
+    shape->lon_delta = 180;
+    if (polar < 90){
+        // a circle is a spherical cap: sin(dlon) = sin(r / R) / cos(lat);
+        // a box spans `half_w` along the parallel of each point, the most degrees nearest the pole
+        double s = shape->box ? sin(half_w / (2 * k_earth_radius_m)) / cos(deg_rad(polar))
+                              : sin(half_w / k_earth_radius_m) / cos(deg_rad(shape->lat));
+        if (s < 1){
+            double d = rad_deg(asin(s)) * (shape->box ? 2 : 1) + k_slack;
+            shape->lon_delta = std::min(d, 180.0);
+        }
+    }
+}
+
+size_t geo_cover(const GeoShape *shape, GeoRange *ranges){
+    double min_lat = std::max(shape->min_lat, k_geo_lat_min);
+    double max_lat = std::min(shape->max_lat, k_geo_lat_max);
+    bool all_lon = shape->lon_delta >= 180;
+
+    // the finest step at which the bounding box takes at most k_geo_max_cells cells
+    uint32_t step = k_geo_step;
+    int64_t lat_lo = 0, lat_hi = 0, lon_lo = 0, lon_hi = 0, cells = 0;
+    for (;; --step){
+        cells = (int64_t)1 << step;
+        double cell_w = (k_geo_lon_max - k_geo_lon_min) / (double)cells;
+        lat_lo = cell_index(min_lat, k_geo_lat_min, k_geo_lat_max, step);
+        lat_hi = cell_index(max_lat, k_geo_lat_min, k_geo_lat_max, step);
+        if (all_lon){
+            lon_lo = 0;
+            lon_hi = cells - 1;
+        } else { // may run past the antimeridian, wrapped below
+            lon_lo = (int64_t)floor((shape->lon - shape->lon_delta - k_geo_lon_min) / cell_w);
+            lon_hi = (int64_t)floor((shape->lon + shape->lon_delta - k_geo_lon_min) / cell_w);
+            lon_hi = std::min(lon_hi, lon_lo + cells - 1);
+        }
+        if (step == 1 || (uint64_t)((lat_hi - lat_lo + 1) * (lon_hi - lon_lo + 1)) <= k_geo_max_cells) break;
+    }
+
+    uint32_t shift = 2 * (k_geo_step - step);
+    size_t n = 0;
+    for (int64_t y = lat_lo; y <= lat_hi; ++y){
+        for (int64_t x = lon_lo; x <= lon_hi; ++x){
+            uint64_t bits = interleave((uint32_t)y, (uint32_t)(((x % cells) + cells) % cells));
+            ranges[n].min = bits << shift;
+            ranges[n].max = (bits + 1) << shift;
+            n++;
+        }
+    }
+
+    // neighbouring cells are often consecutive ranges, merging them saves seeks
+    std::sort(ranges, ranges + n, [](const GeoRange &a, const GeoRange &b){
+        return a.min < b.min;
+    });
+    size_t m = 0;
+    for (size_t i = 0; i < n; ++i){
+        if (m && ranges[i].min <= ranges[m - 1].max){
+            ranges[m - 1].max = std::max(ranges[m - 1].max, ranges[i].max);
+        } else {
+            ranges[m++] = ranges[i];
+        }
+    }
+    return m;
+}
+
+bool geo_match(const GeoShape *shape, double lon, double lat, double *dist){
+    // most candidates of a covering fall outside the bounding box, no need for trigonometry
+    if (lat < shape->min_lat || lat > shape->max_lat) return false;
+    double dlon = fabs(lon - shape->lon);
+    if (std::min(dlon, 360 - dlon) > shape->lon_delta) return false;
+    if (shape->box){
+        // distances along the meridian and the parallel of the point
+        if (geo_dist(lon, lat, lon, shape->lat) > shape->height / 2) return false;
+        if (geo_dist(lon, lat, shape->lon, lat) > shape->width / 2) return false;
+    }
+    *dist = geo_dist(shape->lon, shape->lat, lon, lat);
+    return shape->box || *dist <= shape->radius;
+}
@@ -0,0 +1,242 @@
+#include "hash.h"
+#include "config.h"
+#include "utils.h"
+
+#include <string.h>
+
+// packed length prefix
+static size_t len_size(size_t len){
+    return len < 0x80 ? 1 : 5;
+}
+
+static void len_put(std::string &out, size_t len){
+    if (len < 0x80){
+        out.push_back((char)len);
+        return;
+    }
+    uint32_t len32 = (uint32_t)len;
+    out.push_back((char)0x80);
+    out.append((char *)&len32, 4);
+}
+
+static size_t len_get(const char *p){
+    if ((uint8_t)p[0] < 0x80) return (uint8_t)p[0];
+    uint32_t len = 0;
+    memcpy(&len, &p[1], 4);
+    return len;
+}
+
+// offset of the packed pair with this field, or npos
+static size_t packed_find(const std::string &packed, const char *field, size_t flen){
+    const char *p = packed.data();
+    size_t pos = 0;
+    while (pos < packed.size()){
+        size_t l = len_get(&p[pos]);
+        size_t vpos = pos + len_size(l) + l;
+        size_t vl = len_get(&p[vpos]);
+        if (l == flen && 0 == memcmp(&p[pos + len_size(l)], field, flen)){
+            return pos;
+        }
+        pos = vpos + len_size(vl) + vl;
+    }
+    return std::string::npos;
+}
+
+// HKey-style comparison against a field name
+static bool hfield_eq(HNode *node, HNode *key){
+    HField *hf = container_of(node, HField, node);
+    HKey *hkey = container_of(key, HKey, node);
+    return hf->field.size() == hkey->len && 0 == memcmp(hf->field.data(), hkey->name, hkey->len);
+}
+
+static HField *hmap_find(Hash *hash, const char *field, size_t flen){
+    HKey key;
+    key.node.hcode = str_hash((uint8_t *)field, flen);
+    key.name = field;
+    key.len = flen;
+    HNode *node = hm_lookup(&hash->hmap, &key.node, &hfield_eq);
+    return node ? container_of(node, HField, node) : NULL;
+}
+
+static size_t hfield_mem(HField *hf){
+    size_t mem = sizeof(HField);
+    if (hf->field.capacity() > 15) mem += hf->field.capacity() + 1;
+    if (hf->val.capacity() > 15) mem += hf->val.capacity() + 1;
+    return mem;
+}
+
+static void hmap_add(Hash *hash, const char *field, size_t flen, const char *val, size_t vlen){
+    HField *hf = new HField();
+    hf->field.assign(field, flen);
+    hf->val.assign(val, vlen);
+    hf->node.hcode = str_hash((uint8_t *)field, flen);
+    hm_insert(&hash->hmap, &hf->node);
+    hash->bytes += hfield_mem(hf);
+}
+
+static void cb_convert(const char *field, size_t flen, const char *val, size_t vlen, void *arg){
+    hmap_add((Hash *)arg, field, flen, val, vlen);
+}
+
+// switch a packed hash over to the hashtable
+static void hash_convert(Hash *hash){
+    hash_scan(hash, &cb_convert, hash);
+    hash->enc = HASH_HMAP;
+    std::string().swap(hash->packed);
+}
+
+const char *hash_get(Hash *hash, const char *field, size_t flen, size_t *vlen){
+    if (hash->enc == HASH_HMAP){
+        HField *hf = hmap_find(hash, field, flen);
+        if (!hf) return NULL;
+        *vlen = hf->val.size();
+        return hf->val.data();
+    }
+    size_t pos = packed_find(hash->packed, field, flen);
+    if (pos == std::string::npos) return NULL;
+    size_t vpos = pos + len_size(flen) + flen;
+    *vlen = len_get(&hash->packed[vpos]);
+    return &hash->packed[vpos + len_size(*vlen)];
+}
+
+bool hash_set(Hash *hash, const char *field, size_t flen, const char *val, size_t vlen){
+    if (hash->enc == HASH_PACKED){
+        size_t max_len = (size_t)g_config.hash_max_packed_value;
+        if (flen > max_len || vlen > max_len
+            || hash->n >= (size_t)g_config.hash_max_packed_entries){
+            hash_convert(hash);
+        }
+    }
+    if (hash->enc == HASH_HMAP){
+        HField *hf = hmap_find(hash, field, flen);
+        if (hf){
+            hash->bytes -= hfield_mem(hf);
+            hf->val.assign(val, vlen);
+            hash->bytes += hfield_mem(hf);
+            return false;
+        }
+        hmap_add(hash, field, flen, val, vlen);
+        hash->n++;
+        return true;
+    }
+
+    size_t pos = packed_find(hash->packed, field, flen);
+    if (pos != std::string::npos){ // splice the new value in place of the old one
+        size_t vpos = pos + len_size(flen) + flen;
+        size_t old = len_get(&hash->packed[vpos]);
+        std::string enc;
+        len_put(enc, vlen);
+        enc.append(val, vlen);
+        hash->packed.replace(vpos, len_size(old) + old, enc);
+        return false;
+    }
+    len_put(hash->packed, flen);
+    hash->packed.append(field, flen);
+    len_put(hash->packed, vlen);
+    hash->packed.append(val, vlen);
+    hash->n++;
+    return true;
+}
+
+bool hash_del(Hash *hash, const char *field, size_t flen){
+    if (hash->enc == HASH_HMAP){
+        HKey key;
+        key.node.hcode = str_hash((uint8_t *)field, flen);
+        key.name = field;
+        key.len = flen;
+        HNode *node = hm_pop(&hash->hmap, &key.node, &hfield_eq);
+        if (!node) return false;
+        HField *hf = container_of(node, HField, node);
+        hash->bytes -= hfield_mem(hf);
+        delete hf;
+        hash->n--;
+        return true;
+    }
+    size_t pos = packed_find(hash->packed, field, flen);
+    if (pos == std::string::npos) return false;
+    size_t vpos = pos + len_size(flen) + flen;
+    size_t vl = len_get(&hash->packed[vpos]);
+    hash->packed.erase(pos, vpos + len_size(vl) + vl - pos);
+    hash->n--;
+    return true;
+}
+
+struct HashScan {
+    void (*f)(const char *, size_t, const char *, size_t, void *);
+    void *arg;
+};
+
+static void cb_scan_field(HNode *node, void *arg){
+    HashScan *scan = (HashScan *)arg;
+    HField *hf = container_of(node, HField, node);
+    scan->f(hf->field.data(), hf->field.size(), hf->val.data(), hf->val.size(), scan->arg);
+}
+
+void hash_scan(Hash *hash, void (*f)(const char *, size_t, const char *, size_t, void *), void *arg){
+    if (hash->enc == HASH_HMAP){
+        HashScan scan = {f, arg};
+        h_scan(&hash->hmap.tb1, &cb_scan_field, &scan);
+        h_scan(&hash->hmap.tb2, &cb_scan_field, &scan);
+        return;
+    }
+    const char *p = hash->packed.data();
+    size_t pos = 0;
+    while (pos < hash->packed.size()){
+        size_t fl = len_get(&p[pos]);
+        const char *field = &p[pos + len_size(fl)];
+        size_t vpos = pos + len_size(fl) + fl;
+        size_t vl = len_get(&p[vpos]);
+        f(field, fl, &p[vpos + len_size(vl)], vl, arg);
+        pos = vpos + len_size(vl) + vl;
+    }
+}
+
+static void htab_free_fields(HTab *tab){
+    for (size_t i = 0; tab->tab && i < tab->mask + 1; ++i){
+        HNode *node = tab->tab[i];
+        while (node){
+            HNode *next = node->next;
+            delete container_of(node, HField, node);
+            node = next;
+        }
+    }
+}
+
+void hash_dispose(Hash *hash){
+    if (hash->enc == HASH_HMAP){
+        htab_free_fields(&hash->hmap.tb1);
+        htab_free_fields(&hash->hmap.tb2);
+        hm_destroy(&hash->hmap);
+    }
+    *hash = Hash{};
+}
+
+static void cb_encode(const char *field, size_t flen, const char *val, size_t vlen, void *arg){
+    std::string &out = *(std::string *)arg;
+    uint32_t len = (uint32_t)flen;
+    out.append((char *)&len, 4);
+    out.append(field, flen);
+    len = (uint32_t)vlen;
+    out.append((char *)&len, 4);
+    out.append(val, vlen);
+}
+
+void hash_encode(Hash *hash, std::string &out){
+    hash_scan(hash, &cb_encode, &out);
+}
+
+bool hash_decode(Hash *hash, const char *data, size_t len){
+    size_t pos = 0;
+    while (pos < len){
+        uint32_t flen = 0;
+        uint32_t vlen = 0;
+        if (len - pos < 4) return false;
+        memcpy(&flen, &data[pos], 4);
+        if (len - pos - 4 < (size_t)flen + 4) return false;
+        memcpy(&vlen, &data[pos + 4 + flen], 4);
+        if (len - pos - 8 - flen < vlen) return false;
+        hash_set(hash, &data[pos + 4], flen, &data[pos + 8 + flen], vlen);
+        pos += 8 + (size_t)flen + vlen;
+    }
+    return true;
+}
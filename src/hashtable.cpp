@@ -3,10 +3,13 @@
 
 #include "hashtable.h"
 #include "utils.h"
+#include "latency.h"
+#include "memtrack.h"
+#include "trace.h"
 
 void h_init(HTab *htab, size_t n){
     assert(n > 0 && ((n-1) & n) == 0);
-    htab->tab = static_cast<HNode **>(calloc(sizeof(struct HNode *), n));
+    htab->tab = static_cast<HNode **>(mem_calloc(n, sizeof(struct HNode *), MEM_HTAB));
     htab->mask = n - 1;
     htab->size = 0;
 }
@@ -34,7 +37,7 @@ HNode** h_lookup(HTab *htab, HNode *key, bool (*eq)(HNode *, HNode *)){
     // lookup in one pass
     HNode **from = &htab->tab[pos];
     for (HNode *cur; (cur = *from)!=NULL; from = &cur->next){
-        if(cur->hcode == key->hcode && eq(key, cur)) {
+        if(cur->hcode == key->hcode && eq(cur, key)) {
             return from;
         }
     }
@@ -116,9 +119,12 @@ void hm_insert(HMap *hmap, HNode *node){
  */
 void hm_start_resizing(HMap *hmap){
     assert(!hmap->tb2.tab);
+    if (!g_lat_quiet) TRACE3(resize_start, hmap, hmap->tb1.mask + 1, hmap->tb1.size);
+    uint64_t start = lat_now();
     hmap->tb2 = hmap->tb1;
     h_init(&hmap->tb1, 2 * (hmap->tb1.mask + 1));
     hmap->resizing_pos = 0;
+    lat_event(LAT_EV_RESIZE, lat_now() - start);
 }
 
 /**
@@ -128,18 +134,26 @@ void hm_start_resizing(HMap *hmap){
  */
 void hm_help_resizing(HMap *hmap){
     msg("hm_help_resizing");
+    if (!hmap->tb2.tab){
+        return;
+    }
     size_t n_work = 0;
     while(n_work < k_resizing_work && hmap->tb2.size > 0){ // move node from tb2 to tb1, one by one
-        if(!hmap->tb2.tab[hmap->resizing_pos]){
+        HNode **from = &hmap->tb2.tab[hmap->resizing_pos];
+        if(!*from){ // empty slot, move on
             hmap->resizing_pos++;
+            continue;
         }
-        HNode *to_move = h_detach(&hmap->tb2, &hmap->tb2.tab[hmap->resizing_pos]);
+        HNode *to_move = h_detach(&hmap->tb2, from);
         h_insert(&hmap->tb1, to_move);
+        n_work++;
     }
+    if (!g_lat_quiet) TRACE3(resize_step, hmap, n_work, hmap->tb2.size);
 
-    if(hmap->tb2.size == 0 && hmap->tb2.tab){ // tb2 is empty now
-        free(hmap->tb2.tab);
+    if(hmap->tb2.size == 0){ // tb2 is empty now
+        mem_free(hmap->tb2.tab, MEM_HTAB);
         hmap->tb2 = HTab{}; // renew the whole table
+        if (!g_lat_quiet) TRACE1(resize_done, hmap);
     }
 }
 
@@ -152,6 +166,7 @@ HNode *hm_lookup(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *)){
 }
 
 HNode *hm_pop(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *)){
+    hm_help_resizing(hmap);
     // check first table
     HNode **from = h_lookup(&hmap->tb1, key, eq);
     if(from){
@@ -165,4 +180,31 @@ HNode *hm_pop(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *)){
         return deleted;
     }
     return NULL;
+}
+
+HNode *hm_sample(HMap *hmap, uint64_t rnd){
+    size_t total = hmap->tb1.size + hmap->tb2.size;
+    if (total == 0) return NULL;
+    // pick a table weighted by its size, then a bucket, then a node of the chain
+    HTab *tab = (rnd % total) < hmap->tb1.size ? &hmap->tb1 : &hmap->tb2;
+    size_t pos = (size_t)(rnd >> 20);
+    for (size_t i = 0; i <= tab->mask; ++i){ // walk to the next non-empty bucket
+        HNode *node = tab->tab[(pos + i) & tab->mask];
+        if (!node) continue;
+        size_t len = 0;
+        for (HNode *cur = node; cur; cur = cur->next){
+            len++;
+        }
+        for (size_t k = (size_t)(rnd >> 44) % len; k > 0; --k){
+            node = node->next;
+        }
+        return node;
+    }
+    return NULL;
+}
+
+void hm_destroy(HMap *hmap){
+    mem_free(hmap->tb1.tab, MEM_HTAB);
+    mem_free(hmap->tb2.tab, MEM_HTAB);
+    *hmap = HMap{};
 }
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include "hll.h"
+#include "config.h"
+
+#include <immintrin.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+// the last group of registers is read with a whole vector load
+const size_t k_hll_dense_alloc = k_hll_dense_bytes + 8;
+const char k_hll_magic[4] = {'H', 'Y', 'L', 'L'};
+
+uint64_t hll_hash(const void *key, size_t len){
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    uint64_t h = 0xadc83b19ull ^ (len * m);
+    const uint8_t *data = (const uint8_t *)key;
+    const uint8_t *end = data + (len - (len & 7));
+    while (data != end){
+        uint64_t k;
+        memcpy(&k, data, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+        data += 8;
+    }
+    switch (len & 7){
+        case 7: h ^= (uint64_t)data[6] << 48; // fallthrough
+        case 6: h ^= (uint64_t)data[5] << 40; // fallthrough
+        case 5: h ^= (uint64_t)data[4] << 32; // fallthrough
+        case 4: h ^= (uint64_t)data[3] << 24; // fallthrough
+        case 3: h ^= (uint64_t)data[2] << 16; // fallthrough
+        case 2: h ^= (uint64_t)data[1] << 8;  // fallthrough
+        case 1:
+            h ^= (uint64_t)data[0];
+            h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+static uint32_t dense_get(const uint8_t *p, uint32_t i){
+    size_t pos = (size_t)i * 6;
+    uint32_t v = p[pos >> 3] | (uint32_t)p[(pos >> 3) + 1] << 8;
+    return (v >> (pos & 7)) & 63;
+}
+
+static void dense_set(uint8_t *p, uint32_t i, uint32_t val){
+    size_t pos = (size_t)i * 6;
+    uint8_t *b = &p[pos >> 3];
+    uint32_t v = b[0] | (uint32_t)b[1] << 8;
+    v = (v & ~(63u << (pos & 7))) | val << (pos & 7);
+    b[0] = (uint8_t)v;
+    b[1] = (uint8_t)(v >> 8);
+}
+
+static void to_dense(Hll *h){
+    h->dense = (uint8_t *)calloc(1, k_hll_dense_alloc);
+    for (uint32_t e : h->sparse){
+        dense_set(h->dense, e >> 6, e & 63);
+    }
+    std::vector<uint32_t>().swap(h->sparse);
+    h->enc = HLL_DENSE;
+}
+
+// raise register `idx` to `rank`, false if it was already there
+static bool sparse_set(Hll *h, uint32_t idx, uint32_t rank){
+    std::vector<uint32_t> &s = h->sparse;
+    std::vector<uint32_t>::iterator it = std::lower_bound(s.begin(), s.end(), idx << 6);
+    if (it != s.end() && (*it >> 6) == idx){
+        if ((*it & 63) >= rank) return false;
+        *it = idx << 6 | rank;
+    } else {
+        s.insert(it, idx << 6 | rank);
+    }
+    if (s.size() * sizeof(uint32_t) > (size_t)g_config.hll_sparse_max_bytes){
+        to_dense(h);
+    }
+    return true;
+}
+
+bool hll_add(Hll *h, const char *data, size_t len){
+    uint64_t hash = hll_hash(data, len);
+    uint32_t idx = (uint32_t)(hash & (k_hll_regs - 1));
+    // the sentinel bit caps the rank at q + 1
+    uint32_t rank = (uint32_t)__builtin_ctzll(hash >> k_hll_p | 1ull << k_hll_q) + 1;
+    bool changed = false;
+    if (h->enc == HLL_SPARSE){
+        changed = sparse_set(h, idx, rank);
+    } else if (dense_get(h->dense, idx) < rank){
+        dense_set(h->dense, idx, rank);
+        changed = true;
+    }
+    if (changed){
+        h->card = -1;
+    }
+    return changed;
+}
+
+
+
+
+// Estimate
+static double hll_sigma(double x){
+    if (x == 1.0) return INFINITY;
+    double y = 1.0;
+    double z = x;
+    double zp;
+    do {
+        x *= x;
+        zp = z;
+        z += x * y;
+        y += y;
+    } while (zp != z);
+    return z;
+}
+
+static double hll_tau(double x){
+    if (x == 0.0 || x == 1.0) return 0.0;
+    double y = 1.0;
+    double z = 1 - x;
+    double zp;
+    do {
+        x = sqrt(x);
+        zp = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    } while (zp != z);
+    return z / 3;
+}
+
+// Ertl's improved estimator: the plain harmonic sum with its two end bins
+// (empty and saturated registers) replaced by bias-corrected terms
+static uint64_t estimate_from(double sum, uint32_t n_zero, uint32_t n_max){
+    if (n_zero == k_hll_regs) return 0;
+    double m = (double)k_hll_regs;
+    double z = sum - n_zero - n_max * ldexp(1.0, -(int)(k_hll_q + 1))
+        + m * hll_tau(1 - n_max / m) * ldexp(1.0, -(int)k_hll_q)
+        + m * hll_sigma(n_zero / m);
+    return (uint64_t)llround(0.5 / log(2.0) * m * m / z);
+}
+
+// 2^-r for every 6-bit register value
+static const double *pow2_neg(){
+    static double table[64];
+    static bool init = false;
+    if (!init){
+        for (int r = 0; r < 64; ++r){
+            table[r] = ldexp(1.0, -r);
+        }
+        init = true;
+    }
+    return table;
+}
+
+// sum of 2^-r over the registers, with the counts of empty and saturated ones
+static void regs_sum_scalar(const uint8_t *regs, double *sum, uint32_t *n_zero, uint32_t *n_max){
+    const double *pow2 = pow2_neg();
+    double s = 0;
+    uint32_t z = 0, mx = 0;
+    for (uint32_t i = 0; i < k_hll_regs; ++i){
+        s += pow2[regs[i] & 63];
+        z += regs[i] == 0;
+        mx += regs[i] == k_hll_q + 1;
+    }
+    *sum = s;
+    *n_zero = z;
+    *n_max = mx;
+}
+
+__attribute__((target("avx2,popcnt")))
+static void regs_sum_avx2(const uint8_t *regs, double *sum, uint32_t *n_zero, uint32_t *n_max){
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i top = _mm256_set1_epi8((char)(k_hll_q + 1));
+    const __m256i bias = _mm256_set1_epi32(127);
+    __m256d acc = _mm256_setzero_pd();
+    uint32_t z = 0, mx = 0;
+    for (uint32_t i = 0; i < k_hll_regs; i += 32){
+        __m256i v = _mm256_loadu_si256((const __m256i *)(regs + i));
+        z += (uint32_t)_mm_popcnt_u32((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)));
+        mx += (uint32_t)_mm_popcnt_u32((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, top)));
+        // 2^-r is the float with exponent field 127 - r and no mantissa
+        __m256 part = _mm256_setzero_ps();
+        for (uint32_t j = 0; j < 32; j += 8){
+            __m256i r = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(regs + i + j)));
+            part = _mm256_add_ps(part, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_sub_epi32(bias, r), 23)));
+        }
+        acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_castps256_ps128(part)));
+        acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_extractf128_ps(part, 1)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    *sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    *n_zero = z;
+    *n_max = mx;
+}
+
+static void merge_dense_scalar(const uint8_t *p, uint8_t *regs){
+    for (uint32_t i = 0; i < k_hll_regs; ++i){
+        regs[i] = std::max(regs[i], (uint8_t)dense_get(p, i));
+    }
+}
+
+__attribute__((target("avx2")))
+static void merge_dense_avx2(const uint8_t *p, uint8_t *regs){
+    // spread 24 packed bytes to 3 bytes per dword (12 per 128-bit lane), then each dword holds 4 registers
+    const __m256i perm = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+    const __m256i shuf = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i m0 = _mm256_set1_epi32(0x3F);
+    const __m256i m1 = _mm256_set1_epi32(0x3F00);
+    const __m256i m2 = _mm256_set1_epi32(0x3F0000);
+    const __m256i m3 = _mm256_set1_epi32(0x3F000000);
+    for (uint32_t i = 0; i < k_hll_regs; i += 32, p += 24){
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, perm), shuf);
+        // register k of a dword sits at bit 6k, move it to byte k
+        __m256i r = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(v, m0), _mm256_and_si256(_mm256_slli_epi32(v, 2), m1)),
+            _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(v, 4), m2), _mm256_and_si256(_mm256_slli_epi32(v, 6), m3)));
+        __m256i cur = _mm256_loadu_si256((const __m256i *)(regs + i));
+        _mm256_storeu_si256((__m256i *)(regs + i), _mm256_max_epu8(cur, r));
+    }
+}
+
+typedef void (*SumFn)(const uint8_t *, double *, uint32_t *, uint32_t *);
+typedef void (*MergeFn)(const uint8_t *, uint8_t *);
+
+static SumFn g_sum = NULL;
+static MergeFn g_merge = &merge_dense_scalar;
+static const char *g_kernel_name = "scalar";
+
+static void pick_kernels(){
+    if (g_sum) return;
+    __builtin_cpu_init();
+    g_sum = &regs_sum_scalar;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")){
+        g_sum = &regs_sum_avx2;
+        g_merge = &merge_dense_avx2;
+        g_kernel_name = "avx2";
+    }
+}
+
+static void merge_sparse(const Hll *h, uint8_t *regs){
+    for (uint32_t e : h->sparse){
+        regs[e >> 6] = std::max(regs[e >> 6], (uint8_t)(e & 63));
+    }
+}
+
+void hll_merge(const Hll *h, uint8_t *regs){
+    pick_kernels();
+    if (h->enc == HLL_SPARSE){
+        return merge_sparse(h, regs);
+    }
+    g_merge(h->dense, regs);
+}
+
+void hll_merge_scalar(const Hll *h, uint8_t *regs){
+    if (h->enc == HLL_SPARSE){
+        return merge_sparse(h, regs);
+    }
+    merge_dense_scalar(h->dense, regs);
+}
+
+uint64_t hll_estimate(const uint8_t *regs){
+    pick_kernels();
+    double sum;
+    uint32_t n_zero, n_max;
+    g_sum(regs, &sum, &n_zero, &n_max);
+    return estimate_from(sum, n_zero, n_max);
+}
+
+uint64_t hll_estimate_scalar(const uint8_t *regs){
+    double sum;
+    uint32_t n_zero, n_max;
+    regs_sum_scalar(regs, &sum, &n_zero, &n_max);
+    return estimate_from(sum, n_zero, n_max);
+}
+
+uint64_t hll_count(Hll *h){
+    if (h->card >= 0) return (uint64_t)h->card;
+    if (h->enc == HLL_SPARSE){
+        // registers not listed are all empty, no need to unpack
+        double sum = (double)(k_hll_regs - h->sparse.size());
+        const double *pow2 = pow2_neg();
+        uint32_t n_max = 0;
+        for (uint32_t e : h->sparse){
+            sum += pow2[e & 63];
+            n_max += (e & 63) == k_hll_q + 1;
+        }
+        h->card = (int64_t)estimate_from(sum, k_hll_regs - (uint32_t)h->sparse.size(), n_max);
+    } else {
+        uint8_t regs[k_hll_regs] = {};
+        hll_merge(h, regs);
+        h->card = (int64_t)hll_estimate(regs);
+    }
+    return (uint64_t)h->card;
+}
+
+void hll_store(Hll *h, const uint8_t *regs){
+    size_t n = 0;
+    for (uint32_t i = 0; i < k_hll_regs; ++i){
+        n += regs[i] != 0;
+    }
+    if (n * sizeof(uint32_t) <= (size_t)g_config.hll_sparse_max_bytes){
+        hll_dispose(h);
+        h->sparse.reserve(n);
+        for (uint32_t i = 0; i < k_hll_regs; ++i){
+            if (regs[i]) h->sparse.push_back(i << 6 | regs[i]);
+        }
+    } else {
+        if (h->enc == HLL_SPARSE){
+            hll_dispose(h);
+            h->dense = (uint8_t *)calloc(1, k_hll_dense_alloc);
+            h->enc = HLL_DENSE;
+        }
+        for (uint32_t i = 0; i < k_hll_regs; i += 4){
+            uint32_t v = regs[i] | regs[i + 1] << 6 | regs[i + 2] << 12 | (uint32_t)regs[i + 3] << 18;
+            uint8_t *b = &h->dense[i / 4 * 3];
+            b[0] = (uint8_t)v;
+            b[1] = (uint8_t)(v >> 8);
+            b[2] = (uint8_t)(v >> 16);
+        }
+    }
+    h->card = -1;
+}
+
+size_t hll_mem(const Hll *h){
+    return h->sparse.capacity() * sizeof(uint32_t) + (h->dense ? k_hll_dense_alloc : 0);
+}
+
+void hll_dispose(Hll *h){
+    free(h->dense);
+    h->dense = NULL;
+    std::vector<uint32_t>().swap(h->sparse);
+    h->enc = HLL_SPARSE;
+    h->card = -1;
+}
+
+void hll_encode(const Hll *h, std::string &out){
+    out.append(k_hll_magic, 4);
+    out.push_back((char)h->enc);
+    out.append(3, '\0');
+    if (h->enc == HLL_SPARSE){
+        out.append((const char *)h->sparse.data(), h->sparse.size() * sizeof(uint32_t));
+    } else {
+        out.append((const char *)h->dense, k_hll_dense_bytes);
+    }
+}
+
+bool hll_decode(Hll *h, const char *data, size_t len){
+    if (len < 8 || 0 != memcmp(data, k_hll_magic, 4)) return false;
+    uint8_t enc = (uint8_t)data[4];
+    data += 8;
+    len -= 8;
+    if (enc == HLL_SPARSE){
+        if (len % sizeof(uint32_t)) return false;
+        h->sparse.resize(len / sizeof(uint32_t));
+        memcpy(h->sparse.data(), data, len);
+        for (size_t i = 0; i < h->sparse.size(); ++i){
+            uint32_t e = h->sparse[i];
+            bool sorted = i == 0 || (h->sparse[i - 1] >> 6) < (e >> 6);
+            if ((e >> 6) >= k_hll_regs || (e & 63) == 0 || (e & 63) > k_hll_q + 1 || !sorted) return false;
+        }
+        return true;
+    }
+    if (enc != HLL_DENSE || len != k_hll_dense_bytes) return false;
+    h->enc = HLL_DENSE;
+    h->dense = (uint8_t *)calloc(1, k_hll_dense_alloc);
+    memcpy(h->dense, data, len);
+    for (uint32_t i = 0; i < k_hll_regs; ++i){
+        if (dense_get(h->dense, i) > k_hll_q + 1) return false;
+    }
+    return true;
+}
+
+const char *hll_kernel(){
+    pick_kernels();
+    return g_kernel_name;
+}
@@ -0,0 +1,196 @@
+#include "intersect.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+// skewed sizes: binary search each member of the small side in the big one
+const size_t k_gallop_ratio = 32;
+
+template <class T>
+static size_t merge_tail(const T *a, size_t na, const T *b, size_t nb, T *out){
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb){
+        if (a[i] < b[j]){
+            i++;
+        } else if (b[j] < a[i]){
+            j++;
+        } else {
+            out[k++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    return k;
+}
+
+template <class T>
+static size_t gallop(const T *small, size_t ns, const T *big, size_t nb, T *out){
+    size_t k = 0;
+    size_t lo = 0;
+    for (size_t i = 0; i < ns && lo < nb; ++i){
+        // exponential probe, then binary search in the bracketed range
+        size_t step = 1;
+        size_t hi = lo;
+        while (hi < nb && big[hi] < small[i]){
+            lo = hi + 1;
+            hi += step;
+            step *= 2;
+        }
+        if (hi > nb) hi = nb;
+        while (lo < hi){
+            size_t mid = (lo + hi) / 2;
+            if (big[mid] < small[i]){
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < nb && big[lo] == small[i]){
+            out[k++] = small[i];
+            lo++;
+        }
+    }
+    return k;
+}
+
+template <class T>
+static bool skewed(const T *a, size_t na, const T *b, size_t nb, T *out, size_t *k){
+    if (na * k_gallop_ratio < nb){
+        *k = gallop(a, na, b, nb, out);
+        return true;
+    }
+    if (nb * k_gallop_ratio < na){
+        *k = gallop(b, nb, a, na, out);
+        return true;
+    }
+    return false;
+}
+
+size_t intersect_i32_scalar(const int32_t *a, size_t na, const int32_t *b, size_t nb, int32_t *out){
+    return merge_tail(a, na, b, nb, out);
+}
+
+size_t intersect_i64(const int64_t *a, size_t na, const int64_t *b, size_t nb, int64_t *out){
+    size_t k = 0;
+    if (skewed(a, na, b, nb, out, &k)) return k;
+    return merge_tail(a, na, b, nb, out);
+}
+
+// shuffle masks packing the selected lanes of a vector to the front, by lane bitmask
+static __m128i g_pack4[16];
+static __m256i g_pack8[256];
+
+static void init_tables(){
+    for (int mask = 0; mask < 16; ++mask){
+        uint8_t bytes[16];
+        memset(bytes, 0x80, sizeof(bytes)); // zeroes the unused lanes
+        int k = 0;
+        for (int lane = 0; lane < 4; ++lane){
+            if (mask & (1 << lane)){
+                for (int b = 0; b < 4; ++b){
+                    bytes[k * 4 + b] = (uint8_t)(lane * 4 + b);
+                }
+                k++;
+            }
+        }
+        memcpy(&g_pack4[mask], bytes, 16);
+    }
+    for (int mask = 0; mask < 256; ++mask){
+        int32_t idx[8] = {};
+        int k = 0;
+        for (int lane = 0; lane < 8; ++lane){
+            if (mask & (1 << lane)){
+                idx[k++] = lane;
+            }
+        }
+        memcpy(&g_pack8[mask], idx, 32);
+    }
+}
+
+__attribute__((target("ssse3,popcnt")))
+static size_t intersect_i32_ssse3(const int32_t *a, size_t na, const int32_t *b, size_t nb, int32_t *out){
+    size_t k = 0;
+    if (skewed(a, na, b, nb, out, &k)) return k;
+    size_t i = 0, j = 0;
+    while (i + 4 <= na && j + 4 <= nb){
+        __m128i va = _mm_loadu_si128((const __m128i *)&a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i *)&b[j]);
+        // compare every member of `va` with every member of `vb`, via the 4 rotations of `vb`
+        __m128i eq = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+            _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+        _mm_storeu_si128((__m128i *)&out[k], _mm_shuffle_epi8(va, g_pack4[mask]));
+        k += _mm_popcnt_u32(mask);
+        // drop the block(s) whose largest member can't match anything further
+        int32_t amax = a[i + 3];
+        int32_t bmax = b[j + 3];
+        if (amax <= bmax) i += 4;
+        if (bmax <= amax) j += 4;
+    }
+    return k + merge_tail(&a[i], na - i, &b[j], nb - j, &out[k]);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t intersect_i32_avx2(const int32_t *a, size_t na, const int32_t *b, size_t nb, int32_t *out){
+    size_t k = 0;
+    if (skewed(a, na, b, nb, out, &k)) return k;
+    const __m256i rot = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    size_t i = 0, j = 0;
+    while (i + 8 <= na && j + 8 <= nb){
+        __m256i va = _mm256_loadu_si256((const __m256i *)&a[i]);
+        __m256i vb = _mm256_loadu_si256((const __m256i *)&b[j]);
+        // compare against the 8 rotations of `vb`
+        __m256i eq = _mm256_cmpeq_epi32(va, vb);
+        for (int r = 1; r < 8; ++r){
+            vb = _mm256_permutevar8x32_epi32(vb, rot);
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(va, vb));
+        }
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        _mm256_storeu_si256((__m256i *)&out[k], _mm256_permutevar8x32_epi32(va, g_pack8[mask]));
+        k += _mm_popcnt_u32(mask);
+        int32_t amax = a[i + 7];
+        int32_t bmax = b[j + 7];
+        if (amax <= bmax) i += 8;
+        if (bmax <= amax) j += 8;
+    }
+    return k + merge_tail(&a[i], na - i, &b[j], nb - j, &out[k]);
+}
+
+static size_t intersect_i32_plain(const int32_t *a, size_t na, const int32_t *b, size_t nb, int32_t *out){
+    size_t k = 0;
+    if (skewed(a, na, b, nb, out, &k)) return k;
+    return merge_tail(a, na, b, nb, out);
+}
+
+typedef size_t (*IntersectFn)(const int32_t *, size_t, const int32_t *, size_t, int32_t *);
+
+static IntersectFn g_kernel = NULL;
+static const char *g_kernel_name = "scalar";
+
+static IntersectFn pick_kernel(){
+    if (!g_kernel){
+        init_tables();
+        __builtin_cpu_init();
+        g_kernel = &intersect_i32_plain;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")){
+            g_kernel = &intersect_i32_avx2;
+            g_kernel_name = "avx2";
+        } else if (__builtin_cpu_supports("ssse3") && __builtin_cpu_supports("popcnt")){
+            g_kernel = &intersect_i32_ssse3;
+            g_kernel_name = "ssse3";
+        }
+    }
+    return g_kernel;
+}
+
+size_t intersect_i32(const int32_t *a, size_t na, const int32_t *b, size_t nb, int32_t *out){
+    return pick_kernel()(a, na, b, nb, out);
+}
+
+const char *intersect_kernel(){
+    pick_kernel();
+    return g_kernel_name;
+}
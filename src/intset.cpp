@@ -0,0 +1,150 @@
+#include "intset.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t width_of(int64_t val){
+    if (val >= INT16_MIN && val <= INT16_MAX) return 2;
+    if (val >= INT32_MIN && val <= INT32_MAX) return 4;
+    return 8;
+}
+
+static int64_t get_at(const uint8_t *data, uint32_t width, size_t i){
+    switch (width){
+        case 2: { int16_t v; memcpy(&v, &data[i * 2], 2); return v; }
+        case 4: { int32_t v; memcpy(&v, &data[i * 4], 4); return v; }
+        default: { int64_t v; memcpy(&v, &data[i * 8], 8); return v; }
+    }
+}
+
+static void set_at(uint8_t *data, uint32_t width, size_t i, int64_t val){
+    switch (width){
+        case 2: { int16_t v = (int16_t)val; memcpy(&data[i * 2], &v, 2); break; }
+        case 4: { int32_t v = (int32_t)val; memcpy(&data[i * 4], &v, 4); break; }
+        default: memcpy(&data[i * 8], &val, 8); break;
+    }
+}
+
+// make room for `n` members of `width` bytes, converting existing members if the width grows
+static void intset_reserve(IntSet *is, size_t n, uint32_t width){
+    if (width < is->width) width = is->width;
+    if (width == is->width && n <= is->cap) return;
+    size_t cap = is->cap;
+    while (cap < n){
+        cap = cap < 4 ? 4 : cap * 2;
+    }
+    if (width == is->width){
+        is->data = (uint8_t *)realloc(is->data, cap * width);
+        assert(is->data);
+    } else { // upgrade, back to front so a member is never overwritten before it is read
+        uint8_t *data = (uint8_t *)realloc(is->data, cap * width);
+        assert(data);
+        for (size_t i = is->n; i-- > 0;){
+            set_at(data, width, i, get_at(data, is->width, i));
+        }
+        is->data = data;
+        is->width = width;
+    }
+    is->cap = cap;
+}
+
+int64_t intset_get(const IntSet *is, size_t i){
+    return get_at(is->data, is->width, i);
+}
+
+bool intset_find(const IntSet *is, int64_t val, size_t *pos){
+    size_t lo = 0;
+    size_t hi = is->n;
+    while (lo < hi){
+        size_t mid = (lo + hi) / 2;
+        int64_t cur = get_at(is->data, is->width, mid);
+        if (cur == val){
+            *pos = mid;
+            return true;
+        }
+        if (cur < val){
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return false;
+}
+
+bool intset_add(IntSet *is, int64_t val){
+    size_t pos = 0;
+    if (width_of(val) <= is->width && intset_find(is, val, &pos)){
+        return false;
+    }
+    if (width_of(val) > is->width){ // too wide to be a member, goes to either end
+        intset_reserve(is, is->n + 1, width_of(val));
+        pos = val < 0 ? 0 : is->n;
+    } else {
+        intset_reserve(is, is->n + 1, is->width);
+    }
+    uint32_t w = is->width;
+    memmove(&is->data[(pos + 1) * w], &is->data[pos * w], (is->n - pos) * w);
+    set_at(is->data, w, pos, val);
+    is->n++;
+    return true;
+}
+
+size_t intset_add_sorted(IntSet *is, const int64_t *vals, size_t n){
+    if (n == 0) return 0;
+    uint32_t width = is->width;
+    if (width_of(vals[0]) > width) width = width_of(vals[0]);
+    if (width_of(vals[n - 1]) > width) width = width_of(vals[n - 1]);
+    intset_reserve(is, is->n + n, width);
+
+    // merge from the back into the grown array, so nothing is overwritten before it is read
+    uint32_t w = is->width;
+    size_t i = is->n;       // members left
+    size_t j = n;           // values left
+    size_t k = is->n + n;   // write position
+    while (j > 0){
+        if (j > 1 && vals[j - 1] == vals[j - 2]){ // skip duplicated values
+            j--;
+            continue;
+        }
+        int64_t v = vals[j - 1];
+        int64_t cur = i > 0 ? get_at(is->data, w, i - 1) : INT64_MIN;
+        if (i > 0 && cur > v){
+            set_at(is->data, w, --k, cur);
+            i--;
+        } else {
+            if (i > 0 && cur == v){ // already a member
+                i--;
+            }
+            set_at(is->data, w, --k, v);
+            j--;
+        }
+    }
+    while (i > 0){
+        i--;
+        set_at(is->data, w, --k, get_at(is->data, w, i));
+    }
+    // `k` is now the number of slots left unused at the front
+    size_t total = is->n + n - k;
+    size_t added = total - is->n;
+    memmove(is->data, &is->data[k * w], total * w);
+    is->n = total;
+    return added;
+}
+
+bool intset_del(IntSet *is, int64_t val){
+    size_t pos = 0;
+    if (width_of(val) > is->width || !intset_find(is, val, &pos)){
+        return false;
+    }
+    uint32_t w = is->width;
+    memmove(&is->data[pos * w], &is->data[(pos + 1) * w], (is->n - pos - 1) * w);
+    is->n--;
+    return true;
+}
+
+void intset_dispose(IntSet *is){
+    free(is->data);
+    *is = IntSet{};
+}
@@ -0,0 +1,304 @@
+#include "keystats.h"
+#include "server_utils.h"
+#include "heap.h"
+#include "config.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+uint64_t g_hot_countdown = UINT64_MAX;
+
+// the top-k keys, `heap_idx` is their position in `g_hot_heap`
+struct HotKey {
+    std::string key;
+    uint64_t hcode = 0;
+    size_t heap_idx = 0;
+};
+
+static std::vector<uint32_t> g_cms;             // k_hot_depth rows of k_hot_width counters, allocated on first sample
+static HotKey g_hot[k_hot_topk];
+static HeapItem g_hot_heap[k_hot_topk];         // min-heap of the estimates, the weakest key on top
+static size_t g_hot_n = 0;
+static uint64_t g_hot_samples = 0;
+static int64_t g_hot_rate = 0;                  // rate the countdown follows
+static int64_t g_hot_scale = 1;                 // last rate > 0, to turn samples back into lookups
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+static uint64_t hot_rand(){
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+// uniform in [1, 2 * rate - 1], one lookup in `rate` on average
+static uint64_t hot_next(){
+    uint64_t span = 2 * (uint64_t)g_hot_rate - 1;
+    return 1 + hot_rand() % span;
+}
+
+// `str_hash` is not mixed enough for its bits to index independent rows
+static uint64_t hot_mix(uint64_t h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// count one more occurrence and return the new estimate
+static uint32_t cms_add(uint64_t hcode){
+    if (g_cms.empty()){
+        g_cms.assign(k_hot_depth * k_hot_width, 0);
+    }
+    uint64_t h = hot_mix(hcode);
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h >> 32) | 1;
+    uint32_t *c[k_hot_depth];
+    uint32_t est = UINT32_MAX;
+    for (size_t d = 0; d < k_hot_depth; ++d){
+        c[d] = &g_cms[d * k_hot_width + ((h1 + (uint32_t)d * h2) & (k_hot_width - 1))];
+        est = std::min(est, *c[d]);
+    }
+    // conservative update: only the counters at the minimum grow, which limits the overestimation
+    if (est < UINT32_MAX) est++;
+    for (size_t d = 0; d < k_hot_depth; ++d){
+        if (*c[d] < est) *c[d] = est;
+    }
+    return est;
+}
+
+static void hot_decay(){
+    for (uint32_t &c : g_cms){
+        c >>= 1;
+    }
+    for (size_t i = 0; i < g_hot_n; ++i){ // halving all keeps the heap order
+        g_hot_heap[i].val >>= 1;
+    }
+}
+
+void hotkeys_sample(const std::string &key, uint64_t hcode){
+    g_hot_countdown = g_hot_rate > 0 ? hot_next() : UINT64_MAX;
+    uint32_t est = cms_add(hcode);
+    if (++g_hot_samples % k_hot_decay == 0){
+        hot_decay();
+    }
+
+    for (size_t i = 0; i < g_hot_n; ++i){
+        HotKey &hk = g_hot[i];
+        if (hk.hcode == hcode && hk.key == key){
+            g_hot_heap[hk.heap_idx].val = est;
+            heap_update(g_hot_heap, hk.heap_idx, g_hot_n);
+            return;
+        }
+    }
+    if (g_hot_n < k_hot_topk){
+        HotKey &hk = g_hot[g_hot_n];
+        hk.key = key;
+        hk.hcode = hcode;
+        hk.heap_idx = g_hot_n;
+        g_hot_heap[g_hot_n].val = est;
+        g_hot_heap[g_hot_n].ref = &hk.heap_idx;
+        g_hot_n++;
+        heap_update(g_hot_heap, g_hot_n - 1, g_hot_n);
+    } else if (est > g_hot_heap[0].val){ // evict the weakest
+        HotKey *hk = container_of(g_hot_heap[0].ref, HotKey, heap_idx);
+        hk->key = key;
+        hk->hcode = hcode;
+        g_hot_heap[0].val = est;
+        heap_update(g_hot_heap, 0, g_hot_n);
+    }
+}
+
+// Big keys
+
+const size_t k_big_types = T_STREAM + 1;
+
+static const char *const k_type_names[k_big_types] = {
+    "string", "zset", "list", "hash", "set", "hll", "bloom", "cuckoo", "stream",
+};
+
+struct BigKey {
+    std::string key;
+    uint32_t type = 0;
+    size_t mem = 0;
+};
+
+struct BigScan {
+    std::vector<BigKey> top;                // the largest keys, unordered while scanning
+    BigKey largest[k_big_types];            // per type
+    uint64_t type_keys[k_big_types] = {};
+    uint64_t type_mem[k_big_types] = {};
+    uint64_t keys = 0;
+    uint64_t done_ms = 0;                   // when the scan ended
+};
+
+static BigScan g_scan;                      // running
+static BigScan g_big;                       // last finished
+static bool g_scan_on = false;
+static size_t g_scan_tab = 0;               // 0: `tb1`, 1: `tb2` (the table being emptied)
+static size_t g_scan_pos = 0;               // next bucket
+static HNode **g_scan_tb1 = NULL;           // `tb1` when the scan started, a resize replaces it
+
+static void big_visit(Entry *ent){
+    BigScan &s = g_scan;
+    uint32_t type = ent->type < k_big_types ? ent->type : (uint32_t)T_STR;
+    s.keys++;
+    s.type_keys[type]++;
+    s.type_mem[type] += ent->mem;
+    if (ent->mem > s.largest[type].mem){
+        s.largest[type].key = ent->key;
+        s.largest[type].type = type;
+        s.largest[type].mem = ent->mem;
+    }
+
+    size_t slot = s.top.size();
+    if (slot == k_big_top){
+        slot = 0;
+        for (size_t i = 1; i < s.top.size(); ++i){
+            if (s.top[i].mem < s.top[slot].mem) slot = i;
+        }
+        if (ent->mem <= s.top[slot].mem) return;
+    }
+    if (slot == s.top.size()){
+        s.top.emplace_back();
+    }
+    s.top[slot].key = ent->key;
+    s.top[slot].type = type;
+    s.top[slot].mem = ent->mem;
+}
+
+static void big_finish(){
+    g_scan_on = false;
+    g_scan.done_ms = g_data.now_ms;
+    std::sort(g_scan.top.begin(), g_scan.top.end(), [](const BigKey &a, const BigKey &b){
+        return a.mem > b.mem;
+    });
+    g_big = std::move(g_scan);
+    g_scan = BigScan();
+}
+
+static void big_start(){
+    g_scan = BigScan();
+    g_scan_on = true;
+    g_scan_tab = 0;
+    g_scan_pos = 0;
+    g_scan_tb1 = g_data.db.tb1.tab;
+}
+
+static void big_step(){
+    HMap &db = g_data.db;
+    if (db.tb1.tab != g_scan_tb1){
+        // the walked `tb1` became `tb2` and would be walked again, skewing the totals
+        big_start();
+    }
+    size_t budget = k_big_step;
+    while (budget){
+        HTab *t = g_scan_tab == 0 ? &db.tb1 : &db.tb2;
+        if (!t->tab || g_scan_pos > t->mask){
+            if (g_scan_tab == 1){
+                return big_finish();
+            }
+            g_scan_tab = 1;
+            g_scan_pos = 0;
+            continue;
+        }
+        for (HNode *node = t->tab[g_scan_pos]; node; node = node->next){
+            big_visit(container_of(node, Entry, node));
+        }
+        g_scan_pos++;
+        budget--;
+    }
+}
+
+void keystats_tick(){
+    int64_t rate = g_config.hotkeys_sample_rate > 0 ? g_config.hotkeys_sample_rate : 0;
+    if (rate != g_hot_rate){
+        g_hot_rate = rate;
+        if (rate) g_hot_scale = rate;
+        g_hot_countdown = rate ? hot_next() : UINT64_MAX;
+    }
+    if (g_scan_on){
+        big_step();
+    }
+}
+
+void do_hotkeys(std::vector<std::string>& cmd, std::string &out){
+    if (cmd.size() == 2 && cmd_is(cmd[1], "reset")){
+        std::vector<uint32_t>().swap(g_cms);
+        for (size_t i = 0; i < g_hot_n; ++i){
+            std::string().swap(g_hot[i].key);
+        }
+        g_hot_n = 0;
+        g_hot_samples = 0;
+        return out_nil(out);
+    }
+    int64_t count = 10;
+    if (cmd.size() > 2 || (cmd.size() == 2 && (!parse_int(cmd[1], count) || count < 0))){
+        return out_err(out, ERR_ARG, "expect HOTKEYS [count] | HOTKEYS RESET");
+    }
+    std::vector<size_t> order(g_hot_n);
+    for (size_t i = 0; i < g_hot_n; ++i){
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [](size_t a, size_t b){
+        return g_hot_heap[g_hot[a].heap_idx].val > g_hot_heap[g_hot[b].heap_idx].val;
+    });
+    size_t n = (uint64_t)count < g_hot_n ? (size_t)count : g_hot_n;
+    out_arr(out, (uint32_t)n);
+    for (size_t i = 0; i < n; ++i){ // [key, estimated lookups]
+        const HotKey &hk = g_hot[order[i]];
+        out_arr(out, 2);
+        out_str(out, hk.key);
+        out_int(out, (int64_t)(g_hot_heap[hk.heap_idx].val * (uint64_t)g_hot_scale));
+    }
+}
+
+static void out_bigkey(std::string &out, const BigKey &b){
+    out_arr(out, 3);
+    out_str(out, b.key);
+    out_str(out, k_type_names[b.type]);
+    out_int(out, (int64_t)b.mem);
+}
+
+void do_bigkeys(std::vector<std::string>& cmd, std::string &out){
+    if (cmd.size() == 2 && cmd_is(cmd[1], "scan")){ // (re)start
+        big_start();
+        return out_nil(out);
+    }
+    if (cmd.size() == 2 && cmd_is(cmd[1], "status")){ // [scanning, keys seen so far, unix time of the last result or -1]
+        out_arr(out, 3);
+        out_int(out, g_scan_on ? 1 : 0);
+        out_int(out, (int64_t)g_scan.keys);
+        out_int(out, g_big.done_ms ? (int64_t)(g_big.done_ms / 1000) : -1);
+        return;
+    }
+    if (cmd.size() == 2 && cmd_is(cmd[1], "types")){ // [type, keys, bytes, largest key, its bytes]
+        uint32_t n = 0;
+        for (size_t t = 0; t < k_big_types; ++t){
+            n += g_big.type_keys[t] ? 1 : 0;
+        }
+        out_arr(out, n);
+        for (size_t t = 0; t < k_big_types; ++t){
+            if (!g_big.type_keys[t]) continue;
+            out_arr(out, 5);
+            out_str(out, k_type_names[t]);
+            out_int(out, (int64_t)g_big.type_keys[t]);
+            out_int(out, (int64_t)g_big.type_mem[t]);
+            out_str(out, g_big.largest[t].key);
+            out_int(out, (int64_t)g_big.largest[t].mem);
+        }
+        return;
+    }
+    int64_t count = 10;
+    if (cmd.size() > 2 || (cmd.size() == 2 && (!parse_int(cmd[1], count) || count < 0))){
+        return out_err(out, ERR_ARG, "expect BIGKEYS [count] | BIGKEYS SCAN | BIGKEYS STATUS | BIGKEYS TYPES");
+    }
+    size_t n = (uint64_t)count < g_big.top.size() ? (size_t)count : g_big.top.size();
+    out_arr(out, (uint32_t)n);
+    for (size_t i = 0; i < n; ++i){ // largest first
+        out_bigkey(out, g_big.top[i]);
+    }
+}
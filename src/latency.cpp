@@ -0,0 +1,351 @@
+#include "latency.h"
+#include "server_utils.h"
+#include "config.h"
+
+#include <execinfo.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+// a (cycles, ns) reading at startup, the ratio is measured from there
+static uint64_t g_base_cycles = 0;
+static uint64_t g_base_ns = 0;
+
+void lat_init(){
+    g_base_cycles = lat_now();
+    g_base_ns = get_mono_ns();
+}
+
+double lat_cycles_ns(uint64_t cycles){
+    uint64_t ns = get_mono_ns() - g_base_ns;
+    if (ns < 1000000){ // too short a baseline (or none), wait for 1 ms
+        if (!g_base_ns) lat_init();
+        uint64_t deadline = get_mono_ns() + 1000000;
+        while (get_mono_ns() < deadline){}
+        ns = get_mono_ns() - g_base_ns;
+    }
+    uint64_t elapsed = lat_now() - g_base_cycles;
+    return elapsed ? (double)cycles * (double)ns / (double)elapsed : 0;
+}
+
+// the highest value counted in a bucket
+static uint64_t bucket_max(size_t i){
+    if (i < (1u << k_lat_sub_bits)) return i;
+    uint32_t e = (uint32_t)(i >> k_lat_sub_bits) + k_lat_sub_bits - 1;
+    uint64_t sub = i & ((1u << k_lat_sub_bits) - 1);
+    uint64_t width = 1ull << (e - k_lat_sub_bits);
+    return (((1ull << k_lat_sub_bits) + sub) << (e - k_lat_sub_bits)) + width - 1;
+}
+
+uint64_t lat_quantile(const LatHist *h, double q){
+    if (!h->count) return 0;
+    uint64_t rank = (uint64_t)(q * (double)h->count + 0.999999);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < k_lat_buckets; ++i){
+        seen += h->buckets[i];
+        if (seen >= rank){
+            uint64_t v = bucket_max(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+void lat_cumulative(const LatHist *h, const uint64_t *bounds, size_t n, uint64_t *counts){
+    uint64_t seen = 0;
+    size_t i = 0;
+    for (size_t b = 0; b < n; ++b){
+        while (i < k_lat_buckets && bucket_max(i) <= bounds[b]){
+            seen += h->buckets[i++];
+        }
+        counts[b] = seen;
+    }
+}
+
+// Latency events
+struct LatSample {
+    uint64_t time_ms = 0;
+    uint64_t usec = 0;
+};
+
+struct LatEventLog {
+    uint64_t worst = 0;     // in cycles, kept whatever the threshold
+    uint64_t worst_time_ms = 0;
+    LatSample history[k_lat_history];   // samples over the threshold, `n` of them ending before `pos`
+    size_t pos = 0;
+    size_t n = 0;
+};
+
+static const char *const k_lat_ev_names[LAT_EV_COUNT] = {
+    "loop", "command", "expire", "resize", "eviction", "persistence",
+};
+
+uint64_t g_lat_floor[LAT_EV_COUNT] = {};
+thread_local bool g_lat_quiet = false;
+static LatEventLog g_lat_events[LAT_EV_COUNT];
+static uint64_t g_lat_threshold = UINT64_MAX;   // latency-monitor-threshold in cycles, UINT64_MAX when off
+
+// the event loop
+static LatHist g_loop_hist;
+static uint64_t g_loop_start = 0;
+static uint64_t g_loop_iters = 0;
+static uint64_t g_loop_events = 0;
+static uint64_t g_loop_max_events = 0;
+
+// settings the thresholds were computed for
+static int64_t g_lat_ms = -1;
+static int64_t g_watchdog_ms = 0;
+static timer_t g_watchdog_timer;
+static bool g_watchdog_timer_ok = false;
+
+// glibc only names it since 2.35
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+static uint64_t g_lat_calc_ms = 0;
+
+static void lat_set_floor(uint32_t ev){
+    uint64_t worst = g_lat_events[ev].worst;
+    g_lat_floor[ev] = worst + 1 < g_lat_threshold ? worst + 1 : g_lat_threshold;
+}
+
+void lat_event_push(uint32_t ev, uint64_t cycles){
+    LatEventLog &log = g_lat_events[ev];
+    if (cycles > log.worst){
+        log.worst = cycles;
+        log.worst_time_ms = g_data.now_ms;
+    }
+    if (cycles >= g_lat_threshold){
+        LatSample &smp = log.history[log.pos];
+        smp.time_ms = g_data.now_ms;
+        smp.usec = (uint64_t)(lat_cycles_ns(cycles) / 1000);
+        log.pos = (log.pos + 1) % k_lat_history;
+        if (log.n < k_lat_history) log.n++;
+    }
+    lat_set_floor(ev);
+}
+
+static void watchdog_handler(int){
+    static const char k_msg[] = "--- WATCHDOG: event loop iteration over watchdog-period, backtrace:\n";
+    ssize_t rv = write(STDERR_FILENO, k_msg, sizeof(k_msg) - 1);
+    (void)rv;
+    void *frames[64];
+    int n = backtrace(frames, 64);
+    backtrace_symbols_fd(frames, n, STDERR_FILENO);
+}
+
+// a process-wide SIGALRM lands on any thread that doesn't block it, e.g. an idle lazyfree or loader
+// thread; this timer signals the calling thread, the event loop, so the backtrace is the stuck one
+static void watchdog_timer_init(){
+    struct sigevent sev = {};
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGALRM;
+    sev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+    g_watchdog_timer_ok = 0 == timer_create(CLOCK_MONOTONIC, &sev, &g_watchdog_timer);
+    if (!g_watchdog_timer_ok){
+        msg("timer_create() failed, the watchdog is off");
+    }
+}
+
+// one-shot SIGALRM after `ms`, 0 disarms
+static void watchdog_arm(int64_t ms){
+    if (!g_watchdog_timer_ok) return;
+    struct itimerspec it = {};
+    it.it_value.tv_sec = ms / 1000;
+    it.it_value.tv_nsec = (ms % 1000) * 1000000;
+    timer_settime(g_watchdog_timer, 0, &it, NULL);
+}
+
+// follow the latency settings, once a second or when they change
+static void lat_tick(){
+    int64_t ms = g_config.latency_monitor_threshold;
+    if (g_config.watchdog_period != g_watchdog_ms){
+        if (g_config.watchdog_period > 0 && g_watchdog_ms <= 0){
+            void *frames[1];
+            backtrace(frames, 1);   // loads libgcc now, the signal handler must not allocate
+            struct sigaction sa = {};
+            sa.sa_handler = watchdog_handler;
+            sa.sa_flags = SA_RESTART;
+            sigemptyset(&sa.sa_mask);
+            sigaction(SIGALRM, &sa, NULL);
+            if (!g_watchdog_timer_ok){
+                watchdog_timer_init();
+            }
+        }
+        if (g_config.watchdog_period <= 0){
+            watchdog_arm(0);
+        }
+        g_watchdog_ms = g_config.watchdog_period;
+    }
+    if (ms == g_lat_ms && g_data.now_ms - g_lat_calc_ms < 1000){
+        return;
+    }
+    g_lat_ms = ms;
+    g_lat_calc_ms = g_data.now_ms;
+    if (ms <= 0){
+        g_lat_threshold = UINT64_MAX;
+    } else {
+        double ns_per_cycle = lat_cycles_ns(1000000) / 1000000;
+        g_lat_threshold = ns_per_cycle > 0 ? (uint64_t)((double)ms * 1000000 / ns_per_cycle) : 0;
+    }
+    for (uint32_t ev = 0; ev < LAT_EV_COUNT; ++ev){
+        lat_set_floor(ev);
+    }
+}
+
+void lat_loop_begin(){
+    g_loop_start = lat_now();
+    if (g_watchdog_ms > 0){
+        watchdog_arm(g_watchdog_ms);
+    }
+}
+
+void lat_loop_end(size_t n_events){
+    uint64_t busy = lat_now() - g_loop_start;
+    lat_add(&g_loop_hist, busy);
+    lat_event(LAT_EV_LOOP, busy);
+    g_loop_iters++;
+    g_loop_events += n_events;
+    if (n_events > g_loop_max_events) g_loop_max_events = n_events;
+    if (g_watchdog_ms > 0){
+        watchdog_arm(0);   // waiting in epoll is not a stall
+    }
+    lat_tick();
+}
+
+const LatHist *lat_loop_hist(){
+    return &g_loop_hist;
+}
+
+static int32_t lat_event_find(const std::string &name){
+    for (uint32_t ev = 0; ev < LAT_EV_COUNT; ++ev){
+        if (cmd_is(name, k_lat_ev_names[ev])) return (int32_t)ev;
+    }
+    return -1;
+}
+
+static void lat_event_reset(uint32_t ev){
+    g_lat_events[ev] = LatEventLog();
+    lat_set_floor(ev);
+}
+
+// [name, calls, p50, p99, p999, max], times in µs
+static void out_hist(std::string &out, const char *name, const LatHist *h){
+    out_arr(out, 6);
+    out_str(out, name, strlen(name));
+    out_int(out, (int64_t)h->count);
+    out_dbl(out, lat_cycles_ns(lat_quantile(h, 0.5)) / 1000);
+    out_dbl(out, lat_cycles_ns(lat_quantile(h, 0.99)) / 1000);
+    out_dbl(out, lat_cycles_ns(lat_quantile(h, 0.999)) / 1000);
+    out_dbl(out, lat_cycles_ns(h->max) / 1000);
+}
+
+// the commands named from cmd[2] on, or all of them, that have a histogram
+static std::vector<Command *> lat_select(std::vector<std::string>& cmd){
+    std::vector<Command *> sel;
+    if (cmd.size() > 2){
+        for (size_t i = 2; i < cmd.size(); ++i){
+            Command *c = cmd_lookup(cmd[i]);
+            if (c && c->hist) sel.push_back(c);
+        }
+        return sel;
+    }
+    size_t n = 0;
+    Command *cmds = cmd_table(&n);
+    for (size_t i = 0; i < n; ++i){
+        if (cmds[i].hist) sel.push_back(&cmds[i]);
+    }
+    return sel;
+}
+
+// LATENCY HISTOGRAM [command ...] | LATEST | HISTORY event | LOOP | RESET [command|event ...]
+void do_latency(std::vector<std::string>& cmd, std::string &out){
+    if (cmd_is(cmd[1], "histogram")){
+        std::vector<Command *> sel = lat_select(cmd);
+        out_arr(out, (uint32_t)sel.size());
+        for (Command *c : sel){
+            out_hist(out, c->name, c->hist);
+        }
+        return;
+    }
+    if (cmd_is(cmd[1], "latest") && cmd.size() == 2){
+        // [event, unix time of the latest sample, latest ms, worst ms ever] per class over the threshold
+        uint32_t n = 0;
+        for (uint32_t ev = 0; ev < LAT_EV_COUNT; ++ev){
+            n += g_lat_events[ev].n > 0;
+        }
+        out_arr(out, n);
+        for (uint32_t ev = 0; ev < LAT_EV_COUNT; ++ev){
+            const LatEventLog &log = g_lat_events[ev];
+            if (!log.n) continue;
+            const LatSample &last = log.history[(log.pos + k_lat_history - 1) % k_lat_history];
+            out_arr(out, 4);
+            out_str(out, k_lat_ev_names[ev], strlen(k_lat_ev_names[ev]));
+            out_int(out, (int64_t)(last.time_ms / 1000));
+            out_dbl(out, (double)last.usec / 1000);
+            out_dbl(out, lat_cycles_ns(log.worst) / 1e6);
+        }
+        return;
+    }
+    if (cmd_is(cmd[1], "history") && cmd.size() == 3){
+        int32_t ev = lat_event_find(cmd[2]);
+        if (ev < 0){
+            return out_err(out, ERR_ARG, "unknown event, expect loop|command|expire|resize|eviction|persistence");
+        }
+        // [unix time, ms] oldest first
+        const LatEventLog &log = g_lat_events[ev];
+        out_arr(out, (uint32_t)log.n);
+        for (size_t i = 0; i < log.n; ++i){
+            const LatSample &smp = log.history[(log.pos + k_lat_history - log.n + i) % k_lat_history];
+            out_arr(out, 2);
+            out_int(out, (int64_t)(smp.time_ms / 1000));
+            out_dbl(out, (double)smp.usec / 1000);
+        }
+        return;
+    }
+    if (cmd_is(cmd[1], "loop") && cmd.size() == 2){
+        // [iterations, events, most events in one iteration, busy p50, p99, p999, max µs]
+        out_arr(out, 7);
+        out_int(out, (int64_t)g_loop_iters);
+        out_int(out, (int64_t)g_loop_events);
+        out_int(out, (int64_t)g_loop_max_events);
+        out_dbl(out, lat_cycles_ns(lat_quantile(&g_loop_hist, 0.5)) / 1000);
+        out_dbl(out, lat_cycles_ns(lat_quantile(&g_loop_hist, 0.99)) / 1000);
+        out_dbl(out, lat_cycles_ns(lat_quantile(&g_loop_hist, 0.999)) / 1000);
+        out_dbl(out, lat_cycles_ns(g_loop_hist.max) / 1000);
+        return;
+    }
+    if (cmd_is(cmd[1], "reset")){
+        // commands and event classes by name, everything without names
+        std::vector<Command *> sel = lat_select(cmd);
+        for (Command *c : sel){
+            *c->hist = LatHist();
+        }
+        int64_t n = (int64_t)sel.size();
+        for (uint32_t ev = 0; ev < LAT_EV_COUNT; ++ev){
+            bool named = false;
+            for (size_t i = 2; i < cmd.size() && !named; ++i){
+                named = lat_event_find(cmd[i]) == (int32_t)ev;
+            }
+            if (cmd.size() == 2 || named){
+                lat_event_reset(ev);
+                n++;
+            }
+        }
+        bool loop = cmd.size() == 2;
+        for (size_t i = 2; i < cmd.size(); ++i){
+            loop = loop || cmd_is(cmd[i], "loop");
+        }
+        if (loop){ // the loop histogram goes with the loop event class
+            g_loop_hist = LatHist();
+            g_loop_iters = g_loop_events = g_loop_max_events = 0;
+        }
+        return out_int(out, n);
+    }
+    out_err(out, ERR_ARG, "expect LATENCY HISTOGRAM [command ...] | LATEST | HISTORY event | LOOP | RESET [name ...]");
+}
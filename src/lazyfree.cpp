@@ -0,0 +1,73 @@
+#include "lazyfree.h"
+#include "zset.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <atomic>
+
+const size_t k_lazyfree_page = 4096;         // bytes of a flat buffer counted as one unit of free effort
+
+static std::atomic<HNode *> g_stack(NULL);   // entries to free, linked by `node.next`
+static std::atomic<size_t> g_pending(0);
+static sem_t g_wake;
+
+static void *reclaim_worker(void *arg){
+    (void)arg;
+    while (true){
+        while (sem_wait(&g_wake) != 0 && errno == EINTR){}
+        // take everything pushed so far, a later post finds the stack empty
+        HNode *node = g_stack.exchange(NULL, std::memory_order_acquire);
+        while (node){
+            HNode *next = node->next;
+            entry_free(container_of(node, Entry, node));
+            g_pending.fetch_sub(1, std::memory_order_relaxed);
+            node = next;
+        }
+    }
+    return NULL;
+}
+
+void lazyfree_init(){
+    if (sem_init(&g_wake, 0, 0)){
+        die("sem_init()");
+    }
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, &reclaim_worker, NULL)){
+        die("pthread_create()");
+    }
+    pthread_detach(tid);
+}
+
+void lazyfree_push(Entry *ent){
+    g_pending.fetch_add(1, std::memory_order_relaxed);
+    HNode *head = g_stack.load(std::memory_order_relaxed);
+    do {
+        ent->node.next = head;
+    } while (!g_stack.compare_exchange_weak(head, &ent->node,
+                                            std::memory_order_release, std::memory_order_relaxed));
+    sem_post(&g_wake);
+}
+
+size_t lazyfree_pending(){
+    return g_pending.load(std::memory_order_relaxed);
+}
+
+size_t entry_free_effort(Entry *ent){
+    switch (ent->type){
+        case T_ZSET:
+            return zset_size(ent->zset);
+        case T_LIST:
+            return ent->list->n_chunks;
+        case T_HASH:
+            return ent->hash->enc == HASH_HMAP ? ent->hash->n : 1;
+        case T_SET:
+            return ent->set->enc == SET_HMAP ? set_size(ent->set) : 1;
+        case T_STREAM:
+            return ent->stream->blocks.size();
+        default:
+            // strings (bitmaps too), HLLs and filters are one or two flat buffers, but a big one is unmapped page by page
+            return 1 + ent->mem / k_lazyfree_page;
+    }
+}
@@ -0,0 +1,87 @@
+#include "memtrack.h"
+#include "server_utils.h"
+#include "lazyfree.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+MemCat g_mem[MEM_CAT_COUNT];
+
+size_t mem_rss(){
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long long pages = 0, resident = 0;
+    int n = fscanf(f, "%llu %llu", &pages, &resident);
+    fclose(f);
+    return n == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+void mem_allocator(size_t &allocated, size_t &active){
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = mallinfo2();
+    allocated = mi.uordblks + mi.hblkhd;
+    active = mi.arena + mi.hblkhd;
+#else
+    allocated = 0;
+    active = 0;
+#endif
+}
+
+static void stat_int(std::string &out, const char *name, size_t val){
+    out_str(out, name, strlen(name));
+    out_int(out, (int64_t)val);
+}
+
+static void stat_dbl(std::string &out, const char *name, double val){
+    out_str(out, name, strlen(name));
+    out_dbl(out, val);
+}
+
+void do_memory(std::vector<std::string>& cmd, std::string &out){
+    if (cmd.size() == 3 && cmd_is(cmd[1], "usage")){
+        Entry key;
+        key.key.swap(cmd[2]);
+        key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+        Entry *ent = entry_lookup(&key);
+        if (ent){
+            return out_int(out, (int64_t)entry_mem(ent));
+        }
+        SnapRecord *rec = snap_entry_lookup(&key);
+        if (rec){ // bytes of the mapped record
+            return out_int(out, (int64_t)(sizeof(SnapRecord) + rec->klen + rec->vlen));
+        }
+        return out_nil(out);
+    }
+    if (cmd.size() == 2 && cmd_is(cmd[1], "stats")){ // flat [name, value, ...]
+        const HMap &db = g_data.db;
+        size_t keys = db.tb1.size + db.tb2.size;
+        size_t allocated = 0, active = 0;
+        mem_allocator(allocated, active);
+        size_t rss = mem_rss();
+        out_arr(out, 2 * 18);
+        stat_int(out, "dataset.bytes", g_data.used_memory);
+        stat_int(out, "keys.count", keys);
+        stat_int(out, "keys.bytes-per-key", keys ? g_data.used_memory / keys : 0);
+        stat_int(out, "snapshot.keys", g_data.snap.n_live);
+        stat_int(out, "snapshot.mapped", g_data.snap.size);
+        stat_int(out, "overhead.hashtable.main", mem_size(db.tb1.tab) + mem_size(db.tb2.tab));
+        stat_int(out, "overhead.hashtables", g_mem[MEM_HTAB].bytes.load(std::memory_order_relaxed));
+        stat_int(out, "overhead.expires", g_data.heap.capacity() * sizeof(HeapItem));
+        stat_int(out, "zset.nodes", g_mem[MEM_ZNODE].allocs.load(std::memory_order_relaxed));
+        stat_int(out, "zset.nodes.bytes", g_mem[MEM_ZNODE].bytes.load(std::memory_order_relaxed));
+        stat_int(out, "clients.count", g_stats.conns);
+        stat_int(out, "clients.bytes", g_mem[MEM_CONN].bytes.load(std::memory_order_relaxed));
+        stat_int(out, "lazyfree.pending", lazyfree_pending());
+        stat_int(out, "allocator.allocated", allocated);
+        stat_int(out, "allocator.active", active);
+        stat_dbl(out, "allocator.fragmentation.ratio", allocated ? (double)active / (double)allocated : 0);
+        stat_int(out, "rss", rss);
+        stat_dbl(out, "rss.ratio", allocated ? (double)rss / (double)allocated : 0);
+        return;
+    }
+    out_err(out, ERR_ARG, "expect MEMORY USAGE key | MEMORY STATS");
+}
@@ -0,0 +1,311 @@
+#include "metrics.h"
+#include "server_utils.h"
+#include "blocking.h"
+#include "latency.h"
+#include "lazyfree.h"
+#include "memtrack.h"
+#include "stats.h"
+#include "config.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+
+const size_t k_metrics_hdr_room = 256;      // reserved before the body for the status line and headers
+
+// a scrape in progress, its buffers are reused by the next one
+struct MetricsConn {
+    int fd = -1;
+    bool writing = false;
+    uint64_t since_ms = 0;
+    size_t req_len = 0;
+    size_t out_pos = 0;                     // bytes of `out` left to send, from `out_pos` to `out_end`
+    size_t out_end = 0;
+    char req[k_metrics_req_max];
+    char out[k_metrics_buf];
+};
+
+static MetricsConn g_mconns[k_metrics_conns];
+static int g_metrics_fd = -1;
+
+// histogram bounds, in seconds
+static const double k_metrics_le[] = {
+    1e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2, 5e-2, 1e-1, 1,
+};
+const size_t k_metrics_n_le = sizeof(k_metrics_le) / sizeof(k_metrics_le[0]);
+
+int32_t metrics_init(int epfd){
+    if (g_config.metrics_port <= 0){
+        return 0;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0){
+        return -1;
+    }
+    int val = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)g_config.metrics_port);
+    addr.sin_addr.s_addr = htonl(0);
+    if (bind(fd, (const sockaddr *)&addr, sizeof(addr)) || listen(fd, SOMAXCONN)){
+        close(fd);
+        return -1;
+    }
+    fd_set_nb(fd);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    g_metrics_fd = fd;
+    return 0;
+}
+
+// Rendering
+
+struct MetricsOut {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool full;          // something did not fit, the output is unusable
+};
+
+static void mo_printf(MetricsOut &o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void mo_printf(MetricsOut &o, const char *fmt, ...){
+    if (o.full) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o.buf + o.len, o.cap - o.len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= o.cap - o.len){
+        o.full = true;
+        return;
+    }
+    o.len += (size_t)n;
+}
+
+static void mo_family(MetricsOut &o, const char *name, const char *type, const char *help){
+    mo_printf(o, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void mo_scalar(MetricsOut &o, const char *name, const char *type, const char *help, uint64_t val){
+    mo_family(o, name, type, help);
+    mo_printf(o, "%s %llu\n", name, (unsigned long long)val);
+}
+
+// the samples of one histogram, `labels` may be empty
+static void mo_hist(MetricsOut &o, const char *name, const char *labels, const LatHist *h, const uint64_t *bounds){
+    uint64_t counts[k_metrics_n_le];
+    lat_cumulative(h, bounds, k_metrics_n_le, counts);
+    const char *sep = labels[0] ? "," : "";
+    for (size_t i = 0; i < k_metrics_n_le; ++i){
+        mo_printf(o, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, sep, k_metrics_le[i],
+                  (unsigned long long)counts[i]);
+    }
+    mo_printf(o, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep, (unsigned long long)h->count);
+    const char *lbrace = labels[0] ? "{" : "";
+    const char *rbrace = labels[0] ? "}" : "";
+    mo_printf(o, "%s_sum%s%s%s %.9f\n", name, lbrace, labels, rbrace, lat_cycles_ns(h->sum) / 1e9);
+    mo_printf(o, "%s_count%s%s%s %llu\n", name, lbrace, labels, rbrace, (unsigned long long)h->count);
+}
+
+// the body of a scrape, false if it does not fit
+static bool metrics_render(MetricsOut &o){
+    const HMap &db = g_data.db;
+    size_t allocated = 0, active = 0;
+    mem_allocator(allocated, active);
+
+    mo_scalar(o, "nanoredis_uptime_seconds", "gauge", "Seconds since startup.",
+              (g_data.now_ms - g_stats.start_ms) / 1000);
+    mo_scalar(o, "nanoredis_connected_clients", "gauge", "Connected clients.", g_stats.conns);
+    mo_scalar(o, "nanoredis_blocked_clients", "gauge", "Clients waiting in a blocking command.", block_count());
+    mo_scalar(o, "nanoredis_connections_received_total", "counter", "Connections accepted.", g_stats.total_conns);
+    mo_scalar(o, "nanoredis_commands_processed_total", "counter", "Requests processed, rejected ones included.",
+              g_stats.commands);
+    mo_scalar(o, "nanoredis_commands_rejected_total", "counter", "Unknown, malformed or refused requests.",
+              g_stats.rejected);
+    mo_scalar(o, "nanoredis_net_input_bytes_total", "counter", "Bytes read from clients.", g_stats.net_in);
+    mo_scalar(o, "nanoredis_net_output_bytes_total", "counter", "Bytes written to clients.", g_stats.net_out);
+    mo_scalar(o, "nanoredis_memory_used_bytes", "gauge", "Bytes accounted to keys.", g_data.used_memory);
+    mo_scalar(o, "nanoredis_memory_max_bytes", "gauge", "maxmemory, 0 without a limit.",
+              g_config.maxmemory > 0 ? (uint64_t)g_config.maxmemory : 0);
+    mo_scalar(o, "nanoredis_memory_rss_bytes", "gauge", "Resident set size.", mem_rss());
+    mo_scalar(o, "nanoredis_allocator_allocated_bytes", "gauge", "Bytes in blocks handed out by malloc.", allocated);
+    mo_scalar(o, "nanoredis_allocator_active_bytes", "gauge", "Bytes malloc holds from the system.", active);
+    mo_scalar(o, "nanoredis_lazyfree_pending_objects", "gauge", "Values waiting to be freed in the background.",
+              lazyfree_pending());
+    mo_scalar(o, "nanoredis_keys", "gauge", "Keys, mapped snapshot included.",
+              db.tb1.size + db.tb2.size + g_data.snap.n_live);
+    mo_scalar(o, "nanoredis_expiring_keys", "gauge", "Keys with a TTL.", g_data.heap.size());
+
+    // bounds in cycles, from the current cycles-per-ns estimate
+    uint64_t bounds[k_metrics_n_le];
+    double ns_per_cycle = lat_cycles_ns(1000000000) / 1e9;
+    for (size_t i = 0; i < k_metrics_n_le; ++i){
+        bounds[i] = ns_per_cycle > 0 ? (uint64_t)(k_metrics_le[i] * 1e9 / ns_per_cycle) : 0;
+    }
+
+    size_t n = 0;
+    Command *cmds = cmd_table(&n);
+    mo_family(o, "nanoredis_command_calls_total", "counter", "Calls per command.");
+    for (size_t i = 0; i < n; ++i){
+        if (!cmds[i].calls) continue;
+        mo_printf(o, "nanoredis_command_calls_total{cmd=\"%s\"} %llu\n", cmds[i].name,
+                  (unsigned long long)cmds[i].calls);
+    }
+    mo_family(o, "nanoredis_command_duration_seconds", "histogram", "Time spent in command handlers.");
+    for (size_t i = 0; i < n; ++i){
+        if (!cmds[i].hist || !cmds[i].hist->count) continue;
+        char labels[64];
+        snprintf(labels, sizeof(labels), "cmd=\"%s\"", cmds[i].name);
+        mo_hist(o, "nanoredis_command_duration_seconds", labels, cmds[i].hist, bounds);
+    }
+    mo_family(o, "nanoredis_event_loop_busy_seconds", "histogram", "Busy time per event loop iteration.");
+    mo_hist(o, "nanoredis_event_loop_busy_seconds", "", lat_loop_hist(), bounds);
+    return !o.full;
+}
+
+// Connections
+
+static void metrics_close(MetricsConn &m, int epfd){
+    epoll_ctl(epfd, EPOLL_CTL_DEL, m.fd, NULL);
+    close(m.fd);
+    m.fd = -1;
+}
+
+static void metrics_write(MetricsConn &m, int epfd){
+    while (m.out_pos < m.out_end){
+        ssize_t rv = write(m.fd, m.out + m.out_pos, m.out_end - m.out_pos);
+        if (rv < 0 && errno == EINTR) continue;
+        if (rv < 0 && errno == EAGAIN) return;  // the rest goes on EPOLLOUT
+        if (rv <= 0) return metrics_close(m, epfd);
+        m.out_pos += (size_t)rv;
+    }
+    metrics_close(m, epfd);
+}
+
+// render the reply to a complete (or oversized) request and start sending it
+static void metrics_respond(MetricsConn &m, int epfd, bool too_long){
+    char *body = m.out + k_metrics_hdr_room;
+    MetricsOut o = {body, 0, sizeof(m.out) - k_metrics_hdr_room, false};
+    const char *status = "200 OK";
+    const char *path = m.req + 4;
+    size_t path_len = strcspn(path, " ?\r\n");
+    if (too_long){
+        status = "431 Request Header Fields Too Large";
+    } else if (strncmp(m.req, "GET ", 4)){
+        status = "405 Method Not Allowed";
+    } else if ((path_len == 8 && !strncmp(path, "/metrics", 8)) || (path_len == 1 && path[0] == '/')){
+        if (!metrics_render(o)){
+            status = "500 Internal Server Error";
+            o = MetricsOut{body, 0, o.cap, false};
+            mo_printf(o, "metrics do not fit in %zu bytes\n", o.cap);
+        }
+    } else {
+        status = "404 Not Found";
+    }
+    if (!o.len){ // errors get their status as body
+        mo_printf(o, "%s\n", status);
+    }
+
+    char hdr[k_metrics_hdr_room];
+    int hlen = snprintf(hdr, sizeof(hdr),
+        "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, o.len);
+    memcpy(body - hlen, hdr, (size_t)hlen);
+    m.out_pos = k_metrics_hdr_room - (size_t)hlen;
+    m.out_end = k_metrics_hdr_room + o.len;
+    m.writing = true;
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLOUT;
+    ev.data.fd = m.fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, m.fd, &ev);
+    metrics_write(m, epfd);
+}
+
+static void metrics_read(MetricsConn &m, int epfd){
+    while (true){
+        size_t room = k_metrics_req_max - 1 - m.req_len;
+        if (!room){
+            return metrics_respond(m, epfd, true);
+        }
+        ssize_t rv = read(m.fd, m.req + m.req_len, room);
+        if (rv < 0 && errno == EINTR) continue;
+        if (rv < 0 && errno == EAGAIN) return;
+        if (rv <= 0) return metrics_close(m, epfd);
+        m.req_len += (size_t)rv;
+        m.req[m.req_len] = '\0';
+        if (strstr(m.req, "\r\n\r\n")){ // the body of a GET, if any, is ignored
+            return metrics_respond(m, epfd, false);
+        }
+    }
+}
+
+static void metrics_accept(int epfd){
+    int fd = accept(g_metrics_fd, NULL, NULL);
+    if (fd < 0){
+        return;
+    }
+    MetricsConn *m = NULL;
+    for (MetricsConn &slot : g_mconns){
+        if (slot.fd < 0){
+            m = &slot;
+            break;
+        }
+    }
+    if (!m){ // all slots busy
+        close(fd);
+        return;
+    }
+    fd_set_nb(fd);
+    m->fd = fd;
+    m->writing = false;
+    m->since_ms = g_data.now_ms;
+    m->req_len = 0;
+    m->req[0] = '\0';
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+bool metrics_handle(int fd, uint32_t events, int epfd){
+    if (g_metrics_fd < 0){
+        return false;
+    }
+    if (fd == g_metrics_fd){
+        metrics_accept(epfd);
+        return true;
+    }
+    for (MetricsConn &m : g_mconns){
+        if (m.fd != fd) continue;
+        if (events & (EPOLLERR | EPOLLHUP)){
+            metrics_close(m, epfd);
+        } else if (m.writing){
+            metrics_write(m, epfd);
+        } else {
+            metrics_read(m, epfd);
+        }
+        return true;
+    }
+    return false;
+}
+
+void metrics_tick(int epfd){
+    if (g_metrics_fd < 0){
+        return;
+    }
+    for (MetricsConn &m : g_mconns){
+        if (m.fd >= 0 && g_data.now_ms - m.since_ms > k_metrics_idle_ms){
+            metrics_close(m, epfd);
+        }
+    }
+}
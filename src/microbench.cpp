@@ -0,0 +1,930 @@
+//
+// In-process microbenchmarks of the server internals.
+// Prints a JSON array with one object per measurement; pass a substring to run only matching benches.
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+#include <vector>
+
+#include "compress.h"
+#include "intersect.h"
+#include "bitops.h"
+#include "hll.h"
+#include "bloom.h"
+#include "cuckoo.h"
+#include "stream.h"
+#include "latency.h"
+#include "server_utils.h"
+#include "hashtable.h"
+#include "avl_tree.h"
+#include "zset.h"
+
+static const char *g_filter = NULL;
+static bool g_first = true;
+
+static bool enabled(const char *name){
+    return !g_filter || strstr(name, g_filter);
+}
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// print one result object, `fields` is a preformatted list of `"key":value` pairs
+static void report(const char *bench, const std::string &fields){
+    printf("%s\n  {\"bench\":\"%s\",%s}", g_first ? "" : ",", bench, fields.c_str());
+    g_first = false;
+    fflush(stdout);
+}
+
+static std::string field(const char *key, double val){
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\"%s\":%.10g", key, val);
+    return buf;
+}
+
+static std::string field(const char *key, const char *val){
+    return std::string("\"") + key + "\":\"" + val + "\"";
+}
+
+// deterministic xorshift, so every run benches the same data
+static uint64_t g_rng = 88172645463325252ull;
+static uint64_t rnd(){
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+
+
+
+// Block compression
+static std::string gen_text(size_t len){
+    static const char *words[] = {
+        "the", "user", "session", "id", "value", "cache", "request", "server",
+        "status", "ok", "error", "timeout", "latency", "event", "click", "page",
+        "product", "cart", "price", "order", "shipping", "address", "token", "time",
+    };
+    const size_t n_words = sizeof(words) / sizeof(words[0]);
+    std::string out;
+    while (out.size() < len){
+        out += words[rnd() % n_words];
+        out += (rnd() % 8) ? ' ' : '\n';
+    }
+    out.resize(len);
+    return out;
+}
+
+static std::string gen_json(size_t len){
+    std::string out;
+    char buf[256];
+    while (out.size() < len){
+        snprintf(buf, sizeof(buf),
+                 "{\"id\":%llu,\"name\":\"user%llu\",\"score\":%llu,\"active\":%s,\"tags\":[\"a\",\"b\"]}\n",
+                 (unsigned long long)(rnd() % 1000000), (unsigned long long)(rnd() % 10000),
+                 (unsigned long long)(rnd() % 100), (rnd() & 1) ? "true" : "false");
+        out += buf;
+    }
+    out.resize(len);
+    return out;
+}
+
+static std::string gen_random(size_t len){
+    std::string out(len, '\0');
+    for (size_t i = 0; i < len; ++i){
+        out[i] = (char)rnd();
+    }
+    return out;
+}
+
+static void bench_lz_one(const char *input, const std::string &data){
+    std::vector<uint8_t> packed(lz_bound(data.size()));
+    std::vector<uint8_t> unpacked(data.size());
+    const uint8_t *src = (const uint8_t *)data.data();
+
+    size_t n = 0;
+    size_t rounds = 0;
+    double t0 = now_sec();
+    double t1 = t0;
+    while (t1 - t0 < 0.3){
+        n = lz_compress(src, data.size(), packed.data(), packed.size());
+        rounds++;
+        t1 = now_sec();
+    }
+    double comp = (double)(data.size() * rounds) / (t1 - t0) / 1e6;
+
+    int64_t m = 0;
+    rounds = 0;
+    t0 = now_sec();
+    t1 = t0;
+    while (t1 - t0 < 0.3){
+        m = lz_decompress(packed.data(), n, unpacked.data(), unpacked.size());
+        rounds++;
+        t1 = now_sec();
+    }
+    double decomp = (double)(data.size() * rounds) / (t1 - t0) / 1e6;
+    bool ok = m == (int64_t)data.size() && 0 == memcmp(unpacked.data(), src, data.size());
+
+    report("lz", field("input", input) + "," + field("bytes", (double)data.size())
+        + "," + field("ratio", (double)data.size() / (double)n)
+        + "," + field("compress_mb_s", comp)
+        + "," + field("decompress_mb_s", decomp)
+        + "," + field("roundtrip_ok", ok ? 1.0 : 0.0));
+}
+
+static void bench_lz(){
+    if (!enabled("lz")) return;
+    const size_t sizes[] = {1024, 16 * 1024, 4 << 20};
+    for (size_t len : sizes){
+        bench_lz_one("text", gen_text(len));
+        bench_lz_one("json", gen_json(len));
+        bench_lz_one("random", gen_random(len));
+    }
+}
+
+
+
+
+// Sorted set intersection
+static std::vector<int32_t> gen_ids(size_t n, uint32_t universe){
+    std::vector<int32_t> ids;
+    ids.reserve(n);
+    // sample without replacement by striding over the universe
+    uint64_t step = universe / n;
+    for (size_t i = 0; i < n; ++i){
+        ids.push_back((int32_t)(i * step + rnd() % step));
+    }
+    return ids;
+}
+
+static void bench_intersect_one(size_t na, size_t nb, uint32_t universe){
+    std::vector<int32_t> a = gen_ids(na, universe);
+    std::vector<int32_t> b = gen_ids(nb, universe);
+    std::vector<int32_t> out1(std::min(na, nb) + 8);
+    std::vector<int32_t> out2(std::min(na, nb) + 8);
+
+    typedef size_t (*Fn)(const int32_t *, size_t, const int32_t *, size_t, int32_t *);
+    Fn fns[2] = {&intersect_i32_scalar, &intersect_i32};
+    double ns[2] = {};
+    size_t n[2] = {};
+    for (int f = 0; f < 2; ++f){
+        size_t rounds = 0;
+        double t0 = now_sec();
+        double t1 = t0;
+        while (t1 - t0 < 0.3){
+            n[f] = fns[f](a.data(), na, b.data(), nb, f ? out2.data() : out1.data());
+            rounds++;
+            t1 = now_sec();
+        }
+        ns[f] = (t1 - t0) * 1e9 / (double)rounds;
+    }
+    bool ok = n[0] == n[1] && 0 == memcmp(out1.data(), out2.data(), n[0] * sizeof(int32_t));
+
+    report("intersect", field("kernel", intersect_kernel()) + "," + field("na", (double)na)
+        + "," + field("nb", (double)nb) + "," + field("matches", (double)n[0])
+        + "," + field("scalar_us", ns[0] / 1e3)
+        + "," + field("simd_us", ns[1] / 1e3)
+        + "," + field("speedup", ns[0] / ns[1])
+        + "," + field("same_result", ok ? 1.0 : 0.0));
+}
+
+static void bench_intersect(){
+    if (!enabled("intersect")) return;
+    bench_intersect_one(100000, 100000, 1000000);
+    bench_intersect_one(100000, 100000, 200000);
+    bench_intersect_one(1000, 100000, 1000000);
+}
+
+
+
+
+// Bitmaps
+// mean ns of one call, repeated for at least 0.3s
+template <class F>
+static double time_ns(F fn){
+    size_t rounds = 0;
+    double t0 = now_sec();
+    double t1 = t0;
+    while (t1 - t0 < 0.3){
+        fn();
+        rounds++;
+        t1 = now_sec();
+    }
+    return (t1 - t0) * 1e9 / (double)rounds;
+}
+
+static void bench_bitmap_one(size_t len){
+    std::string a = gen_random(len);
+    std::string b = gen_random(len);
+    const uint8_t *pa = (const uint8_t *)a.data();
+    std::vector<uint8_t> dst1(b.begin(), b.end());
+    std::vector<uint8_t> dst2(b.begin(), b.end());
+
+    uint64_t n1 = 0, n2 = 0;
+    double count_ns[2] = {
+        time_ns([&]{ n1 = bit_count_scalar(pa, len); }),
+        time_ns([&]{ n2 = bit_count(pa, len); }),
+    };
+    // OR is idempotent, so both buffers end up as a | b whatever the number of rounds
+    double op_ns[2] = {
+        time_ns([&]{ bit_op_scalar(BIT_OR, dst1.data(), pa, len); }),
+        time_ns([&]{ bit_op(BIT_OR, dst2.data(), pa, len); }),
+    };
+    bool ok = n1 == n2 && dst1 == dst2;
+
+    double bytes = (double)len; // bytes per ns = GB/s
+    report("bitmap", field("kernel", bitops_kernel()) + "," + field("bytes", (double)len)
+        + "," + field("bitcount_scalar_gb_s", bytes / count_ns[0])
+        + "," + field("bitcount_simd_gb_s", bytes / count_ns[1])
+        + "," + field("bitcount_speedup", count_ns[0] / count_ns[1])
+        + "," + field("bitop_scalar_gb_s", bytes / op_ns[0])
+        + "," + field("bitop_simd_gb_s", bytes / op_ns[1])
+        + "," + field("bitop_speedup", op_ns[0] / op_ns[1])
+        + "," + field("same_result", ok ? 1.0 : 0.0));
+}
+
+static void bench_bitmap(){
+    if (!enabled("bitmap")) return;
+    bench_bitmap_one(4096);
+    bench_bitmap_one(256 << 10);
+    bench_bitmap_one(16 << 20); // a daily active user bitmap
+}
+
+
+
+
+// HyperLogLog
+static void bench_hll_accuracy(){
+    // one counter grown through each checkpoint, hashing distinct decimal elements
+    const uint64_t checkpoints[] = {100, 1000, 10000, 100000, 1000000, 10000000};
+    Hll h;
+    uint64_t n = 0;
+    for (uint64_t target : checkpoints){
+        for (; n < target; ++n){
+            std::string e = std::to_string(n);
+            hll_add(&h, e.data(), e.size());
+        }
+        uint64_t est = hll_count(&h);
+        report("hll_accuracy", field("cardinality", (double)n) + "," + field("estimate", (double)est)
+            + "," + field("error_pct", 100.0 * ((double)est - (double)n) / (double)n)
+            + "," + field("encoding", h.enc == HLL_SPARSE ? "sparse" : "dense")
+            + "," + field("bytes", (double)hll_mem(&h)));
+    }
+    hll_dispose(&h);
+}
+
+// PFCOUNT over several dense keys: unpack + max every key, then estimate the union
+static void bench_hll_union(size_t n_keys){
+    std::vector<Hll> keys(n_keys);
+    for (size_t k = 0; k < n_keys; ++k){
+        for (size_t i = 0; i < 200000; ++i){
+            uint64_t e = rnd();
+            hll_add(&keys[k], (const char *)&e, sizeof(e));
+        }
+    }
+    std::vector<uint8_t> regs(k_hll_regs);
+    uint64_t est[2] = {};
+    double ns[2] = {};
+    for (int f = 0; f < 2; ++f){
+        ns[f] = time_ns([&]{
+            std::fill(regs.begin(), regs.end(), 0);
+            for (const Hll &h : keys){
+                f ? hll_merge(&h, regs.data()) : hll_merge_scalar(&h, regs.data());
+            }
+            est[f] = f ? hll_estimate(regs.data()) : hll_estimate_scalar(regs.data());
+        });
+    }
+    for (Hll &h : keys){
+        hll_dispose(&h);
+    }
+    report("hll_union", field("kernel", hll_kernel()) + "," + field("keys", (double)n_keys)
+        + "," + field("estimate", (double)est[1])
+        + "," + field("scalar_us", ns[0] / 1e3)
+        + "," + field("simd_us", ns[1] / 1e3)
+        + "," + field("speedup", ns[0] / ns[1])
+        + "," + field("same_result", est[0] == est[1] ? 1.0 : 0.0));
+}
+
+static void bench_hll(){
+    if (!enabled("hll")) return;
+    bench_hll_accuracy();
+    bench_hll_union(1);
+    bench_hll_union(8);
+}
+
+
+
+// Membership filters
+// false positive rate at capacity and ns per check; the big filters don't fit in cache, so every check is a miss
+static void bench_bloom_one(uint64_t capacity){
+    Bloom bf;
+    bf_init(&bf, capacity, k_bf_default_error);
+    char item[32];
+    for (uint64_t i = 0; i < capacity; ++i){
+        int len = snprintf(item, sizeof(item), "member:%llu", (unsigned long long)i);
+        bf_add(&bf, item, (size_t)len);
+    }
+    // hashes of elements never added, so every hit is a false positive
+    const size_t n_probes = 1 << 20;
+    std::vector<uint64_t> probes(n_probes);
+    for (size_t i = 0; i < n_probes; ++i){
+        int len = snprintf(item, sizeof(item), "other:%llu", (unsigned long long)i);
+        probes[i] = hll_hash(item, (size_t)len);
+    }
+    double ns[2] = {};
+    size_t hits[2] = {};
+    for (int k = 0; k < 2; ++k){
+        size_t rounds = 0;
+        double t0 = now_sec();
+        double t1 = t0;
+        while (t1 - t0 < 0.3){
+            size_t h = 0;
+            for (size_t i = 0; i < n_probes; ++i){
+                h += k == 0 ? bf_exists_scalar(&bf, probes[i]) : bf_exists_hash(&bf, probes[i]);
+            }
+            hits[k] = h;
+            rounds++;
+            t1 = now_sec();
+        }
+        ns[k] = (t1 - t0) * 1e9 / (double)(rounds * n_probes);
+    }
+    report("bloom", field("kernel", bf_kernel()) + "," + field("capacity", (double)capacity)
+        + "," + field("bytes", (double)bf_mem(&bf))
+        + "," + field("false_positive_rate", (double)hits[1] / n_probes)
+        + "," + field("scalar_ns", ns[0])
+        + "," + field("simd_ns", ns[1])
+        + "," + field("speedup", ns[0] / ns[1])
+        + "," + field("same_result", hits[0] == hits[1] ? 1.0 : 0.0));
+    bf_dispose(&bf);
+}
+
+static void bench_cuckoo_one(uint64_t capacity){
+    Cuckoo cf;
+    cf_init(&cf, capacity);
+    char item[32];
+    // fill until the first failed add to find the reachable load
+    uint64_t n = 0;
+    for (;; ++n){
+        int len = snprintf(item, sizeof(item), "member:%llu", (unsigned long long)n);
+        if (!cf_add(&cf, item, (size_t)len)) break;
+    }
+    const size_t n_probes = 1 << 20;
+    std::vector<std::string> probes(n_probes);
+    for (size_t i = 0; i < n_probes; ++i){
+        probes[i] = "other:" + std::to_string(i);
+    }
+    size_t rounds = 0;
+    size_t hits = 0;
+    double t0 = now_sec();
+    double t1 = t0;
+    while (t1 - t0 < 0.3){
+        hits = 0;
+        for (size_t i = 0; i < n_probes; ++i){
+            hits += cf_exists(&cf, probes[i].data(), probes[i].size());
+        }
+        rounds++;
+        t1 = now_sec();
+    }
+    // every member must still be found, and deletes must empty the filter
+    bool ok = true;
+    for (uint64_t i = 0; i < n && ok; ++i){
+        int len = snprintf(item, sizeof(item), "member:%llu", (unsigned long long)i);
+        ok = cf_exists(&cf, item, (size_t)len) && cf_del(&cf, item, (size_t)len);
+    }
+    ok = ok && cf.n_items == 0;
+    report("cuckoo", field("capacity", (double)capacity)
+        + "," + field("bytes", (double)cf_mem(&cf))
+        + "," + field("load", (double)n / (double)(cf.n_buckets * k_cf_bucket_slots))
+        + "," + field("false_positive_rate", (double)hits / n_probes)
+        + "," + field("check_ns", (t1 - t0) * 1e9 / (double)(rounds * n_probes))
+        + "," + field("members_ok", ok ? 1.0 : 0.0));
+    cf_dispose(&cf);
+}
+
+static void bench_filter(){
+    if (!enabled("filter")) return;
+    bench_bloom_one(100000);
+    bench_bloom_one(10000000);
+    bench_cuckoo_one(100000);
+    bench_cuckoo_one(10000000);
+}
+
+
+
+// Streams
+// append cost and bytes per entry, then seeks to random IDs: the cost should grow with log(entries)
+static void bench_stream_one(size_t n_entries){
+    Stream s;
+    std::vector<std::string> items = {"sensor", "", "temp", ""};
+    double t0 = now_sec();
+    for (size_t i = 0; i < n_entries; ++i){
+        items[1] = std::to_string(i % 64);
+        items[3] = std::to_string(200 + i % 50);
+        StreamId id;
+        id.ms = 1700000000000ull + i / 4;   // a few entries per ms, as under steady load
+        id.seq = i % 4;
+        stream_add(&s, id, items.data(), items.size());
+    }
+    double add_ns = (now_sec() - t0) * 1e9 / (double)n_entries;
+
+    const size_t n_seeks = 1 << 18;
+    std::vector<StreamId> targets(n_seeks);
+    for (size_t i = 0; i < n_seeks; ++i){
+        size_t k = rnd() % n_entries;
+        targets[i].ms = 1700000000000ull + k / 4;
+        targets[i].seq = k % 4;
+    }
+    size_t found = 0;
+    size_t rounds = 0;
+    t0 = now_sec();
+    double t1 = t0;
+    while (t1 - t0 < 0.3){
+        found = 0;
+        SEntry ent;
+        for (size_t i = 0; i < n_seeks; ++i){
+            SIter it = stream_seek(&s, targets[i]);
+            found += stream_next(&s, &it, &ent) && sid_cmp(ent.id, targets[i]) == 0;
+        }
+        rounds++;
+        t1 = now_sec();
+    }
+    report("stream", field("entries", (double)n_entries)
+        + "," + field("blocks", (double)s.blocks.size())
+        + "," + field("bytes_per_entry", (double)s.bytes / (double)n_entries)
+        + "," + field("add_ns", add_ns)
+        + "," + field("seek_ns", (t1 - t0) * 1e9 / (double)(rounds * n_seeks))
+        + "," + field("all_found", found == n_seeks ? 1.0 : 0.0));
+    stream_dispose(&s);
+}
+
+static void bench_stream(){
+    if (!enabled("stream")) return;
+    bench_stream_one(10000);
+    bench_stream_one(1000000);
+}
+
+
+
+
+// Hot counters
+static void run_cmd(std::vector<std::string> &cmd, std::string &out){
+    out.clear();
+    do_request(cmd, out);
+}
+
+// INCR against the GET-modify-SET round trip clients had to do before, both through the command table
+static void bench_counter_one(size_t n_keys){
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < n_keys; ++i){
+        keys.push_back("bench:ctr:" + std::to_string(i));
+    }
+    std::vector<std::string> cmd;
+    std::string out;
+    double ops[2] = {};
+    bool ok = true;
+    for (int f = 0; f < 2; ++f){
+        // fresh counters, as strings so INCR also covers the first conversion
+        for (const std::string &k : keys){
+            cmd = {"set", k, "0"};
+            run_cmd(cmd, out);
+        }
+        size_t rounds = 0;
+        double t0 = now_sec();
+        double t1 = t0;
+        while (t1 - t0 < 0.3){
+            for (size_t i = 0; i < 1024; ++i){
+                const std::string &k = keys[(rounds * 1024 + i) % n_keys];
+                if (f == 0){
+                    cmd = {"incr", k};
+                    run_cmd(cmd, out);
+                    continue;
+                }
+                cmd = {"get", k};
+                run_cmd(cmd, out);
+                uint32_t len = 0;
+                memcpy(&len, &out[1], 4);
+                int64_t v = 0;
+                parse_int(out.substr(5, len), v);
+                cmd = {"set", k, std::to_string(v + 1)};
+                run_cmd(cmd, out);
+            }
+            rounds++;
+            t1 = now_sec();
+        }
+        ops[f] = (double)(rounds * 1024) / (t1 - t0);
+        // every key must hold its number of increments
+        for (size_t i = 0; i < n_keys && ok; ++i){
+            int64_t want = (int64_t)(rounds * 1024 / n_keys + (i < rounds * 1024 % n_keys));
+            cmd = {"get", keys[i]};
+            run_cmd(cmd, out);
+            ok = out.size() > 5 && out.substr(5) == std::to_string(want);
+        }
+    }
+    for (std::string &k : keys){
+        cmd = {"del", k};
+        run_cmd(cmd, out);
+    }
+
+    report("counter", field("keys", (double)n_keys)
+        + "," + field("incr_ops_s", ops[0])
+        + "," + field("get_set_ops_s", ops[1])
+        + "," + field("speedup", ops[0] / ops[1])
+        + "," + field("counts_ok", ok ? 1.0 : 0.0));
+}
+
+static void bench_counter(){
+    if (!enabled("counter")) return;
+    bench_counter_one(16);
+    bench_counter_one(100000);
+}
+
+
+
+// Geo search
+// nearby-driver lookups: 5M points over a 100 km x 100 km metro area, radius queries through the command table
+static void bench_geo(){
+    if (!enabled("geo")) return;
+    const size_t n_points = 5000000;
+    const double lon0 = 2.35, lat0 = 48.85, span = 0.45;    // about 100 km around Paris
+    auto coord = [&](){ return ((double)(rnd() % 1000000) / 1000000.0 - 0.5) * 2 * span; };
+    std::vector<std::string> cmd;
+    std::string out;
+    double t0 = now_sec();
+    for (size_t i = 0; i < n_points; i += 1000){
+        cmd = {"geoadd", "bench:geo"};
+        for (size_t j = i; j < i + 1000; ++j){
+            cmd.push_back(std::to_string(lon0 + coord()));
+            cmd.push_back(std::to_string(lat0 + coord()));
+            cmd.push_back("driver:" + std::to_string(j));
+        }
+        run_cmd(cmd, out);
+    }
+    double add_s = now_sec() - t0;
+
+    const char *radii[] = {"500", "2000"};
+    for (const char *radius : radii){
+        for (int with_count = 0; with_count < 2; ++with_count){
+            const size_t n_queries = 2000;
+            std::vector<double> us(n_queries);
+            double hits = 0;
+            for (size_t q = 0; q < n_queries; ++q){
+                cmd = {"geosearch", "bench:geo", "fromlonlat", std::to_string(lon0 + coord()),
+                       std::to_string(lat0 + coord()), "byradius", radius, "m"};
+                if (with_count){
+                    cmd.push_back("count");
+                    cmd.push_back("10");
+                }
+                double q0 = now_sec();
+                run_cmd(cmd, out);
+                us[q] = (now_sec() - q0) * 1e6;
+                uint32_t n = 0;
+                memcpy(&n, &out[1], 4);
+                hits += n;
+            }
+            std::sort(us.begin(), us.end());
+            report("geo", field("points", (double)n_points)
+                + "," + field("add_s", add_s)
+                + "," + field("radius_m", atof(radius))
+                + "," + field("count", with_count ? 10.0 : 0.0)
+                + "," + field("avg_hits", hits / n_queries)
+                + "," + field("p50_us", us[n_queries / 2])
+                + "," + field("p99_us", us[n_queries * 99 / 100]));
+        }
+    }
+    cmd = {"del", "bench:geo"};
+    run_cmd(cmd, out);
+}
+
+
+
+
+// Latency recording
+// cost of timing one command (two TSC reads and a histogram update) and the quantile error of the buckets
+static void bench_latency(){
+    if (!enabled("latency")) return;
+    LatHist *h = new LatHist();
+    uint64_t sink = 0;
+    double record_ns = time_ns([&]{
+        for (int i = 0; i < 1000; ++i){
+            uint64_t t0 = lat_now();
+            sink += t0 & 1;
+            lat_add(h, lat_now() - t0);
+        }
+    }) / 1000;
+    double clock_ns = time_ns([&]{
+        for (int i = 0; i < 1000; ++i){
+            uint64_t t0 = get_mono_ns();
+            sink += t0 & 1;
+            sink += get_mono_ns() - t0;
+        }
+    }) / 1000;
+
+    // skewed durations: mostly ~1k cycles with a tail up to millions
+    *h = LatHist();
+    std::vector<uint64_t> vals;
+    for (size_t i = 0; i < 1000000; ++i){
+        uint64_t v = 500 + rnd() % 1000;
+        if (rnd() % 100 == 0) v *= 1 + rnd() % 1000;
+        vals.push_back(v);
+        lat_add(h, v);
+    }
+    std::sort(vals.begin(), vals.end());
+    double worst = 0;
+    const double qs[] = {0.5, 0.99, 0.999};
+    for (double q : qs){
+        double exact = (double)vals[(size_t)(q * (double)vals.size()) - 1];
+        double err = ((double)lat_quantile(h, q) - exact) / exact;
+        worst = std::max(worst, err < 0 ? -err : err);
+    }
+    report("latency", field("record_ns", record_ns)
+        + "," + field("clock_gettime_pair_ns", clock_ns)
+        + "," + field("worst_quantile_rel_error", worst)
+        + "," + field("sink", (double)(sink & 1)));
+    delete h;
+}
+
+
+
+
+// Hashtable
+struct BenchNode {
+    HNode node;
+    uint64_t key = 0;
+};
+
+static bool bench_node_eq(HNode *lhs, HNode *rhs){
+    return container_of(lhs, BenchNode, node)->key == container_of(rhs, BenchNode, node)->key;
+}
+
+// a well spread hcode for an integer key, so the table and not the hash is measured
+static uint64_t mix64(uint64_t h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static void bench_hmap_insert(HMap *m, std::vector<BenchNode> &nodes, size_t n){
+    for (size_t i = 0; i < n; ++i){
+        hm_insert(m, &nodes[i].node);
+    }
+}
+
+// mean ns of a lookup of the keys in `probes`, cycling over them
+static double bench_hmap_lookups(HMap *m, std::vector<BenchNode> &probes, uint64_t &sink){
+    size_t pos = 0;
+    return time_ns([&]{
+        for (int i = 0; i < 1000; ++i){
+            sink += hm_lookup(m, &probes[pos].node, &bench_node_eq) != NULL;
+            pos = pos + 1 < probes.size() ? pos + 1 : 0;
+        }
+    }) / 1000;
+}
+
+// insert (with the progressive resizes it triggers), hit and miss lookups, lookups
+// while a resize is in progress, and pops in random order
+static void bench_hmap_one(size_t n){
+    std::vector<BenchNode> nodes(n);
+    for (size_t i = 0; i < n; ++i){
+        nodes[i].key = i;
+        nodes[i].node.hcode = mix64(i);
+    }
+    HMap m;
+    double t0 = now_sec();
+    bench_hmap_insert(&m, nodes, n);
+    double insert_ns = (now_sec() - t0) * 1e9 / (double)n;
+    hm_destroy(&m);
+
+    // again one by one for the worst insert: the one that allocates the bigger table
+    uint64_t worst = 0;
+    for (size_t i = 0; i < n; ++i){
+        uint64_t c0 = lat_now();
+        hm_insert(&m, &nodes[i].node);
+        worst = std::max(worst, lat_now() - c0);
+    }
+    while (m.tb2.tab){
+        hm_help_resizing(&m);
+    }
+
+    const size_t n_probes = 1 << 16;
+    std::vector<BenchNode> hits(n_probes), misses(n_probes);
+    for (size_t i = 0; i < n_probes; ++i){
+        hits[i].key = rnd() % n;
+        hits[i].node.hcode = mix64(hits[i].key);
+        misses[i].key = n + rnd() % n;
+        misses[i].node.hcode = mix64(misses[i].key);
+    }
+    uint64_t sink = 0;
+    double hit_ns = bench_hmap_lookups(&m, hits, sink);
+    double miss_ns = bench_hmap_lookups(&m, misses, sink);
+
+    // fresh map stopped right where the last resize within `n` keys started, then lookups until it is done
+    hm_destroy(&m);
+    size_t start_at = 9;    // the resize starts when size / buckets > k_max_load_factor
+    while ((start_at * 2) <= n) start_at *= 2;
+    bench_hmap_insert(&m, nodes, start_at);
+    size_t resize_ops = 0;
+    t0 = now_sec();
+    while (m.tb2.tab){
+        BenchNode &probe = hits[resize_ops % n_probes];
+        sink += hm_lookup(&m, &probe.node, &bench_node_eq) != NULL;
+        resize_ops++;
+    }
+    double resize_ns = resize_ops ? (now_sec() - t0) * 1e9 / (double)resize_ops : 0;
+    hm_destroy(&m);
+
+    bench_hmap_insert(&m, nodes, n);
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i){
+        order[i] = i;
+    }
+    for (size_t i = n; i > 1; --i){
+        std::swap(order[i - 1], order[rnd() % i]);
+    }
+    t0 = now_sec();
+    for (size_t i = 0; i < n; ++i){
+        sink += hm_pop(&m, &nodes[order[i]].node, &bench_node_eq) != NULL;
+    }
+    double pop_ns = (now_sec() - t0) * 1e9 / (double)n;
+    hm_destroy(&m);
+
+    report("hmap", field("keys", (double)n)
+        + "," + field("insert_ns", insert_ns)
+        + "," + field("insert_max_us", lat_cycles_ns(worst) / 1000)
+        + "," + field("lookup_hit_ns", hit_ns)
+        + "," + field("lookup_miss_ns", miss_ns)
+        + "," + field("resize_keys", (double)start_at)
+        + "," + field("resize_lookups", (double)resize_ops)
+        + "," + field("resize_lookup_ns", resize_ns)
+        + "," + field("pop_ns", pop_ns)
+        + "," + field("sink", (double)(sink & 1)));
+}
+
+static void bench_hmap(){
+    if (!enabled("hmap")) return;
+    lat_init();
+    bench_hmap_one(1000);
+    bench_hmap_one(100000);
+    bench_hmap_one(1000000);
+}
+
+
+
+
+// AVL tree
+// `tree_add` with random scores, then `avl_del` in random order, and the height reached
+static void bench_avl_one(size_t n){
+    ZSet z;
+    std::vector<ZNode *> nodes(n);
+    for (size_t i = 0; i < n; ++i){
+        std::string name = "m" + std::to_string(i);
+        nodes[i] = znode_new(name.data(), name.size(), (double)(rnd() % (4 * n)));
+    }
+    double t0 = now_sec();
+    for (size_t i = 0; i < n; ++i){
+        tree_add(&z, nodes[i]);
+    }
+    double add_ns = (now_sec() - t0) * 1e9 / (double)n;
+    uint32_t height = avl_height(z.tree);
+
+    for (size_t i = n; i > 1; --i){
+        std::swap(nodes[i - 1], nodes[rnd() % i]);
+    }
+    t0 = now_sec();
+    for (size_t i = 0; i < n; ++i){
+        z.tree = avl_del(&nodes[i]->tree);
+    }
+    double del_ns = (now_sec() - t0) * 1e9 / (double)n;
+    for (ZNode *node : nodes){
+        znode_del(node);
+    }
+    report("avl", field("nodes", (double)n)
+        + "," + field("tree_add_ns", add_ns)
+        + "," + field("avl_del_ns", del_ns)
+        + "," + field("height", (double)height)
+        + "," + field("height_over_log2n", (double)height / log2((double)n)));
+}
+
+static void bench_avl(){
+    if (!enabled("avl")) return;
+    bench_avl_one(1000);
+    bench_avl_one(100000);
+    bench_avl_one(1000000);
+}
+
+
+
+
+// Sorted sets
+// `zset_add`, then ZRANGEBYSCORE-style scans (seek a random score, walk `k` successors)
+// and ZRANGE-style rank jumps with `znode_offset`
+static void bench_zset_one(size_t n){
+    ZSet z;
+    double t0 = now_sec();
+    for (size_t i = 0; i < n; ++i){
+        std::string name = "member:" + std::to_string(i);
+        zset_add(&z, name.data(), name.size(), (double)(rnd() % (4 * n)));
+    }
+    double add_ns = (now_sec() - t0) * 1e9 / (double)n;
+    ZNode *first = zset_seekge(&z, -INFINITY, "", 0);
+
+    double sink = 0;
+    double seek_ns = time_ns([&]{
+        for (int i = 0; i < 100; ++i){
+            ZNode *node = zset_seekge(&z, (double)(rnd() % (4 * n)), "", 0);
+            sink += node ? node->score : 0;
+        }
+    }) / 100;
+    double range_ns[2] = {};
+    const size_t ks[2] = {10, 100};
+    for (size_t r = 0; r < 2; ++r){
+        range_ns[r] = time_ns([&]{
+            for (int i = 0; i < 100; ++i){
+                ZNode *node = zset_seekge(&z, (double)(rnd() % (4 * n)), "", 0);
+                for (size_t j = 0; j < ks[r] && node; ++j){
+                    sink += node->score;
+                    node = znode_offset(node, 1);
+                }
+            }
+        }) / 100;
+    }
+    double rank_ns = time_ns([&]{
+        for (int i = 0; i < 100; ++i){
+            ZNode *node = znode_offset(first, (int64_t)(rnd() % n));
+            sink += node ? node->score : 0;
+        }
+    }) / 100;
+    zset_dispose(&z);
+
+    report("zset", field("members", (double)n)
+        + "," + field("add_ns", add_ns)
+        + "," + field("seek_ns", seek_ns)
+        + "," + field("range10_ns", range_ns[0])
+        + "," + field("range100_ns", range_ns[1])
+        + "," + field("rank_ns", rank_ns)
+        + "," + field("sink", sink > 0 ? 1.0 : 0.0));
+}
+
+static void bench_zset(){
+    if (!enabled("zset")) return;
+    bench_zset_one(1000);
+    bench_zset_one(100000);
+    bench_zset_one(1000000);
+}
+
+
+
+
+// Key hashing
+static void bench_str_hash(){
+    if (!enabled("str_hash")) return;
+    const size_t lens[] = {8, 16, 64, 256, 4096};
+    for (size_t len : lens){
+        std::string data = gen_random(len);
+        uint64_t sink = 0;
+        double ns = time_ns([&]{
+            for (int i = 0; i < 1000; ++i){
+                data[0] = (char)i;  // a different input each call
+                sink += str_hash((const uint8_t *)data.data(), len);
+            }
+        }) / 1000;
+        report("str_hash", field("bytes", (double)len)
+            + "," + field("ns", ns)
+            + "," + field("gb_per_s", (double)len / ns)
+            + "," + field("sink", (double)(sink & 1)));
+    }
+}
+
+int main(int argc, char **argv){
+    if (argc > 1){
+        g_filter = argv[1];
+    }
+    printf("[");
+    bench_lz();
+    bench_intersect();
+    bench_bitmap();
+    bench_hll();
+    bench_filter();
+    bench_stream();
+    bench_counter();
+    bench_geo();
+    bench_latency();
+    bench_hmap();
+    bench_avl();
+    bench_zset();
+    bench_str_hash();
+    printf("\n]\n");
+    return 0;
+}
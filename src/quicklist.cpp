@@ -0,0 +1,224 @@
+#include "quicklist.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bytes taken by the length fields of an item
+static uint32_t len_size(size_t len){
+    return len < 0x80 ? 1 : 5;
+}
+
+static uint32_t item_size(size_t len){
+    return (uint32_t)len + 2 * len_size(len);
+}
+
+// write an item at `p`, which must have `item_size(len)` bytes
+static void item_put(uint8_t *p, const char *data, size_t len){
+    if (len < 0x80){
+        p[0] = (uint8_t)len;
+        memcpy(&p[1], data, len);
+        p[1 + len] = (uint8_t)len;
+        return;
+    }
+    uint32_t len32 = (uint32_t)len;
+    p[0] = 0x80;
+    memcpy(&p[1], &len32, 4);
+    memcpy(&p[5], data, len);
+    memcpy(&p[5 + len], &len32, 4);
+    p[9 + len] = 0x80;
+}
+
+// length of the item starting at `p`
+static uint32_t item_len_fwd(const uint8_t *p){
+    if (p[0] < 0x80) return p[0];
+    uint32_t len = 0;
+    memcpy(&len, &p[1], 4);
+    return len;
+}
+
+// length of the item ending right before `end`
+static uint32_t item_len_back(const uint8_t *end){
+    if (end[-1] < 0x80) return end[-1];
+    uint32_t len = 0;
+    memcpy(&len, end - 5, 4);
+    return len;
+}
+
+// the first chunk of a list holds just what it needs and grows from there, later ones start full size
+static QChunk *chunk_new(QList *ql, uint32_t need, bool front){
+    uint32_t cap = need > k_qchunk_bytes || !ql->first ? need : k_qchunk_bytes;
+    QChunk *chunk = (QChunk *)malloc(sizeof(QChunk) + cap);
+    assert(chunk);
+    chunk->prev = chunk->next = NULL;
+    chunk->cap = cap;
+    chunk->n = 0;
+    // leave the free space on the side that keeps growing
+    chunk->head = chunk->tail = front ? cap : 0;
+    ql->n_chunks++;
+    ql->bytes += sizeof(QChunk) + cap;
+    return chunk;
+}
+
+// make room for `size` more bytes on one side of a chunk below the default capacity, doubling it (capped at
+// k_qchunk_bytes) with the items moved to the other end; NULL if they wouldn't fit in k_qchunk_bytes
+static QChunk *chunk_grow(QList *ql, QChunk *chunk, uint32_t size, bool front){
+    uint32_t used = chunk->tail - chunk->head;
+    if (chunk->cap >= k_qchunk_bytes || used + size > k_qchunk_bytes) return NULL;
+    uint32_t cap = chunk->cap * 2;
+    if (cap < used + size) cap = used + size;
+    if (cap > k_qchunk_bytes) cap = k_qchunk_bytes;
+    QChunk *p = (QChunk *)realloc(chunk, sizeof(QChunk) + cap);
+    assert(p);
+    ql->bytes += cap - p->cap;
+    uint32_t head = front ? cap - used : 0;
+    memmove(&p->data[head], &p->data[p->head], used);
+    p->head = head;
+    p->tail = head + used;
+    p->cap = cap;
+    (p->prev ? p->prev->next : ql->first) = p;
+    (p->next ? p->next->prev : ql->last) = p;
+    return p;
+}
+
+static void chunk_unlink(QList *ql, QChunk *chunk){
+    (chunk->prev ? chunk->prev->next : ql->first) = chunk->next;
+    (chunk->next ? chunk->next->prev : ql->last) = chunk->prev;
+    ql->n_chunks--;
+    ql->bytes -= sizeof(QChunk) + chunk->cap;
+    free(chunk);
+}
+
+void ql_push(QList *ql, bool front, const char *data, size_t len){
+    uint32_t size = item_size(len);
+    if (front){
+        QChunk *chunk = ql->first;
+        if (chunk && chunk->head < size){
+            chunk = chunk_grow(ql, chunk, size, true);
+        }
+        if (!chunk || chunk->head < size){
+            chunk = chunk_new(ql, size, true);
+            chunk->next = ql->first;
+            (ql->first ? ql->first->prev : ql->last) = chunk;
+            ql->first = chunk;
+        }
+        chunk->head -= size;
+        item_put(&chunk->data[chunk->head], data, len);
+        chunk->n++;
+    } else {
+        QChunk *chunk = ql->last;
+        if (chunk && chunk->cap - chunk->tail < size){
+            chunk = chunk_grow(ql, chunk, size, false);
+        }
+        if (!chunk || chunk->cap - chunk->tail < size){
+            chunk = chunk_new(ql, size, false);
+            chunk->prev = ql->last;
+            (ql->last ? ql->last->next : ql->first) = chunk;
+            ql->last = chunk;
+        }
+        item_put(&chunk->data[chunk->tail], data, len);
+        chunk->tail += size;
+        chunk->n++;
+    }
+    ql->n++;
+}
+
+bool ql_pop(QList *ql, bool front, std::string &out){
+    QChunk *chunk = front ? ql->first : ql->last;
+    if (!chunk) return false;
+    if (front){
+        uint8_t *p = &chunk->data[chunk->head];
+        uint32_t len = item_len_fwd(p);
+        out.assign((char *)p + len_size(len), len);
+        chunk->head += item_size(len);
+    } else {
+        uint8_t *end = &chunk->data[chunk->tail];
+        uint32_t len = item_len_back(end);
+        out.assign((char *)end - len_size(len) - len, len);
+        chunk->tail -= item_size(len);
+    }
+    chunk->n--;
+    ql->n--;
+    if (chunk->n == 0){
+        chunk_unlink(ql, chunk);
+    }
+    return true;
+}
+
+QIter ql_index(QList *ql, size_t idx){
+    QIter it;
+    if (idx < ql->n / 2){ // from the front
+        QChunk *chunk = ql->first;
+        while (idx >= chunk->n){
+            idx -= chunk->n;
+            chunk = chunk->next;
+        }
+        it.chunk = chunk;
+    } else { // from the back, counting what's left behind the target
+        size_t back = ql->n - 1 - idx;
+        QChunk *chunk = ql->last;
+        while (back >= chunk->n){
+            back -= chunk->n;
+            chunk = chunk->prev;
+        }
+        it.chunk = chunk;
+        idx = chunk->n - 1 - back;
+    }
+    // items are variable-length, so walk within the chunk
+    it.off = it.chunk->head;
+    while (idx--){
+        it.off += item_size(item_len_fwd(&it.chunk->data[it.off]));
+    }
+    return it;
+}
+
+const char *ql_item(QIter it, size_t *len){
+    const uint8_t *p = &it.chunk->data[it.off];
+    *len = item_len_fwd(p);
+    return (const char *)p + len_size(*len);
+}
+
+bool ql_next(QIter *it){
+    it->off += item_size(item_len_fwd(&it->chunk->data[it->off]));
+    if (it->off < it->chunk->tail) return true;
+    it->chunk = it->chunk->next;
+    if (!it->chunk) return false;
+    it->off = it->chunk->head;
+    return true;
+}
+
+void ql_dispose(QList *ql){
+    QChunk *chunk = ql->first;
+    while (chunk){
+        QChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    *ql = QList{};
+}
+
+void ql_encode(QList *ql, std::string &out){
+    for (QChunk *chunk = ql->first; chunk; chunk = chunk->next){
+        uint32_t off = chunk->head;
+        while (off < chunk->tail){
+            uint32_t len = item_len_fwd(&chunk->data[off]);
+            out.append((char *)&len, 4);
+            out.append((char *)&chunk->data[off + len_size(len)], len);
+            off += item_size(len);
+        }
+    }
+}
+
+bool ql_decode(QList *ql, const char *data, size_t len){
+    size_t pos = 0;
+    while (pos < len){
+        if (len - pos < 4) return false;
+        uint32_t ilen = 0;
+        memcpy(&ilen, &data[pos], 4);
+        pos += 4;
+        if (len - pos < ilen) return false;
+        ql_push(ql, false, &data[pos], ilen);
+        pos += ilen;
+    }
+    return true;
+}
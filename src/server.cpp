@@ -5,6 +5,7 @@
 #include <vector>
 
 #include <stdlib.h>
+#include <errno.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
@@ -13,10 +14,51 @@
 
 #include "utils.h"
 #include "server_utils.h"
+#include "config.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "lazyfree.h"
+#include "blocking.h"
+#include "stats.h"
+#include "latency.h"
+#include "slowlog.h"
+#include "keystats.h"
+#include "metrics.h"
+#include "trace.h"
 
 #define MAX_EVENT_LEN 100
 
-int main(){
+int main(int argc, char **argv){
+    if (config_parse_args(argc, argv)){
+        return 1;
+    }
+
+    g_data.now_ms = get_wall_ms();
+    g_stats.start_ms = g_data.now_ms;
+    lat_init();
+    slowlog_tick();
+    lazyfree_init();
+
+    // warm restart: map the snapshot, keys are served from it until they get written
+    int32_t err = snap_open(g_config.snapshot_path.c_str(), &g_data.snap);
+    if (err < 0){
+        die("fail to open snapshot");
+    }
+    if (err == 2){ // an older build's file, keep serving rather than refuse to start
+        fprintf(stderr, "snapshot %s is not in format version %u, starting empty (SAVE overwrites it)\n",
+                g_config.snapshot_path.c_str(), k_snap_version);
+    }
+    // or copy everything into heap up front (compressed files can only be loaded this way)
+    if (err == 0 && (!g_config.snapshot_mmap || (g_data.snap.hdr->flags & SNAP_F_LZ))){
+        size_t n_threads = g_config.load_threads > 0 ? (size_t)g_config.load_threads : cpu_count();
+        uint64_t start = lat_now();
+        if (snap_load_all(&g_data.snap, &g_data.db, n_threads)){
+            die("corrupted snapshot");
+        }
+        lat_event(LAT_EV_PERSISTENCE, lat_now() - start);
+        snap_close(&g_data.snap);
+    }
+
     int fd = socket(AF_INET, SOCK_STREAM, 0);
     if (fd < 0){
         die("fail to create server socket");
@@ -58,34 +100,59 @@ int main(){
     listen_event.events = EPOLLIN;
     listen_event.data.fd = fd;
     epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &listen_event);
+    // and the Prometheus endpoint, if configured
+    if (metrics_init(epoll_fd)){
+        die("metrics listener");
+    }
     while(true){
         /* prepare arguments for epoll() */
         // push all existing connection fds
 
         /* poll for active fds (user thread blocked */
         // kernel would mark active fds in poll_args.data() array)
-        int rv = epoll_wait(epoll_fd, events_buf, MAX_EVENT_LEN, 30000);
-        if(rv < 0){
+        int rv = epoll_wait(epoll_fd, events_buf, MAX_EVENT_LEN, next_timer_ms());
+        if(rv < 0 && errno != EINTR){
             die("epoll_wait failed");
         }
+        g_data.now_ms = get_wall_ms();
+        lat_loop_begin();
 
         /* process active connections */
-        for(size_t i = 0; i < rv; ++i){
+        for(int i = 0; i < rv; ++i){
             int active_fd = events_buf[i].data.fd;
 			if (active_fd == fd){
 			    (void) accept_new_conn(fd2conn, fd, epoll_fd);
 				continue;
 			}
+            if (metrics_handle(active_fd, events_buf[i].events, epoll_fd)){
+                continue;
+            }
             Conn *conn = fd2conn[active_fd]; // locate the buffer
             connection_io(conn, epoll_fd);
             if(conn->state == STATE_END){
                 // destory the conn
                 fd2conn[conn->fd] = NULL;
+                g_stats.conns--;
+                TRACE1(conn_close, conn->fd);
                 (void)close(conn->fd);
 				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
-                free(conn);
+                conn_free(conn);
             }
         }
+
+        /* answer blocked clients whose keys got data or whose timeout passed */
+        block_run(epoll_fd);
+
+        /* delete keys whose TTL has passed */
+        uint64_t expire_start = lat_now();
+        expire_run();
+        lat_event(LAT_EV_EXPIRE, lat_now() - expire_start);
+
+        stats_tick();
+        slowlog_tick();
+        keystats_tick();
+        metrics_tick(epoll_fd);
+        lat_loop_end(rv > 0 ? (size_t)rv : 0);
     }
 
     if (close(epoll_fd)){
@@ -5,6 +5,16 @@
 #include "utils.h"
 #include "server_utils.h"
 #include "hashtable.h"
+#include "config.h"
+#include "compress.h"
+#include "evict.h"
+#include "lazyfree.h"
+#include "blocking.h"
+#include "stats.h"
+#include "slowlog.h"
+#include "keystats.h"
+#include "memtrack.h"
+#include "trace.h"
 
 #include <arpa/inet.h>
 #include <sys/socket.h>
@@ -18,8 +28,11 @@
 #include <sys/epoll.h>
 #include <string>
 #include <map>
+#include <algorithm>
 #include <iostream>
+#include <math.h>
 
+GlobalData g_data;
 
 void fd_set_nb(int fd){
     errno = 0;
@@ -43,6 +56,25 @@ void conn_put(std::vector<Conn*> &fd2conn, struct Conn *conn){
         fd2conn.resize(conn->fd + 1);
     }
     fd2conn[conn->fd] = conn;
+    g_stats.conns++;
+    g_stats.total_conns++;
+}
+
+void conn_free(Conn *conn){
+    block_cancel(conn);
+    mem_free(conn->rbuf, MEM_CONN);
+    mem_free(conn->wbuf, MEM_CONN);
+    mem_free(conn, MEM_CONN);
+}
+
+// resize a connection buffer, keeping the bytes that still fit; dies when out of memory
+static void conn_buf_resize(uint8_t *&buf, size_t &cap, size_t new_cap){
+    uint8_t *p = (uint8_t *)mem_realloc(buf, new_cap, MEM_CONN);
+    if (!p){
+        die("realloc() conn buffer");
+    }
+    buf = p;
+    cap = new_cap;
 }
 
 int32_t accept_new_conn(std::vector<Conn*> &fd2conn, int fd, int epfd){
@@ -59,7 +91,7 @@ int32_t accept_new_conn(std::vector<Conn*> &fd2conn, int fd, int epfd){
     fd_set_nb(connfd);
 
     // creating the Conn struct as state of this server-client connection
-    struct Conn *conn = (struct Conn *)malloc(sizeof(struct Conn));
+    struct Conn *conn = (struct Conn *)mem_malloc(sizeof(struct Conn), MEM_CONN);
     if(!conn){
         close(connfd);
         return -1;
@@ -67,9 +99,20 @@ int32_t accept_new_conn(std::vector<Conn*> &fd2conn, int fd, int epfd){
     conn->fd = connfd;
     conn->state = STATE_REQ;
     conn->rbuf_size = 0;
+    conn->rbuf_cap = k_conn_buf_init;
+    conn->rbuf = (uint8_t *)mem_malloc(conn->rbuf_cap, MEM_CONN);
     conn->wbuf_size = 0;
     conn->wbuf_sent = 0;
+    conn->wbuf_cap = k_conn_buf_init;
+    conn->wbuf = (uint8_t *)mem_malloc(conn->wbuf_cap, MEM_CONN);
+    conn->blocked = NULL;
+    if (!conn->rbuf || !conn->wbuf){
+        conn_free(conn);
+        close(connfd);
+        return -1;
+    }
     conn_put(fd2conn, conn);
+    TRACE1(conn_accept, connfd);
 
 	// epoll should monitor connfd
 	struct epoll_event conn_event;
@@ -88,23 +131,156 @@ void connection_io(Conn *conn, int epfd){
         state_req(conn, epfd);
     } else if (conn->state == STATE_RES){
         state_res(conn, epfd);
+        // requests pipelined behind a reply that had to wait for the socket are already in rbuf
+        while (conn->state == STATE_REQ && try_one_request(conn, epfd)){}
+    } else if (conn->state == STATE_BLOCKED){
+        conn->state = STATE_END; // only a hangup is watched while blocked
     } else {
         assert(0); // not expected
     }
 }
 
-void do_request(std::vector<std::string> &cmd, std::string &out){
-    if (cmd.size() == 1 && cmd_is(cmd[0], "keys")) {
-        do_keys(cmd, out);
-    } else if(cmd.size() == 2 && cmd_is(cmd[0], "get")) {
-        do_get(cmd, out);
-    } else if(cmd.size() == 3 && cmd_is(cmd[0], "set")) {
-        do_set(cmd, out);
-    } else if(cmd.size() == 2 && cmd_is(cmd[0], "del")) {
-        do_del(cmd, out);
-    } else { // cmd is not recognized
+// command table, kept sorted by name for lookup
+static Command g_cmds[] = {
+    {"bf.add", 3, CMD_WRITE | CMD_DENYOOM, &do_bf_add},
+    {"bf.exists", 3, 0, &do_bf_exists},
+    {"bf.madd", -3, CMD_WRITE | CMD_DENYOOM, &do_bf_madd},
+    {"bf.mexists", -3, 0, &do_bf_mexists},
+    {"bf.reserve", 4, CMD_WRITE | CMD_DENYOOM, &do_bf_reserve},
+    {"bigkeys", -1, 0, &do_bigkeys},
+    {"bitcount", -2, 0, &do_bitcount},
+    {"bitop", -4, CMD_WRITE | CMD_DENYOOM, &do_bitop},
+    {"bitpos", -3, 0, &do_bitpos},
+    {"blpop", -3, CMD_WRITE, &do_blpop},
+    {"brpop", -3, CMD_WRITE, &do_brpop},
+    {"bzpopmax", -3, CMD_WRITE, &do_bzpopmax},
+    {"bzpopmin", -3, CMD_WRITE, &do_bzpopmin},
+    {"cf.add", 3, CMD_WRITE | CMD_DENYOOM, &do_cf_add},
+    {"cf.addnx", 3, CMD_WRITE | CMD_DENYOOM, &do_cf_addnx},
+    {"cf.count", 3, 0, &do_cf_count},
+    {"cf.del", 3, CMD_WRITE, &do_cf_del},
+    {"cf.exists", 3, 0, &do_cf_exists},
+    {"cf.reserve", 3, CMD_WRITE | CMD_DENYOOM, &do_cf_reserve},
+    {"config", -2, 0, &do_config},
+    {"decr", 2, CMD_WRITE | CMD_DENYOOM, &do_decr},
+    {"decrby", 3, CMD_WRITE | CMD_DENYOOM, &do_decrby},
+    {"del", -2, CMD_WRITE, &do_del},
+    {"expire", 3, CMD_WRITE, &do_expire},
+    {"geoadd", -5, CMD_WRITE | CMD_DENYOOM, &do_geoadd},
+    {"geodist", -4, 0, &do_geodist},
+    {"geopos", -3, 0, &do_geopos},
+    {"geosearch", -7, 0, &do_geosearch},
+    {"get", 2, 0, &do_get},
+    {"getbit", 3, 0, &do_getbit},
+    {"hdel", -3, CMD_WRITE, &do_hdel},
+    {"hget", 3, 0, &do_hget},
+    {"hgetall", 2, 0, &do_hgetall},
+    {"hincrby", 4, CMD_WRITE | CMD_DENYOOM, &do_hincrby},
+    {"hlen", 2, 0, &do_hlen},
+    {"hotkeys", -1, 0, &do_hotkeys},
+    {"hset", -4, CMD_WRITE | CMD_DENYOOM, &do_hset},
+    {"incr", 2, CMD_WRITE | CMD_DENYOOM, &do_incr},
+    {"incrby", 3, CMD_WRITE | CMD_DENYOOM, &do_incrby},
+    {"incrbyfloat", 3, CMD_WRITE | CMD_DENYOOM, &do_incrbyfloat},
+    {"info", -1, 0, &do_info},
+    {"keys", 1, 0, &do_keys},
+    {"latency", -2, 0, &do_latency},
+    {"lindex", 3, 0, &do_lindex},
+    {"llen", 2, 0, &do_llen},
+    {"lpop", -2, CMD_WRITE, &do_lpop},
+    {"lpush", -3, CMD_WRITE | CMD_DENYOOM, &do_lpush},
+    {"lrange", 4, 0, &do_lrange},
+    {"memory", -2, 0, &do_memory},
+    {"persist", 2, CMD_WRITE, &do_persist},
+    {"pexpire", 3, CMD_WRITE, &do_pexpire},
+    {"pfadd", -2, CMD_WRITE | CMD_DENYOOM, &do_pfadd},
+    {"pfcount", -2, 0, &do_pfcount},
+    {"pfmerge", -2, CMD_WRITE | CMD_DENYOOM, &do_pfmerge},
+    {"pttl", 2, 0, &do_pttl},
+    {"rpop", -2, CMD_WRITE, &do_rpop},
+    {"rpush", -3, CMD_WRITE | CMD_DENYOOM, &do_rpush},
+    {"sadd", -3, CMD_WRITE | CMD_DENYOOM, &do_sadd},
+    {"save", 1, 0, &do_save},
+    {"scard", 2, 0, &do_scard},
+    {"set", 3, CMD_WRITE | CMD_DENYOOM, &do_set},
+    {"setbit", 4, CMD_WRITE | CMD_DENYOOM, &do_setbit},
+    {"sinter", -2, 0, &do_sinter},
+    {"sismember", 3, 0, &do_sismember},
+    {"slowlog", -2, 0, &do_slowlog},
+    {"smembers", 2, 0, &do_smembers},
+    {"srem", -3, CMD_WRITE, &do_srem},
+    {"sunion", -2, 0, &do_sunion},
+    {"ttl", 2, 0, &do_ttl},
+    {"unlink", -2, CMD_WRITE, &do_unlink},
+    {"xadd", -5, CMD_WRITE | CMD_DENYOOM, &do_xadd},
+    {"xlen", 2, 0, &do_xlen},
+    {"xrange", -4, 0, &do_xrange},
+    {"xread", -4, 0, &do_xread},
+    {"xtrim", -4, CMD_WRITE, &do_xtrim},
+    {"zadd", -4, CMD_WRITE | CMD_DENYOOM, &do_zadd},
+    {"zcard", 2, 0, &do_zcard},
+    {"zpopmax", -2, CMD_WRITE, &do_zpopmax},
+    {"zpopmin", -2, CMD_WRITE, &do_zpopmin},
+    {"zquery", 6, 0, &do_zquery},
+    {"zrange", -4, 0, &do_zrange},
+    {"zrem", -3, CMD_WRITE, &do_zrem},
+    {"zscore", 3, 0, &do_zscore},
+};
+
+Command *cmd_lookup(const std::string &name){
+    size_t lo = 0;
+    size_t hi = sizeof(g_cmds) / sizeof(g_cmds[0]);
+    while (lo < hi){
+        size_t mid = (lo + hi) / 2;
+        int rv = strcasecmp(name.c_str(), g_cmds[mid].name);
+        if (rv == 0) return &g_cmds[mid];
+        if (rv < 0){
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+Command *cmd_table(size_t *n){
+    *n = sizeof(g_cmds) / sizeof(g_cmds[0]);
+    return g_cmds;
+}
+
+uint64_t do_request(std::vector<std::string> &cmd, std::string &out){
+    g_stats.commands++;
+    Command *c = cmd.empty() ? NULL : cmd_lookup(cmd[0]);
+    if (!c){ // cmd is not recognized
+        g_stats.rejected++;
         out_err(out, ERR_UNKNOWN, "Unknown cmd");
+        return 0;
     }
+    int32_t argc = (int32_t)cmd.size();
+    if ((c->arity > 0 && argc != c->arity) || (c->arity < 0 && argc < -c->arity)){
+        g_stats.rejected++;
+        out_err(out, ERR_ARG, "wrong number of arguments");
+        return 0;
+    }
+    // make room before anything that may grow the keyspace
+    if ((c->flags & CMD_DENYOOM) && !evict_run()){
+        g_stats.rejected++;
+        out_err(out, ERR_OOM, "maxmemory reached");
+        return 0;
+    }
+    if (!c->hist){
+        c->hist = new LatHist();
+    }
+    TRACE2(command_start, c->name, argc);
+    uint64_t start = lat_now();
+    c->fn(cmd, out);
+    uint64_t cycles = lat_now() - start;
+    TRACE2(command_done, c->name, cycles);
+    c->calls++;
+    c->cycles += cycles;
+    lat_add(c->hist, cycles);
+    lat_event(LAT_EV_COMMAND, cycles);
+    return cycles;
 }
 
 bool try_one_request(Conn *conn, int epfd){
@@ -135,8 +311,29 @@ bool try_one_request(Conn *conn, int epfd){
     
     // do the request
     std::string out;
-    do_request(cmd, out);
+    uint64_t cycles = do_request(cmd, out);
+    slowlog_check(&conn->rbuf[4], len, cycles, conn->fd);
+
+    // remove this request from rbuf
+    // note: frequent removal is inefficient
+    size_t remain = conn->rbuf_size - (4 + len);
+    if (remain){
+        memmove(conn->rbuf, &conn->rbuf[4+len], remain);
+    }
+    conn->rbuf_size = remain;
+
+    // a blocking command with nothing to serve replies later
+    if (block_park(conn, epfd)){
+        return false;
+    }
+    conn_reply(conn, out, epfd);
+    state_res(conn, epfd);
 
+    // continue the outer loop if all requests are processed
+    return (conn->state == STATE_REQ);
+}
+
+void conn_reply(Conn *conn, std::string &out, int epfd){
     // now pack the response into the buffer
     if(4 + out.size() > k_max_msg) {
         out.clear();
@@ -145,30 +342,20 @@ bool try_one_request(Conn *conn, int epfd){
 
     // fill in header and rescode in wbuf
     uint32_t wlen = (uint32_t)out.size(); // add 4 bytes for rescode length
+    if (4 + out.size() > conn->wbuf_cap){
+        conn_buf_resize(conn->wbuf, conn->wbuf_cap, 4 + out.size());
+    }
     memcpy(&conn->wbuf[0], &wlen, 4);
     memcpy(&conn->wbuf[4], out.data(), out.size());
     conn->wbuf_size = 4 + wlen;
 
-    // remove this request from rbuf
-    // note: frequent removal is inefficient
-    size_t remain = conn->rbuf_size - (4 + len);
-    if (remain){
-        memmove(conn->rbuf, &conn->rbuf[4+len], remain);
-    }
-    conn->rbuf_size = remain;
-
-    // update state of connection as RES, and the event type for epoll monitor, then respond to the client
+    // update state of connection as RES, and the event type for epoll monitor
     conn->state = STATE_RES;
 
 	struct epoll_event epollout_event = {};
 	epollout_event.events = EPOLLOUT;
 	epollout_event.data.fd = conn->fd;
 	epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &epollout_event);
-
-	state_res(conn, epfd);
-
-    // continue the outer loop if all requests are processed
-    return (conn->state == STATE_REQ);
 }
 
 void state_req(Conn *conn, int epfd){
@@ -176,11 +363,17 @@ void state_req(Conn *conn, int epfd){
 }
 
 bool try_fill_buffer(Conn *conn, int epfd){
-    // try to fill the read buffer
-    assert(conn->rbuf_size < sizeof(conn->rbuf));
+    // a full buffer holds an incomplete request (whose length was checked), grow it
+    if (conn->rbuf_size == conn->rbuf_cap){
+        uint32_t len = 0;
+        memcpy(&len, &conn->rbuf[0], 4);
+        size_t want = std::max(conn->rbuf_cap * 2, (size_t)8 << 10);
+        conn_buf_resize(conn->rbuf, conn->rbuf_cap, std::min(want, (size_t)4 + len));
+    }
+    assert(conn->rbuf_size < conn->rbuf_cap);
     ssize_t rv = 0;
     do{
-        size_t cap = sizeof(conn->rbuf) - conn->rbuf_size;
+        size_t cap = conn->rbuf_cap - conn->rbuf_size;
         rv = read(conn->fd, &conn->rbuf[conn->rbuf_size], cap);
     }while(rv < 0 && errno == EINTR); // retry if read failed because of system interrupts
 
@@ -205,10 +398,16 @@ bool try_fill_buffer(Conn *conn, int epfd){
 
     // update rbuf states
     conn->rbuf_size += (size_t)rv;
-    assert(conn->rbuf_size < (size_t)sizeof(conn->rbuf));
+    g_stats.net_in += (uint64_t)rv;
+    TRACE2(conn_read, conn->fd, rv);
+    assert(conn->rbuf_size <= conn->rbuf_cap);
 
     // try to process requests one by one
     while(try_one_request(conn, epfd)){}
+    // don't keep a big buffer around for one big request
+    if (conn->rbuf_cap > k_conn_buf_idle && conn->rbuf_size < k_conn_buf_init){
+        conn_buf_resize(conn->rbuf, conn->rbuf_cap, k_conn_buf_init);
+    }
     return (conn->state == STATE_REQ);
 }
 
@@ -237,12 +436,17 @@ bool try_flush_buffer(Conn *conn, int epfd){
 
     // update connection states
     conn->wbuf_sent += (size_t)rv;
+    g_stats.net_out += (uint64_t)rv;
+    TRACE2(conn_write, conn->fd, rv);
     assert(conn->wbuf_sent <= conn->wbuf_size);
     if(conn->wbuf_sent == conn->wbuf_size){ // response is fully sent
 		// conn state
         conn->state = STATE_REQ;
         conn->wbuf_sent = 0;
         conn->wbuf_size = 0;
+        if (conn->wbuf_cap > k_conn_buf_idle){
+            conn_buf_resize(conn->wbuf, conn->wbuf_cap, k_conn_buf_init);
+        }
 
 		// event type to for epoll monitor
 	    struct epoll_event epollin_event = {};
@@ -293,9 +497,47 @@ bool cmd_is(const std::string &word, const char *cmd){
 
 void do_keys(std::vector<std::string>& cmd, std::string &out){
     (void)cmd;
-    out_arr(out, (uint32_t)hm_size(&g_data.db));
-    h_scan(&g_data.db.tb1, &cb_scan, &out);
-    h_scan(&g_data.db.tb2, &cb_scan, &out);
+    // expired keys are skipped, so the count is only known afterwards
+    KeysScan scan;
+    h_scan(&g_data.db.tb1, &cb_scan, &scan);
+    h_scan(&g_data.db.tb2, &cb_scan, &scan);
+    snap_scan(&g_data.snap, &cb_scan_snap, &scan);
+    out_arr(out, scan.n);
+    out.append(scan.out);
+}
+
+
+void do_save(std::vector<std::string>& cmd, std::string &out){
+    (void)cmd;
+    uint64_t start = lat_now();
+    int32_t err = snap_save(g_config.snapshot_path.c_str(), &g_data.db, &g_data.snap, g_config.snapshot_compression);
+    lat_event(LAT_EV_PERSISTENCE, lat_now() - start);
+    if (err){
+        return out_err(out, ERR_IO, "snapshot write failed");
+    }
+    out_nil(out);
+}
+
+
+void do_config(std::vector<std::string>& cmd, std::string &out){
+    if (cmd.size() == 3 && cmd_is(cmd[1], "get")){
+        std::string val;
+        if (!config_get(cmd[2], val)){
+            return out_nil(out);
+        }
+        return out_str(out, val);
+    }
+    if (cmd.size() == 4 && cmd_is(cmd[1], "set")){
+        if (config_set(cmd[2], cmd[3])){
+            return out_err(out, ERR_ARG, "bad config option or value");
+        }
+        return out_nil(out);
+    }
+    if (cmd.size() == 2 && cmd_is(cmd[1], "resetstat")){
+        stats_reset();
+        return out_nil(out);
+    }
+    out_err(out, ERR_ARG, "expect CONFIG GET name | CONFIG SET name value | CONFIG RESETSTAT");
 }
 
 
@@ -306,53 +548,632 @@ void do_get(std::vector<std::string>& cmd, std::string &out){
     key.key.swap(cmd[1]);
     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
 
-    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
-    if(!node){ // not exist
-        out_nil(out);
+    Entry *ent = entry_lookup(&key);
+    if(!ent){ // not in heap, reads of unmigrated keys are served from the mapping
+        SnapRecord *rec = snap_entry_lookup(&key);
+        if (!rec){
+            out_nil(out);
+        } else if (rec->type != SNAP_T_STR){
+            out_err(out, ERR_TYPE, "WRONGTYPE");
+        } else {
+            out_str(out, rec_val(rec), rec->vlen);
+        }
         return;
     }
+    if (ent->type != T_STR){
+        return out_err(out, ERR_TYPE, "WRONGTYPE");
+    }
 
     // fetch the data
-    const std::string &val = container_of(node, Entry, node)->val; assert(val.size() < k_max_msg);
-    out_str(out, val);
+    entry_touch(ent);
+    std::string buf;
+    out_str(out, entry_get_str(ent, buf));
 }
 
 
-void do_set(std::vector<std::string>& cmd, std::string &out){
+void entry_put_str(std::string &name, std::string &val){
     Entry key;
-    key.key.swap(cmd[1]);
+    key.key.swap(name);
     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-    HNode *query = hm_lookup(&g_data.db, &key.node, entry_eq);
-    if(query){ // key already exist
-        container_of(query, Entry, node)->val.swap(cmd[2]);
+    Entry *ent = entry_lookup(&key);
+    if (ent && ent->type != T_STR){ // a value of another type is replaced as a whole
+        hm_pop(&g_data.db, &ent->node, &hnode_same);
+        entry_del(ent);
+        ent = NULL;
+    }
+    if(ent){ // key already exist
+        entry_set_str(ent, val);
+        entry_set_ttl(ent, -1);
+        entry_touch(ent);
     } else { // key not found
-        Entry *new_entry = (Entry *)malloc(sizeof(Entry)); // heap allocation
-        new_entry->key.swap(key.key);
-        new_entry->val.swap(cmd[2]);
-        new_entry->node.hcode = str_hash((uint8_t *)new_entry->key.data(), new_entry->key.size());
-        hm_insert(&g_data.db, &new_entry->node);
+        // a snapshot copy of the key is now stale
+        SnapRecord *rec = snap_entry_lookup(&key);
+        if (rec){
+            snap_kill(&g_data.snap, rec);
+        }
+        ent = new Entry(); // heap allocation
+        ent->key.swap(key.key);
+        entry_set_str(ent, val);
+        ent->node.hcode = key.node.hcode;
+        entry_init_lru(ent);
+        hm_insert(&g_data.db, &ent->node);
     }
+    entry_account(ent);
+}
+
+void do_set(std::vector<std::string>& cmd, std::string &out){
+    entry_put_str(cmd[1], cmd[2]);
     out_nil(out);
 }
 
 
-void do_del(std::vector<std::string>& cmd, std::string &out){
-    // deletion 
+bool del_key(std::string &name, bool lazy){
     // 1. construct key for query
     Entry key;
-    key.key.swap(cmd[1]);
+    key.key.swap(name);
     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
     // 2. get the Entry object on heap (if exist)
-    HNode *del_node = hm_pop(&g_data.db, &key.node, entry_eq);
-    if (del_node){
-        free((Entry *)container_of(del_node, Entry, node)); // heap deallocation
+    Entry *ent = entry_lookup(&key);
+    if (ent){
+        hm_pop(&g_data.db, &ent->node, &hnode_same);
+        entry_del(ent, lazy); // heap deallocation
+        return true;
+    }
+    // 3. a key that was never migrated only needs its record marked dead
+    SnapRecord *rec = snap_entry_lookup(&key);
+    if (rec){
+        snap_kill(&g_data.snap, rec);
+    }
+    return rec != NULL;
+}
+
+void do_del(std::vector<std::string>& cmd, std::string &out){
+    // respond with an interger, indicating how many deletions took place
+    int64_t n = 0;
+    for (size_t i = 1; i < cmd.size(); ++i){
+        n += del_key(cmd[i], g_config.lazyfree);
+    }
+    out_int(out, n);
+}
+
+void do_unlink(std::vector<std::string>& cmd, std::string &out){
+    // same as DEL, but big values are always freed in the background
+    int64_t n = 0;
+    for (size_t i = 1; i < cmd.size(); ++i){
+        n += del_key(cmd[i], true);
+    }
+    out_int(out, n);
+}
+
+
+
+
+// TTL commands
+bool parse_int(const std::string &s, int64_t &out){
+    char *end = NULL;
+    errno = 0;
+    long long v = strtoll(s.c_str(), &end, 10);
+    if (errno || s.empty() || *end != '\0') return false;
+    out = (int64_t)v;
+    return true;
+}
+
+bool parse_dbl(const std::string &s, double &out){
+    char *end = NULL;
+    errno = 0;
+    out = strtod(s.c_str(), &end);
+    return !s.empty() && *end == '\0' && !errno && !isnan(out);
+}
+
+static void expire_generic(std::vector<std::string>& cmd, std::string &out, int64_t unit_ms){
+    int64_t ttl = 0;
+    if (!parse_int(cmd[2], ttl) || ttl > INT64_MAX / unit_ms || ttl < INT64_MIN / unit_ms){
+        return out_err(out, ERR_ARG, "expect int64");
+    }
+    Entry key;
+    key.key.swap(cmd[1]);
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    Entry *ent = entry_lookup_mut(&key);
+    if (!ent){
+        return out_int(out, 0);
+    }
+    if (ttl * unit_ms <= 0){ // already expired
+        hm_pop(&g_data.db, &ent->node, &hnode_same);
+        entry_del(ent);
+        return out_int(out, 1);
+    }
+    entry_set_ttl(ent, ttl * unit_ms);
+    out_int(out, 1);
+}
+
+void do_expire(std::vector<std::string>& cmd, std::string &out){
+    expire_generic(cmd, out, 1000);
+}
+
+void do_pexpire(std::vector<std::string>& cmd, std::string &out){
+    expire_generic(cmd, out, 1);
+}
+
+static void ttl_generic(std::vector<std::string>& cmd, std::string &out, int64_t unit_ms){
+    Entry key;
+    key.key.swap(cmd[1]);
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    int64_t expire_at = -1;
+    Entry *ent = entry_lookup(&key);
+    if (ent){
+        expire_at = entry_expire_at(ent);
+    } else if (SnapRecord *rec = snap_entry_lookup(&key)){
+        expire_at = rec->expire_at;
+    } else {
+        return out_int(out, -2); // no such key
+    }
+    if (expire_at < 0){
+        return out_int(out, -1); // no TTL
+    }
+    int64_t left = expire_at - (int64_t)g_data.now_ms;
+    out_int(out, left > 0 ? (left + unit_ms - 1) / unit_ms : 0);
+}
+
+void do_ttl(std::vector<std::string>& cmd, std::string &out){
+    ttl_generic(cmd, out, 1000);
+}
+
+void do_pttl(std::vector<std::string>& cmd, std::string &out){
+    ttl_generic(cmd, out, 1);
+}
+
+void do_persist(std::vector<std::string>& cmd, std::string &out){
+    Entry key;
+    key.key.swap(cmd[1]);
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    Entry *ent = entry_lookup_mut(&key);
+    if (!ent || ent->heap_idx == (size_t)-1){
+        return out_int(out, 0);
+    }
+    entry_set_ttl(ent, -1);
+    out_int(out, 1);
+}
+
+
+
+
+// Keyspace helpers
+static bool entry_expired(Entry *ent){
+    return ent->heap_idx != (size_t)-1 && g_data.heap[ent->heap_idx].val <= g_data.now_ms;
+}
+
+Entry *entry_lookup(Entry *key){
+    hotkeys_check(key->key, key->node.hcode);
+    HNode *node = hm_lookup(&g_data.db, &key->node, &entry_eq);
+    if (!node) return NULL;
+    Entry *ent = container_of(node, Entry, node);
+    if (entry_expired(ent)){ // lazy expiration
+        hm_pop(&g_data.db, node, &hnode_same);
+        entry_del(ent);
+        return NULL;
+    }
+    return ent;
+}
+
+SnapRecord *snap_entry_lookup(Entry *key){
+    SnapRecord *rec = snap_lookup(&g_data.snap, key->key.data(), key->key.size(), key->node.hcode);
+    if (rec && rec->expire_at >= 0 && (uint64_t)rec->expire_at <= g_data.now_ms){
+        snap_kill(&g_data.snap, rec);
+        return NULL;
+    }
+    return rec;
+}
+
+Entry *entry_lookup_mut(Entry *key){
+    Entry *ent = entry_lookup(key);
+    if (ent) return ent;
+    SnapRecord *rec = snap_entry_lookup(key);
+    if (!rec) return NULL;
+
+    // migrate the mapped key into heap storage before it gets modified
+    ent = new Entry();
+    ent->key.assign(rec_key(rec), rec->klen);
+    if (!entry_restore(ent, rec->type, rec_val(rec), rec->vlen)){
+        msg("corrupted snapshot record");
+        entry_free(ent);
+        snap_kill(&g_data.snap, rec);
+        return NULL;
+    }
+    ent->node.hcode = rec->hcode;
+    entry_init_lru(ent);
+    if (rec->expire_at >= 0){
+        entry_set_ttl_at(ent, (uint64_t)rec->expire_at);
+    }
+    snap_kill(&g_data.snap, rec);
+    hm_insert(&g_data.db, &ent->node);
+    entry_account(ent);
+    return ent;
+}
+
+bool entry_find(std::string &name, uint32_t type, Entry &key, Entry *&ent, std::string &out){
+    key.key.swap(name);
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    ent = entry_lookup_mut(&key);
+    if (ent && ent->type != type){
+        out_err(out, ERR_TYPE, "WRONGTYPE");
+        return false;
     }
+    if (ent){
+        entry_touch(ent);
+    }
+    return true;
+}
 
-    // respond with an interger, indicating whether the deletion took place
-    return out_int(out, del_node ? 1:0);
+Entry *entry_create(Entry &key, uint32_t type){
+    Entry *ent = new Entry();
+    ent->key.swap(key.key);
+    ent->node.hcode = key.node.hcode;
+    ent->type = type;
+    switch (type){
+        case T_STR:
+            break;
+        case T_ZSET:
+            ent->zset = new ZSet();
+            break;
+        case T_LIST:
+            ent->list = new QList();
+            break;
+        case T_HASH:
+            ent->hash = new Hash();
+            break;
+        case T_SET:
+            ent->set = new Set();
+            break;
+        case T_HLL:
+            ent->hll = new Hll();
+            break;
+        case T_BLOOM:   // sized by the caller with `bf_init`
+            ent->bf = new Bloom();
+            break;
+        case T_CUCKOO:  // sized by the caller with `cf_init`
+            ent->cf = new Cuckoo();
+            break;
+        case T_STREAM:
+            ent->stream = new Stream();
+            break;
+        default:
+            assert(0);
+    }
+    entry_init_lru(ent);
+    hm_insert(&g_data.db, &ent->node);
+    return ent;
 }
 
+static bool entry_empty(Entry *ent){
+    switch (ent->type){
+        case T_ZSET:
+            return zset_size(ent->zset) == 0;
+        case T_LIST:
+            return ent->list->n == 0;
+        case T_HASH:
+            return ent->hash->n == 0;
+        case T_SET:
+            return set_size(ent->set) == 0;
+        default:
+            return false;
+    }
+}
 
+void entry_account_or_drop(Entry *ent){
+    if (entry_empty(ent)){
+        hm_pop(&g_data.db, &ent->node, &hnode_same);
+        entry_del(ent);
+    } else {
+        entry_account(ent);
+    }
+}
+
+void entry_set_ttl_at(Entry *ent, uint64_t expire_at){
+    if (ent->heap_idx == (size_t)-1){ // add a new item to the heap
+        HeapItem item;
+        item.ref = &ent->heap_idx;
+        g_data.heap.push_back(item);
+        ent->heap_idx = g_data.heap.size() - 1;
+    }
+    g_data.heap[ent->heap_idx].val = expire_at;
+    heap_update(g_data.heap.data(), ent->heap_idx, g_data.heap.size());
+}
+
+void entry_set_ttl(Entry *ent, int64_t ttl_ms){
+    if (ttl_ms >= 0){
+        return entry_set_ttl_at(ent, g_data.now_ms + (uint64_t)ttl_ms);
+    }
+    if (ent->heap_idx == (size_t)-1) return;
+    // erase the item from the heap by replacing it with the last one
+    size_t pos = ent->heap_idx;
+    g_data.heap[pos] = g_data.heap.back();
+    g_data.heap.pop_back();
+    if (pos < g_data.heap.size()){
+        heap_update(g_data.heap.data(), pos, g_data.heap.size());
+    }
+    ent->heap_idx = -1;
+}
+
+int64_t entry_expire_at(Entry *ent){
+    return ent->heap_idx == (size_t)-1 ? -1 : (int64_t)g_data.heap[ent->heap_idx].val;
+}
+
+static size_t str_mem(const std::string &s){
+    return s.capacity() > 15 ? mem_size(s.data()) : 0; // short strings live inside the object
+}
+
+static size_t htab_mem(HTab *tab){
+    return mem_size(tab->tab);
+}
+
+size_t entry_mem(Entry *ent){
+    size_t mem = mem_size(ent) + str_mem(ent->key) + str_mem(ent->val);
+    switch (ent->type){
+        case T_ZSET:
+            mem += sizeof(ZSet) + ent->zset->bytes + htab_mem(&ent->zset->hmap.tb1) + htab_mem(&ent->zset->hmap.tb2);
+            break;
+        case T_LIST:
+            mem += sizeof(QList) + ent->list->bytes;
+            break;
+        case T_HASH:
+            mem += sizeof(Hash) + str_mem(ent->hash->packed) + ent->hash->bytes
+                + htab_mem(&ent->hash->hmap.tb1) + htab_mem(&ent->hash->hmap.tb2);
+            break;
+        case T_SET:
+            mem += sizeof(Set) + ent->set->is.cap * ent->set->is.width + ent->set->bytes
+                + htab_mem(&ent->set->hmap.tb1) + htab_mem(&ent->set->hmap.tb2);
+            break;
+        case T_HLL:
+            mem += sizeof(Hll) + hll_mem(ent->hll);
+            break;
+        case T_BLOOM:
+            mem += sizeof(Bloom) + bf_mem(ent->bf);
+            break;
+        case T_CUCKOO:
+            mem += sizeof(Cuckoo) + cf_mem(ent->cf);
+            break;
+        case T_STREAM:
+            mem += sizeof(Stream) + ent->stream->bytes + ent->stream->blocks.size() * sizeof(SBlock *);
+            break;
+    }
+    return mem;
+}
+
+void entry_account(Entry *ent){
+    size_t mem = entry_mem(ent);
+    g_data.used_memory += mem - ent->mem;
+    ent->mem = mem;
+}
+
+void entry_del(Entry *ent, bool lazy){
+    entry_set_ttl(ent, -1);
+    g_data.used_memory -= ent->mem;
+    if (lazy && entry_free_effort(ent) > (size_t)g_config.lazyfree_threshold){
+        return lazyfree_push(ent);
+    }
+    entry_free(ent);
+}
+
+void entry_del(Entry *ent){
+    entry_del(ent, g_config.lazyfree);
+}
+
+void entry_free(Entry *ent){
+    switch (ent->type){
+        case T_ZSET:
+            if (ent->zset){
+                zset_dispose(ent->zset);
+                delete ent->zset;
+            }
+            break;
+        case T_LIST:
+            if (ent->list){
+                ql_dispose(ent->list);
+                delete ent->list;
+            }
+            break;
+        case T_HASH:
+            if (ent->hash){
+                hash_dispose(ent->hash);
+                delete ent->hash;
+            }
+            break;
+        case T_SET:
+            if (ent->set){
+                set_dispose(ent->set);
+                delete ent->set;
+            }
+            break;
+        case T_HLL:
+            if (ent->hll){
+                hll_dispose(ent->hll);
+                delete ent->hll;
+            }
+            break;
+        case T_BLOOM:
+            if (ent->bf){
+                bf_dispose(ent->bf);
+                delete ent->bf;
+            }
+            break;
+        case T_CUCKOO:
+            if (ent->cf){
+                cf_dispose(ent->cf);
+                delete ent->cf;
+            }
+            break;
+        case T_STREAM:
+            if (ent->stream){
+                stream_dispose(ent->stream);
+                delete ent->stream;
+            }
+            break;
+    }
+    delete ent;
+}
+
+void expire_run(){
+    const size_t k_max_works = 2000;
+    size_t nworks = 0;
+    while (!g_data.heap.empty() && g_data.heap[0].val <= g_data.now_ms && nworks++ < k_max_works){
+        Entry *ent = container_of(g_data.heap[0].ref, Entry, heap_idx);
+        HNode *node = hm_pop(&g_data.db, &ent->node, &hnode_same);
+        assert(node == &ent->node);
+        (void)node;
+        entry_del(ent);
+    }
+}
+
+int32_t next_timer_ms(){
+    const int32_t k_idle_timeout_ms = 30000;
+    uint64_t next = std::min(g_data.heap.empty() ? UINT64_MAX : g_data.heap[0].val, block_next_ms());
+    if (next == UINT64_MAX){
+        return k_idle_timeout_ms;
+    }
+    if (next <= g_data.now_ms){
+        return 0;
+    }
+    return next - g_data.now_ms < (uint64_t)k_idle_timeout_ms ? (int32_t)(next - g_data.now_ms) : k_idle_timeout_ms;
+}
+
+void entry_set_int(Entry *ent, int64_t val){
+    std::string().swap(ent->val); // release the old bytes
+    ent->enc = ENC_INT;
+    ent->raw_len = 0;
+    ent->ival = val;
+}
+
+void entry_set_str(Entry *ent, std::string &val){
+    int64_t ival = 0;
+    if (str_to_int(val.data(), val.size(), &ival)){
+        return entry_set_int(ent, ival);
+    }
+    ent->enc = ENC_RAW;
+    ent->raw_len = 0;
+    if (g_config.value_compression && val.size() >= (size_t)g_config.value_compression_threshold
+        && val.size() <= UINT32_MAX){
+        std::string packed(lz_bound(val.size()), '\0');
+        size_t n = lz_compress((uint8_t *)val.data(), val.size(), (uint8_t *)&packed[0], packed.size());
+        if (n && n <= val.size() - val.size() / 8){ // keep it only if it saves at least 1/8
+            packed.resize(n);
+            packed.shrink_to_fit();
+            ent->val.swap(packed);
+            ent->enc = ENC_LZ;
+            ent->raw_len = (uint32_t)val.size();
+            return;
+        }
+    }
+    ent->val.swap(val);
+}
+
+const std::string &entry_get_str(Entry *ent, std::string &buf){
+    if (ent->enc == ENC_RAW){
+        return ent->val;
+    }
+    if (ent->enc == ENC_INT){
+        buf = std::to_string(ent->ival);
+        return buf;
+    }
+    buf.resize(ent->raw_len);
+    int64_t n = lz_decompress((uint8_t *)ent->val.data(), ent->val.size(), (uint8_t *)&buf[0], buf.size());
+    assert(n == (int64_t)ent->raw_len);
+    (void)n;
+    return buf;
+}
+
+std::string &entry_str_mut(Entry *ent){
+    if (ent->enc != ENC_RAW){
+        std::string buf;
+        entry_get_str(ent, buf); // decoded into `buf` for both encodings
+        ent->val.swap(buf);
+        ent->enc = ENC_RAW;
+        ent->raw_len = 0;
+    }
+    return ent->val;
+}
+
+const std::string &entry_dump(Entry *ent, std::string &buf){
+    switch (ent->type){
+        case T_ZSET:
+            buf.clear();
+            zset_encode(ent->zset, buf);
+            return buf;
+        case T_LIST:
+            buf.clear();
+            ql_encode(ent->list, buf);
+            return buf;
+        case T_HASH:
+            buf.clear();
+            hash_encode(ent->hash, buf);
+            return buf;
+        case T_SET:
+            buf.clear();
+            set_encode(ent->set, buf);
+            return buf;
+        case T_HLL:
+            buf.clear();
+            hll_encode(ent->hll, buf);
+            return buf;
+        case T_BLOOM:
+            buf.clear();
+            bf_encode(ent->bf, buf);
+            return buf;
+        case T_CUCKOO:
+            buf.clear();
+            cf_encode(ent->cf, buf);
+            return buf;
+        case T_STREAM:
+            buf.clear();
+            stream_encode(ent->stream, buf);
+            return buf;
+        default:
+            return entry_get_str(ent, buf);
+    }
+}
+
+bool entry_restore(Entry *ent, uint32_t type, const char *val, size_t len){
+    switch (type){
+        case T_STR: {
+            std::string str(val, len);
+            entry_set_str(ent, str);
+            return true;
+        }
+        case T_ZSET:
+            ent->type = T_ZSET;
+            ent->zset = new ZSet();
+            return zset_decode(ent->zset, val, len);
+        case T_LIST:
+            ent->type = T_LIST;
+            ent->list = new QList();
+            return ql_decode(ent->list, val, len);
+        case T_HASH:
+            ent->type = T_HASH;
+            ent->hash = new Hash();
+            return hash_decode(ent->hash, val, len);
+        case T_SET:
+            ent->type = T_SET;
+            ent->set = new Set();
+            return set_decode(ent->set, val, len);
+        case T_HLL:
+            ent->type = T_HLL;
+            ent->hll = new Hll();
+            return hll_decode(ent->hll, val, len);
+        case T_BLOOM:
+            ent->type = T_BLOOM;
+            ent->bf = new Bloom();
+            return bf_decode(ent->bf, val, len);
+        case T_CUCKOO:
+            ent->type = T_CUCKOO;
+            ent->cf = new Cuckoo();
+            return cf_decode(ent->cf, val, len);
+        case T_STREAM:
+            ent->type = T_STREAM;
+            ent->stream = new Stream();
+            return stream_decode(ent->stream, val, len);
+        default:
+            return false;
+    }
+}
 
 bool entry_eq(HNode *lhs, HNode *rhs){
     msg("entry_eq()");
@@ -363,6 +1184,10 @@ bool entry_eq(HNode *lhs, HNode *rhs){
     return le->key == re->key;
 }
 
+bool hnode_same(HNode *lhs, HNode *rhs){
+    return lhs == rhs;
+}
+
 
 
 // Data Encoding Scheme
@@ -381,6 +1206,13 @@ void out_str(std::string &out, const std::string &val){
     out.append(val);
 }
 
+void out_str(std::string &out, const char *val, size_t len){
+    out.push_back(SER_STR);
+    uint32_t len32 = (uint32_t)len;
+    out.append((char *)&len32, 4);
+    out.append(val, len);
+}
+
 void out_int(std::string &out, int64_t val){
     // 1b - SER_INT
     // 4b - val
@@ -388,6 +1220,13 @@ void out_int(std::string &out, int64_t val){
     out.append((char *)&val, 8);
 }
 
+void out_dbl(std::string &out, double val){
+    // 1b - SER_DBL
+    // 8b - val
+    out.push_back(SER_DBL);
+    out.append((char *)&val, 8);
+}
+
 void out_err(std::string &out, int32_t code, const std::string &msg){
     // 1b - SER_ERR
     // 4b - ERR_CODE
@@ -395,7 +1234,7 @@ void out_err(std::string &out, int32_t code, const std::string &msg){
     // varlen - msg
     out.push_back(SER_ERR);
     out.append((char *)&code, 4);
-    uint32_t msg_len = (uint32_t)out.size();
+    uint32_t msg_len = (uint32_t)msg.size();
     out.append((char *)&msg_len, 4);
     out.append(msg);
 }
@@ -412,6 +1251,16 @@ void out_arr(std::string &out, uint32_t n) {
 
 // Scan Callbacks
 void cb_scan(HNode *node, void *arg){
-    std::string &out = *(std::string *)arg;
-    out_str(out, container_of(node, Entry, node)->key);
+    KeysScan &scan = *(KeysScan *)arg;
+    Entry *ent = container_of(node, Entry, node);
+    if (entry_expired(ent)) return;
+    out_str(scan.out, ent->key);
+    scan.n++;
+}
+
+void cb_scan_snap(SnapRecord *rec, void *arg){
+    KeysScan &scan = *(KeysScan *)arg;
+    if (rec->expire_at >= 0 && (uint64_t)rec->expire_at <= g_data.now_ms) return;
+    out_str(scan.out, rec_key(rec), rec->klen);
+    scan.n++;
 }
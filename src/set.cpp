@@ -0,0 +1,207 @@
+#include "set.h"
+#include "config.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+bool str_to_int(const char *data, size_t len, int64_t *val){
+    // canonical form only, so the member prints back as the same bytes
+    if (len == 0 || len > 20) return false;
+    size_t i = 0;
+    bool neg = data[0] == '-';
+    if (neg){
+        i = 1;
+        if (len == 1) return false;
+    }
+    if (data[i] == '0' && (len > i + 1 || neg)) return false; // leading zero or "-0"
+    uint64_t v = 0;
+    for (; i < len; ++i){
+        if (data[i] < '0' || data[i] > '9') return false;
+        uint64_t d = (uint64_t)(data[i] - '0');
+        if (v > (UINT64_MAX - d) / 10) return false;
+        v = v * 10 + d;
+    }
+    if (neg){
+        if (v > (uint64_t)INT64_MAX + 1) return false;
+        *val = (int64_t)(0 - v);
+    } else {
+        if (v > (uint64_t)INT64_MAX) return false;
+        *val = (int64_t)v;
+    }
+    return true;
+}
+
+static bool smember_eq(HNode *node, HNode *key){
+    SMember *sm = container_of(node, SMember, node);
+    HKey *hkey = container_of(key, HKey, node);
+    return sm->name.size() == hkey->len && 0 == memcmp(sm->name.data(), hkey->name, hkey->len);
+}
+
+static size_t smember_mem(SMember *sm){
+    return sizeof(SMember) + (sm->name.capacity() > 15 ? sm->name.capacity() + 1 : 0);
+}
+
+static bool hmap_add(Set *set, const char *name, size_t len){
+    HKey key;
+    key.node.hcode = str_hash((uint8_t *)name, len);
+    key.name = name;
+    key.len = len;
+    if (hm_lookup(&set->hmap, &key.node, &smember_eq)) return false;
+    SMember *sm = new SMember();
+    sm->name.assign(name, len);
+    sm->node.hcode = key.node.hcode;
+    hm_insert(&set->hmap, &sm->node);
+    set->bytes += smember_mem(sm);
+    return true;
+}
+
+// switch an intset over to the hashtable
+static void set_convert(Set *set){
+    char buf[32];
+    for (size_t i = 0; i < set->is.n; ++i){
+        int len = snprintf(buf, sizeof(buf), "%lld", (long long)intset_get(&set->is, i));
+        hmap_add(set, buf, (size_t)len);
+    }
+    intset_dispose(&set->is);
+    set->enc = SET_HMAP;
+}
+
+size_t set_size(Set *set){
+    return set->enc == SET_INTSET ? set->is.n : set->hmap.tb1.size + set->hmap.tb2.size;
+}
+
+bool set_add(Set *set, const char *name, size_t len){
+    int64_t val = 0;
+    if (set->enc == SET_INTSET){
+        if (str_to_int(name, len, &val)){
+            size_t pos = 0;
+            if (intset_find(&set->is, val, &pos)) return false;
+            if (set->is.n < (size_t)g_config.set_max_intset_entries){
+                return intset_add(&set->is, val);
+            }
+        }
+        set_convert(set);
+    }
+    return hmap_add(set, name, len);
+}
+
+size_t set_add_many(Set *set, const std::string *names, size_t n){
+    if (set->enc == SET_INTSET){
+        std::vector<int64_t> vals(n);
+        bool all_int = true;
+        for (size_t i = 0; i < n && all_int; ++i){
+            all_int = str_to_int(names[i].data(), names[i].size(), &vals[i]);
+        }
+        if (all_int && set->is.n + n <= (size_t)g_config.set_max_intset_entries){
+            std::sort(vals.begin(), vals.end());
+            return intset_add_sorted(&set->is, vals.data(), n);
+        }
+    }
+    size_t added = 0;
+    for (size_t i = 0; i < n; ++i){
+        added += set_add(set, names[i].data(), names[i].size());
+    }
+    return added;
+}
+
+bool set_del(Set *set, const char *name, size_t len){
+    if (set->enc == SET_INTSET){
+        int64_t val = 0;
+        return str_to_int(name, len, &val) && intset_del(&set->is, val);
+    }
+    HKey key;
+    key.node.hcode = str_hash((uint8_t *)name, len);
+    key.name = name;
+    key.len = len;
+    HNode *node = hm_pop(&set->hmap, &key.node, &smember_eq);
+    if (!node) return false;
+    SMember *sm = container_of(node, SMember, node);
+    set->bytes -= smember_mem(sm);
+    delete sm;
+    return true;
+}
+
+bool set_has(Set *set, const char *name, size_t len){
+    if (set->enc == SET_INTSET){
+        int64_t val = 0;
+        size_t pos = 0;
+        return str_to_int(name, len, &val) && intset_find(&set->is, val, &pos);
+    }
+    HKey key;
+    key.node.hcode = str_hash((uint8_t *)name, len);
+    key.name = name;
+    key.len = len;
+    return hm_lookup(&set->hmap, &key.node, &smember_eq) != NULL;
+}
+
+struct SetScan {
+    void (*f)(const char *, size_t, void *);
+    void *arg;
+};
+
+static void cb_scan_member(HNode *node, void *arg){
+    SetScan *scan = (SetScan *)arg;
+    SMember *sm = container_of(node, SMember, node);
+    scan->f(sm->name.data(), sm->name.size(), scan->arg);
+}
+
+void set_scan(Set *set, void (*f)(const char *, size_t, void *), void *arg){
+    if (set->enc == SET_HMAP){
+        SetScan scan = {f, arg};
+        h_scan(&set->hmap.tb1, &cb_scan_member, &scan);
+        h_scan(&set->hmap.tb2, &cb_scan_member, &scan);
+        return;
+    }
+    char buf[32];
+    for (size_t i = 0; i < set->is.n; ++i){
+        int len = snprintf(buf, sizeof(buf), "%lld", (long long)intset_get(&set->is, i));
+        f(buf, (size_t)len, arg);
+    }
+}
+
+static void htab_free_members(HTab *tab){
+    for (size_t i = 0; tab->tab && i < tab->mask + 1; ++i){
+        HNode *node = tab->tab[i];
+        while (node){
+            HNode *next = node->next;
+            delete container_of(node, SMember, node);
+            node = next;
+        }
+    }
+}
+
+void set_dispose(Set *set){
+    intset_dispose(&set->is);
+    htab_free_members(&set->hmap.tb1);
+    htab_free_members(&set->hmap.tb2);
+    hm_destroy(&set->hmap);
+    *set = Set{};
+}
+
+static void cb_encode(const char *name, size_t len, void *arg){
+    std::string &out = *(std::string *)arg;
+    uint32_t len32 = (uint32_t)len;
+    out.append((char *)&len32, 4);
+    out.append(name, len);
+}
+
+void set_encode(Set *set, std::string &out){
+    set_scan(set, &cb_encode, &out);
+}
+
+bool set_decode(Set *set, const char *data, size_t len){
+    size_t pos = 0;
+    while (pos < len){
+        if (len - pos < 4) return false;
+        uint32_t mlen = 0;
+        memcpy(&mlen, &data[pos], 4);
+        pos += 4;
+        if (len - pos < mlen) return false;
+        set_add(set, &data[pos], mlen);
+        pos += mlen;
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+#include "slowlog.h"
+#include "latency.h"
+#include "server_utils.h"
+#include "config.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+uint64_t g_slowlog_cycles = UINT64_MAX;
+
+static std::vector<SlowEntry> g_ring;   // `g_slow_n` entries ending before `g_slow_pos`
+static size_t g_slow_pos = 0;
+static size_t g_slow_n = 0;
+static uint64_t g_slow_next_id = 0;
+
+// settings the threshold was computed for
+static int64_t g_slow_usec = -1;
+static uint64_t g_slow_calc_ms = 0;
+
+// entry `i` counting back from the newest
+static SlowEntry &slow_at(size_t i){
+    return g_ring[(g_slow_pos + g_ring.size() - 1 - i) % g_ring.size()];
+}
+
+void slowlog_tick(){
+    // the ring follows slowlog-max-len, keeping the newest entries
+    size_t want = g_config.slowlog_max_len > 0 ? (size_t)g_config.slowlog_max_len : 0;
+    if (want != g_ring.size()){
+        std::vector<SlowEntry> ring(want);
+        size_t n = g_slow_n < want ? g_slow_n : want;
+        for (size_t i = 0; i < n; ++i){
+            ring[n - 1 - i] = std::move(slow_at(i));
+        }
+        g_ring.swap(ring);
+        g_slow_n = n;
+        g_slow_pos = want ? n % want : 0;
+    }
+    // the cycles-per-ns ratio gets more precise with uptime, refresh it once a second
+    int64_t usec = g_config.slowlog_log_slower_than;
+    if (usec == g_slow_usec && g_data.now_ms - g_slow_calc_ms < 1000){
+        return;
+    }
+    g_slow_usec = usec;
+    g_slow_calc_ms = g_data.now_ms;
+    if (usec < 0 || g_ring.empty()){
+        g_slowlog_cycles = UINT64_MAX;
+    } else {
+        double ns_per_cycle = lat_cycles_ns(1000000) / 1000000;
+        g_slowlog_cycles = ns_per_cycle > 0 ? (uint64_t)((double)usec * 1000 / ns_per_cycle) : 0;
+    }
+}
+
+// append an argument, cut to k_slowlog_max_arg_len bytes
+static void slow_arg(std::vector<std::string> &args, const char *p, size_t len){
+    if (len <= k_slowlog_max_arg_len){
+        args.emplace_back(p, len);
+        return;
+    }
+    args.emplace_back(p, k_slowlog_max_arg_len);
+    args.back() += "... (" + std::to_string(len - k_slowlog_max_arg_len) + " more bytes)";
+}
+
+void slowlog_push(const uint8_t *req, size_t len, uint64_t cycles, int fd){
+    if (g_ring.empty()) return;
+    SlowEntry &e = g_ring[g_slow_pos];
+    e.id = g_slow_next_id++;
+    e.time_ms = g_data.now_ms;
+    e.usec = (uint64_t)(lat_cycles_ns(cycles) / 1000);
+    e.fd = fd;
+    e.args.clear();
+
+    // the request was parsed once already, it is well formed
+    uint32_t n = 0;
+    memcpy(&n, req, 4);
+    size_t pos = 4;
+    for (uint32_t i = 0; i < n && pos + 4 <= len; ++i){
+        uint32_t sz = 0;
+        memcpy(&sz, &req[pos], 4);
+        if (i + 1 == k_slowlog_max_args && n > k_slowlog_max_args){
+            e.args.push_back("... (" + std::to_string(n - i) + " more arguments)");
+            break;
+        }
+        slow_arg(e.args, (const char *)&req[pos + 4], sz);
+        pos += 4 + sz;
+    }
+
+    g_slow_pos = (g_slow_pos + 1) % g_ring.size();
+    if (g_slow_n < g_ring.size()) g_slow_n++;
+}
+
+// SLOWLOG GET [count] | LEN | RESET
+void do_slowlog(std::vector<std::string>& cmd, std::string &out){
+    if (cmd_is(cmd[1], "get") && cmd.size() <= 3){
+        int64_t count = 10;
+        if (cmd.size() == 3 && (!parse_int(cmd[2], count) || count < -1)){
+            return out_err(out, ERR_ARG, "count should be greater than or equal to -1");
+        }
+        size_t n = count < 0 || (uint64_t)count > g_slow_n ? g_slow_n : (size_t)count;
+        out_arr(out, (uint32_t)n);
+        for (size_t i = 0; i < n; ++i){ // newest first
+            const SlowEntry &e = slow_at(i);
+            out_arr(out, 5);
+            out_int(out, (int64_t)e.id);
+            out_int(out, (int64_t)(e.time_ms / 1000));
+            out_int(out, (int64_t)e.usec);
+            out_arr(out, (uint32_t)e.args.size());
+            for (const std::string &a : e.args){
+                out_str(out, a);
+            }
+            out_int(out, e.fd);
+        }
+        return;
+    }
+    if (cmd_is(cmd[1], "len") && cmd.size() == 2){
+        return out_int(out, (int64_t)g_slow_n);
+    }
+    if (cmd_is(cmd[1], "reset") && cmd.size() == 2){
+        for (size_t i = 0; i < g_slow_n; ++i){
+            std::vector<std::string>().swap(slow_at(i).args);
+        }
+        g_slow_n = 0;
+        return out_nil(out);
+    }
+    out_err(out, ERR_ARG, "expect SLOWLOG GET [count] | SLOWLOG LEN | SLOWLOG RESET");
+}
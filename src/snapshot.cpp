@@ -0,0 +1,450 @@
+#include "snapshot.h"
+#include "server_utils.h"
+#include "thread_pool.h"
+#include "compress.h"
+#include "evict.h"
+#include "utils.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include <string>
+
+static const char k_snap_magic[8] = {'N', 'R', 'S', 'N', 'A', 'P', 0, 0};
+
+static size_t rec_size(size_t klen, size_t vlen){
+    return (sizeof(SnapRecord) + klen + vlen + 7) & ~(size_t)7;
+}
+
+/**
+ * @brief state of an in-progress snapshot write
+ *
+ */
+struct SnapWriter {
+    FILE *fp = NULL;
+    uint64_t off = 0;                   // file offset of the current chunk
+    bool lz = false;                    // compress chunks
+    std::string buf;                    // records of the current chunk
+    std::string packed;                 // scratch for compression
+    std::vector<uint64_t> index;        // bucket heads, only kept when not compressing
+    std::vector<SnapChunk> chunks;
+    uint64_t n_entries = 0;
+    uint64_t n_records = 0;             // records in `buf`
+    bool err = false;
+};
+
+static void writer_flush(SnapWriter *w){
+    if (w->err || w->buf.empty()) return;
+
+    SnapChunk chunk = {w->off, w->buf.size(), w->n_records, 0};
+    const char *data = w->buf.data();
+    if (w->lz){
+        w->packed.resize(lz_bound(w->buf.size()));
+        size_t n = lz_compress((uint8_t *)w->buf.data(), w->buf.size(),
+                               (uint8_t *)&w->packed[0], w->packed.size());
+        if (n && n < w->buf.size()){
+            chunk.len = n;
+            chunk.raw_len = w->buf.size();
+            data = w->packed.data();
+        }
+    }
+
+    static const char pad[8] = {};
+    size_t npad = (8 - chunk.len % 8) % 8;  // keep the next chunk aligned
+    if (fwrite(data, 1, chunk.len, w->fp) != chunk.len
+        || fwrite(pad, 1, npad, w->fp) != npad){
+        w->err = true;
+        return;
+    }
+    w->chunks.push_back(chunk);
+    w->off += chunk.len + npad;
+    w->buf.clear();
+    w->n_records = 0;
+}
+
+static void writer_put(SnapWriter *w, const char *key, size_t klen,
+                       const char *val, size_t vlen, uint32_t type, uint64_t hcode, int64_t expire_at){
+    if (w->err) return;
+
+    SnapRecord rec;
+    rec.hcode = hcode;
+    rec.expire_at = expire_at;
+    rec.klen = (uint32_t)klen;
+    rec.vlen = (uint32_t)vlen;
+    rec.type = type;
+    if (!w->lz){ // chain to the previous head of the bucket
+        uint64_t slot = hcode & (w->index.size() - 1);
+        rec.next = w->index[slot];
+        w->index[slot] = w->off + w->buf.size();
+    }
+
+    size_t total = rec_size(klen, vlen);
+    w->buf.append((char *)&rec, sizeof(rec));
+    w->buf.append(key, klen);
+    w->buf.append(val, vlen);
+    w->buf.append(total - sizeof(rec) - klen - vlen, '\0');
+    w->n_records++;
+    w->n_entries++;
+    if (w->buf.size() >= k_snap_chunk_bytes){
+        writer_flush(w);
+    }
+}
+
+// Scan callbacks
+static void cb_save_entry(HNode *node, void *arg){
+    Entry *ent = container_of(node, Entry, node);
+    std::string buf;
+    const std::string &val = entry_dump(ent, buf);
+    writer_put((SnapWriter *)arg, ent->key.data(), ent->key.size(),
+               val.data(), val.size(), ent->type, ent->node.hcode, entry_expire_at(ent));
+}
+
+static void cb_save_record(SnapRecord *rec, void *arg){
+    writer_put((SnapWriter *)arg, rec_key(rec), rec->klen,
+               rec_val(rec), rec->vlen, rec->type, rec->hcode, rec->expire_at);
+}
+
+int32_t snap_save(const char *path, HMap *db, Snapshot *snap, bool compress){
+    std::string tmp = std::string(path) + ".tmp";
+    SnapWriter w;
+    w.fp = fopen(tmp.c_str(), "wb");
+    if (!w.fp){
+        msg("snap_save: fopen() error");
+        return -1;
+    }
+
+    // one bucket per key keeps chains short without a second pass over the data,
+    // a compressed file can't be served mapped so it gets an empty index
+    size_t n = (size_t)(db->tb1.size + db->tb2.size) + (snap ? snap->n_live : 0);
+    size_t n_buckets = 1;
+    while (!compress && n_buckets < n){
+        n_buckets <<= 1;
+    }
+    w.lz = compress;
+    w.index.assign(n_buckets, 0);
+
+    // header is rewritten once the offsets are known
+    SnapHeader hdr = {};
+    w.err = fwrite(&hdr, sizeof(hdr), 1, w.fp) != 1;
+    w.off = sizeof(hdr);
+
+    h_scan(&db->tb1, &cb_save_entry, &w);
+    h_scan(&db->tb2, &cb_save_entry, &w);
+    if (snap){
+        snap_scan(snap, &cb_save_record, &w);
+    }
+    writer_flush(&w);
+
+    memcpy(hdr.magic, k_snap_magic, sizeof(hdr.magic));
+    hdr.version = k_snap_version;
+    hdr.flags = compress ? SNAP_F_LZ : 0;
+    hdr.n_entries = w.n_entries;
+    hdr.n_buckets = n_buckets;
+    hdr.data_off = sizeof(hdr);
+    hdr.chunk_off = w.off;
+    hdr.n_chunks = w.chunks.size();
+    hdr.index_off = hdr.chunk_off + hdr.n_chunks * sizeof(SnapChunk);
+    hdr.file_size = hdr.index_off + n_buckets * sizeof(uint64_t);
+
+    if (!w.err){
+        w.err = fwrite(w.chunks.data(), sizeof(SnapChunk), w.chunks.size(), w.fp) != w.chunks.size()
+            || fwrite(w.index.data(), sizeof(uint64_t), n_buckets, w.fp) != n_buckets
+            || fseek(w.fp, 0, SEEK_SET) != 0
+            || fwrite(&hdr, sizeof(hdr), 1, w.fp) != 1
+            || fflush(w.fp) != 0
+            || fsync(fileno(w.fp)) != 0;
+    }
+    if (fclose(w.fp) != 0){
+        w.err = true;
+    }
+    if (w.err || rename(tmp.c_str(), path) != 0){
+        msg("snap_save: write error");
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int32_t snap_open(const char *path, Snapshot *snap){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return errno == ENOENT ? 1 : -1;
+    }
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapHeader)){
+        close(fd);
+        return -1;
+    }
+
+    // private writable mapping: marking records dead only dirties our copy of the page
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED){
+        return -1;
+    }
+
+    SnapHeader *hdr = (SnapHeader *)base;
+    size_t size = (size_t)st.st_size;
+    if (0 == memcmp(hdr->magic, k_snap_magic, sizeof(hdr->magic)) && hdr->version != k_snap_version){
+        munmap(base, size);
+        return 2;
+    }
+    bool ok = 0 == memcmp(hdr->magic, k_snap_magic, sizeof(hdr->magic))
+        && hdr->file_size == size
+        && hdr->n_buckets > 0 && (hdr->n_buckets & (hdr->n_buckets - 1)) == 0
+        && hdr->data_off >= sizeof(SnapHeader)
+        && hdr->data_off <= hdr->chunk_off
+        && hdr->chunk_off % 8 == 0
+        && hdr->chunk_off + hdr->n_chunks * sizeof(SnapChunk) == hdr->index_off
+        && hdr->index_off + hdr->n_buckets * sizeof(uint64_t) == size;
+    if (!ok){
+        munmap(base, size);
+        return -1;
+    }
+
+    // lookups hop between random records, don't let the kernel read ahead
+    madvise(base, size, MADV_RANDOM);
+
+    snap->base = (uint8_t *)base;
+    snap->size = size;
+    snap->hdr = hdr;
+    snap->chunks = (SnapChunk *)(snap->base + hdr->chunk_off);
+    snap->index = (uint64_t *)(snap->base + hdr->index_off);
+    // records of compressed chunks can't be addressed in place, only `snap_load_all` reads them
+    snap->n_live = (hdr->flags & SNAP_F_LZ) ? 0 : hdr->n_entries;
+    return 0;
+}
+
+void snap_close(Snapshot *snap){
+    if (snap->base){
+        munmap(snap->base, snap->size);
+    }
+    *snap = Snapshot{};
+}
+
+/**
+ * @brief get the record at an offset of `base`, checking it lies fully inside [begin, end)
+ *
+ * @return SnapRecord* the record, or NULL if the offset is out of bounds
+ */
+static SnapRecord *rec_at(uint8_t *base, uint64_t off, uint64_t begin, uint64_t end){
+    if (off < begin || off % 8 != 0 || off > end || end - off < sizeof(SnapRecord)){
+        return NULL;
+    }
+    SnapRecord *rec = (SnapRecord *)(base + off);
+    if ((uint64_t)rec->klen + rec->vlen > end - off - sizeof(SnapRecord)){
+        return NULL;
+    }
+    return rec;
+}
+
+SnapRecord *snap_lookup(Snapshot *snap, const char *key, size_t len, uint64_t hcode){
+    if (!snap->n_live) return NULL;
+    uint64_t off = snap->index[hcode & (snap->hdr->n_buckets - 1)];
+    while (off){
+        SnapRecord *rec = rec_at(snap->base, off, snap->hdr->data_off, snap->hdr->chunk_off);
+        if (!rec){
+            msg("snap_lookup: corrupted chain");
+            return NULL;
+        }
+        if (rec->hcode == hcode && rec->klen == len && 0 == memcmp(rec_key(rec), key, len)){
+            return (rec->flags & SNAP_REC_DEAD) ? NULL : rec;
+        }
+        off = rec->next;
+    }
+    return NULL;
+}
+
+void snap_kill(Snapshot *snap, SnapRecord *rec){
+    if (rec->flags & SNAP_REC_DEAD) return;
+    rec->flags |= SNAP_REC_DEAD;
+    snap->n_live--;
+}
+
+void snap_scan(Snapshot *snap, void (*f)(SnapRecord *, void *), void *arg){
+    if (!snap->n_live) return;
+    uint64_t off = snap->hdr->data_off;
+    while (off < snap->hdr->chunk_off){
+        SnapRecord *rec = rec_at(snap->base, off, snap->hdr->data_off, snap->hdr->chunk_off);
+        if (!rec){
+            msg("snap_scan: corrupted record");
+            return;
+        }
+        if (!(rec->flags & SNAP_REC_DEAD)){
+            f(rec, arg);
+        }
+        off += rec_size(rec->klen, rec->vlen);
+    }
+}
+
+/**
+ * Parallel load, in two passes over disjoint data so no locks are needed:
+ *   1. each chunk is decoded by one worker into heap entries, which are
+ *      sorted by bucket range into `n_parts` intrusive lists (via `HNode::next`)
+ *   2. each bucket range is owned by one worker, which links the entries of
+ *      that range from every chunk into the pre-sized table
+ */
+struct LoadChunk {
+    Snapshot *snap = NULL;
+    const SnapChunk *chunk = NULL;
+    size_t mask = 0;                // table mask
+    uint32_t part_shift = 0;        // bucket >> part_shift = partition
+    std::vector<HNode *> parts;     // list heads, one per partition
+    std::vector<std::pair<Entry *, int64_t> > ttls; // entries with a TTL, added to the heap afterwards
+    size_t n_loaded = 0;
+    size_t mem = 0;
+    bool err = false;
+};
+
+struct LoadPart {
+    std::vector<LoadChunk> *chunks = NULL;
+    HTab *tab = NULL;
+    size_t part = 0;
+};
+
+static void load_chunk(void *arg){
+    // restoring collections resizes their tables, the event loop accounts the whole load instead
+    g_lat_quiet = true;
+    LoadChunk *lc = (LoadChunk *)arg;
+    Snapshot *snap = lc->snap;
+    uint64_t off = lc->chunk->off;
+    uint64_t end = lc->chunk->off + lc->chunk->len;
+    if (off < snap->hdr->data_off || end > snap->hdr->chunk_off || end < off){
+        lc->err = true;
+        return;
+    }
+
+    // records are parsed in place, or out of a decompressed copy of the chunk
+    uint8_t *base = snap->base;
+    std::vector<uint64_t> raw;
+    if (lc->chunk->raw_len){
+        raw.resize((lc->chunk->raw_len + 7) / 8);
+        int64_t n = lz_decompress(snap->base + off, lc->chunk->len, (uint8_t *)raw.data(), lc->chunk->raw_len);
+        if (n != (int64_t)lc->chunk->raw_len){
+            lc->err = true;
+            return;
+        }
+        base = (uint8_t *)raw.data();
+        off = 0;
+        end = lc->chunk->raw_len;
+    }
+    uint64_t begin = off;
+
+    for (uint64_t i = 0; i < lc->chunk->n_records; ++i){
+        SnapRecord *rec = rec_at(base, off, begin, end);
+        if (!rec){
+            lc->err = true;
+            return;
+        }
+        off += rec_size(rec->klen, rec->vlen);
+        if (rec->flags & SNAP_REC_DEAD) continue;
+        if (rec->expire_at >= 0 && (uint64_t)rec->expire_at <= g_data.now_ms) continue;
+
+        Entry *ent = new Entry();
+        ent->key.assign(rec_key(rec), rec->klen);
+        if (!entry_restore(ent, rec->type, rec_val(rec), rec->vlen)){
+            entry_free(ent);
+            lc->err = true;
+            return;
+        }
+        ent->node.hcode = str_hash((uint8_t *)ent->key.data(), ent->key.size());
+        entry_init_lru(ent);
+        ent->mem = entry_mem(ent);
+        lc->mem += ent->mem;
+        if (rec->expire_at >= 0){
+            lc->ttls.push_back(std::make_pair(ent, rec->expire_at));
+        }
+
+        HNode **head = &lc->parts[(ent->node.hcode & lc->mask) >> lc->part_shift];
+        ent->node.next = *head;
+        *head = &ent->node;
+        lc->n_loaded++;
+    }
+}
+
+static void load_part(void *arg){
+    LoadPart *lp = (LoadPart *)arg;
+    HTab *tab = lp->tab;
+    for (LoadChunk &lc : *lp->chunks){
+        HNode *node = lc.parts[lp->part];
+        while (node){
+            HNode *next = node->next;
+            // buckets of this partition are only ever touched by this worker
+            HNode **slot = &tab->tab[node->hcode & tab->mask];
+            node->next = *slot;
+            *slot = node;
+            node = next;
+        }
+    }
+}
+
+int32_t snap_load_all(Snapshot *snap, HMap *db, size_t n_threads){
+    assert(!db->tb1.tab && !db->tb2.tab);
+    size_t n = snap->hdr->n_entries;
+    if (!n) return 0;
+
+    // size the table up front so nothing gets rehashed
+    size_t n_buckets = 4;
+    while (n_buckets < n){
+        n_buckets <<= 1;
+    }
+    size_t n_parts = 1;
+    uint32_t part_bits = 0;
+    while (n_parts < 4 * n_threads && n_parts < n_buckets){
+        n_parts <<= 1;
+        part_bits++;
+    }
+    uint32_t table_bits = 0;
+    while (((size_t)1 << table_bits) < n_buckets){
+        table_bits++;
+    }
+
+    std::vector<LoadChunk> chunks(snap->hdr->n_chunks);
+    for (size_t i = 0; i < chunks.size(); ++i){
+        chunks[i].snap = snap;
+        chunks[i].chunk = &snap->chunks[i];
+        chunks[i].mask = n_buckets - 1;
+        chunks[i].part_shift = table_bits - part_bits;
+        chunks[i].parts.assign(n_parts, NULL);
+    }
+
+    madvise(snap->base, snap->size, MADV_SEQUENTIAL);
+    ThreadPool tp;
+    thread_pool_init(&tp, n_threads);
+    for (LoadChunk &lc : chunks){
+        thread_pool_queue(&tp, &load_chunk, &lc);
+    }
+    thread_pool_wait(&tp);
+
+    bool err = false;
+    for (LoadChunk &lc : chunks){
+        err = err || lc.err;
+    }
+
+    // link whatever got decoded, so a failed load can still be freed through `db`
+    h_init(&db->tb1, n_buckets);
+    std::vector<LoadPart> parts(n_parts);
+    for (size_t i = 0; i < n_parts; ++i){
+        parts[i].chunks = &chunks;
+        parts[i].tab = &db->tb1;
+        parts[i].part = i;
+        thread_pool_queue(&tp, &load_part, &parts[i]);
+    }
+    thread_pool_destroy(&tp);
+
+    for (LoadChunk &lc : chunks){
+        db->tb1.size += lc.n_loaded;
+        g_data.used_memory += lc.mem;
+        for (std::pair<Entry *, int64_t> &ttl : lc.ttls){
+            entry_set_ttl_at(ttl.first, (uint64_t)ttl.second);
+        }
+    }
+    return err ? -1 : 0;
+}
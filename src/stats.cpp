@@ -0,0 +1,150 @@
+#include "stats.h"
+#include "server_utils.h"
+#include "blocking.h"
+#include "lazyfree.h"
+#include "config.h"
+#include "memtrack.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+Stats g_stats;
+
+// a sample of the accumulating counters, for instantaneous rates
+struct StatsSample {
+    uint64_t ms = 0;
+    uint64_t commands = 0;
+    uint64_t net_in = 0;
+    uint64_t net_out = 0;
+};
+
+static StatsSample g_samples[k_stats_samples];
+static size_t g_sample_pos = 0;     // next slot to write
+static size_t g_sample_n = 0;
+
+void stats_tick(){
+    size_t last = (g_sample_pos + k_stats_samples - 1) % k_stats_samples;
+    if (g_sample_n && g_data.now_ms - g_samples[last].ms < k_stats_sample_ms){
+        return;
+    }
+    StatsSample &s = g_samples[g_sample_pos];
+    s.ms = g_data.now_ms;
+    s.commands = g_stats.commands;
+    s.net_in = g_stats.net_in;
+    s.net_out = g_stats.net_out;
+    g_sample_pos = (g_sample_pos + 1) % k_stats_samples;
+    if (g_sample_n < k_stats_samples) g_sample_n++;
+}
+
+void stats_reset(){
+    g_stats.commands = 0;
+    g_stats.rejected = 0;
+    g_stats.net_in = 0;
+    g_stats.net_out = 0;
+    g_sample_n = 0;
+    size_t n = 0;
+    Command *cmds = cmd_table(&n);
+    for (size_t i = 0; i < n; ++i){
+        cmds[i].calls = 0;
+        cmds[i].cycles = 0;
+    }
+}
+
+// per second over the sampled window, the current values being the newest sample
+static double stats_rate(uint64_t StatsSample::*field, uint64_t now_val){
+    if (!g_sample_n) return 0;
+    size_t oldest = g_sample_n < k_stats_samples ? 0 : g_sample_pos;
+    const StatsSample &s = g_samples[oldest];
+    if (g_data.now_ms <= s.ms || now_val < s.*field) return 0;
+    return (double)(now_val - s.*field) * 1000.0 / (double)(g_data.now_ms - s.ms);
+}
+
+static void info_line(std::string &text, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void info_line(std::string &text, const char *fmt, ...){
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    text.append(buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+    text.append("\r\n");
+}
+
+static bool info_want(const std::vector<std::string> &cmd, const char *section){
+    if (cmd.size() == 1) return true;
+    for (size_t i = 1; i < cmd.size(); ++i){
+        if (cmd_is(cmd[i], section) || cmd_is(cmd[i], "all") || cmd_is(cmd[i], "everything")) return true;
+    }
+    return false;
+}
+
+void do_info(std::vector<std::string>& cmd, std::string &out){
+    std::string text;
+    if (info_want(cmd, "server")){
+        info_line(text, "# Server");
+        info_line(text, "uptime_in_seconds:%llu", (unsigned long long)((g_data.now_ms - g_stats.start_ms) / 1000));
+        info_line(text, "now_ms:%llu", (unsigned long long)g_data.now_ms);
+        text.append("\r\n");
+    }
+    if (info_want(cmd, "clients")){
+        info_line(text, "# Clients");
+        info_line(text, "connected_clients:%llu", (unsigned long long)g_stats.conns);
+        info_line(text, "blocked_clients:%zu", block_count());
+        text.append("\r\n");
+    }
+    if (info_want(cmd, "stats")){
+        info_line(text, "# Stats");
+        info_line(text, "total_connections_received:%llu", (unsigned long long)g_stats.total_conns);
+        info_line(text, "total_commands_processed:%llu", (unsigned long long)g_stats.commands);
+        info_line(text, "rejected_commands:%llu", (unsigned long long)g_stats.rejected);
+        info_line(text, "instantaneous_ops_per_sec:%.0f", stats_rate(&StatsSample::commands, g_stats.commands));
+        info_line(text, "total_net_input_bytes:%llu", (unsigned long long)g_stats.net_in);
+        info_line(text, "total_net_output_bytes:%llu", (unsigned long long)g_stats.net_out);
+        info_line(text, "instantaneous_input_kbps:%.2f", stats_rate(&StatsSample::net_in, g_stats.net_in) / 1024);
+        info_line(text, "instantaneous_output_kbps:%.2f", stats_rate(&StatsSample::net_out, g_stats.net_out) / 1024);
+        text.append("\r\n");
+    }
+    if (info_want(cmd, "memory")){
+        info_line(text, "# Memory");
+        size_t allocated = 0, active = 0;
+        mem_allocator(allocated, active);
+        info_line(text, "used_memory:%zu", g_data.used_memory);
+        info_line(text, "used_memory_rss:%zu", mem_rss());
+        info_line(text, "allocator_allocated:%zu", allocated);
+        info_line(text, "allocator_active:%zu", active);
+        info_line(text, "maxmemory:%lld", (long long)g_config.maxmemory);
+        info_line(text, "lazyfree_pending_objects:%zu", lazyfree_pending());
+        text.append("\r\n");
+    }
+    if (info_want(cmd, "keyspace")){
+        const HMap &db = g_data.db;
+        info_line(text, "# Keyspace");
+        info_line(text, "keys:%zu", db.tb1.size + db.tb2.size + g_data.snap.n_live);
+        info_line(text, "expires:%zu", g_data.heap.size());
+        info_line(text, "snapshot_keys:%zu", g_data.snap.n_live);
+        info_line(text, "db_table:size=%zu,buckets=%zu", db.tb1.size, db.tb1.tab ? db.tb1.mask + 1 : 0);
+        info_line(text, "db_resizing:%d", db.tb2.tab ? 1 : 0);
+        if (db.tb2.tab){
+            info_line(text, "db_old_table:size=%zu,buckets=%zu,resizing_pos=%zu",
+                      db.tb2.size, db.tb2.mask + 1, db.resizing_pos);
+        }
+        text.append("\r\n");
+    }
+    if (info_want(cmd, "commandstats")){
+        info_line(text, "# Commandstats");
+        size_t n = 0;
+        Command *cmds = cmd_table(&n);
+        for (size_t i = 0; i < n; ++i){
+            if (!cmds[i].calls) continue;
+            double usec = lat_cycles_ns(cmds[i].cycles) / 1000;
+            info_line(text, "cmdstat_%s:calls=%llu,usec=%.0f,usec_per_call=%.2f", cmds[i].name,
+                      (unsigned long long)cmds[i].calls, usec, usec / (double)cmds[i].calls);
+        }
+        text.append("\r\n");
+    }
+    out_str(out, text);
+}
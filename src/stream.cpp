@@ -0,0 +1,265 @@
+#include "stream.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+// LEB128: 7 bits per byte, low bits first, the top bit marks a continuation
+static uint32_t varint_size(uint64_t v){
+    uint32_t n = 1;
+    while (v >= 0x80){
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static uint8_t *varint_put(uint8_t *p, uint64_t v){
+    while (v >= 0x80){
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static const uint8_t *varint_get(const uint8_t *p, uint64_t *v){
+    uint64_t r = 0;
+    for (uint32_t shift = 0;; shift += 7){
+        uint8_t b = *p++;
+        r |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+    }
+    *v = r;
+    return p;
+}
+
+// bytes of the items part of an entry
+static uint32_t payload_size(const std::string *items, size_t n_items){
+    uint32_t size = varint_size(n_items);
+    for (size_t i = 0; i < n_items; ++i){
+        size += varint_size(items[i].size()) + (uint32_t)items[i].size();
+    }
+    return size;
+}
+
+static uint32_t entry_size(uint64_t ms_delta, uint64_t seq, uint32_t payload){
+    return varint_size(ms_delta) + varint_size(seq) + varint_size(payload) + payload;
+}
+
+// decode the entry at `off`, filling its fields only if `ent` is given; returns the offset past it
+static uint32_t entry_read(const SBlock *blk, uint32_t off, StreamId *id, SEntry *ent){
+    const uint8_t *p = blk->data + off;
+    uint64_t delta = 0, n_items = 0;
+    uint64_t payload = 0;
+    p = varint_get(p, &delta);
+    p = varint_get(p, &id->seq);
+    id->ms = blk->base_ms + delta;
+    p = varint_get(p, &payload);
+    uint32_t end = (uint32_t)(p - blk->data + payload);
+    if (!ent) return end;   // seeks only need the ID
+    ent->id = *id;
+    ent->items.clear();
+    p = varint_get(p, &n_items);
+    for (uint64_t i = 0; i < n_items; ++i){
+        uint64_t len = 0;
+        p = varint_get(p, &len);
+        ent->items.emplace_back((const char *)p, (size_t)len);
+        p += len;
+    }
+    return end;
+}
+
+static SBlock *block_new(Stream *s, uint32_t need, uint64_t base_ms){
+    uint32_t cap = need > k_sblock_bytes ? need : k_sblock_bytes;
+    SBlock *blk = (SBlock *)malloc(sizeof(SBlock) + cap);
+    assert(blk);
+    new (blk) SBlock();
+    blk->cap = cap;
+    blk->base_ms = base_ms;
+    s->blocks.push_back(blk);
+    s->bytes += sizeof(SBlock) + cap;
+    return blk;
+}
+
+static void block_pop_front(Stream *s){
+    SBlock *blk = s->blocks.front();
+    s->blocks.pop_front();
+    s->n -= blk->n;
+    s->bytes -= sizeof(SBlock) + blk->cap;
+    free(blk);
+}
+
+void stream_add(Stream *s, StreamId id, const std::string *items, size_t n_items){
+    SBlock *blk = s->blocks.empty() ? NULL : s->blocks.back();
+    uint32_t payload = payload_size(items, n_items);
+    uint32_t size = 0;
+    if (blk){
+        size = entry_size(id.ms - blk->base_ms, id.seq, payload);
+    }
+    if (!blk || blk->n >= k_sblock_entries || blk->cap - blk->tail < size){
+        size = entry_size(0, id.seq, payload);
+        blk = block_new(s, size, id.ms);
+    }
+    uint8_t *p = blk->data + blk->tail;
+    p = varint_put(p, id.ms - blk->base_ms);
+    p = varint_put(p, id.seq);
+    p = varint_put(p, payload);
+    p = varint_put(p, n_items);
+    for (size_t i = 0; i < n_items; ++i){
+        p = varint_put(p, items[i].size());
+        memcpy(p, items[i].data(), items[i].size());
+        p += items[i].size();
+    }
+    blk->tail += size;
+    if (blk->n == 0){
+        blk->first = id;
+    }
+    blk->last = id;
+    blk->n++;
+    s->n++;
+    s->last_id = id;
+}
+
+SIter stream_seek(const Stream *s, StreamId id){
+    // the first block that still has an entry >= id
+    auto pos = std::partition_point(s->blocks.begin(), s->blocks.end(), [&](const SBlock *blk){
+        return sid_cmp(blk->last, id) < 0;
+    });
+    SIter it;
+    it.block = (size_t)(pos - s->blocks.begin());
+    if (it.block == s->blocks.size()) return it;
+    const SBlock *blk = *pos;
+    it.off = blk->head;
+    while (it.off < blk->tail){
+        StreamId cur;
+        uint32_t next = entry_read(blk, it.off, &cur, NULL);
+        if (sid_cmp(cur, id) >= 0) break;
+        it.off = next;
+    }
+    return it;
+}
+
+bool stream_next(const Stream *s, SIter *it, SEntry *ent){
+    if (it->block >= s->blocks.size()) return false;
+    const SBlock *blk = s->blocks[it->block];
+    StreamId id;
+    it->off = entry_read(blk, it->off, &id, ent);
+    if (it->off >= blk->tail){
+        it->block++;
+        it->off = it->block < s->blocks.size() ? s->blocks[it->block]->head : 0;
+    }
+    return true;
+}
+
+// drop the first `k` entries of the first block, which keeps at least one
+static void block_drop(Stream *s, uint32_t k){
+    SBlock *blk = s->blocks.front();
+    assert(k < blk->n);
+    StreamId id;
+    for (uint32_t i = 0; i < k; ++i){
+        blk->head = entry_read(blk, blk->head, &id, NULL);
+    }
+    entry_read(blk, blk->head, &blk->first, NULL);
+    blk->n -= k;
+    s->n -= k;
+}
+
+size_t stream_trim_maxlen(Stream *s, uint64_t maxlen, bool approx){
+    size_t before = s->n;
+    while (s->n > maxlen){
+        SBlock *blk = s->blocks.front();
+        if (s->n - blk->n >= maxlen){
+            block_pop_front(s);
+            continue;
+        }
+        if (!approx){
+            block_drop(s, (uint32_t)(s->n - maxlen));
+        }
+        break;
+    }
+    return before - s->n;
+}
+
+size_t stream_trim_minid(Stream *s, StreamId minid, bool approx){
+    size_t before = s->n;
+    while (!s->blocks.empty()){
+        SBlock *blk = s->blocks.front();
+        if (sid_cmp(blk->last, minid) < 0){
+            block_pop_front(s);
+            continue;
+        }
+        if (!approx){
+            uint32_t k = 0;
+            uint32_t off = blk->head;
+            StreamId id;
+            while ((off = entry_read(blk, off, &id, NULL), sid_cmp(id, minid) < 0)){
+                k++;
+            }
+            if (k){
+                block_drop(s, k);
+            }
+        }
+        break;
+    }
+    return before - s->n;
+}
+
+void stream_dispose(Stream *s){
+    while (!s->blocks.empty()){
+        block_pop_front(s);
+    }
+}
+
+void stream_encode(const Stream *s, std::string &out){
+    out.append((const char *)&s->last_id.ms, 8);
+    out.append((const char *)&s->last_id.seq, 8);
+    SIter it = stream_seek(s, StreamId());
+    SEntry ent;
+    while (stream_next(s, &it, &ent)){
+        out.append((const char *)&ent.id.ms, 8);
+        out.append((const char *)&ent.id.seq, 8);
+        uint32_t n_items = (uint32_t)ent.items.size();
+        out.append((const char *)&n_items, 4);
+        for (auto &item : ent.items){
+            uint32_t len = (uint32_t)item.second;
+            out.append((const char *)&len, 4);
+            out.append(item.first, item.second);
+        }
+    }
+}
+
+bool stream_decode(Stream *s, const char *data, size_t len){
+    if (len < 16) return false;
+    StreamId last;
+    memcpy(&last.ms, data, 8);
+    memcpy(&last.seq, data + 8, 8);
+    size_t pos = 16;
+    std::vector<std::string> items;
+    while (pos < len){
+        if (len - pos < 20) return false;
+        StreamId id;
+        uint32_t n_items = 0;
+        memcpy(&id.ms, data + pos, 8);
+        memcpy(&id.seq, data + pos + 8, 8);
+        memcpy(&n_items, data + pos + 16, 4);
+        pos += 20;
+        if ((s->n && sid_cmp(id, s->last_id) <= 0) || n_items > (len - pos) / 4) return false;
+        items.resize(n_items);
+        for (uint32_t i = 0; i < n_items; ++i){
+            uint32_t ilen = 0;
+            if (len - pos < 4) return false;
+            memcpy(&ilen, data + pos, 4);
+            pos += 4;
+            if (len - pos < ilen) return false;
+            items[i].assign(data + pos, ilen);
+            pos += ilen;
+        }
+        stream_add(s, id, items.data(), items.size());
+    }
+    if (s->n && sid_cmp(last, s->last_id) < 0) return false;
+    s->last_id = last;
+    return true;
+}
@@ -0,0 +1,94 @@
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <assert.h>
+#include <unistd.h>
+
+static void *worker(void *arg){
+    ThreadPool *tp = (ThreadPool *)arg;
+    while (true){
+        pthread_mutex_lock(&tp->mu);
+        // wait for the condition: a non-empty queue
+        while (tp->queue.empty() && !tp->stopping){
+            pthread_cond_wait(&tp->not_empty, &tp->mu);
+        }
+        if (tp->queue.empty()){ // stopping and nothing left
+            pthread_mutex_unlock(&tp->mu);
+            return NULL;
+        }
+
+        // got the job
+        Work w = tp->queue.front();
+        tp->queue.pop_front();
+        tp->n_busy++;
+        pthread_mutex_unlock(&tp->mu);
+
+        // do the work
+        w.f(w.arg);
+
+        pthread_mutex_lock(&tp->mu);
+        tp->n_busy--;
+        if (tp->queue.empty() && tp->n_busy == 0){
+            pthread_cond_broadcast(&tp->idle);
+        }
+        pthread_mutex_unlock(&tp->mu);
+    }
+}
+
+void thread_pool_init(ThreadPool *tp, size_t num_threads){
+    assert(num_threads > 0);
+
+    int rv = pthread_mutex_init(&tp->mu, NULL);
+    assert(rv == 0);
+    rv = pthread_cond_init(&tp->not_empty, NULL);
+    assert(rv == 0);
+    rv = pthread_cond_init(&tp->idle, NULL);
+    assert(rv == 0);
+    (void)rv;
+
+    tp->threads.resize(num_threads);
+    for (size_t i = 0; i < num_threads; ++i){
+        if (pthread_create(&tp->threads[i], NULL, &worker, tp)){
+            die("pthread_create()");
+        }
+    }
+}
+
+void thread_pool_queue(ThreadPool *tp, void (*f)(void *), void *arg){
+    Work w;
+    w.f = f;
+    w.arg = arg;
+
+    pthread_mutex_lock(&tp->mu);
+    tp->queue.push_back(w);
+    pthread_cond_signal(&tp->not_empty);
+    pthread_mutex_unlock(&tp->mu);
+}
+
+void thread_pool_wait(ThreadPool *tp){
+    pthread_mutex_lock(&tp->mu);
+    while (!tp->queue.empty() || tp->n_busy > 0){
+        pthread_cond_wait(&tp->idle, &tp->mu);
+    }
+    pthread_mutex_unlock(&tp->mu);
+}
+
+void thread_pool_destroy(ThreadPool *tp){
+    pthread_mutex_lock(&tp->mu);
+    tp->stopping = true;
+    pthread_cond_broadcast(&tp->not_empty);
+    pthread_mutex_unlock(&tp->mu);
+
+    for (pthread_t &t : tp->threads){
+        pthread_join(t, NULL);
+    }
+    tp->threads.clear();
+    pthread_cond_destroy(&tp->idle);
+    pthread_cond_destroy(&tp->not_empty);
+    pthread_mutex_destroy(&tp->mu);
+}
+
+size_t cpu_count(){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+}
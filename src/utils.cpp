@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <time.h>
 
 
 int32_t read_full(int fd, char *buf, size_t n){
@@ -56,4 +57,16 @@ uint64_t str_hash(const uint8_t *data, size_t len){ // MD-construction
         h = (h + data[i]) * 0x01000193;
     };
     return h;
-}
\ No newline at end of file
+}
+
+uint64_t get_wall_ms(){
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_REALTIME, &tv);
+    return uint64_t(tv.tv_sec) * 1000 + tv.tv_nsec / 1000000;
+}
+
+uint64_t get_mono_ns(){
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000000000 + tv.tv_nsec;
+}
@@ -1,5 +1,6 @@
 #include "zset.h"
 #include <memory.h>
+#include "memtrack.h"
 
 
 /**
@@ -11,7 +12,7 @@
  * @return ZNode* znode on heap
  */
 ZNode *znode_new(const char *name, size_t len, double score){
-    ZNode *new_node = (ZNode *)malloc(sizeof(ZNode) + len);
+    ZNode *new_node = (ZNode *)mem_malloc(sizeof(ZNode) + len, MEM_ZNODE);
     // data
     new_node->score = score;
     memcpy(&new_node->name[0], name, len);
@@ -60,6 +61,7 @@ bool zset_add(ZSet *zset, const char *name, size_t len, double score){
     }
     // allocate new znode on heap
     ZNode *node = znode_new(name, len, score);
+    zset->bytes += mem_size(node);
     // link znode to hashtable index
     hm_insert(&zset->hmap, &node->hmap);
     // link znode to avl tree index
@@ -95,7 +97,7 @@ void zset_update(ZSet *zset, ZNode *node, double score){
  * @return ZNode* detached node
  */
 ZNode *zset_pop(ZSet *zset, const char *name, size_t len){
-    if (!zset) return;
+    if (!zset) return NULL;
     // lookup and detach from hashset
     HKey key;
     key.len = len;
@@ -107,7 +109,8 @@ ZNode *zset_pop(ZSet *zset, const char *name, size_t len){
     ZNode *found = container_of(hnode, ZNode, hmap);
     // detach from avl tree
     zset->tree = avl_del(&found->tree);
-    
+    zset->bytes -= mem_size(found);
+
     return found;
 }
 
@@ -118,7 +121,86 @@ ZNode *zset_pop(ZSet *zset, const char *name, size_t len){
  * @param node node to deallocate
  */
 void znode_del(ZNode *node){
-    free(node);
+    mem_free(node, MEM_ZNODE);
+}
+
+
+
+// compare a node against a (score, name) pair
+static bool zless(AVLNode *lhs, double score, const char *name, size_t len){
+    ZNode *zl = container_of(lhs, ZNode, tree);
+    if (zl->score != score) return zl->score < score;
+    int rv = memcmp(zl->name, name, zl->len < len ? zl->len : len);
+    if (rv != 0) return rv < 0;
+    return zl->len < len;
+}
+
+ZNode *zset_seekge(ZSet *zset, double score, const char *name, size_t len){
+    AVLNode *found = NULL;
+    AVLNode *cur = zset->tree;
+    while (cur){
+        if (zless(cur, score, name, len)){
+            cur = cur->right;
+        } else {
+            found = cur; // candidate
+            cur = cur->left;
+        }
+    }
+    return found ? container_of(found, ZNode, tree) : NULL;
+}
+
+ZNode *znode_offset(ZNode *node, int64_t offset){
+    AVLNode *tnode = node ? avl_offset(&node->tree, offset) : NULL;
+    return tnode ? container_of(tnode, ZNode, tree) : NULL;
+}
+
+size_t zset_size(ZSet *zset){
+    return avl_cnt(zset->tree);
+}
+
+// free a subtree in post order, the depth is bounded by the tree height
+static void tree_dispose(AVLNode *node){
+    if (!node) return;
+    tree_dispose(node->left);
+    tree_dispose(node->right);
+    znode_del(container_of(node, ZNode, tree));
+}
+
+void zset_dispose(ZSet *zset){
+    tree_dispose(zset->tree);
+    hm_destroy(&zset->hmap);
+    zset->tree = NULL;
+    zset->bytes = 0;
+}
+
+void zset_encode(ZSet *zset, std::string &out){
+    if (!zset->tree) return;
+    AVLNode *first = zset->tree;
+    while (first->left){
+        first = first->left;
+    }
+    for (ZNode *node = container_of(first, ZNode, tree); node; node = znode_offset(node, 1)){
+        uint32_t len = (uint32_t)node->len;
+        out.append((char *)&node->score, 8);
+        out.append((char *)&len, 4);
+        out.append(node->name, node->len);
+    }
+}
+
+bool zset_decode(ZSet *zset, const char *data, size_t len){
+    size_t pos = 0;
+    while (pos < len){
+        if (len - pos < 12) return false;
+        double score = 0;
+        uint32_t nlen = 0;
+        memcpy(&score, &data[pos], 8);
+        memcpy(&nlen, &data[pos + 8], 4);
+        pos += 12;
+        if (len - pos < nlen) return false;
+        zset_add(zset, &data[pos], nlen, score);
+        pos += nlen;
+    }
+    return true;
 }
 
 
@@ -160,5 +242,8 @@ bool zless(AVLNode *lhs, AVLNode *rhs){
     ZNode *ls = container_of(lhs, ZNode, tree);
     ZNode *rs = container_of(rhs, ZNode, tree);
     if (ls->score != rs->score) return ls->score < rs->score;
-    return strcmp(ls->name, rs->name) < 0;
+    // names are not NUL-terminated
+    int rv = memcmp(ls->name, rs->name, ls->len < rs->len ? ls->len : rs->len);
+    if (rv != 0) return rv < 0;
+    return ls->len < rs->len;
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+//
+// Server tests: real client sockets against the connection state machine, driven by hand in place of the event loop
+//
+
+#include "server_utils.h"
+#include "blocking.h"
+#include "latency.h"
+#include "lazyfree.h"
+#include "config.h"
+#include "utils.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define CHECK(cond) do { \
+    if (!(cond)){ \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+static int g_epfd = -1;
+static int g_listen_fd = -1;
+static std::vector<Conn *> g_fd2conn;
+
+// a client socket and the server side of its connection
+struct Client {
+    int fd = -1;
+    Conn *conn = NULL;
+};
+
+static void setup(){
+    g_data.now_ms = get_wall_ms();
+    lat_init();
+    lazyfree_init();
+    g_epfd = epoll_create1(0);
+    CHECK(g_epfd >= 0);
+    g_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(0 == bind(g_listen_fd, (const sockaddr *)&addr, sizeof(addr)));
+    CHECK(0 == listen(g_listen_fd, 16));
+}
+
+static Client client_new(){
+    struct sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    CHECK(0 == getsockname(g_listen_fd, (sockaddr *)&addr, &len));
+    Client c;
+    c.fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(0 == connect(c.fd, (const sockaddr *)&addr, sizeof(addr)));
+    CHECK(0 == accept_new_conn(g_fd2conn, g_listen_fd, g_epfd));
+    c.conn = g_fd2conn.back();
+    return c;
+}
+
+// send a request and let the server read and process it
+static void client_send(Client &c, const std::vector<std::string> &cmd){
+    std::string body;
+    uint32_t n = (uint32_t)cmd.size();
+    body.append((const char *)&n, 4);
+    for (const std::string &s : cmd){
+        uint32_t len = (uint32_t)s.size();
+        body.append((const char *)&len, 4);
+        body.append(s);
+    }
+    uint32_t len = (uint32_t)body.size();
+    std::string msg((const char *)&len, 4);
+    msg.append(body);
+    CHECK(write(c.fd, msg.data(), msg.size()) == (ssize_t)msg.size());
+    connection_io(c.conn, g_epfd);
+}
+
+// the reply the server has for a client, "" if none
+static std::string client_reply(Client &c){
+    if (c.conn->state == STATE_RES){
+        connection_io(c.conn, g_epfd);
+    }
+    char buf[4096];
+    ssize_t rv = recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT);
+    return rv > 4 ? std::string(buf + 4, (size_t)(rv - 4)) : std::string();
+}
+
+static bool contains(const std::string &s, const char *needle){
+    return s.find(needle) != std::string::npos;
+}
+
+// the value of an integer reply
+static int64_t reply_int(const std::string &out){
+    int64_t v = 0;
+    CHECK(out.size() == 9 && out[0] == SER_INT);
+    memcpy(&v, out.data() + 1, 8);
+    return v;
+}
+
+// an XREAD waiter that blocks again must not hold back the XREAD waiters queued behind it
+static void test_xread_block_order(){
+    Client future = client_new();
+    Client latest = client_new();
+    Client writer = client_new();
+    client_send(future, {"xread", "block", "0", "streams", "s", "99999999999999-0"});
+    client_send(latest, {"xread", "block", "0", "streams", "s", "$"});
+    CHECK(future.conn->state == STATE_BLOCKED);
+    CHECK(latest.conn->state == STATE_BLOCKED);
+
+    client_send(writer, {"xadd", "s", "5-1", "f", "v"});
+    CHECK(contains(client_reply(writer), "5-1"));
+    block_run(g_epfd);
+    CHECK(future.conn->state == STATE_BLOCKED);
+    CHECK(contains(client_reply(latest), "5-1"));
+    CHECK(client_reply(future).empty());
+
+    client_send(writer, {"xadd", "s", "99999999999999-1", "f", "v"});
+    block_run(g_epfd);
+    CHECK(contains(client_reply(future), "99999999999999-1"));
+}
+
+static Entry *lookup(const std::string &name){
+    Entry key;
+    key.key = name;
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    return entry_lookup(&key);
+}
+
+// a big flat value is freed off the event loop, whatever its number of allocations
+static void test_unlink_big_bitmap(){
+    Client c = client_new();
+    client_send(c, {"setbit", "bits", std::to_string(64ull << 23), "1"});   // 64 MB
+    CHECK(!client_reply(c).empty());
+    Entry *ent = lookup("bits");
+    CHECK(ent && ent->type == T_STR);
+    CHECK(entry_free_effort(ent) > (size_t)g_config.lazyfree_threshold);
+
+    client_send(c, {"setbit", "small", "7", "1"});
+    CHECK(!client_reply(c).empty());
+    CHECK(entry_free_effort(lookup("small")) <= (size_t)g_config.lazyfree_threshold);
+
+    client_send(c, {"unlink", "bits", "small"});
+    CHECK(reply_int(client_reply(c)) == 2);
+    CHECK(!lookup("bits"));
+    for (int i = 0; i < 1000 && lazyfree_pending(); ++i){
+        usleep(1000);
+    }
+    CHECK(lazyfree_pending() == 0);
+}
+
+// the error code of a reply, -1 if it isn't an error
+static int32_t reply_err(const std::string &out){
+    int32_t code = -1;
+    if (out.size() >= 5 && out[0] == SER_ERR){
+        memcpy(&code, out.data() + 1, 4);
+    }
+    return code;
+}
+
+// a short list takes about what it holds, and keeps its order while its first chunk grows
+static void test_list_small_chunks(){
+    Client c = client_new();
+    client_send(c, {"rpush", "short", "a"});
+    CHECK(reply_int(client_reply(c)) == 1);
+    client_send(c, {"memory", "usage", "short"});
+    CHECK(reply_int(client_reply(c)) < 512);
+
+    for (int i = 0; i < 300; ++i){
+        client_send(c, {i % 2 ? "lpush" : "rpush", "grow", std::to_string(i)});
+        CHECK(reply_int(client_reply(c)) == i + 1);
+    }
+    client_send(c, {"lindex", "grow", "0"});
+    CHECK(contains(client_reply(c), "299"));
+    client_send(c, {"lindex", "grow", "-1"});
+    CHECK(contains(client_reply(c), "298"));
+}
+
+// out of range values are refused, not stored
+static void test_config_bounds(){
+    Client c = client_new();
+    client_send(c, {"config", "set", "slowlog-max-len", "99999999999"});
+    CHECK(reply_err(client_reply(c)) == ERR_ARG);
+    client_send(c, {"config", "set", "slowlog-max-len", "-1"});
+    CHECK(reply_err(client_reply(c)) == ERR_ARG);
+    CHECK(g_config.slowlog_max_len == 128);
+    client_send(c, {"config", "set", "slowlog-max-len", "16384"});
+    CHECK(reply_err(client_reply(c)) == -1);
+    CHECK(g_config.slowlog_max_len == 16384);
+
+    client_send(c, {"config", "set", "maxmemory-samples", "0"});
+    CHECK(reply_err(client_reply(c)) == ERR_ARG);
+    client_send(c, {"config", "set", "lfu-decay-time", "-1"});
+    CHECK(reply_err(client_reply(c)) == ERR_ARG);
+    client_send(c, {"config", "set", "metrics-port", "65536"});
+    CHECK(reply_err(client_reply(c)) == ERR_ARG);
+    CHECK(g_config.maxmemory_samples == 5 && g_config.lfu_decay_time == 1 && g_config.metrics_port == 0);
+}
+
+int main(){
+    setup();
+    test_xread_block_order();
+    test_unlink_big_bitmap();
+    test_config_bounds();
+    test_list_small_chunks();
+    printf("ok\n");
+    return 0;
+}